@@ -0,0 +1,478 @@
+/*
+	conduit-bench.cc
+	----------------
+*/
+
+// Standard C/C++
+#include <cstdio>
+
+// Standard C
+#include <stdlib.h>
+#include <string.h>
+
+// POSIX
+#include <pthread.h>
+#include <sched.h>
+
+// Standard C++
+#include <list>
+
+// iota
+#include "iota/strings.hh"
+
+// poseven
+#include "poseven/functions/gettimeofday.hh"
+#include "poseven/functions/write.hh"
+
+// conduit
+#include "conduit/pipe_core.hh"
+
+// Orion
+#include "Orion/get_options.hh"
+#include "Orion/Main.hh"
+
+
+/*
+	conduit-bench runs a writer and a reader thread against one pipe_core,
+	first as a stress test (random write and read sizes, scattered and
+	gathered, with the data checked byte for byte), then as a benchmark
+	of each write size with and without loans.  For comparison, it also
+	times a mutex-guarded list of 4K pages, as MacRelix pipes used to be.
+	
+	Relix has no threads, so this builds for Unix hosts only.
+	
+	E.g.  conduit-bench -s 256
+*/
+
+namespace tool
+{
+	
+	namespace p7 = poseven;
+	namespace o = orion;
+	
+	
+	typedef unsigned long long microseconds;
+	
+	static microseconds now()
+	{
+		const timeval tv = p7::gettimeofday();
+		
+		return tv.tv_sec * 1000000ull + tv.tv_usec;
+	}
+	
+	static inline char pattern_byte( unsigned long long i )
+	{
+		return char( i * 31 + (i >> 11) );
+	}
+	
+	static void fill_pattern( char* p, std::size_t n, unsigned long long offset )
+	{
+		for ( std::size_t i = 0;  i < n;  ++i )
+		{
+			p[ i ] = pattern_byte( offset + i );
+		}
+	}
+	
+	// xorshift, so each thread has its own repeatable sequence
+	static unsigned next_random( unsigned& state )
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state <<  5;
+		
+		return state;
+	}
+	
+	
+	struct Run
+	{
+		conduit::pipe_core*  pipe;
+		unsigned long long   total;
+		std::size_t          chunk;   // 0 for random sizes
+		std::size_t          min_loan;
+		bool                 verify;
+		bool                 failed;
+	};
+	
+	static void* writer( void* arg )
+	{
+		Run& run = *(Run*) arg;
+		
+		conduit::pipe_core& pipe = *run.pipe;
+		
+		const std::size_t max_chunk = run.chunk ? run.chunk : 256 * 1024;
+		
+		char* buffer = (char*) malloc( max_chunk );
+		
+		if ( !run.verify )
+		{
+			fill_pattern( buffer, max_chunk, 0 );
+		}
+		
+		unsigned state = 2463534242u;
+		
+		unsigned long long offset = 0;
+		
+		while ( offset < run.total )
+		{
+			std::size_t n = run.chunk ? run.chunk : next_random( state ) % max_chunk + 1;
+			
+			if ( n > run.total - offset )
+			{
+				n = run.total - offset;
+			}
+			
+			if ( run.verify )
+			{
+				fill_pattern( buffer, n, offset );
+			}
+			
+			std::size_t written = 0;
+			
+			while ( written < n )
+			{
+				while ( !pipe.is_writable() )
+				{
+					sched_yield();
+				}
+				
+				const std::size_t half = (n - written) / 2;
+				
+				const conduit::const_segment v[] =
+				{
+					{ buffer + written,        half                },
+					{ buffer + written + half, n - written - half },
+				};
+				
+				written += pipe.writev( v, 2 );
+				
+				if ( n - written >= run.min_loan )
+				{
+					pipe.lend( buffer + written, n - written );
+					
+					while ( pipe.loan_outstanding() )
+					{
+						sched_yield();
+					}
+					
+					written += pipe.reclaim();
+				}
+			}
+			
+			offset += n;
+		}
+		
+		pipe.close_ingress();
+		
+		free( buffer );
+		
+		return NULL;
+	}
+	
+	static void* reader( void* arg )
+	{
+		Run& run = *(Run*) arg;
+		
+		conduit::pipe_core& pipe = *run.pipe;
+		
+		const std::size_t buffer_size = 256 * 1024;
+		
+		char* buffer = (char*) malloc( buffer_size );
+		
+		unsigned state = 88675123u;
+		
+		unsigned long long offset = 0;
+		
+		while ( true )
+		{
+			while ( !pipe.is_readable() )
+			{
+				sched_yield();
+			}
+			
+			const std::size_t want = run.verify ? next_random( state ) % buffer_size + 1
+			                                    : buffer_size;
+			
+			const std::size_t third = want / 3;
+			
+			const conduit::segment v[] =
+			{
+				{ buffer,             third            },
+				{ buffer + third,     0                },
+				{ buffer + third,     want - third     },
+			};
+			
+			const std::size_t n = pipe.readv( v, 3 );
+			
+			if ( n == 0 )
+			{
+				if ( pipe.ingress_has_closed()  &&  pipe.readable() == 0 )
+				{
+					break;
+				}
+				
+				continue;
+			}
+			
+			if ( run.verify )
+			{
+				for ( std::size_t i = 0;  i < n;  ++i )
+				{
+					if ( buffer[ i ] != pattern_byte( offset + i ) )
+					{
+						std::fprintf( stderr, "conduit-bench: mismatch at byte %llu\n", offset + i );
+						
+						run.failed = true;
+						
+						free( buffer );
+						
+						return NULL;
+					}
+				}
+			}
+			
+			offset += n;
+		}
+		
+		run.failed = offset != run.total;
+		
+		free( buffer );
+		
+		return NULL;
+	}
+	
+	static microseconds time_run( Run& run )
+	{
+		conduit::pipe_core pipe;
+		
+		run.pipe   = &pipe;
+		run.failed = false;
+		
+		const microseconds t0 = now();
+		
+		pthread_t threads[ 2 ];
+		
+		pthread_create( &threads[ 0 ], NULL, &reader, &run );
+		pthread_create( &threads[ 1 ], NULL, &writer, &run );
+		
+		pthread_join( threads[ 1 ], NULL );
+		pthread_join( threads[ 0 ], NULL );
+		
+		const microseconds elapsed = now() - t0;
+		
+		return elapsed ? elapsed : 1;
+	}
+	
+	
+	/*
+		The old way:  a std::list of 4K pages, capped at 20, each write
+		copied into fresh pages.  Here it needs a mutex to be fair.
+	*/
+	
+	struct Page
+	{
+		std::size_t  written;
+		std::size_t  read;
+		char         data[ 4096 ];
+	};
+	
+	struct PageQueue
+	{
+		pthread_mutex_t     mutex;
+		std::list< Page >   pages;
+		bool                closed;
+		unsigned long long  total;
+		std::size_t         chunk;
+	};
+	
+	static void* page_writer( void* arg )
+	{
+		PageQueue& queue = *(PageQueue*) arg;
+		
+		char* buffer = (char*) malloc( queue.chunk );
+		
+		fill_pattern( buffer, queue.chunk, 0 );
+		
+		for ( unsigned long long offset = 0;  offset < queue.total;  offset += queue.chunk )
+		{
+			while ( true )
+			{
+				pthread_mutex_lock( &queue.mutex );
+				
+				if ( queue.pages.size() < 20 )
+				{
+					break;
+				}
+				
+				pthread_mutex_unlock( &queue.mutex );
+				
+				sched_yield();
+			}
+			
+			const char* p = buffer;
+			std::size_t n = queue.chunk;
+			
+			while ( n > 0 )
+			{
+				queue.pages.push_back( Page() );
+				
+				Page& page = queue.pages.back();
+				
+				const std::size_t m = n < sizeof page.data ? n : sizeof page.data;
+				
+				memcpy( page.data, p, m );
+				
+				page.written = m;
+				page.read    = 0;
+				
+				p += m;
+				n -= m;
+			}
+			
+			pthread_mutex_unlock( &queue.mutex );
+		}
+		
+		pthread_mutex_lock( &queue.mutex );
+		
+		queue.closed = true;
+		
+		pthread_mutex_unlock( &queue.mutex );
+		
+		free( buffer );
+		
+		return NULL;
+	}
+	
+	static void* page_reader( void* arg )
+	{
+		PageQueue& queue = *(PageQueue*) arg;
+		
+		char buffer[ 4096 ];
+		
+		while ( true )
+		{
+			pthread_mutex_lock( &queue.mutex );
+			
+			if ( queue.pages.empty() )
+			{
+				const bool closed = queue.closed;
+				
+				pthread_mutex_unlock( &queue.mutex );
+				
+				if ( closed )
+				{
+					break;
+				}
+				
+				sched_yield();
+				
+				continue;
+			}
+			
+			Page& page = queue.pages.front();
+			
+			memcpy( buffer, page.data + page.read, page.written - page.read );
+			
+			queue.pages.pop_front();
+			
+			pthread_mutex_unlock( &queue.mutex );
+		}
+		
+		return NULL;
+	}
+	
+	static microseconds time_pages( unsigned long long total, std::size_t chunk )
+	{
+		PageQueue queue;
+		
+		pthread_mutex_init( &queue.mutex, NULL );
+		
+		queue.closed = false;
+		queue.total  = total;
+		queue.chunk  = chunk;
+		
+		const microseconds t0 = now();
+		
+		pthread_t threads[ 2 ];
+		
+		pthread_create( &threads[ 0 ], NULL, &page_reader, &queue );
+		pthread_create( &threads[ 1 ], NULL, &page_writer, &queue );
+		
+		pthread_join( threads[ 1 ], NULL );
+		pthread_join( threads[ 0 ], NULL );
+		
+		pthread_mutex_destroy( &queue.mutex );
+		
+		const microseconds elapsed = now() - t0;
+		
+		return elapsed ? elapsed : 1;
+	}
+	
+	
+	static const std::size_t gChunkSizes[] = { 64, 512, 4096, 64 * 1024, 1024 * 1024 };
+	
+	int Main( int argc, char** argv )
+	{
+		std::size_t size_in_MiB = 256;
+		
+		o::bind_option_to_variable( "-s", size_in_MiB );
+		
+		o::alias_option( "-s", "--size" );
+		
+		o::get_options( argc, argv );
+		
+		if ( o::free_argument_count() > 0  ||  size_in_MiB == 0 )
+		{
+			p7::write( p7::stderr_fileno, STR_LEN( "Usage: conduit-bench [-s MiB]\n" ) );
+			
+			return 2;
+		}
+		
+		const unsigned long long total = size_in_MiB * 1024ull * 1024;
+		
+		Run run = { NULL, total / 4, 0, 32 * 1024, true, false };
+		
+		time_run( run );
+		
+		std::printf( "stress test (%lu MiB, random sizes): %s\n\n",
+		             (unsigned long) size_in_MiB / 4,
+		             run.failed ? "FAILED" : "ok" );
+		
+		if ( run.failed )
+		{
+			return 1;
+		}
+		
+		std::printf( "%lu MiB per run, in MB/s\n\n", (unsigned long) size_in_MiB );
+		
+		std::printf( "%-12s%12s%12s%12s\n", "write size", "4K pages", "ring", "ring+loans" );
+		
+		const std::size_t n_chunk_sizes = sizeof gChunkSizes / sizeof gChunkSizes[0];
+		
+		for ( std::size_t i = 0;  i < n_chunk_sizes;  ++i )
+		{
+			const std::size_t chunk = gChunkSizes[ i ];
+			
+			std::printf( "%-12lu", (unsigned long) chunk );
+			
+			std::fflush( stdout );
+			
+			std::printf( "%12.0f", double( total ) / time_pages( total, chunk ) );
+			
+			std::fflush( stdout );
+			
+			Run copying = { NULL, total, chunk, std::size_t( -1 ), false, false };
+			
+			std::printf( "%12.0f", double( total ) / time_run( copying ) );
+			
+			std::fflush( stdout );
+			
+			Run lending = { NULL, total, chunk, 32 * 1024, false, false };
+			
+			std::printf( "%12.0f\n", double( total ) / time_run( lending ) );
+		}
+		
+		return 0;
+	}
+	
+}
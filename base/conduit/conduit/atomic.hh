@@ -0,0 +1,48 @@
+/*
+	atomic.hh
+	---------
+*/
+
+#ifndef CONDUIT_ATOMIC_HH
+#define CONDUIT_ATOMIC_HH
+
+
+namespace conduit
+{
+	
+	/*
+		Where the compiler can fence, these make a single producer and a
+		single consumer on different threads safe.  Elsewhere (e.g. with
+		cooperative threads only) they're plain loads and stores.
+	*/
+	
+	inline void memory_barrier()
+	{
+	#ifdef __GNUC__
+		
+		__sync_synchronize();
+		
+	#endif
+	}
+	
+	template < class T >
+	inline T load_acquire( const volatile T& x )
+	{
+		const T result = x;
+		
+		memory_barrier();
+		
+		return result;
+	}
+	
+	template < class T >
+	inline void store_release( volatile T& x, T value )
+	{
+		memory_barrier();
+		
+		x = value;
+	}
+	
+}
+
+#endif
@@ -0,0 +1,146 @@
+/*
+	pipe_core.cc
+	------------
+*/
+
+#include "conduit/pipe_core.hh"
+
+// Standard C
+#include <string.h>
+
+// Debug
+#include "debug/assert.hh"
+
+// conduit
+#include "conduit/atomic.hh"
+
+
+namespace conduit
+{
+	
+	pipe_core::pipe_core( std::size_t capacity )
+	:
+		itsRing( capacity ),
+		itsLoan( NULL ),
+		itsLoanBegin( 0 ),
+		itsLoanEnd  ( 0 ),
+		itsLoanTaken( 0 ),
+		itsIngressHasClosed( false ),
+		itsEgressHasClosed ( false )
+	{
+	}
+	
+	std::size_t pipe_core::readable() const
+	{
+		const std::size_t end = load_acquire( itsLoanEnd );
+		
+		return itsRing.readable() + (end - load_acquire( itsLoanTaken ));
+	}
+	
+	std::size_t pipe_core::writable() const
+	{
+		return lending() ? 0 : itsRing.writable();
+	}
+	
+	std::size_t pipe_core::read( char* buffer, std::size_t n )
+	{
+		const segment v = { buffer, n };
+		
+		return readv( &v, 1 );
+	}
+	
+	std::size_t pipe_core::readv( const segment* v, unsigned count )
+	{
+		/*
+			Look for a loan first:  If there is one, then the ring already
+			holds everything written before it, and nothing more will be
+			written to the ring until it's reclaimed.
+		*/
+		
+		const std::size_t end = load_acquire( itsLoanEnd );
+		
+		std::size_t total = itsRing.readv( v, count );
+		
+		std::size_t taken = itsLoanTaken;
+		
+		if ( taken == end )
+		{
+			return total;
+		}
+		
+		// Skip the parts of v that the ring filled.
+		
+		std::size_t skip = total;
+		
+		for ( unsigned i = 0;  i < count  &&  taken != end;  ++i )
+		{
+			if ( skip >= v[ i ].size )
+			{
+				skip -= v[ i ].size;
+				
+				continue;
+			}
+			
+			const std::size_t room = v[ i ].size - skip;
+			const std::size_t left = end - taken;
+			
+			const std::size_t n = room < left ? room : left;
+			
+			memcpy( v[ i ].data + skip, itsLoan + (taken - itsLoanBegin), n );
+			
+			skip = 0;
+			
+			taken += n;
+			total += n;
+		}
+		
+		store_release( itsLoanTaken, taken );
+		
+		return total;
+	}
+	
+	std::size_t pipe_core::write( const char* buffer, std::size_t n )
+	{
+		const const_segment v = { buffer, n };
+		
+		return writev( &v, 1 );
+	}
+	
+	std::size_t pipe_core::writev( const const_segment* v, unsigned count )
+	{
+		ASSERT( !lending() );
+		
+		return itsRing.writev( v, count );
+	}
+	
+	void pipe_core::lend( const char* buffer, std::size_t n )
+	{
+		ASSERT( !lending() );
+		
+		itsLoan = buffer;
+		
+		store_release( itsLoanEnd, itsLoanBegin + n );
+	}
+	
+	bool pipe_core::loan_outstanding() const
+	{
+		return load_acquire( itsLoanTaken ) != itsLoanEnd;
+	}
+	
+	std::size_t pipe_core::reclaim()
+	{
+		// Whatever the reader hasn't taken yet, it won't.
+		
+		const std::size_t taken = load_acquire( itsLoanTaken );
+		
+		store_release( itsLoanEnd, taken );
+		
+		const std::size_t result = taken - itsLoanBegin;
+		
+		itsLoanBegin = taken;
+		itsLoan      = NULL;
+		
+		return result;
+	}
+	
+}
@@ -0,0 +1,102 @@
+/*
+	pipe_core.hh
+	------------
+*/
+
+#ifndef CONDUIT_PIPECORE_HH
+#define CONDUIT_PIPECORE_HH
+
+// Standard C/C++
+#include <cstddef>
+
+// conduit
+#include "conduit/ring_buffer.hh"
+
+
+namespace conduit
+{
+	
+	/*
+		The data side of a pipe:  a ring buffer, plus a loan through which
+		a writer can offer a large buffer for the reader to copy from
+		directly, instead of copying it into the ring a piece at a time.
+		Blocking, signals, and other policy belong to the caller.
+		
+		A loan's bytes follow everything in the ring when it's made, and
+		the writer adds nothing more until it calls reclaim(), which ends
+		the loan and reports how much of it the reader took.  With the
+		reader on another thread, reclaim() must wait until the loan has
+		been taken completely (or the reader has gone away); with
+		cooperative threads, it may be called at any time.
+	*/
+	
+	class pipe_core
+	{
+		private:
+			ring_buffer              itsRing;
+			
+			/*
+				Loan positions count bytes ever lent, so the reader's
+				progress is never reset underneath it.  The writer owns the
+				others; the reader owns itsLoanTaken.
+			*/
+			
+			const char*              itsLoan;
+			std::size_t              itsLoanBegin;
+			volatile std::size_t     itsLoanEnd;
+			volatile std::size_t     itsLoanTaken;
+			
+			volatile bool            itsIngressHasClosed;
+			volatile bool            itsEgressHasClosed;
+			
+			// not implemented:
+			pipe_core( const pipe_core& );
+			pipe_core& operator=( const pipe_core& );
+		
+		public:
+			static const std::size_t default_capacity = 64 * 1024;
+			
+			explicit pipe_core( std::size_t capacity = default_capacity );
+			
+			std::size_t capacity() const  { return itsRing.capacity(); }
+			
+			// Bytes waiting for the reader, including any unread part of a loan
+			std::size_t readable() const;
+			
+			// Room in the ring (none while a loan is outstanding)
+			std::size_t writable() const;
+			
+			bool is_readable() const  { return itsIngressHasClosed  ||  readable() != 0; }
+			bool is_writable() const  { return itsEgressHasClosed   ||  writable() != 0; }
+			
+			bool ingress_has_closed() const  { return itsIngressHasClosed; }
+			bool egress_has_closed()  const  { return itsEgressHasClosed;  }
+			
+			// Each returns true if the other end was already closed.
+			bool close_ingress()  { itsIngressHasClosed = true;  return itsEgressHasClosed;  }
+			bool close_egress()   { itsEgressHasClosed  = true;  return itsIngressHasClosed; }
+			
+			// Reader:  Never blocks; returns 0 if there's nothing to read.
+			
+			std::size_t read ( char* buffer, std::size_t n );
+			std::size_t readv( const segment* v, unsigned count );
+			
+			// Writer:  Never blocks; copies as much as fits in the ring.
+			
+			std::size_t write ( const char* buffer, std::size_t n );
+			std::size_t writev( const const_segment* v, unsigned count );
+			
+			// Writer:  Lend a buffer, which must stay valid until reclaim().
+			
+			void lend( const char* buffer, std::size_t n );
+			
+			bool lending() const  { return itsLoanEnd != itsLoanBegin; }
+			
+			bool loan_outstanding() const;
+			
+			std::size_t reclaim();
+	};
+	
+}
+
+#endif
@@ -0,0 +1,220 @@
+/*
+	ring_buffer.cc
+	--------------
+*/
+
+#include "conduit/ring_buffer.hh"
+
+// Standard C
+#include <string.h>
+
+// Debug
+#include "debug/assert.hh"
+
+// conduit
+#include "conduit/atomic.hh"
+
+
+namespace conduit
+{
+	
+	static std::size_t power_of_two_at_least( std::size_t n )
+	{
+		std::size_t result = 1;
+		
+		while ( result < n )
+		{
+			result <<= 1;
+		}
+		
+		return result;
+	}
+	
+	ring_buffer::ring_buffer( std::size_t capacity )
+	:
+		itsBuffer  ( NULL ),
+		itsCapacity( power_of_two_at_least( capacity ) ),
+		itsHead    ( 0 ),
+		itsTail    ( 0 )
+	{
+	}
+	
+	ring_buffer::~ring_buffer()
+	{
+		delete [] itsBuffer;
+	}
+	
+	/*
+		The indices count bytes since the beginning and are allowed to wrap
+		around, so tail - head is always the amount in the buffer.
+	*/
+	
+	std::size_t ring_buffer::readable() const
+	{
+		return load_acquire( itsTail ) - load_acquire( itsHead );
+	}
+	
+	std::size_t ring_buffer::writable() const
+	{
+		return itsCapacity - readable();
+	}
+	
+	static unsigned make_segments( char*        buffer,
+	                               std::size_t  capacity,
+	                               std::size_t  start,
+	                               std::size_t  length,
+	                               segment      result[ 2 ] )
+	{
+		if ( length == 0 )
+		{
+			return 0;
+		}
+		
+		const std::size_t offset = start & (capacity - 1);
+		const std::size_t first  = capacity - offset;
+		
+		result[ 0 ].data = buffer + offset;
+		
+		if ( length <= first )
+		{
+			result[ 0 ].size = length;
+			
+			return 1;
+		}
+		
+		result[ 0 ].size = first;
+		
+		result[ 1 ].data = buffer;
+		result[ 1 ].size = length - first;
+		
+		return 2;
+	}
+	
+	unsigned ring_buffer::readable_segments( segment result[ 2 ] ) const
+	{
+		const std::size_t tail = load_acquire( itsTail );
+		
+		return make_segments( itsBuffer, itsCapacity, itsHead, tail - itsHead, result );
+	}
+	
+	unsigned ring_buffer::writable_segments( segment result[ 2 ] )
+	{
+		if ( itsBuffer == NULL )
+		{
+			// The consumer won't look until commit() publishes something.
+			
+			itsBuffer = new char[ itsCapacity ];
+		}
+		
+		const std::size_t head = load_acquire( itsHead );
+		
+		return make_segments( itsBuffer, itsCapacity, itsTail, itsCapacity - (itsTail - head), result );
+	}
+	
+	void ring_buffer::consume( std::size_t n )
+	{
+		ASSERT( n <= readable() );
+		
+		store_release( itsHead, itsHead + n );
+	}
+	
+	void ring_buffer::commit( std::size_t n )
+	{
+		ASSERT( n <= writable() );
+		
+		store_release( itsTail, itsTail + n );
+	}
+	
+	std::size_t ring_buffer::read( char* buffer, std::size_t n )
+	{
+		const segment v = { buffer, n };
+		
+		return readv( &v, 1 );
+	}
+	
+	std::size_t ring_buffer::write( const char* buffer, std::size_t n )
+	{
+		const const_segment v = { buffer, n };
+		
+		return writev( &v, 1 );
+	}
+	
+	std::size_t ring_buffer::readv( const segment* v, unsigned count )
+	{
+		segment source[ 2 ];
+		
+		const unsigned n_sources = readable_segments( source );
+		
+		unsigned s = 0;
+		
+		std::size_t total = 0;
+		
+		for ( unsigned i = 0;  i < count  &&  s < n_sources;  ++i )
+		{
+			char*       dest = v[ i ].data;
+			std::size_t room = v[ i ].size;
+			
+			while ( room > 0  &&  s < n_sources )
+			{
+				const std::size_t n = room < source[ s ].size ? room : source[ s ].size;
+				
+				memcpy( dest, source[ s ].data, n );
+				
+				dest  += n;
+				room  -= n;
+				total += n;
+				
+				source[ s ].data += n;
+				
+				if ( (source[ s ].size -= n) == 0 )
+				{
+					++s;
+				}
+			}
+		}
+		
+		consume( total );
+		
+		return total;
+	}
+	
+	std::size_t ring_buffer::writev( const const_segment* v, unsigned count )
+	{
+		segment dest[ 2 ];
+		
+		const unsigned n_dests = writable_segments( dest );
+		
+		unsigned d = 0;
+		
+		std::size_t total = 0;
+		
+		for ( unsigned i = 0;  i < count  &&  d < n_dests;  ++i )
+		{
+			const char* source = v[ i ].data;
+			std::size_t length = v[ i ].size;
+			
+			while ( length > 0  &&  d < n_dests )
+			{
+				const std::size_t n = length < dest[ d ].size ? length : dest[ d ].size;
+				
+				memcpy( dest[ d ].data, source, n );
+				
+				source += n;
+				length -= n;
+				total  += n;
+				
+				dest[ d ].data += n;
+				
+				if ( (dest[ d ].size -= n) == 0 )
+				{
+					++d;
+				}
+			}
+		}
+		
+		commit( total );
+		
+		return total;
+	}
+	
+}
@@ -0,0 +1,73 @@
+/*
+	ring_buffer.hh
+	--------------
+*/
+
+#ifndef CONDUIT_RINGBUFFER_HH
+#define CONDUIT_RINGBUFFER_HH
+
+// Standard C/C++
+#include <cstddef>
+
+// conduit
+#include "conduit/segment.hh"
+
+
+namespace conduit
+{
+	
+	/*
+		A byte FIFO for one producer and one consumer, which may run on
+		different threads without locking.  The capacity is rounded up to a
+		power of two, and the storage isn't allocated until the first write.
+		
+		Only the producer may call writable_segments(), commit(), write()
+		and writev(); only the consumer may call readable_segments(),
+		consume(), read() and readv().  Either may ask readable() and
+		writable(), though the answer may be stale by the time it arrives.
+	*/
+	
+	class ring_buffer
+	{
+		private:
+			char*                  itsBuffer;
+			const std::size_t      itsCapacity;
+			volatile std::size_t   itsHead;  // total bytes consumed
+			volatile std::size_t   itsTail;  // total bytes committed
+			
+			// not implemented:
+			ring_buffer( const ring_buffer& );
+			ring_buffer& operator=( const ring_buffer& );
+		
+		public:
+			explicit ring_buffer( std::size_t capacity );
+			
+			~ring_buffer();
+			
+			std::size_t capacity() const  { return itsCapacity; }
+			
+			std::size_t readable() const;
+			std::size_t writable() const;
+			
+			bool empty() const  { return readable() == 0; }
+			
+			// Zero-copy access:  Fill in up to two segments, returning the count.
+			
+			unsigned readable_segments( segment result[ 2 ] ) const;
+			unsigned writable_segments( segment result[ 2 ] );
+			
+			void consume( std::size_t n );
+			void commit ( std::size_t n );
+			
+			// Copy as much as fits (or is there), returning the byte count.
+			
+			std::size_t read ( char* buffer, std::size_t n );
+			std::size_t write( const char* buffer, std::size_t n );
+			
+			std::size_t readv ( const segment*        v, unsigned count );
+			std::size_t writev( const const_segment*  v, unsigned count );
+	};
+	
+}
+
+#endif
@@ -0,0 +1,32 @@
+/*
+	segment.hh
+	----------
+*/
+
+#ifndef CONDUIT_SEGMENT_HH
+#define CONDUIT_SEGMENT_HH
+
+// Standard C/C++
+#include <cstddef>
+
+
+namespace conduit
+{
+	
+	// Laid out like struct iovec, but without needing POSIX
+	
+	struct segment
+	{
+		char*        data;
+		std::size_t  size;
+	};
+	
+	struct const_segment
+	{
+		const char*  data;
+		std::size_t  size;
+	};
+	
+}
+
+#endif
@@ -0,0 +1,121 @@
+/*
+	t/pipe_core.cc
+	--------------
+*/
+
+// Standard C
+#include <string.h>
+
+// iota
+#include "iota/strings.hh"
+
+// conduit
+#include "conduit/pipe_core.hh"
+
+// tap-out
+#include "tap/test.hh"
+
+
+static const unsigned n_tests = 4 + 6 + 3 + 3;
+
+
+using tap::ok_if;
+
+
+static void closing()
+{
+	conduit::pipe_core pipe( 16 );
+	
+	ok_if( !pipe.is_readable()  &&  pipe.is_writable() );
+	
+	ok_if( !pipe.close_ingress(), "egress still open" );
+	
+	ok_if( pipe.is_readable(), "readable at EOF" );
+	
+	ok_if( pipe.close_egress(), "both ends closed" );
+}
+
+static void lending()
+{
+	conduit::pipe_core pipe( 4 );
+	
+	static const char loan[] = "0123456789";
+	
+	pipe.write( STR_LEN( "ab" ) );
+	
+	pipe.lend( loan, 10 );
+	
+	ok_if( !pipe.is_writable()  &&  pipe.readable() == 12, "loan counts as readable" );
+	
+	char buffer[ 16 ];
+	
+	ok_if( pipe.read( buffer, 5 ) == 5  &&  memcmp( buffer, "ab012", 5 ) == 0, "ring first, then loan" );
+	
+	ok_if( pipe.loan_outstanding() );
+	
+	ok_if( pipe.read( buffer, sizeof buffer ) == 7  &&  memcmp( buffer, "3456789", 7 ) == 0 );
+	
+	ok_if( !pipe.loan_outstanding()  &&  pipe.reclaim() == 10, "loan taken completely" );
+	
+	ok_if( pipe.is_writable()  &&  pipe.readable() == 0 );
+}
+
+static void reclaiming()
+{
+	conduit::pipe_core pipe( 4 );
+	
+	pipe.lend( STR_LEN( "abcdefgh" ) );
+	
+	char buffer[ 16 ];
+	
+	pipe.read( buffer, 3 );
+	
+	ok_if( pipe.reclaim() == 3, "reclaim() reports what was taken" );
+	
+	ok_if( pipe.readable() == 0  &&  pipe.read( buffer, sizeof buffer ) == 0, "the rest is withdrawn" );
+	
+	pipe.write( STR_LEN( "xy" ) );
+	
+	ok_if( pipe.read( buffer, sizeof buffer ) == 2  &&  memcmp( buffer, "xy", 2 ) == 0 );
+}
+
+static void vectored()
+{
+	conduit::pipe_core pipe( 4 );
+	
+	pipe.write( STR_LEN( "abc" ) );
+	
+	pipe.lend( STR_LEN( "defghij" ) );
+	
+	char a[ 2 ];
+	char b[ 3 ];
+	char c[ 9 ];
+	
+	const conduit::segment out[] =
+	{
+		{ a, sizeof a },
+		{ b, sizeof b },
+		{ c, sizeof c },
+	};
+	
+	ok_if( pipe.readv( out, 3 ) == 10, "readv() spans the ring and the loan" );
+	
+	ok_if( memcmp( a, "ab", 2 ) == 0  &&  memcmp( b, "cde", 3 ) == 0  &&  memcmp( c, "fghij", 5 ) == 0 );
+	
+	ok_if( pipe.reclaim() == 7 );
+}
+
+int main( int argc, const char *const *argv )
+{
+	tap::start( "pipe_core", n_tests );
+	
+	closing();
+	
+	lending();
+	
+	reclaiming();
+	
+	vectored();
+	
+	return 0;
+}
@@ -0,0 +1,114 @@
+/*
+	t/ring_buffer.cc
+	----------------
+*/
+
+// Standard C
+#include <string.h>
+
+// iota
+#include "iota/strings.hh"
+
+// conduit
+#include "conduit/ring_buffer.hh"
+
+// tap-out
+#include "tap/test.hh"
+
+
+static const unsigned n_tests = 5 + 5 + 4;
+
+
+using tap::ok_if;
+
+
+static void basics()
+{
+	conduit::ring_buffer ring( 10 );
+	
+	ok_if( ring.capacity() == 16, "capacity rounds up to a power of two" );
+	
+	ok_if( ring.empty()  &&  ring.writable() == 16 );
+	
+	char buffer[ 32 ];
+	
+	ok_if( ring.read( buffer, sizeof buffer ) == 0, "empty ring reads nothing" );
+	
+	ok_if( ring.write( STR_LEN( "0123456789abcdefXYZ" ) ) == 16, "write stops when full" );
+	
+	ok_if( ring.read( buffer, sizeof buffer ) == 16  &&  memcmp( buffer, "0123456789abcdef", 16 ) == 0 );
+}
+
+static void wrap_around()
+{
+	conduit::ring_buffer ring( 8 );
+	
+	char buffer[ 8 ];
+	
+	ring.write( STR_LEN( "abcdef" ) );
+	
+	ring.read( buffer, 5 );
+	
+	ok_if( ring.write( STR_LEN( "ghijklmn" ) ) == 7, "write wraps around" );
+	
+	conduit::segment segments[ 2 ];
+	
+	const unsigned n = ring.readable_segments( segments );
+	
+	ok_if( n == 2  &&  segments[ 0 ].size == 3  &&  segments[ 1 ].size == 5, "readable data in two segments" );
+	
+	ok_if( ring.read( buffer, 8 ) == 8  &&  memcmp( buffer, "fghijklm", 8 ) == 0 );
+	
+	ok_if( ring.writable_segments( segments ) == 2  &&  segments[ 0 ].size + segments[ 1 ].size == 8 );
+	
+	memcpy( segments[ 0 ].data, "zz", 2 );
+	
+	ring.commit( 2 );
+	
+	ok_if( ring.read( buffer, 8 ) == 2  &&  memcmp( buffer, "zz", 2 ) == 0, "commit() publishes in place" );
+}
+
+static void vectored()
+{
+	conduit::ring_buffer ring( 16 );
+	
+	const conduit::const_segment in[] =
+	{
+		{ "abc", 3 },
+		{ "",    0 },
+		{ "def", 3 },
+		{ "gh",  2 },
+	};
+	
+	ok_if( ring.writev( in, 4 ) == 8, "writev() gathers" );
+	
+	char a[ 1 ];
+	char b[ 4 ];
+	char c[ 8 ];
+	
+	const conduit::segment out[] =
+	{
+		{ a, sizeof a },
+		{ b, sizeof b },
+		{ c, sizeof c },
+	};
+	
+	ok_if( ring.readv( out, 3 ) == 8, "readv() scatters" );
+	
+	ok_if( a[ 0 ] == 'a'  &&  memcmp( b, "bcde", 4 ) == 0  &&  memcmp( c, "fgh", 3 ) == 0 );
+	
+	ok_if( ring.empty() );
+}
+
+int main( int argc, const char *const *argv )
+{
+	tap::start( "ring_buffer", n_tests );
+	
+	basics();
+	
+	wrap_around();
+	
+	vectored();
+	
+	return 0;
+}
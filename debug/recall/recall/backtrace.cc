@@ -27,6 +27,7 @@
 
 // Recall
 #include "recall/demangle.hh"
+#include "recall/elf.hh"
 #include "recall/mach_o.hh"
 #include "recall/macsbug_symbols.hh"
 #include "recall/name_filter.hh"
@@ -93,15 +94,6 @@ namespace recall
 		}
 	};
 	
-#endif
-	
-#ifdef __ELF__
-	
-	static const char* find_symbol_name( return_address_native )
-	{
-		return NULL;
-	}
-	
 #endif
 	
 	template < class SymbolPtr >
@@ -0,0 +1,322 @@
+/*	======
+ *	elf.cc
+ *	======
+ */
+
+#include "recall/elf.hh"
+
+#ifdef __ELF__
+
+// Standard C++
+#include <algorithm>
+#include <vector>
+
+// Standard C
+#include <string.h>
+
+// POSIX
+#include <fcntl.h>
+#include <link.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __GNUC__
+#include <cxxabi.h>
+#endif
+
+// plus
+#include "plus/string.hh"
+
+#endif
+
+
+namespace recall
+{
+
+#ifdef __ELF__
+
+	typedef ElfW(Addr) elf_addr;
+	
+	struct elf_symbol
+	{
+		elf_addr             address;  // as linked, before relocation
+		elf_addr             size;
+		const char*          name;     // points into the mapped file
+		mutable const char*  demangled;
+	};
+	
+	struct elf_object
+	{
+		plus::string               path;
+		elf_addr                   bias;  // load address minus link address
+		elf_addr                   low;
+		elf_addr                   high;
+		bool                       indexed;
+		std::vector< elf_symbol >  symbols;  // sorted by address
+	};
+	
+	typedef std::vector< elf_object > elf_objects;
+	
+	static elf_objects* global_objects = NULL;
+	
+	
+	static bool symbol_precedes( const elf_symbol& a, const elf_symbol& b )
+	{
+		return a.address < b.address;
+	}
+	
+	static bool address_precedes( elf_addr address, const elf_symbol& symbol )
+	{
+		return address < symbol.address;
+	}
+	
+	static int add_object( dl_phdr_info* info, size_t, void* data )
+	{
+		elf_objects& objects = *(elf_objects*) data;
+		
+		const char* name = info->dlpi_name;
+		
+		// The main program comes first, with an empty name.
+		
+		if ( name == NULL  ||  name[0] == '\0' )
+		{
+			name = objects.empty() ? "/proc/self/exe" : "";
+		}
+		
+		elf_object object;
+		
+		object.path    = name;
+		object.bias    = info->dlpi_addr;
+		object.low     = elf_addr( -1 );
+		object.high    = 0;
+		object.indexed = false;
+		
+		for ( int i = 0;  i < info->dlpi_phnum;  ++i )
+		{
+			const ElfW(Phdr)& segment = info->dlpi_phdr[ i ];
+			
+			if ( segment.p_type == PT_LOAD )
+			{
+				const elf_addr begin = object.bias + segment.p_vaddr;
+				
+				object.low  = std::min( object.low,  begin                   );
+				object.high = std::max( object.high, begin + segment.p_memsz );
+			}
+		}
+		
+		objects.push_back( object );
+		
+		return 0;
+	}
+	
+	static const ElfW(Shdr)* find_section( const ElfW(Shdr)* begin,
+	                                       const ElfW(Shdr)* end,
+	                                       ElfW(Word)         type )
+	{
+		for ( const ElfW(Shdr)* it = begin;  it < end;  ++it )
+		{
+			if ( it->sh_type == type )
+			{
+				return it;
+			}
+		}
+		
+		return NULL;
+	}
+	
+	static void index_symbols( elf_object& object )
+	{
+		object.indexed = true;
+		
+		const int fd = open( object.path.c_str(), O_RDONLY );
+		
+		if ( fd < 0 )
+		{
+			return;
+		}
+		
+		struct stat sb;
+		
+		void* map = MAP_FAILED;
+		
+		if ( fstat( fd, &sb ) == 0  &&  sb.st_size >= off_t( sizeof (ElfW(Ehdr)) ) )
+		{
+			map = mmap( NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+		}
+		
+		close( fd );
+		
+		if ( map == MAP_FAILED )
+		{
+			return;
+		}
+		
+		const std::size_t size = sb.st_size;
+		
+		const char* base = (const char*) map;
+		
+		const ElfW(Ehdr)& header = *(const ElfW(Ehdr)*) base;
+		
+		const unsigned char native_class = sizeof (void*) == 8 ? ELFCLASS64 : ELFCLASS32;
+		
+		if (    memcmp( header.e_ident, ELFMAG, SELFMAG ) != 0
+		     || header.e_ident[ EI_CLASS ] != native_class
+		     || header.e_shentsize != sizeof (ElfW(Shdr))
+		     || header.e_shoff > size
+		     || header.e_shnum > (size - header.e_shoff) / sizeof (ElfW(Shdr)) )
+		{
+			munmap( map, size );
+			
+			return;
+		}
+		
+		const ElfW(Shdr)* sections = (const ElfW(Shdr)*) (base + header.e_shoff);
+		const ElfW(Shdr)* sections_end = sections + header.e_shnum;
+		
+		// Stripped shared libraries still have their dynamic symbols.
+		
+		const ElfW(Shdr)* symtab = find_section( sections, sections_end, SHT_SYMTAB );
+		
+		if ( symtab == NULL )
+		{
+			symtab = find_section( sections, sections_end, SHT_DYNSYM );
+		}
+		
+		if (    symtab == NULL
+		     || symtab->sh_link >= header.e_shnum
+		     || symtab->sh_offset > size
+		     || symtab->sh_size > size - symtab->sh_offset )
+		{
+			munmap( map, size );
+			
+			return;
+		}
+		
+		const ElfW(Shdr)& strtab = sections[ symtab->sh_link ];
+		
+		if ( strtab.sh_offset > size  ||  strtab.sh_size > size - strtab.sh_offset )
+		{
+			munmap( map, size );
+			
+			return;
+		}
+		
+		const ElfW(Sym)* syms = (const ElfW(Sym)*) (base + symtab->sh_offset);
+		const ElfW(Sym)* syms_end = syms + symtab->sh_size / sizeof (ElfW(Sym));
+		
+		const char* strings = base + strtab.sh_offset;
+		
+		std::vector< elf_symbol >& symbols = object.symbols;
+		
+		symbols.reserve( syms_end - syms );
+		
+		for ( const ElfW(Sym)* it = syms;  it < syms_end;  ++it )
+		{
+			const bool is_function = (it->st_info & 0xf) == STT_FUNC;
+			
+			if (    !is_function
+			     || it->st_shndx == SHN_UNDEF
+			     || it->st_value == 0
+			     || it->st_name >= strtab.sh_size )
+			{
+				continue;
+			}
+			
+			elf_symbol symbol = { it->st_value, it->st_size, strings + it->st_name, NULL };
+			
+			symbols.push_back( symbol );
+		}
+		
+		std::sort( symbols.begin(), symbols.end(), symbol_precedes );
+		
+		// The mapping stays, since the symbol names point into it.
+	}
+	
+	static elf_object* find_object( elf_addr address )
+	{
+		if ( global_objects == NULL )
+		{
+			global_objects = new elf_objects;
+			
+			dl_iterate_phdr( add_object, global_objects );
+		}
+		
+		typedef elf_objects::iterator Iter;
+		
+		for ( Iter it = global_objects->begin();  it != global_objects->end();  ++it )
+		{
+			if ( it->low <= address  &&  address < it->high )
+			{
+				return &*it;
+			}
+		}
+		
+		return NULL;
+	}
+	
+	const elf_symbol* find_symbol_name( return_address_elf addr )
+	{
+		const elf_addr address = (elf_addr) addr;
+		
+		elf_object* object = find_object( address );
+		
+		if ( object == NULL )
+		{
+			return NULL;
+		}
+		
+		if ( !object->indexed )
+		{
+			index_symbols( *object );
+		}
+		
+		const std::vector< elf_symbol >& symbols = object->symbols;
+		
+		const elf_addr link_address = address - object->bias;
+		
+		typedef std::vector< elf_symbol >::const_iterator Iter;
+		
+		Iter it = std::upper_bound( symbols.begin(), symbols.end(), link_address, address_precedes );
+		
+		if ( it == symbols.begin() )
+		{
+			return NULL;
+		}
+		
+		--it;
+		
+		if ( it->size != 0  &&  link_address >= it->address + it->size )
+		{
+			return NULL;  // between functions
+		}
+		
+		return &*it;
+	}
+	
+	const char* get_symbol_string( const elf_symbol* symbol )
+	{
+		return symbol->name;
+	}
+	
+	const char* get_demangled_symbol_string( const elf_symbol* symbol )
+	{
+		if ( symbol->demangled == NULL )
+		{
+			const char* unmangled = NULL;
+			
+		#ifdef __GNUC__
+			
+			unmangled = abi::__cxa_demangle( symbol->name, NULL, NULL, NULL );
+			
+		#endif
+			
+			symbol->demangled = unmangled ? unmangled : symbol->name;
+		}
+		
+		return symbol->demangled;
+	}
+	
+#endif
+
+}
@@ -0,0 +1,34 @@
+/*	======
+ *	elf.hh
+ *	======
+ */
+
+#ifndef RECALL_ELF_HH
+#define RECALL_ELF_HH
+
+// Recall
+#include "recall/return_address.hh"
+
+
+namespace recall
+{
+	
+	struct elf_symbol;
+	
+	/*
+		Symbolizes addresses in the executable and any loaded shared
+		objects by mapping each file once and indexing its function
+		symbols (.symtab, or else .dynsym) by address.  Not for use in
+		signal handlers, since the first lookup in a file builds its index.
+	*/
+	
+	const elf_symbol* find_symbol_name( return_address_elf addr );
+	
+	const char* get_symbol_string( const elf_symbol* symbol );
+	
+	// Demangled once per symbol and cached
+	const char* get_demangled_symbol_string( const elf_symbol* symbol );
+	
+}
+
+#endif
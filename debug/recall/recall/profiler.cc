@@ -0,0 +1,423 @@
+/*	===========
+ *	profiler.cc
+ *	===========
+ */
+
+#include "recall/profiler.hh"
+
+#if defined( __linux__ )  &&  (defined( __i386__ )  ||  defined( __x86_64__ ))
+#define RECALL_CAN_PROFILE  1
+#else
+#define RECALL_CAN_PROFILE  0
+#endif
+
+#if RECALL_CAN_PROFILE
+
+// Standard C++
+#include <map>
+
+// Standard C
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+// Iota
+#include "iota/strings.hh"
+
+// gear
+#include "gear/inscribe_decimal.hh"
+#include "gear/parse_decimal.hh"
+
+// plus
+#include "plus/var_string.hh"
+
+// Recall
+#include "recall/elf.hh"
+#include "recall/stack_crawl.hh"
+
+#endif
+
+
+namespace recall
+{
+
+#if RECALL_CAN_PROFILE
+
+	/*
+		Each sample is stored as a count n, the interrupted PC, and then
+		n - 1 return addresses, innermost first.  The buffer is reserved
+		up front, so the signal handler never allocates; its pages are
+		only committed as samples fill them.
+	*/
+	
+	typedef const void* word;
+	
+	static const unsigned max_depth = 64;
+	
+	static const std::size_t buffer_words = 4 * 1024 * 1024;
+	
+	static word*        global_samples     = NULL;
+	static std::size_t  global_sample_mark = 0;
+	static std::size_t  global_dropped     = 0;
+	
+	static const void*  global_stack_limit = NULL;
+	
+	static plus::string global_output_path;
+	
+	static pid_t global_profiled_pid = 0;
+	
+	
+	static inline bool is_aligned( const void* p )
+	{
+		return ((long) p & (sizeof (void*) - 1)) == 0;
+	}
+	
+	static void sigprof_handler( int, siginfo_t*, void* context )
+	{
+		const int saved_errno = errno;
+		
+		const mcontext_t& regs = ((const ucontext_t*) context)->uc_mcontext;
+		
+	#ifdef __x86_64__
+		
+		const void* pc = (const void*) regs.gregs[ REG_RIP ];
+		const void* fp = (const void*) regs.gregs[ REG_RBP ];
+		const void* sp = (const void*) regs.gregs[ REG_RSP ];
+		
+	#else
+		
+		const void* pc = (const void*) regs.gregs[ REG_EIP ];
+		const void* fp = (const void*) regs.gregs[ REG_EBP ];
+		const void* sp = (const void*) regs.gregs[ REG_ESP ];
+		
+	#endif
+		
+		frame_data frames[ max_depth - 1 ];
+		
+		unsigned n_frames = 0;
+		
+		/*
+			On the main thread, everything between sp and the limit is mapped,
+			so the crawl is safe even if the interrupted code uses the frame
+			pointer for something else.  Other threads' stacks are elsewhere,
+			and the limit says nothing about them, so their samples get the
+			pc alone.
+		*/
+		
+		const bool main_stack = syscall( SYS_gettid ) == global_profiled_pid  &&  sp < global_stack_limit;
+		
+		if ( main_stack  &&  fp >= sp  &&  fp < global_stack_limit  &&  is_aligned( fp ) )
+		{
+			n_frames = make_stack_crawl( frames,
+			                             max_depth - 1,
+			                             (stack_frame_pointer) fp,
+			                             global_stack_limit );
+		}
+		
+		const std::size_t n_words = 2 + n_frames;
+		
+		if ( global_sample_mark + n_words > buffer_words )
+		{
+			++global_dropped;
+		}
+		else
+		{
+			word* p = global_samples + global_sample_mark;
+			
+			*p++ = (word) (std::size_t) (1 + n_frames);
+			*p++ = pc;
+			
+			for ( unsigned i = 0;  i < n_frames;  ++i )
+			{
+				*p++ = frames[ i ].addr_native;
+			}
+			
+			global_sample_mark += n_words;
+		}
+		
+		errno = saved_errno;
+	}
+	
+	static const void* find_stack_limit()
+	{
+		// The upper end of the main thread's stack mapping
+		
+		FILE* maps = fopen( "/proc/self/maps", "r" );
+		
+		if ( maps == NULL )
+		{
+			return NULL;
+		}
+		
+		unsigned long limit = 0;
+		
+		char line[ 512 ];
+		
+		while ( fgets( line, sizeof line, maps ) )
+		{
+			unsigned long begin, end;
+			
+			if ( strstr( line, "[stack]" )  &&  sscanf( line, "%lx-%lx", &begin, &end ) == 2 )
+			{
+				limit = end;
+				
+				break;
+			}
+		}
+		
+		fclose( maps );
+		
+		// Leave room to read a whole frame record at the last link
+		return limit ? (const char*) limit - 2 * sizeof (void*) : NULL;
+	}
+	
+	static void set_timer( unsigned hz )
+	{
+		itimerval timer = { { 0, 0 }, { 0, 0 } };
+		
+		if ( hz != 0 )
+		{
+			timer.it_interval.tv_usec = 1000000 / hz;
+			timer.it_value           = timer.it_interval;
+		}
+		
+		setitimer( ITIMER_PROF, &timer, NULL );
+	}
+	
+	bool start_profiling( const char* output_path, unsigned hz )
+	{
+		if ( global_samples != NULL  ||  hz == 0  ||  hz > 100000 )
+		{
+			return false;
+		}
+		
+		global_stack_limit = find_stack_limit();
+		
+		if ( global_stack_limit == NULL )
+		{
+			return false;
+		}
+		
+		void* buffer = mmap( NULL,
+		                     buffer_words * sizeof (word),
+		                     PROT_READ | PROT_WRITE,
+		                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+		                     -1,
+		                     0 );
+		
+		if ( buffer == MAP_FAILED )
+		{
+			return false;
+		}
+		
+		global_samples      = (word*) buffer;
+		global_output_path  = output_path;
+		global_profiled_pid = getpid();
+		
+		struct sigaction action;
+		
+		memset( &action, 0, sizeof action );
+		
+		action.sa_sigaction = &sigprof_handler;
+		action.sa_flags     = SA_SIGINFO | SA_RESTART;
+		
+		sigemptyset( &action.sa_mask );
+		
+		sigaction( SIGPROF, &action, NULL );
+		
+		set_timer( hz );
+		
+		return true;
+	}
+	
+	
+	typedef std::map< const void*, plus::string > name_cache;
+	
+	static const plus::string& function_name( name_cache& cache, const void* address )
+	{
+		name_cache::iterator it = cache.find( address );
+		
+		if ( it != cache.end() )
+		{
+			return it->second;
+		}
+		
+		plus::string& name = cache[ address ];
+		
+		if ( const elf_symbol* symbol = find_symbol_name( (return_address_elf) address ) )
+		{
+			name = get_demangled_symbol_string( symbol );
+		}
+		else
+		{
+			name = "[unknown]";
+		}
+		
+		return name;
+	}
+	
+	static plus::string output_pathname()
+	{
+		const plus::string& path = global_output_path;
+		
+		const char* p = strstr( path.c_str(), "%p" );
+		
+		if ( p == NULL )
+		{
+			return path;
+		}
+		
+		plus::var_string result;
+		
+		result.assign( path.data(), p - path.data() );
+		
+		result += gear::inscribe_decimal( getpid() );
+		result += p + STRLEN( "%p" );
+		
+		return result;
+	}
+	
+	static void write_folded_stacks( int fd )
+	{
+		typedef std::map< plus::string, std::size_t > folded_stacks;
+		
+		name_cache names;
+		
+		folded_stacks stacks;
+		
+		plus::var_string stack;
+		
+		const word* p   = global_samples;
+		const word* end = global_samples + global_sample_mark;
+		
+		while ( p < end )
+		{
+			const std::size_t n = (std::size_t) *p++;
+			
+			stack.clear();
+			
+			// Outermost caller first; return addresses are backed up into
+			// the call instruction, so they land in the calling function.
+			
+			for ( std::size_t i = n;  i-- > 0; )
+			{
+				const char* address = (const char*) p[ i ] - (i != 0);
+				
+				if ( !stack.empty() )
+				{
+					stack += ";";
+				}
+				
+				stack += function_name( names, address );
+			}
+			
+			++stacks[ stack ];
+			
+			p += n;
+		}
+		
+		plus::var_string output;
+		
+		typedef folded_stacks::const_iterator Iter;
+		
+		for ( Iter it = stacks.begin();  it != stacks.end();  ++it )
+		{
+			output += it->first;
+			output += " ";
+			output += gear::inscribe_decimal( it->second );
+			output += "\n";
+		}
+		
+		write( fd, output.data(), output.size() );
+	}
+	
+	void stop_profiling()
+	{
+		if ( global_samples == NULL )
+		{
+			return;
+		}
+		
+		set_timer( 0 );
+		
+		signal( SIGPROF, SIG_IGN );
+		
+		// Forked children inherit the atexit() hook, but not the timer.
+		
+		if ( getpid() == global_profiled_pid )
+		{
+			const plus::string path = output_pathname();
+			
+			const int fd = open( path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666 );
+			
+			if ( fd >= 0 )
+			{
+				write_folded_stacks( fd );
+				
+				close( fd );
+			}
+			
+			if ( global_dropped != 0 )
+			{
+				fprintf( stderr, "recall: profile buffer full; %lu samples dropped\n",
+				                 (unsigned long) global_dropped );
+			}
+		}
+		
+		munmap( global_samples, buffer_words * sizeof (word) );
+		
+		global_samples     = NULL;
+		global_sample_mark = 0;
+		global_dropped     = 0;
+	}
+	
+	void start_profiling_from_environment()
+	{
+		const char* path = getenv( "RECALL_PROFILE" );
+		
+		if ( path == NULL  ||  path[0] == '\0' )
+		{
+			return;
+		}
+		
+		unsigned hz = 97;
+		
+		if ( const char* rate = getenv( "RECALL_PROFILE_HZ" ) )
+		{
+			hz = gear::parse_unsigned_decimal( rate );
+		}
+		
+		if ( start_profiling( path, hz ) )
+		{
+			atexit( &stop_profiling );
+		}
+	}
+	
+#else
+
+	bool start_profiling( const char* output_path, unsigned hz )
+	{
+		return false;
+	}
+	
+	void stop_profiling()
+	{
+	}
+	
+	void start_profiling_from_environment()
+	{
+	}
+	
+#endif
+
+}
@@ -0,0 +1,44 @@
+/*	===========
+ *	profiler.hh
+ *	===========
+ */
+
+#ifndef RECALL_PROFILER_HH
+#define RECALL_PROFILER_HH
+
+
+namespace recall
+{
+	
+	/*
+		A sampling profiler.  While it runs, SIGPROF interrupts the process
+		hz times per second of CPU time, and the handler records the
+		interrupted stack with make_stack_crawl() into a preallocated
+		buffer (so code built without frame pointers yields short stacks).
+		Samples taken on threads other than the main one record only the
+		interrupted pc.
+		
+		stop_profiling() symbolizes the samples and writes them as folded
+		stacks -- one line per distinct call chain, followed by its sample
+		count -- which is the input format of flamegraph.pl.  Any "%p" in
+		the output path is replaced with the process ID.
+		
+		Currently implemented for Linux on x86 and x86_64 only; elsewhere
+		start_profiling() returns false.
+	*/
+	
+	bool start_profiling( const char* output_path, unsigned hz = 97 );
+	
+	void stop_profiling();
+	
+	/*
+		Profiles the whole run if RECALL_PROFILE is set to an output path,
+		at RECALL_PROFILE_HZ samples per second if that's set too.  The
+		profile is written at exit().
+	*/
+	
+	void start_profiling_from_environment();
+	
+}
+
+#endif
@@ -51,7 +51,7 @@ namespace recall
 #endif
 	
 	
-#ifdef __i386__
+#if defined( __i386__ )  ||  defined( __x86_64__ )
 	
 	typedef return_address_native return_address_x86;
 	
@@ -73,6 +73,17 @@ namespace recall
 #endif
 
 
+#ifdef __ELF__
+	
+	typedef return_address_native return_address_elf;
+	
+#else
+	
+	typedef const struct opaque_code_alien_elf* return_address_elf;
+	
+#endif
+
+
 #if defined( __POWERPC__ ) && !defined( __MACH__ )  ||  defined( __MACOS__ )
 	
 	typedef return_address_ppc return_address_traceback;
@@ -97,10 +97,21 @@ namespace recall
 #endif
 	
 	
+	template < class StackFrame >
+	static inline bool is_plausible_link( const StackFrame* frame, const void* limit )
+	{
+		const StackFrame* next = frame->next;
+		
+		return    next > frame
+		       && (const void*) next < limit
+		       && ((long) next & (sizeof (void*) - 1)) == 0;
+	}
+	
 	template < class StackFrame >
 	static unsigned crawl_stack( const StackFrame*  frame,
 	                             frame_data*        result,
-	                             unsigned           capacity )
+	                             unsigned           capacity,
+	                             const void*        limit = NULL )
 	{
 	next:
 		
@@ -115,7 +126,7 @@ namespace recall
 		{
 			if ( typename traits::next_frame_type next = traits::check( frame ) )
 			{
-				crawl_stack( next, result, capacity );
+				crawl_stack( next, result, capacity, limit );
 				
 				return capacity;
 			}
@@ -126,6 +137,10 @@ namespace recall
 		
 		--capacity;
 		
+		if ( limit != NULL  &&  !is_plausible_link( frame, limit ) )
+		{
+			return capacity;
+		}
 		
 		frame = frame->next;
 		
@@ -134,12 +149,13 @@ namespace recall
 	
 	unsigned make_stack_crawl( frame_data*          result,
 	                           unsigned             capacity,
-	                           stack_frame_pointer  top )
+	                           stack_frame_pointer  top,
+	                           const void*          stack_limit )
 	{
 		const stack_frame* top_frame = top ? (const stack_frame*) top
 		                                   : get_top_frame();
 		
-		return capacity - crawl_stack( top_frame, result, capacity );
+		return capacity - crawl_stack( top_frame, result, capacity, stack_limit );
 		
 		return 0;
 	}
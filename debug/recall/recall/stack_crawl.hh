@@ -70,9 +70,16 @@ namespace recall
 	
 	stack_frame_pointer get_stack_frame_pointer( int levels_to_skip = 0 );
 	
+	/*
+		If stack_limit is given, the crawl stops at any frame link that
+		doesn't point upward, below the limit -- e.g. when sampling code
+		whose frame pointer register may hold something else.
+	*/
+	
 	unsigned make_stack_crawl( frame_data*          result,
 	                           unsigned             capacity,
-	                           stack_frame_pointer  top = 0L );  // NULL
+	                           stack_frame_pointer  top = 0L,  // NULL
+	                           const void*          stack_limit = 0L );
 	
 }
 
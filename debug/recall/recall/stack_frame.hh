@@ -110,6 +110,24 @@ namespace recall
 	
 #endif
 	
+#ifdef __x86_64__
+	
+	// Requires -fno-omit-frame-pointer, as does i386.
+	
+	typedef stack_frame_x86 stack_frame;
+	
+	inline const stack_frame_x86* get_frame_pointer()
+	{
+		return (const stack_frame_x86*) __builtin_frame_address( 0 );
+	}
+	
+	static const stack_frame_x86* get_top_frame()
+	{
+		return (const stack_frame_x86*) __builtin_frame_address( 0 );
+	}
+	
+#endif
+	
 }
 
 #endif
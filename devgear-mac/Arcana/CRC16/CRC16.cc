@@ -0,0 +1,91 @@
+/*	========
+ *	CRC16.cc
+ *	========
+ */
+
+#include "CRC16.hh"
+
+
+namespace CRC16
+{
+	
+	typedef unsigned short Word;
+	
+	enum
+	{
+		kQuotient = 0x1021
+	};
+	
+	/*
+		gTables[ k ][ i ] is what byte i contributes to the register when
+		it's followed by k more bytes, so eight bytes take eight lookups
+		(slicing-by-8) instead of sixty-four shifts.  They're built on first
+		use, not by a static constructor.
+	*/
+	
+	static Word gTables[ 8 ][ 256 ];
+	
+	static bool gTablesReady;
+	
+	static void MakeTables()
+	{
+		for ( int i = 0;  i < 256;  ++i )
+		{
+			unsigned crc = i << 8;
+			
+			for ( int j = 0;  j < 8;  ++j )
+			{
+				crc = crc & 0x8000 ? (crc << 1) ^ kQuotient
+				                   :  crc << 1;
+			}
+			
+			gTables[ 0 ][ i ] = crc;
+		}
+		
+		for ( int k = 1;  k < 8;  ++k )
+		{
+			for ( int i = 0;  i < 256;  ++i )
+			{
+				const Word crc = gTables[ k - 1 ][ i ];
+				
+				gTables[ k ][ i ] = (crc << 8) ^ gTables[ 0 ][ crc >> 8 ];
+			}
+		}
+		
+		gTablesReady = true;
+	}
+	
+	unsigned short Update( unsigned short crc, const void* data, std::size_t bytes )
+	{
+		if ( !gTablesReady )
+		{
+			MakeTables();
+		}
+		
+		const unsigned char* p   = (const unsigned char*) data;
+		const unsigned char* end = p + bytes;
+		
+		while ( end - p >= 8 )
+		{
+			crc = gTables[ 7 ][ p[ 0 ] ^ (crc >> 8)   ]
+			    ^ gTables[ 6 ][ p[ 1 ] ^ (crc & 0xFF) ]
+			    ^ gTables[ 5 ][ p[ 2 ] ]
+			    ^ gTables[ 4 ][ p[ 3 ] ]
+			    ^ gTables[ 3 ][ p[ 4 ] ]
+			    ^ gTables[ 2 ][ p[ 5 ] ]
+			    ^ gTables[ 1 ][ p[ 6 ] ]
+			    ^ gTables[ 0 ][ p[ 7 ] ];
+			
+			p += 8;
+		}
+		
+		while ( p < end )
+		{
+			crc = (crc << 8) ^ gTables[ 0 ][ (crc >> 8) ^ *p++ ];
+		}
+		
+		return crc;
+	}
+	
+}  // namespace CRC16
+
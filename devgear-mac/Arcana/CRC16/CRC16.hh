@@ -0,0 +1,32 @@
+/*	========
+ *	CRC16.hh
+ *	========
+ *	
+ *	Implemented by CRC16.cc
+ */
+
+#pragma once
+
+// Standard C/C++
+#include <cstddef>
+
+
+namespace CRC16
+{
+	
+	/*
+		The CCITT CRC-16 (polynomial 0x1021, starting from zero, with no
+		reflection or final inversion), as used by MacBinary and XMODEM.
+		
+		Pass the result of one Update() to the next to checksum a stream.
+	*/
+	
+	unsigned short Update( unsigned short crc, const void* data, std::size_t bytes );
+	
+	inline unsigned short Checksum( const void* data, std::size_t bytes )
+	{
+		return Update( 0, data, bytes );
+	}
+	
+}
+
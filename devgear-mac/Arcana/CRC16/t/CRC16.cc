@@ -0,0 +1,122 @@
+/*
+	t/CRC16.cc
+	----------
+*/
+
+// Standard C
+#include <stdlib.h>
+
+// CRC16
+#include "CRC16.hh"
+
+// tap-out
+#include "tap/test.hh"
+
+
+static const unsigned n_tests = 3 + 1;
+
+
+using tap::ok_if;
+
+
+// A bit at a time, as MacBinary used to compute it
+
+static unsigned short reference( const unsigned char* data, std::size_t size )
+{
+	unsigned long crc = 0;
+	
+	while ( size-- > 0 )
+	{
+		unsigned long dataByte = *data++ << 8;
+		
+		for ( int i = 0;  i < 8;  ++i )
+		{
+			const unsigned long bit = dataByte ^ crc;
+			
+			dataByte += dataByte;
+			crc      += crc;
+			
+			if ( bit & 0x8000 )
+			{
+				crc ^= 0x1021;
+			}
+		}
+	}
+	
+	return crc;
+}
+
+static unsigned char gData[ 64 * 1024 ];
+
+static void fill_data()
+{
+	srand( 1 );
+	
+	for ( unsigned i = 0;  i < sizeof gData;  ++i )
+	{
+		gData[ i ] = rand() >> 4;
+	}
+}
+
+static bool checksums_match( unsigned max_size, unsigned n_trials )
+{
+	for ( unsigned i = 0;  i < n_trials;  ++i )
+	{
+		const unsigned size   = rand() % (max_size + 1);
+		const unsigned offset = rand() % 16;
+		
+		const unsigned char* data = gData + offset;
+		
+		if ( CRC16::Checksum( data, size ) != reference( data, size ) )
+		{
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+static void checksum()
+{
+	ok_if( CRC16::Checksum( "123456789", 9 ) == 0x31C3, "check value" );
+	
+	ok_if( checksums_match( 130, 2000 ), "short inputs" );
+	
+	ok_if( checksums_match( sizeof gData - 16, 100 ), "long inputs" );
+}
+
+static void update()
+{
+	const unsigned size = sizeof gData;
+	
+	unsigned short crc = 0;
+	
+	for ( unsigned n = 0;  n < size;  )
+	{
+		unsigned piece = rand() % 100;
+		
+		if ( piece > size - n )
+		{
+			piece = size - n;
+		}
+		
+		crc = CRC16::Update( crc, gData + n, piece );
+		
+		n += piece;
+	}
+	
+	ok_if( crc == reference( gData, size ), "in pieces" );
+}
+
+int main( int argc, const char *const *argv )
+{
+	tap::start( "CRC16", n_tests );
+	
+	fill_data();
+	
+	checksum();
+	
+	update();
+	
+	return 0;
+}
@@ -5,78 +5,355 @@
 
 // A recoded implementation of Algorithm Three from "Fast CRC32 in Software".
 // See <http://www.cl.cam.ac.uk/Research/SRG/bluebook/21/crc/node6.html>.
+//
+// Algorithm Three feeds each byte into the bottom of the register, so the
+// register always lags four bytes behind the input.  Instead, the Engine
+// runs the usual table-driven CRC (which multiplies the input by x^32)
+// over all but the last four bytes, starting from all ones (the same as
+// inverting the first four bytes), and adds the last four bytes in at the
+// end.  The result is the same, and the bulk of the input can be taken
+// eight bytes at a time (slicing-by-8), or folded with carry-less
+// multiplication where the CPU has it.
 
 
 #include "CRC32.hh"
 
+// Carry-less multiplication needs both the instructions and intrinsics that
+// can be enabled per function.
+
+#if defined( __GNUC__ )  &&  (defined( __x86_64__ )  ||  defined( __i386__ ))
+#if defined( __clang__ )  ||  __GNUC__ > 4  ||  __GNUC__ == 4  &&  __GNUC_MINOR__ >= 9
+#define CRC32_CLMUL  1
+#endif
+#endif
+
+#ifdef CRC32_CLMUL
+
+// x86
+#include <cpuid.h>
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#include <wmmintrin.h>
+
+#endif
+
 
 namespace CRC32
 {
 	
-	class Table
-	{
-		private:
-			unsigned int data[ 256 ];
-		
-		public:
-			Table();
-			
-			unsigned int operator[]( unsigned char i ) const  { return data[ i ]; }
-	};
+	typedef unsigned int Word;
 	
 	enum
 	{
 		kQuotient = 0x04c11db7
 	};
 	
-	Table::Table()
+	/*
+		gTables[ k ][ i ] is i * x^(32 + 8k) mod P:  what byte i contributes
+		to the register when it's followed by k more bytes.
+		
+		The compiler is C++98, so the tables are built on first use rather
+		than at compile time -- and not by a static constructor, so that
+		checksums can be taken during static initialization.
+	*/
+	
+	static Word gTables[ 8 ][ 256 ];
+	
+	static bool gTablesReady;
+	
+	static inline Word MultiplyByX( Word crc )
 	{
-		for ( int i = 0;  i < 256;	++i )
+		return crc & 0x80000000 ? (crc << 1) ^ kQuotient
+		                        :  crc << 1;
+	}
+	
+	// x^n mod P
+	static Word PowerOfX( unsigned n )
+	{
+		Word result = 1;
+		
+		while ( n-- > 0 )
 		{
-			unsigned int crc = i << 24;
+			result = MultiplyByX( result );
+		}
+		
+		return result;
+	}
+	
+	static void MakeTables()
+	{
+		for ( int i = 0;  i < 256;  ++i )
+		{
+			Word crc = i << 24;
 			
 			for ( int j = 0;  j < 8;  ++j )
 			{
-				if ( crc & 0x80000000 )
-				{
-					crc = (crc << 1) ^ kQuotient;
-				}
-				else
-				{
-					crc = crc << 1;
-				}
+				crc = MultiplyByX( crc );
 			}
 			
-			data[ i ] = crc;
+			gTables[ 0 ][ i ] = crc;
 		}
+		
+		for ( int k = 1;  k < 8;  ++k )
+		{
+			for ( int i = 0;  i < 256;  ++i )
+			{
+				const Word crc = gTables[ k - 1 ][ i ];
+				
+				gTables[ k ][ i ] = (crc << 8) ^ gTables[ 0 ][ crc >> 24 ];
+			}
+		}
+		
+		gTablesReady = true;
+	}
+	
+	static inline Word LoadBig32( const unsigned char* p )
+	{
+		return Word( p[ 0 ] ) << 24 | p[ 1 ] << 16 | p[ 2 ] << 8 | p[ 3 ];
 	}
 	
-	static Table gTable;
+	// word * x^32 mod P
+	static inline Word TimesX32( Word word )
+	{
+		return gTables[ 3 ][ word >> 24         ]
+		     ^ gTables[ 2 ][ word >> 16 & 0xFF ]
+		     ^ gTables[ 1 ][ word >>  8 & 0xFF ]
+		     ^ gTables[ 0 ][ word       & 0xFF ];
+	}
 	
-	unsigned int Checksum( const void* text, unsigned int bytes )
+	// word * x^64 mod P
+	static inline Word TimesX64( Word word )
 	{
-		if ( bytes <= 4 )
+		return gTables[ 7 ][ word >> 24         ]
+		     ^ gTables[ 6 ][ word >> 16 & 0xFF ]
+		     ^ gTables[ 5 ][ word >>  8 & 0xFF ]
+		     ^ gTables[ 4 ][ word       & 0xFF ];
+	}
+	
+	static inline Word AdvanceByte( Word crc, unsigned char byte )
+	{
+		return (crc << 8) ^ gTables[ 0 ][ (crc >> 24) ^ byte ];
+	}
+	
+	static Word AdvanceSliced( Word crc, const unsigned char* data, std::size_t n )
+	{
+		const unsigned char* end = data + n;
+		
+		while ( end - data >= 8 )
+		{
+			crc ^= LoadBig32( data );
+			
+			crc = TimesX64( crc ) ^ TimesX32( LoadBig32( data + 4 ) );
+			
+			data += 8;
+		}
+		
+		while ( data < end )
+		{
+			crc = AdvanceByte( crc, *data++ );
+		}
+		
+		return crc;
+	}
+	
+#ifdef CRC32_CLMUL
+
+	/*
+		The input, taken as a polynomial, is reduced modulo P sixteen bytes
+		at a time by multiplying the part that overflows 128 bits by the
+		appropriate power of x mod P, in four independent streams (which is
+		what keeps the multiplier busy).  The final 128 bits are brought
+		down to 64 the same way, and the tables do the rest.
+	*/
+	
+	static bool gHasCLMUL;
+	
+	// { x^(n + 64) mod P, x^n mod P }, for folding across n bits
+	static Word gFold512[ 2 ];
+	static Word gFold128[ 2 ];
+	
+	static Word gX64;  // x^64 mod P
+	
+	static void SetUpCLMUL()
+	{
+		unsigned int a, b, c, d;
+		
+		if ( __get_cpuid( 1, &a, &b, &c, &d ) )
 		{
-			return *reinterpret_cast< const unsigned int* >( text ) >> ((4 - bytes) * 8);
+			gHasCLMUL = (c & bit_PCLMUL)  &&  (c & bit_SSSE3);
 		}
 		
-		const unsigned char* data = reinterpret_cast< const unsigned char* >( text );
-		const unsigned char* end = data + bytes;
+		gFold512[ 0 ] = PowerOfX( 512 + 64 );
+		gFold512[ 1 ] = PowerOfX( 512      );
+		gFold128[ 0 ] = PowerOfX( 128 + 64 );
+		gFold128[ 1 ] = PowerOfX( 128      );
 		
-		unsigned int result = data[ 0 ] << 24
-		                    | data[ 1 ] << 16
-		                    | data[ 2 ] << 8
-		                    | data[ 3 ];
+		gX64 = PowerOfX( 64 );
+	}
+	
+	#define CRC32_TARGET  __attribute__(( target( "pclmul,ssse3" ) ))
+	
+	CRC32_TARGET
+	static inline __m128i Load( const unsigned char* p )
+	{
+		// The first byte is the most significant.
 		
-		result = ~result;
-		data += 4;
+		const __m128i reversed = _mm_set_epi8( 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 );
 		
-		while ( data < end )
+		return _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i*) p ), reversed );
+	}
+	
+	CRC32_TARGET
+	static inline __m128i Fold( __m128i x, __m128i k )
+	{
+		return _mm_xor_si128( _mm_clmulepi64_si128( x, k, 0x11 ),
+		                      _mm_clmulepi64_si128( x, k, 0x00 ) );
+	}
+	
+	// n is a multiple of 16, and at least 64
+	CRC32_TARGET
+	static Word AdvanceFolded( Word crc, const unsigned char* data, std::size_t n )
+	{
+		const __m128i k512 = _mm_set_epi64x( gFold512[ 0 ], gFold512[ 1 ] );
+		const __m128i k128 = _mm_set_epi64x( gFold128[ 0 ], gFold128[ 1 ] );
+		
+		__m128i x0 = _mm_xor_si128( Load( data ), _mm_set_epi32( crc, 0, 0, 0 ) );
+		__m128i x1 = Load( data + 16 );
+		__m128i x2 = Load( data + 32 );
+		__m128i x3 = Load( data + 48 );
+		
+		data += 64;
+		n    -= 64;
+		
+		while ( n >= 64 )
+		{
+			x0 = _mm_xor_si128( Fold( x0, k512 ), Load( data      ) );
+			x1 = _mm_xor_si128( Fold( x1, k512 ), Load( data + 16 ) );
+			x2 = _mm_xor_si128( Fold( x2, k512 ), Load( data + 32 ) );
+			x3 = _mm_xor_si128( Fold( x3, k512 ), Load( data + 48 ) );
+			
+			data += 64;
+			n    -= 64;
+		}
+		
+		__m128i x = _mm_xor_si128( Fold( x0, k128 ), x1 );
+		
+		x = _mm_xor_si128( Fold( x, k128 ), x2 );
+		x = _mm_xor_si128( Fold( x, k128 ), x3 );
+		
+		while ( n >= 16 )
+		{
+			x = _mm_xor_si128( Fold( x, k128 ), Load( data ) );
+			
+			data += 16;
+			n    -= 16;
+		}
+		
+		// 128 bits to 96, then to 64
+		
+		const __m128i k64 = _mm_set_epi64x( 0, gX64 );
+		
+		x = _mm_xor_si128( _mm_clmulepi64_si128( x, k64, 0x01 ), _mm_move_epi64( x ) );
+		x = _mm_xor_si128( _mm_clmulepi64_si128( _mm_srli_si128( x, 8 ), k64, 0x00 ), _mm_move_epi64( x ) );
+		
+		const Word high = _mm_cvtsi128_si32( _mm_srli_si128( x, 4 ) );
+		const Word low  = _mm_cvtsi128_si32( x );
+		
+		return TimesX64( high ) ^ TimesX32( low );
+	}
+	
+	#undef CRC32_TARGET
+	
+#endif
+
+	static inline void PrepareTables()
+	{
+		if ( !gTablesReady )
+		{
+		#ifdef CRC32_CLMUL
+			
+			SetUpCLMUL();
+			
+		#endif
+			
+			MakeTables();
+		}
+	}
+	
+	static Word Advance( Word crc, const unsigned char* data, std::size_t n )
+	{
+	#ifdef CRC32_CLMUL
+		
+		if ( gHasCLMUL  &&  n >= 256 )
+		{
+			const std::size_t n_folded = n & ~std::size_t( 15 );
+			
+			crc = AdvanceFolded( crc, data, n_folded );
+			
+			data += n_folded;
+			n    -= n_folded;
+		}
+		
+	#endif
+		
+		return AdvanceSliced( crc, data, n );
+	}
+	
+	void Engine::Update( const void* data, std::size_t bytes )
+	{
+		const unsigned char* p   = (const unsigned char*) data;
+		const unsigned char* end = p + bytes;
+		
+		if ( itsTailSize + bytes <= 4 )
+		{
+			while ( p < end )
+			{
+				itsTail = itsTail << 8 | *p++;
+			}
+			
+			itsTailSize += bytes;
+			
+			return;
+		}
+		
+		PrepareTables();
+		
+		std::size_t n_out = itsTailSize + bytes - 4;
+		
+		// First, the held-back bytes that are no longer among the last four
+		
+		while ( n_out > 0  &&  itsTailSize > 0 )
 		{
-			result = (result << 8 | *data++) ^ gTable[ result >> 24 ];
+			--itsTailSize;
+			
+			itsRegister = AdvanceByte( itsRegister, itsTail >> itsTailSize * 8 );
+			
+			--n_out;
 		}
 		
-		return ~result;
+		// Then the input that goes straight through
+		
+		itsRegister = Advance( itsRegister, p, n_out );
+		
+		p += n_out;
+		
+		// The rest is held back, pushing out what was advanced above.
+		
+		while ( p < end )
+		{
+			itsTail = itsTail << 8 | *p++;
+		}
+		
+		itsTailSize = 4;
+	}
+	
+	unsigned int Checksum( const void* text, unsigned int bytes )
+	{
+		Engine engine;
+		
+		engine.Update( text, bytes );
+		
+		return engine.GetResult();
 	}
 	
 }  // namespace CRC32
@@ -1,17 +1,44 @@
 /*	========
  *	CRC32.hh
  *	========
- *	
+ *
  *	Implemented by CRC32.cc
  */
 
 #pragma once
 
+// Standard C/C++
+#include <cstddef>
+
 
 namespace CRC32
 {
 	
 	unsigned int Checksum( const void* data, unsigned int bytes );
 	
+	/*
+		The same checksum, computed incrementally:  Update() any number of
+		times with consecutive pieces of the input, then GetResult().
+	*/
+	
+	class Engine
+	{
+		private:
+			unsigned int  itsRegister;
+			
+			// The last four bytes seen are held back, since they're
+			// the only ones not multiplied through the polynomial.
+			
+			unsigned int  itsTail;
+			unsigned int  itsTailSize;
+			
+		public:
+			Engine() : itsRegister( 0xFFFFFFFF ), itsTail( 0 ), itsTailSize( 0 )  {}
+			
+			void Update( const void* data, std::size_t bytes );
+			
+			unsigned int GetResult() const  { return ~(itsRegister ^ itsTail); }
+	};
+	
 }
 
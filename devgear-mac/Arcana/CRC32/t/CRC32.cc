@@ -0,0 +1,164 @@
+/*
+	t/CRC32.cc
+	----------
+*/
+
+// Standard C
+#include <stdlib.h>
+#include <string.h>
+
+// CRC32
+#include "CRC32.hh"
+
+// tap-out
+#include "tap/test.hh"
+
+
+static const unsigned n_tests = 4 + 3;
+
+
+using tap::ok_if;
+
+
+// Algorithm Three, a byte at a time, as CRC32 used to compute it
+
+static unsigned int gTable[ 256 ];
+
+static void make_table()
+{
+	for ( int i = 0;  i < 256;  ++i )
+	{
+		unsigned int crc = i << 24;
+		
+		for ( int j = 0;  j < 8;  ++j )
+		{
+			crc = crc & 0x80000000 ? (crc << 1) ^ 0x04c11db7 : crc << 1;
+		}
+		
+		gTable[ i ] = crc;
+	}
+}
+
+static unsigned int reference( const unsigned char* data, unsigned int bytes )
+{
+	unsigned int result = 0;
+	
+	if ( bytes <= 4 )
+	{
+		while ( bytes-- > 0 )
+		{
+			result = result << 8 | *data++;
+		}
+		
+		return result;
+	}
+	
+	const unsigned char* end = data + bytes;
+	
+	result = ~(data[ 0 ] << 24 | data[ 1 ] << 16 | data[ 2 ] << 8 | data[ 3 ]);
+	
+	data += 4;
+	
+	while ( data < end )
+	{
+		result = (result << 8 | *data++) ^ gTable[ result >> 24 ];
+	}
+	
+	return ~result;
+}
+
+static unsigned char gData[ 64 * 1024 + 16 ];
+
+static void fill_data()
+{
+	srand( 1 );
+	
+	for ( unsigned i = 0;  i < sizeof gData;  ++i )
+	{
+		gData[ i ] = rand() >> 4;
+	}
+}
+
+static bool checksums_match( unsigned max_size, unsigned n_trials )
+{
+	for ( unsigned i = 0;  i < n_trials;  ++i )
+	{
+		const unsigned size   = rand() % (max_size + 1);
+		const unsigned offset = rand() % 16;
+		
+		const unsigned char* data = gData + offset;
+		
+		if ( CRC32::Checksum( data, size ) != reference( data, size ) )
+		{
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+static void checksum()
+{
+	ok_if( CRC32::Checksum( "", 0 ) == 0 );
+	
+	ok_if( CRC32::Checksum( "abc", 3 ) == 0x00616263, "up to four bytes are themselves" );
+	
+	ok_if( checksums_match( 64, 2000 ), "short inputs" );
+	
+	ok_if( checksums_match( sizeof gData - 16, 200 ), "long inputs" );
+}
+
+static bool pieces_match( unsigned max_piece, unsigned n_trials )
+{
+	for ( unsigned i = 0;  i < n_trials;  ++i )
+	{
+		const unsigned size = rand() % (sizeof gData + 1);
+		
+		CRC32::Engine engine;
+		
+		for ( unsigned n = 0;  n < size;  )
+		{
+			unsigned piece = rand() % (max_piece + 1);
+			
+			if ( piece > size - n )
+			{
+				piece = size - n;
+			}
+			
+			engine.Update( gData + n, piece );
+			
+			n += piece;
+		}
+		
+		if ( engine.GetResult() != reference( gData, size ) )
+		{
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+static void update()
+{
+	ok_if( pieces_match( 5, 5 ), "tiny pieces" );
+	
+	ok_if( pieces_match( 100, 20 ), "small pieces" );
+	
+	ok_if( pieces_match( 10000, 50 ), "large pieces" );
+}
+
+int main( int argc, const char *const *argv )
+{
+	tap::start( "CRC32", n_tests );
+	
+	make_table();
+	
+	fill_data();
+	
+	checksum();
+	
+	update();
+	
+	return 0;
+}
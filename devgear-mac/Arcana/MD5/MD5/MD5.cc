@@ -7,17 +7,55 @@
 // <http://www.faqs.org/rfcs/rfc1321.html>
 
 #include <algorithm>
-#include <cmath>
-#include <vector>
 
 #include "MD5/MD5.hh"
 
 
+// MWC68K defines neither __BIG_ENDIAN__ nor __BYTE_ORDER__, and GCC on x86
+// defines only the latter.
+
+#if defined( __LITTLE_ENDIAN__ )  ||  defined( __BYTE_ORDER__ )  &&  __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define MD5_LITTLE_ENDIAN  1
+#endif
+
+#if defined( __i386__ )  ||  defined( __x86_64__ )
+#define MD5_UNALIGNED_OK  1
+#endif
+
+// Lanes are vectors where GCC's vector extensions can make them so.
+
+#ifdef __GNUC__
+#define MD5_VECTOR_LANES  1
+
+// The lanes never cross a call boundary, so their ABI doesn't matter.
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+#endif
+
+// Build the lanes for both AVX2 and plain SSE2, and pick at load time.
+
+#if defined( __GNUC__ )  &&  !defined( __clang__ )  &&  defined( __x86_64__ )  &&  defined( __linux__ )
+#define MD5_TARGET_CLONES  __attribute__(( target_clones( "avx2", "default" ) ))
+#else
+#define MD5_TARGET_CLONES
+#endif
+
+
 namespace MD5
 {
 	
 	typedef unsigned int Word;
 	
+#ifdef __GNUC__
+	
+	typedef Word __attribute__(( may_alias )) AliasedWord;
+	
+#else
+	
+	typedef Word AliasedWord;
+	
+#endif
+	
 	static inline unsigned int byteswap4( unsigned int word )
 	{
 		return (word &  0xFF)        << 24
@@ -26,11 +64,9 @@ namespace MD5
 			 | (word & (0xFF << 24)) >> 24;
 	}
 	
-	// MWC68K doesn't define __BIG_ENDIAN__, so we have to use __LITTLE_ENDIAN__.
-	
 	static inline unsigned int HostFromLittle32( unsigned int word )
 	{
-	#ifndef __LITTLE_ENDIAN__
+	#ifndef MD5_LITTLE_ENDIAN
 		
 		word = byteswap4( word );
 		
@@ -41,7 +77,7 @@ namespace MD5
 	
 	static inline unsigned int LittleFromHost32( unsigned int word )
 	{
-	#ifndef __LITTLE_ENDIAN__
+	#ifndef MD5_LITTLE_ENDIAN
 		
 		word = byteswap4( word );
 		
@@ -50,28 +86,9 @@ namespace MD5
 		return word;
 	}
 	
-	class Table
-	{
-		private:
-			unsigned int data[ 64 ];
-		
-		public:
-			Table();
-			
-			unsigned int operator[]( int i ) const  { return data[ i - 1 ]; }
-	};
-	
-	static Table gTable;
-	
-	Table::Table()
+	static inline Word LoadLittle32( const unsigned char* p )
 	{
-		using std::abs;
-		using std::sin;
-		
-		for ( int i = 1;  i <= 64;  ++i )
-		{
-			data[ i - 1 ] = unsigned( 4294967296.0 * abs( sin( double( i ) ) ) );
-		}
+		return p[ 0 ] | p[ 1 ] << 8 | p[ 2 ] << 16 | Word( p[ 3 ] ) << 24;
 	}
 	
 	Buffer::Buffer() : a( byteswap4( 0x01234567 ) ),
@@ -81,148 +98,300 @@ namespace MD5
 	{
 	}
 	
-	static inline unsigned int rotate_left( unsigned int x, unsigned char bits )
+	/*
+		The four rounds, written out in full for any type W that has the
+		unsigned 32-bit arithmetic and bitwise operators:  Word, or a vector
+		of Words (one per lane).  T[i] is the integer part of
+		4294967296 * abs(sin(i + 1)).
+	*/
+	
+	template < class W >
+	static inline W rotate_left( const W& x, int bits )
 	{
 		return (x << bits) | (x >> (32 - bits));
 	}
 	
-	static inline Word F( Word x, Word y, Word z )  { return (x & y)  |  (~x & z); }
-	static inline Word G( Word x, Word y, Word z )  { return (x & z)  |  (y & ~z); }
-	static inline Word H( Word x, Word y, Word z )  { return (x ^ y ^ z); }
-	static inline Word I( Word x, Word y, Word z )  { return (y ^ (x | ~z)); }
+	template < class W >  static inline W F( const W& x, const W& y, const W& z )  { return z ^ (x & (y ^ z)); }
+	template < class W >  static inline W G( const W& x, const W& y, const W& z )  { return y ^ (z & (x ^ y)); }
+	template < class W >  static inline W H( const W& x, const W& y, const W& z )  { return x ^ y ^ z;         }
+	template < class W >  static inline W I( const W& x, const W& y, const W& z )  { return y ^ (x | ~z);      }
 	
-	template < class Munger >
-	class Operator
+	template < class W >
+	static inline void FF( W& a, const W& b, const W& c, const W& d, const W& x, int s, Word t )
 	{
-		private:
-			Munger munger;
-			Word* block;
+		a = b + rotate_left< W >( a + F( b, c, d ) + x + t, s );
+	}
+	
+	template < class W >
+	static inline void GG( W& a, const W& b, const W& c, const W& d, const W& x, int s, Word t )
+	{
+		a = b + rotate_left< W >( a + G( b, c, d ) + x + t, s );
+	}
+	
+	template < class W >
+	static inline void HH( W& a, const W& b, const W& c, const W& d, const W& x, int s, Word t )
+	{
+		a = b + rotate_left< W >( a + H( b, c, d ) + x + t, s );
+	}
+	
+	template < class W >
+	static inline void II( W& a, const W& b, const W& c, const W& d, const W& x, int s, Word t )
+	{
+		a = b + rotate_left< W >( a + I( b, c, d ) + x + t, s );
+	}
+	
+	template < class W, class X >
+	static inline void Transform( W& A, W& B, W& C, W& D, const X& x )
+	{
+		W a = A;
+		W b = B;
+		W c = C;
+		W d = D;
+		
+		FF( a, b, c, d, W( x[  0 ] ),  7, 0xd76aa478 );
+		FF( d, a, b, c, W( x[  1 ] ), 12, 0xe8c7b756 );
+		FF( c, d, a, b, W( x[  2 ] ), 17, 0x242070db );
+		FF( b, c, d, a, W( x[  3 ] ), 22, 0xc1bdceee );
+		FF( a, b, c, d, W( x[  4 ] ),  7, 0xf57c0faf );
+		FF( d, a, b, c, W( x[  5 ] ), 12, 0x4787c62a );
+		FF( c, d, a, b, W( x[  6 ] ), 17, 0xa8304613 );
+		FF( b, c, d, a, W( x[  7 ] ), 22, 0xfd469501 );
+		FF( a, b, c, d, W( x[  8 ] ),  7, 0x698098d8 );
+		FF( d, a, b, c, W( x[  9 ] ), 12, 0x8b44f7af );
+		FF( c, d, a, b, W( x[ 10 ] ), 17, 0xffff5bb1 );
+		FF( b, c, d, a, W( x[ 11 ] ), 22, 0x895cd7be );
+		FF( a, b, c, d, W( x[ 12 ] ),  7, 0x6b901122 );
+		FF( d, a, b, c, W( x[ 13 ] ), 12, 0xfd987193 );
+		FF( c, d, a, b, W( x[ 14 ] ), 17, 0xa679438e );
+		FF( b, c, d, a, W( x[ 15 ] ), 22, 0x49b40821 );
+		
+		GG( a, b, c, d, W( x[  1 ] ),  5, 0xf61e2562 );
+		GG( d, a, b, c, W( x[  6 ] ),  9, 0xc040b340 );
+		GG( c, d, a, b, W( x[ 11 ] ), 14, 0x265e5a51 );
+		GG( b, c, d, a, W( x[  0 ] ), 20, 0xe9b6c7aa );
+		GG( a, b, c, d, W( x[  5 ] ),  5, 0xd62f105d );
+		GG( d, a, b, c, W( x[ 10 ] ),  9, 0x02441453 );
+		GG( c, d, a, b, W( x[ 15 ] ), 14, 0xd8a1e681 );
+		GG( b, c, d, a, W( x[  4 ] ), 20, 0xe7d3fbc8 );
+		GG( a, b, c, d, W( x[  9 ] ),  5, 0x21e1cde6 );
+		GG( d, a, b, c, W( x[ 14 ] ),  9, 0xc33707d6 );
+		GG( c, d, a, b, W( x[  3 ] ), 14, 0xf4d50d87 );
+		GG( b, c, d, a, W( x[  8 ] ), 20, 0x455a14ed );
+		GG( a, b, c, d, W( x[ 13 ] ),  5, 0xa9e3e905 );
+		GG( d, a, b, c, W( x[  2 ] ),  9, 0xfcefa3f8 );
+		GG( c, d, a, b, W( x[  7 ] ), 14, 0x676f02d9 );
+		GG( b, c, d, a, W( x[ 12 ] ), 20, 0x8d2a4c8a );
+		
+		HH( a, b, c, d, W( x[  5 ] ),  4, 0xfffa3942 );
+		HH( d, a, b, c, W( x[  8 ] ), 11, 0x8771f681 );
+		HH( c, d, a, b, W( x[ 11 ] ), 16, 0x6d9d6122 );
+		HH( b, c, d, a, W( x[ 14 ] ), 23, 0xfde5380c );
+		HH( a, b, c, d, W( x[  1 ] ),  4, 0xa4beea44 );
+		HH( d, a, b, c, W( x[  4 ] ), 11, 0x4bdecfa9 );
+		HH( c, d, a, b, W( x[  7 ] ), 16, 0xf6bb4b60 );
+		HH( b, c, d, a, W( x[ 10 ] ), 23, 0xbebfbc70 );
+		HH( a, b, c, d, W( x[ 13 ] ),  4, 0x289b7ec6 );
+		HH( d, a, b, c, W( x[  0 ] ), 11, 0xeaa127fa );
+		HH( c, d, a, b, W( x[  3 ] ), 16, 0xd4ef3085 );
+		HH( b, c, d, a, W( x[  6 ] ), 23, 0x04881d05 );
+		HH( a, b, c, d, W( x[  9 ] ),  4, 0xd9d4d039 );
+		HH( d, a, b, c, W( x[ 12 ] ), 11, 0xe6db99e5 );
+		HH( c, d, a, b, W( x[ 15 ] ), 16, 0x1fa27cf8 );
+		HH( b, c, d, a, W( x[  2 ] ), 23, 0xc4ac5665 );
+		
+		II( a, b, c, d, W( x[  0 ] ),  6, 0xf4292244 );
+		II( d, a, b, c, W( x[  7 ] ), 10, 0x432aff97 );
+		II( c, d, a, b, W( x[ 14 ] ), 15, 0xab9423a7 );
+		II( b, c, d, a, W( x[  5 ] ), 21, 0xfc93a039 );
+		II( a, b, c, d, W( x[ 12 ] ),  6, 0x655b59c3 );
+		II( d, a, b, c, W( x[  3 ] ), 10, 0x8f0ccc92 );
+		II( c, d, a, b, W( x[ 10 ] ), 15, 0xffeff47d );
+		II( b, c, d, a, W( x[  1 ] ), 21, 0x85845dd1 );
+		II( a, b, c, d, W( x[  8 ] ),  6, 0x6fa87e4f );
+		II( d, a, b, c, W( x[ 15 ] ), 10, 0xfe2ce6e0 );
+		II( c, d, a, b, W( x[  6 ] ), 15, 0xa3014314 );
+		II( b, c, d, a, W( x[ 13 ] ), 21, 0x4e0811a1 );
+		II( a, b, c, d, W( x[  4 ] ),  6, 0xf7537e82 );
+		II( d, a, b, c, W( x[ 11 ] ), 10, 0xbd3af235 );
+		II( c, d, a, b, W( x[  2 ] ), 15, 0x2ad7d2bb );
+		II( b, c, d, a, W( x[  9 ] ), 21, 0xeb86d391 );
+		
+		A += a;
+		B += b;
+		C += c;
+		D += d;
+	}
+	
+	union Block
+	{
+		unsigned char  bytes[ 64 ];
+		Word           words[ 16 ];
+	};
+	
+	// Input words on demand, straight from the caller's block
+	struct LittleWords
+	{
+		const unsigned char* bytes;
 		
-		public:
-			Operator( Munger munger, Word* block ) : munger( munger ), block( block )  {}
-			
-			void operator()( Word&  a,
-			                 Word   b,
-			                 Word   c,
-			                 Word   d,
-			                 int    k,
-			                 int    s,
-			                 int    i ) const
-			{
-				a = b + rotate_left( a + munger( b, c, d ) + block[ k ] + gTable[ i ],
-				                     s );
-			}
+		Word operator[]( int i ) const  { return LoadLittle32( bytes + i * 4 ); }
 	};
 	
-	template < class Munger >
-	Operator< Munger > MakeOperator( Munger munger, Word* block )
+	void Engine::DoBlock( const void* input )
 	{
-		return Operator< Munger >( munger, block );
+		DoBlocks( input, 1 );
 	}
 	
-	template < class Operator >
-	void Round1( Operator op, Buffer& buffer )
+	void Engine::DoBlocks( const void* input, std::size_t n_blocks )
 	{
-		Word& a( buffer.a );
-		Word& b( buffer.b );
-		Word& c( buffer.c );
-		Word& d( buffer.d );
+		const unsigned char* p = (const unsigned char*) input;
+		
+		Buffer s = state;
 		
-		for ( int i = 1;  i <= 16;  )
+		for ( std::size_t i = 0;  i < n_blocks;  ++i, p += 64 )
 		{
-			op( a,b,c,d, i - 1,  7, i );  ++i;
-			op( d,a,b,c, i - 1, 12, i );  ++i;
-			op( c,d,a,b, i - 1, 17, i );  ++i;
-			op( b,c,d,a, i - 1, 22, i );  ++i;
+		#ifdef MD5_LITTLE_ENDIAN
+			
+		#ifndef MD5_UNALIGNED_OK
+			
+			if ( (std::size_t) p & 3 )
+			{
+				const LittleWords x = { p };
+				
+				Transform( s.a, s.b, s.c, s.d, x );
+				
+				continue;
+			}
+			
+		#endif
+			
+			// The block is already in the host's word order:  No copy.
+			
+			Transform( s.a, s.b, s.c, s.d, (const AliasedWord*) p );
+			
+		#else
+			
+			Word x[ 16 ];
+			
+			for ( int j = 0;  j < 16;  ++j )
+			{
+				x[ j ] = LoadLittle32( p + j * 4 );
+			}
+			
+			Transform( s.a, s.b, s.c, s.d, x );
+			
+		#endif
 		}
+		
+		state = s;
+		
+		blockCount += n_blocks;
 	}
 	
-	template < class Operator >
-	void Round2( Operator op, Buffer& buffer )
+#ifdef MD5_VECTOR_LANES
+	
+	typedef Word Lanes4 __attribute__(( vector_size( 4 * sizeof (Word) ) ));
+	typedef Word Lanes8 __attribute__(( vector_size( 8 * sizeof (Word) ) ));
+	
+	template < class Lanes, unsigned width >
+	static inline void DoLanes( Buffer*             states[],
+	                            const void* const   inputs[],
+	                            unsigned            n_lanes,
+	                            std::size_t         n_blocks )
 	{
-		Word& a( buffer.a );
-		Word& b( buffer.b );
-		Word& c( buffer.c );
-		Word& d( buffer.d );
+		Lanes a, b, c, d;
 		
-		for ( int i = 16 + 1;  i <= 32;  )
+		for ( unsigned j = 0;  j < width;  ++j )
 		{
-			op( a,b,c,d, (i     ) % 16,  5, i );  ++i;
-			op( d,a,b,c, (i +  4) % 16,  9, i );  ++i;
-			op( c,d,a,b, (i +  8) % 16, 14, i );  ++i;
-			op( b,c,d,a, (i + 12) % 16, 20, i );  ++i;
+			// Idle lanes repeat the first one's work, and are ignored.
+			
+			const Buffer& s = *states[ j < n_lanes ? j : 0 ];
+			
+			a[ j ] = s.a;
+			b[ j ] = s.b;
+			c[ j ] = s.c;
+			d[ j ] = s.d;
 		}
-	}
-	
-	template < class Operator >
-	void Round3( Operator op, Buffer& buffer )
-	{
-		Word& a( buffer.a );
-		Word& b( buffer.b );
-		Word& c( buffer.c );
-		Word& d( buffer.d );
 		
-		for ( int i = 32 + 1;  i <= 48;  )
+		for ( std::size_t i = 0;  i < n_blocks;  ++i )
 		{
-			op( a,b,c,d, (48 - i +  6) % 16,  4, i );  ++i;
-			op( d,a,b,c, (48 - i + 10) % 16, 11, i );  ++i;
-			op( c,d,a,b, (48 - i + 14) % 16, 16, i );  ++i;
-			op( b,c,d,a, (48 - i + 18) % 16, 23, i );  ++i;
+			Lanes x[ 16 ];
+			
+			for ( unsigned j = 0;  j < width;  ++j )
+			{
+				const unsigned char* p = (const unsigned char*) inputs[ j < n_lanes ? j : 0 ] + i * 64;
+				
+				for ( int k = 0;  k < 16;  ++k )
+				{
+					x[ k ][ j ] = LoadLittle32( p + k * 4 );
+				}
+			}
+			
+			Transform( a, b, c, d, x );
 		}
-	}
-	
-	template < class Operator >
-	void Round4( Operator op, Buffer& buffer )
-	{
-		Word& a( buffer.a );
-		Word& b( buffer.b );
-		Word& c( buffer.c );
-		Word& d( buffer.d );
 		
-		for ( int i = 48 + 1;  i <= 64;  )
+		for ( unsigned j = 0;  j < n_lanes;  ++j )
 		{
-			op( a,b,c,d, (64 - i + 1) % 16,  6, i );  ++i;
-			op( d,a,b,c, (64 - i + 9) % 16, 10, i );  ++i;
-			op( c,d,a,b, (64 - i + 1) % 16, 15, i );  ++i;
-			op( b,c,d,a, (64 - i + 9) % 16, 21, i );  ++i;
+			Buffer& s = *states[ j ];
+			
+			s.a = a[ j ];
+			s.b = b[ j ];
+			s.c = c[ j ];
+			s.d = d[ j ];
 		}
 	}
 	
-	union Block
+	MD5_TARGET_CLONES
+	static void DoLanes4( Buffer* states[], const void* const inputs[], unsigned n_lanes, std::size_t n_blocks )
 	{
-		unsigned char  bytes[ 64 ];
-		Word           words[ 16 ];
-	};
+		DoLanes< Lanes4, 4 >( states, inputs, n_lanes, n_blocks );
+	}
 	
-	void Engine::DoBlock( const void* input )
+	MD5_TARGET_CLONES
+	static void DoLanes8( Buffer* states[], const void* const inputs[], unsigned n_lanes, std::size_t n_blocks )
+	{
+		DoLanes< Lanes8, 8 >( states, inputs, n_lanes, n_blocks );
+	}
+	
+#endif
+	
+	void Engine::DoBlocks( Engine* const       engines[],
+	                       const void* const   inputs[],
+	                       unsigned            n_lanes,
+	                       std::size_t         n_blocks )
 	{
-		Word block[ 16 ];
-		const Word* leBlock = reinterpret_cast< const Word* >( input );
+	#ifdef MD5_VECTOR_LANES
+		
+		// Two lanes in a vector aren't faster than one after the other.
 		
-		// Fill the block, swapping into big-endian.
-		for ( int j = 0;  j < 16;  ++j )
+		if ( n_lanes > 2 )
 		{
-			block[ j ] = HostFromLittle32( leBlock[ j ] );
+			Buffer* states[ max_lanes ];
+			
+			for ( unsigned j = 0;  j < n_lanes;  ++j )
+			{
+				states[ j ] = &engines[ j ]->state;
+				
+				engines[ j ]->blockCount += n_blocks;
+			}
+			
+			if ( n_lanes > 4 )
+			{
+				DoLanes8( states, inputs, n_lanes, n_blocks );
+			}
+			else
+			{
+				DoLanes4( states, inputs, n_lanes, n_blocks );
+			}
+			
+			return;
 		}
 		
-		Buffer oldState = state;
-		
-		Round1( MakeOperator( F, block ), state );
-		Round2( MakeOperator( G, block ), state );
-		Round3( MakeOperator( H, block ), state );
-		Round4( MakeOperator( I, block ), state );
-		
-		// Zero the block in case it contains sensitive material.
-		std::fill( block,
-		           block + 16,
-		           0 );
-		
-		state.a += oldState.a;
-		state.b += oldState.b;
-		state.c += oldState.c;
-		state.d += oldState.d;
+	#endif
 		
-		++blockCount;
+		for ( unsigned j = 0;  j < n_lanes;  ++j )
+		{
+			engines[ j ]->DoBlocks( inputs[ j ], n_blocks );
+		}
 	}
 	
 	void Engine::Finish( const void* input, int bits )
@@ -240,8 +409,6 @@ namespace MD5
 		int textBlocks = textWords / 16;
 		
 		Block block1, block2;
-		std::vector< const Block* > blocks;
-		
 		const unsigned char* inputAsBytes = reinterpret_cast< const unsigned char* >( input );
 		
 		// Zero the padding blocks
@@ -263,7 +430,8 @@ namespace MD5
 		// Make a mask with ones where the extra bits are, and zeroes afterword.
 		unsigned char extraMask = (0xFF << (8 - extraBits));
 		
-		const unsigned char& partialByte = inputAsBytes[ inputBytes ];
+		// Don't touch the byte after the input unless it's partly input.
+		const unsigned char partialByte = extraBits ? inputAsBytes[ inputBytes ] : 0;
 		
 		// The first padding byte has leftover bits, if any, and a 1 appended.
 		firstPadByte = (partialByte & extraMask) | (0x80 >> extraBits);
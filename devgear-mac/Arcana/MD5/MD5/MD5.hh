@@ -6,6 +6,9 @@
 #ifndef MD5_HH
 #define MD5_HH
 
+// Standard C/C++
+#include <cstddef>
+
 
 namespace MD5
 {
@@ -31,15 +34,30 @@ namespace MD5
 		Word a, b, c, d;
 	};
 	
+	// The most independent messages that can be hashed together
+	const unsigned max_lanes = 8;
+	
 	class Engine
 	{
 		private:
-			int blockCount;
+			BitCount blockCount;
 			Buffer state;
 		
 		public:
 			Engine() : blockCount( 0 )  {}
 			void DoBlock( const void* input );  // 64 bytes
+			void DoBlocks( const void* input, std::size_t n_blocks );
+			
+			/*
+				Advance up to max_lanes engines by n_blocks each, with the
+				lanes interleaved (in SIMD registers, where available).
+			*/
+			
+			static void DoBlocks( Engine* const       engines[],
+			                      const void* const   inputs[],
+			                      unsigned            n_lanes,
+			                      std::size_t         n_blocks );
+			
 			void Finish( const void* input, int bitCount );
 			const Result& GetResult();
 	};
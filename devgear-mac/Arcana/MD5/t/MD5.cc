@@ -0,0 +1,161 @@
+/*
+	t/MD5.cc
+	--------
+*/
+
+// Standard C
+#include <string.h>
+
+// MD5
+#include "MD5/MD5.hh"
+
+// tap-out
+#include "tap/test.hh"
+
+
+static const unsigned n_tests = 7 + 3 + MD5::max_lanes;
+
+
+using tap::ok_if;
+
+
+static bool digest_is( const MD5::Result& result, const char* hex )
+{
+	const char* digits = "0123456789abcdef";
+	
+	for ( int i = 0;  i < 16;  ++i )
+	{
+		if ( hex[ i * 2     ] != digits[ result.data[ i ] >> 4  ]  ||
+		     hex[ i * 2 + 1 ] != digits[ result.data[ i ] & 0xF ] )
+		{
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+static bool digest_of_is( const char* message, const char* hex )
+{
+	return digest_is( MD5::Digest_Bytes( message, strlen( message ) ), hex );
+}
+
+static void rfc_1321()
+{
+	ok_if( digest_of_is( "", "d41d8cd98f00b204e9800998ecf8427e" ) );
+	
+	ok_if( digest_of_is( "a", "0cc175b9c0f1b6a831c399e269772661" ) );
+	
+	ok_if( digest_of_is( "abc", "900150983cd24fb0d6963f7d28e17f72" ) );
+	
+	ok_if( digest_of_is( "message digest", "f96b697d7cb7938d525a2f31aaf161d0" ) );
+	
+	ok_if( digest_of_is( "abcdefghijklmnopqrstuvwxyz", "c3fcd3d76192e4007dfb496cca67e13b" ) );
+	
+	ok_if( digest_of_is( "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789",
+	                     "d174ab98d277d9f5a5611c2c9f419d9f" ) );
+	
+	ok_if( digest_of_is( "12345678901234567890123456789012345678901234567890123456789012345678901234567890",
+	                     "57edf4a22be3c955ac49da2e2107b67a" ) );
+}
+
+static char gData[ MD5::max_lanes ][ 64 * 10 + 1 ];
+
+static void fill_data()
+{
+	for ( unsigned j = 0;  j < MD5::max_lanes;  ++j )
+	{
+		for ( unsigned i = 0;  i < sizeof gData[ j ];  ++i )
+		{
+			gData[ j ][ i ] = char( i * 7 + j * 131 + (i >> 5) );
+		}
+	}
+}
+
+static void blocks()
+{
+	const char* data = gData[ 0 ];
+	
+	MD5::Engine one_at_a_time;
+	MD5::Engine all_at_once;
+	
+	for ( int i = 0;  i < 10;  ++i )
+	{
+		one_at_a_time.DoBlock( data + i * 64 );
+	}
+	
+	all_at_once.DoBlocks( data, 10 );
+	
+	one_at_a_time.Finish( "", 0 );
+	all_at_once  .Finish( "", 0 );
+	
+	ok_if( memcmp( &one_at_a_time.GetResult(), &all_at_once.GetResult(), 16 ) == 0,
+	       "DoBlocks() matches DoBlock()" );
+	
+	const MD5::Result digest = MD5::Digest_Bytes( data, 64 * 10 );
+	
+	ok_if( memcmp( &digest, &all_at_once.GetResult(), 16 ) == 0, "Digest_Bytes() matches" );
+	
+	MD5::Engine unaligned;
+	
+	unaligned.DoBlocks( gData[ 1 ] + 1, 10 );
+	
+	unaligned.Finish( "", 0 );
+	
+	char block[ 64 * 10 ];
+	
+	memcpy( block, gData[ 1 ] + 1, sizeof block );
+	
+	const MD5::Result copied = MD5::Digest_Bytes( block, sizeof block );
+	
+	ok_if( memcmp( &copied, &unaligned.GetResult(), 16 ) == 0, "unaligned input" );
+}
+
+static void lanes()
+{
+	for ( unsigned n = 1;  n <= MD5::max_lanes;  ++n )
+	{
+		MD5::Engine  engines[ MD5::max_lanes ];
+		MD5::Engine* engine_ptrs[ MD5::max_lanes ];
+		const void*  inputs[ MD5::max_lanes ];
+		
+		for ( unsigned j = 0;  j < n;  ++j )
+		{
+			engine_ptrs[ j ] = &engines[ j ];
+			
+			inputs[ j ] = gData[ j ] + j % 2;
+		}
+		
+		MD5::Engine::DoBlocks( engine_ptrs, inputs, n, 7 );
+		
+		bool matched = true;
+		
+		for ( unsigned j = 0;  j < n;  ++j )
+		{
+			const char* input = (const char*) inputs[ j ];
+			
+			engines[ j ].Finish( input + 7 * 64, 3 * 8 );
+			
+			const MD5::Result expected = MD5::Digest_Bytes( input, 7 * 64 + 3 );
+			
+			matched = matched  &&  memcmp( &expected, &engines[ j ].GetResult(), 16 ) == 0;
+		}
+		
+		ok_if( matched );
+	}
+}
+
+int main( int argc, const char *const *argv )
+{
+	tap::start( "MD5", n_tests );
+	
+	rfc_1321();
+	
+	fill_data();
+	
+	blocks();
+	
+	lanes();
+	
+	return 0;
+}
@@ -38,6 +38,9 @@
 // Debug
 #include "debug/assert.hh"
 
+// CRC16
+#include "CRC16.hh"
+
 // Nitrogen
 #include "Nitrogen/Files.hh"
 #include "Nitrogen/MacMemory.hh"
@@ -185,41 +188,6 @@ namespace MacBinary
 	
 #endif
 	
-	static unsigned short CalcCRC( register const unsigned char *dataBuf, std::size_t size )
-	{
-		//#define CCITT_CRC_GEN	0x1021
-		
-		const unsigned long kMagicNumber = 0x1021;
-		
-		register const unsigned char* dataEnd = dataBuf + size;
-		
-		register unsigned long crc = 0;
-		
-		while ( dataBuf != dataEnd )
-		{
-			register unsigned long dataByte = *dataBuf++;
-			dataByte <<= 8;
-			
-			register long i = 8;
-			
-			do
-			{	
-				register long bit = dataByte;
-				dataByte += dataByte;
-				bit ^= crc;
-				crc += crc;
-				
-				if ( bit &= 0x8000 )
-				{
-					crc ^= kMagicNumber;
-				}
-			}
-			while ( --i );
-		}
-		
-		return crc;
-	}
-	
 	
 	const UInt8 kVersionMacBinaryII  = 129;
 	const UInt8 kVersionMacBinaryIII = 130;
@@ -473,7 +441,7 @@ namespace MacBinary
 		
 		typedef POD_Field_Traits< UInt16, offset > Field;
 		
-		static UInt16 CRC( const unsigned char* data )  { return CalcCRC( data, dataLength ); }
+		static UInt16 CRC( const unsigned char* data )  { return CRC16::Checksum( data, dataLength ); }
 		
 		static bool Check( const Header& h )  { return Field::Get( h ) == CRC( h.data ); }
 		
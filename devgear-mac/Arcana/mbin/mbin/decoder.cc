@@ -0,0 +1,252 @@
+/*
+	mbin/decoder.cc
+	---------------
+*/
+
+#include "mbin/decoder.hh"
+
+// Standard C++
+#include <algorithm>
+
+// Standard C
+#include <string.h>
+
+// POSIX
+#include <unistd.h>
+
+// poseven
+#include "poseven/extras/write_all.hh"
+#include "poseven/functions/futimens.hh"
+#include "poseven/functions/mkdirat.hh"
+#include "poseven/functions/open.hh"
+#include "poseven/functions/openat.hh"
+
+
+namespace mbin
+{
+	
+	namespace n = nucleus;
+	namespace p7 = poseven;
+	
+	
+	static void set_modification_date( p7::fd_t fd, const item_info& info )
+	{
+		// MacBinary dates are local time, of unknown zone.  Take them as GMT.
+		
+		if ( info.modification_date != 0 )
+		{
+			p7::futimens( fd, time_t( info.modification_date ) - time_t( mac_unix_epoch_delta ) );
+		}
+	}
+	
+	decoder::decoder( const char* destination, fork_storage storage )
+	:
+		its_storage    ( storage ),
+		its_dir        ( p7::open( destination, p7::o_rdonly | p7::o_directory ).release() ),
+		its_header_size( 0 ),
+		its_kind       ( item_file ),
+		its_section    ( section_header ),
+		its_payload    ( 0 ),
+		its_padding    ( 0 )
+	{
+		clear_item_info( its_info );
+	}
+	
+	decoder::~decoder()
+	{
+		while ( !its_folders.empty() )
+		{
+			::close( its_folders.back().fd );
+			
+			its_folders.pop_back();
+		}
+		
+		::close( its_dir );
+	}
+	
+	bool decoder::idle() const
+	{
+		return its_section == section_header  &&  its_header_size == 0  &&  its_folders.empty();
+	}
+	
+	void decoder::enter( section s, unsigned long length )
+	{
+		its_section = s;
+		its_payload = length;
+		its_padding = padded_length( length ) - length;
+	}
+	
+	void decoder::begin_item()
+	{
+		its_kind = parse_header( its_header, its_info );
+		
+		const p7::fd_t dir = p7::fd_t( its_folders.empty() ? its_dir : its_folders.back().fd );
+		
+		switch ( its_kind )
+		{
+			case item_file:
+				its_data_fork = p7::openat( dir,
+				                            its_info.name,
+				                            p7::o_wronly | p7::o_creat | p7::o_excl );
+				
+				its_forks.open( its_storage, dir, its_data_fork, its_info );
+				break;
+			
+			case item_folder:
+				{
+					p7::mkdirat( dir, its_info.name.c_str() );
+					
+					folder added;
+					
+					added.fd   = p7::openat( dir, its_info.name, p7::o_rdonly | p7::o_directory ).release();
+					added.info = its_info;
+					
+					its_folders.push_back( added );
+				}
+				break;
+			
+			case item_folder_end:
+				if ( its_folders.empty() )
+				{
+					throw too_many_end_blocks();
+				}
+				break;
+		}
+		
+		enter( section_header, 0 );
+		
+		next_section();
+	}
+	
+	void decoder::next_section()
+	{
+		// Skip sections that are empty (including the header, just parsed).
+		
+		while ( its_payload == 0  &&  its_padding == 0 )
+		{
+			switch ( its_section )
+			{
+				case section_header:
+					enter( section_secondary_header, its_info.secondary_header_length );
+					break;
+				
+				case section_secondary_header:
+					enter( section_data_fork, its_info.data_length );
+					break;
+				
+				case section_data_fork:
+					enter( section_rsrc_fork, its_info.rsrc_length );
+					break;
+				
+				case section_rsrc_fork:
+					enter( section_comment, its_info.comment_length );
+					break;
+				
+				case section_comment:
+					end_item();
+					
+					its_section     = section_header;
+					its_header_size = 0;
+					
+					return;
+			}
+		}
+	}
+	
+	void decoder::end_item()
+	{
+		switch ( its_kind )
+		{
+			case item_file:
+				its_forks.close();
+				
+				set_modification_date( its_data_fork, its_info );
+				
+				its_data_fork.reset();
+				break;
+			
+			case item_folder:
+				break;  // The folder's metadata waits for its end block.
+			
+			case item_folder_end:
+				end_folder();
+				break;
+		}
+	}
+	
+	void decoder::end_folder()
+	{
+		const folder& ended = its_folders.back();
+		
+		const std::size_t depth = its_folders.size();
+		
+		const int parent = depth > 1 ? its_folders[ depth - 2 ].fd : its_dir;
+		
+		its_forks.open( its_storage, p7::fd_t( parent ), p7::fd_t( ended.fd ), ended.info );
+		its_forks.close();
+		
+		// Last, since writing the folder's contents changed its date.
+		
+		set_modification_date( p7::fd_t( ended.fd ), ended.info );
+		
+		::close( ended.fd );
+		
+		its_folders.pop_back();
+	}
+	
+	void decoder::write( const char* data, std::size_t n )
+	{
+		while ( n > 0 )
+		{
+			if ( its_section == section_header )
+			{
+				const std::size_t n_copied = std::min( n, header_size - its_header_size );
+				
+				memcpy( its_header.data + its_header_size, data, n_copied );
+				
+				its_header_size += n_copied;
+				
+				data += n_copied;
+				n    -= n_copied;
+				
+				if ( its_header_size == header_size )
+				{
+					begin_item();
+				}
+				
+				continue;
+			}
+			
+			const std::size_t payload = std::min< unsigned long >( n, its_payload );
+			
+			if ( payload > 0 )
+			{
+				if ( its_section == section_data_fork  &&  its_data_fork.get() )
+				{
+					p7::write_all( its_data_fork, data, payload );
+				}
+				else if ( its_section == section_rsrc_fork  &&  its_kind == item_file )
+				{
+					its_forks.write( data, payload );
+				}
+				
+				// Secondary headers and comments (and any folder forks) are dropped.
+				
+				its_payload -= payload;
+				
+				data += payload;
+				n    -= payload;
+			}
+			
+			const std::size_t padding = std::min< unsigned long >( n, its_padding );
+			
+			its_padding -= padding;
+			
+			data += padding;
+			n    -= padding;
+			
+			next_section();
+		}
+	}
+	
+}
@@ -0,0 +1,96 @@
+/*
+	mbin/decoder.hh
+	---------------
+*/
+
+#ifndef MBIN_DECODER_HH
+#define MBIN_DECODER_HH
+
+// Standard C++
+#include <vector>
+
+// poseven
+#ifndef POSEVEN_FUNCTIONS_CLOSE_HH
+#include "poseven/functions/close.hh"
+#endif
+
+// mbin
+#ifndef MBIN_FORKS_HH
+#include "mbin/forks.hh"
+#endif
+#ifndef MBIN_HEADER_HH
+#include "mbin/header.hh"
+#endif
+
+
+namespace mbin
+{
+	
+	/*
+		Decodes a MacBinary stream into a directory, written in pieces of any
+		size.  Data forks are written straight from the caller's buffer, and
+		nothing is held back but a partial header, so memory use is bounded
+		regardless of the size of the archive (or a resource fork bound for
+		an extended attribute, which has a limit of its own).
+	*/
+	
+	class decoder
+	{
+		private:
+			enum section
+			{
+				section_header,
+				section_secondary_header,
+				section_data_fork,
+				section_rsrc_fork,
+				section_comment
+			};
+			
+			struct folder
+			{
+				int        fd;
+				item_info  info;
+			};
+			
+			fork_storage           its_storage;
+			std::vector< folder >  its_folders;
+			int                    its_dir;
+			
+			header                 its_header;
+			std::size_t            its_header_size;
+			item_kind              its_kind;
+			item_info              its_info;
+			
+			section                its_section;
+			unsigned long          its_payload;  // bytes left in this section
+			unsigned long          its_padding;  // and after them
+			
+			nucleus::owned< poseven::fd_t >  its_data_fork;
+			fork_writer                      its_forks;
+			
+			// non-copyable
+			decoder           ( const decoder& );
+			decoder& operator=( const decoder& );
+			
+			void enter( section s, unsigned long length );
+			
+			void begin_item();
+			void next_section();
+			void end_item();
+			
+			void end_folder();
+			
+		public:
+			decoder( const char* destination, fork_storage storage );
+			
+			~decoder();
+			
+			void write( const char* data, std::size_t n );
+			
+			// True between top-level items (e.g. at the end of an archive)
+			bool idle() const;
+	};
+	
+}
+
+#endif
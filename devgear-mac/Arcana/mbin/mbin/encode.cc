@@ -0,0 +1,242 @@
+/*
+	mbin/encode.cc
+	--------------
+*/
+
+#include "mbin/encode.hh"
+
+// Standard C++
+#include <algorithm>
+#include <vector>
+
+// Standard C
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+// POSIX
+#include <dirent.h>
+#include <sys/stat.h>
+
+// plus
+#include "plus/string.hh"
+
+// poseven
+#include "poseven/extras/pump.hh"
+#include "poseven/extras/write_all.hh"
+#include "poseven/functions/dup.hh"
+#include "poseven/functions/fdopendir.hh"
+#include "poseven/functions/fstat.hh"
+#include "poseven/functions/fstatat.hh"
+#include "poseven/functions/open.hh"
+#include "poseven/functions/openat.hh"
+#include "poseven/types/errno_t.hh"
+
+// mbin
+#include "mbin/forks.hh"
+#include "mbin/header.hh"
+
+
+namespace mbin
+{
+	
+	namespace n = nucleus;
+	namespace p7 = poseven;
+	
+	
+	static void write_zeros( p7::fd_t output, unsigned long n )
+	{
+		static const char zeros[ block_size ] = { 0 };
+		
+		while ( n > 0 )
+		{
+			const std::size_t n_written = std::min< unsigned long >( n, sizeof zeros );
+			
+			p7::write_all( output, zeros, n_written );
+			
+			n -= n_written;
+		}
+	}
+	
+	static void write_padding( p7::fd_t output, unsigned long length )
+	{
+		write_zeros( output, padded_length( length ) - length );
+	}
+	
+	static void write_header( p7::fd_t output, item_kind kind, const item_info& info )
+	{
+		header h;
+		
+		make_header( h, kind, info );
+		
+		p7::write_all( output, (const char*) h.data, sizeof h.data );
+	}
+	
+	static void get_dates( const struct stat& st, item_info& info )
+	{
+		// POSIX has no creation date; an AppleDouble file might supply one.
+		
+		info.modification_date = st.st_mtime + mac_unix_epoch_delta;
+		info.creation_date     = info.modification_date;
+	}
+	
+	static void copy_data_fork( p7::fd_t item, p7::fd_t output, unsigned long length )
+	{
+		unsigned long n_copied = 0;
+		
+		off_t offset = 0;
+		
+		while ( n_copied < length )
+		{
+			const ssize_t n = p7::pump( item, &offset, output, NULL, length - n_copied );
+			
+			if ( n == 0 )
+			{
+				break;  // The file shrank.
+			}
+			
+			n_copied += n;
+		}
+		
+		write_zeros( output, length - n_copied );
+	}
+	
+	static void encode_item( p7::fd_t dir, const char* name, p7::fd_t output );
+	
+	static void encode_file( p7::fd_t           dir,
+	                         const char*        name,
+	                         p7::fd_t           item,
+	                         const struct stat& st,
+	                         p7::fd_t           output )
+	{
+		if ( st.st_size > 0xFFFFFFFFul )
+		{
+			p7::throw_errno( EFBIG );  // MacBinary has 32-bit fork lengths.
+		}
+		
+		item_info info;
+		
+		clear_item_info( info );
+		
+		info.name        = name;
+		info.data_length = st.st_size;
+		
+		get_dates( st, info );
+		
+		fork_reader rsrc;
+		
+		rsrc.open( dir, name, item, info );
+		
+		write_header( output, item_file, info );
+		
+		copy_data_fork( item, output, info.data_length );
+		
+		write_padding( output, info.data_length );
+		
+		rsrc.copy( output, info.rsrc_length );
+		
+		write_padding( output, info.rsrc_length );
+	}
+	
+	static void encode_folder( p7::fd_t           dir,
+	                           const char*        name,
+	                           p7::fd_t           item,
+	                           const struct stat& st,
+	                           p7::fd_t           output )
+	{
+		item_info info;
+		
+		clear_item_info( info );
+		
+		info.name = name;
+		
+		get_dates( st, info );
+		
+		fork_reader().open( dir, name, item, info );
+		
+		write_header( output, item_folder, info );
+		
+		// Sorted, so that the same tree always makes the same archive
+		
+		std::vector< plus::string > names;
+		
+		{
+			n::owned< p7::dir_t > contents = p7::fdopendir( p7::dup( item ) );
+			
+			while ( const dirent* entry = ::readdir( contents.get() ) )
+			{
+				const char* entry_name = entry->d_name;
+				
+				const bool dots = entry_name[ 0 ] == '.'  &&  (entry_name[ 1 ] == '\0'  ||
+				                                               entry_name[ 1 ] == '.'  &&  entry_name[ 2 ] == '\0');
+				
+				if ( !dots  &&  !is_appledouble_name( entry_name ) )
+				{
+					names.push_back( entry_name );
+				}
+			}
+		}
+		
+		std::sort( names.begin(), names.end() );
+		
+		typedef std::vector< plus::string >::const_iterator Iter;
+		
+		for ( Iter it = names.begin();  it != names.end();  ++it )
+		{
+			encode_item( item, it->c_str(), output );
+		}
+		
+		write_header( output, item_folder_end, info );
+	}
+	
+	static void encode_item( p7::fd_t dir, const char* name, p7::fd_t output )
+	{
+		struct stat st;
+		
+		if ( !p7::fstatat( dir, name, st, p7::at_symlink_nofollow ) )
+		{
+			return;  // gone already
+		}
+		
+		// Symlinks, devices, and the like have no MacBinary form.
+		
+		if ( S_ISREG( st.st_mode ) )
+		{
+			encode_file( dir, name, p7::openat( dir, name, p7::o_rdonly | p7::o_nofollow ), st, output );
+		}
+		else if ( S_ISDIR( st.st_mode ) )
+		{
+			encode_folder( dir, name, p7::openat( dir, name, p7::o_rdonly | p7::o_directory ), st, output );
+		}
+	}
+	
+	void encode( const char* path, p7::fd_t output )
+	{
+		char* real = ::realpath( path, NULL );
+		
+		if ( real == NULL )
+		{
+			p7::throw_errno( errno );
+		}
+		
+		const plus::string real_path = real;
+		
+		free( real );
+		
+		const std::size_t slash = real_path.find_last_of( '/' );
+		
+		const plus::string name = real_path.substr( slash + 1 );
+		
+		if ( name.empty() )
+		{
+			p7::throw_errno( EISDIR );  // the root directory has no name
+		}
+		
+		const plus::string parent = slash == 0 ? plus::string( "/" ) : real_path.substr( 0, slash );
+		
+		n::owned< p7::fd_t > dir = p7::open( parent, p7::o_rdonly | p7::o_directory );
+		
+		encode_item( dir, name.c_str(), output );
+	}
+	
+}
@@ -0,0 +1,29 @@
+/*
+	mbin/encode.hh
+	--------------
+*/
+
+#ifndef MBIN_ENCODE_HH
+#define MBIN_ENCODE_HH
+
+// poseven
+#ifndef POSEVEN_TYPES_FD_T_HH
+#include "poseven/types/fd_t.hh"
+#endif
+
+
+namespace mbin
+{
+	
+	/*
+		Write the file or folder at path (and everything in a folder, as
+		MacBinary II+ does) to output.  Forks are moved with pump(), so on
+		hosts that can, data never passes through user space; every fork and
+		header starts on a 128-byte boundary in the output.
+	*/
+	
+	void encode( const char* path, poseven::fd_t output );
+	
+}
+
+#endif
@@ -0,0 +1,489 @@
+/*
+	mbin/forks.cc
+	-------------
+*/
+
+#include "mbin/forks.hh"
+
+// Standard C++
+#include <algorithm>
+
+// Standard C
+#include <errno.h>
+#include <string.h>
+
+// POSIX
+#include <fcntl.h>
+#include <unistd.h>
+
+#if defined( __linux__ )  ||  defined( __APPLE__ )  &&  defined( __MACH__ )
+#include <sys/xattr.h>
+#define MBIN_XATTRS  1
+#endif
+
+// plus
+#include "plus/string/concat.hh"
+
+// poseven
+#include "poseven/extras/pump.hh"
+#include "poseven/extras/write_all.hh"
+#include "poseven/functions/openat.hh"
+#include "poseven/functions/pread.hh"
+#include "poseven/types/errno_t.hh"
+
+
+namespace mbin
+{
+	
+	namespace n = nucleus;
+	namespace p7 = poseven;
+	
+	
+#ifdef __linux__
+
+	// Unprivileged processes only get the user namespace.
+	
+	#define XATTR_PREFIX  "user."
+	
+	static inline ssize_t get_xattr( int fd, const char* name, void* buffer, size_t size )
+	{
+		return fgetxattr( fd, name, buffer, size );
+	}
+	
+	static inline int set_xattr( int fd, const char* name, const void* data, size_t size )
+	{
+		return fsetxattr( fd, name, data, size, 0 );
+	}
+	
+#elif defined( MBIN_XATTRS )
+
+	#define XATTR_PREFIX  ""
+	
+	static inline ssize_t get_xattr( int fd, const char* name, void* buffer, size_t size )
+	{
+		return fgetxattr( fd, name, buffer, size, 0, 0 );
+	}
+	
+	static inline int set_xattr( int fd, const char* name, const void* data, size_t size )
+	{
+		return fsetxattr( fd, name, data, size, 0, 0 );
+	}
+	
+#else
+
+	#define XATTR_PREFIX  ""
+	
+	static inline ssize_t get_xattr( int fd, const char* name, void* buffer, size_t size )
+	{
+		errno = ENOSYS;
+		
+		return -1;
+	}
+	
+	static inline int set_xattr( int fd, const char* name, const void* data, size_t size )
+	{
+		errno = ENOSYS;
+		
+		return -1;
+	}
+	
+#endif
+
+	static const char finder_info_xattr[] = XATTR_PREFIX "com.apple.FinderInfo";
+	static const char rsrc_fork_xattr  [] = XATTR_PREFIX "com.apple.ResourceFork";
+	
+	// Larger resource forks go into AppleDouble files, even if asked not to.
+	static const std::size_t max_xattr_fork = 64 * 1024;
+	
+	static bool is_too_big_for_xattr( int error )
+	{
+		switch ( error )
+		{
+			case E2BIG:
+			case ENOSPC:
+			case ERANGE:
+			case ENOSYS:
+		#ifdef ENOTSUP
+			case ENOTSUP:
+		#endif
+		#if defined( EOPNOTSUPP )  &&  EOPNOTSUPP != ENOTSUP
+			case EOPNOTSUPP:
+		#endif
+				return true;
+			
+			default:
+				return false;
+		}
+	}
+	
+	
+	/*
+		AppleDouble version 2:  a header, a table of entries, and their data.
+		The files written here hold Finder info, file dates, and the resource
+		fork, in that order, so everything but the fork's length is fixed.
+	*/
+	
+	static const unsigned long appledouble_magic   = 0x00051607;
+	static const unsigned long appledouble_version = 0x00020000;
+	
+	enum
+	{
+		kResourceForkEntry = 2,
+		kFileDatesEntry    = 8,
+		kFinderInfoEntry   = 9
+	};
+	
+	const std::size_t appledouble_header_size = 26;
+	const std::size_t appledouble_entry_size  = 12;
+	const std::size_t appledouble_max_entries = 16;
+	
+	const std::size_t appledouble_dates_size = 16;
+	
+	const std::size_t appledouble_prefix_size = appledouble_header_size
+	                                          + appledouble_entry_size * 3
+	                                          + finder_info_size
+	                                          + appledouble_dates_size;
+	
+	// AppleDouble dates are signed, and count from 2000 (GMT).
+	static const unsigned long mac_2000_epoch_delta = 3029529600u;
+	
+	static const unsigned long appledouble_unknown_date = 0x80000000;
+	
+	static inline unsigned long get_u32( const unsigned char* p )
+	{
+		return (unsigned long) p[ 0 ] << 24 | p[ 1 ] << 16 | p[ 2 ] << 8 | p[ 3 ];
+	}
+	
+	static inline void set_u32( unsigned char* p, unsigned long x )
+	{
+		p[ 0 ] = x >> 24;
+		p[ 1 ] = x >> 16;
+		p[ 2 ] = x >>  8;
+		p[ 3 ] = x;
+	}
+	
+	static inline unsigned char* set_entry( unsigned char*  p,
+	                                        unsigned long   id,
+	                                        unsigned long   offset,
+	                                        unsigned long   length )
+	{
+		set_u32( p,     id     );
+		set_u32( p + 4, offset );
+		set_u32( p + 8, length );
+		
+		return p + appledouble_entry_size;
+	}
+	
+	static plus::string appledouble_name( const plus::string& name )
+	{
+		return plus::concat( "._", name );
+	}
+	
+	static bool has_finder_info( const finder_info& finder )
+	{
+		for ( std::size_t i = 0;  i < finder_info_size;  ++i )
+		{
+			if ( finder[ i ] != 0 )
+			{
+				return true;
+			}
+		}
+		
+		return false;
+	}
+	
+	bool is_appledouble_name( const char* name )
+	{
+		return name[ 0 ] == '.'  &&  name[ 1 ] == '_';
+	}
+	
+	
+	bool fork_reader::open_xattrs( p7::fd_t item, item_info& info )
+	{
+		const ssize_t n_finder = get_xattr( item, finder_info_xattr, info.finder, finder_info_size );
+		
+		const ssize_t rsrc_size = get_xattr( item, rsrc_fork_xattr, NULL, 0 );
+		
+		if ( n_finder < 0  &&  rsrc_size < 0 )
+		{
+			return false;
+		}
+		
+		if ( n_finder < (ssize_t) finder_info_size )
+		{
+			memset( info.finder + std::max< ssize_t >( n_finder, 0 ),
+			        '\0',
+			        finder_info_size - std::max< ssize_t >( n_finder, 0 ) );
+		}
+		
+		if ( rsrc_size > 0 )
+		{
+			its_bytes.resize( rsrc_size );
+			
+			const ssize_t n = get_xattr( item, rsrc_fork_xattr, &its_bytes[ 0 ], rsrc_size );
+			
+			its_bytes.resize( std::max< ssize_t >( n, 0 ) );
+			
+			info.rsrc_length = its_bytes.size();
+		}
+		
+		return true;
+	}
+	
+	bool fork_reader::open_appledouble( p7::fd_t dir, const char* name, item_info& info )
+	{
+		const int fd = ::openat( dir, appledouble_name( name ).c_str(), O_RDONLY );
+		
+		if ( fd < 0 )
+		{
+			return false;
+		}
+		
+		its_sidecar = n::owned< p7::fd_t >::seize( p7::fd_t( fd ) );
+		
+		unsigned char buffer[ appledouble_header_size
+		                    + appledouble_entry_size * appledouble_max_entries ];
+		
+		const ssize_t n_read = p7::pread( its_sidecar, (char*) buffer, sizeof buffer, 0 );
+		
+		if ( n_read < (ssize_t) appledouble_header_size        ||
+		     get_u32( buffer     ) != appledouble_magic    ||
+		     get_u32( buffer + 4 ) != appledouble_version )
+		{
+			// Not AppleDouble after all, or not a version we know
+			
+			its_sidecar.reset();
+			
+			return false;
+		}
+		
+		std::size_t n_entries = buffer[ 24 ] << 8 | buffer[ 25 ];
+		
+		n_entries = std::min( n_entries, (n_read - appledouble_header_size) / appledouble_entry_size );
+		
+		const unsigned char* entry = buffer + appledouble_header_size;
+		
+		for ( std::size_t i = 0;  i < n_entries;  ++i, entry += appledouble_entry_size )
+		{
+			const unsigned long id     = get_u32( entry     );
+			const unsigned long offset = get_u32( entry + 4 );
+			const unsigned long length = get_u32( entry + 8 );
+			
+			switch ( id )
+			{
+				case kResourceForkEntry:
+					its_offset = offset;
+					
+					info.rsrc_length = length;
+					break;
+				
+				case kFinderInfoEntry:
+					p7::pread( its_sidecar,
+					           (char*) info.finder,
+					           std::min< unsigned long >( length, finder_info_size ),
+					           offset );
+					break;
+				
+				case kFileDatesEntry:
+					if ( length >= 4 )
+					{
+						unsigned char created[ 4 ];
+						
+						if ( p7::pread( its_sidecar, (char*) created, 4, offset ) == 4 )
+						{
+							const unsigned long date = get_u32( created );
+							
+							if ( date != appledouble_unknown_date )
+							{
+								info.creation_date = (date + mac_2000_epoch_delta) & 0xFFFFFFFF;
+							}
+						}
+					}
+					break;
+				
+				default:
+					break;
+			}
+		}
+		
+		return true;
+	}
+	
+	void fork_reader::open( p7::fd_t dir, const char* name, p7::fd_t item, item_info& info )
+	{
+		its_sidecar.reset();
+		its_bytes.clear();
+		
+		its_offset = 0;
+		
+		info.rsrc_length = 0;
+		
+		open_xattrs( item, info )  ||  open_appledouble( dir, name, info );
+	}
+	
+	static void write_zeros( p7::fd_t output, unsigned long n )
+	{
+		static const char zeros[ 4096 ] = { 0 };
+		
+		while ( n > 0 )
+		{
+			const std::size_t n_written = std::min< unsigned long >( n, sizeof zeros );
+			
+			p7::write_all( output, zeros, n_written );
+			
+			n -= n_written;
+		}
+	}
+	
+	void fork_reader::copy( p7::fd_t output, unsigned long length )
+	{
+		unsigned long n_copied = 0;
+		
+		if ( its_sidecar.get() )
+		{
+			off_t offset = its_offset;
+			
+			while ( n_copied < length )
+			{
+				const ssize_t n = p7::pump( its_sidecar, &offset, output, NULL, length - n_copied );
+				
+				if ( n == 0 )
+				{
+					break;
+				}
+				
+				n_copied += n;
+			}
+		}
+		else if ( !its_bytes.empty() )
+		{
+			n_copied = std::min< unsigned long >( length, its_bytes.size() );
+			
+			p7::write_all( output, &its_bytes[ 0 ], n_copied );
+		}
+		
+		write_zeros( output, length - n_copied );
+	}
+	
+	
+	void fork_writer::open( fork_storage      storage,
+	                        p7::fd_t          dir,
+	                        p7::fd_t          item,
+	                        const item_info&  info )
+	{
+		its_storage = storage;
+		its_dir     = dir;
+		its_item    = item;
+		its_info    = info;
+		
+		its_sidecar.reset();
+		its_bytes.clear();
+		
+		if ( storage == fork_storage_xattr  &&  info.rsrc_length <= max_xattr_fork )
+		{
+			its_bytes.reserve( info.rsrc_length );
+		}
+		else if ( info.rsrc_length > 0  ||  has_finder_info( info.finder ) )
+		{
+			its_storage = fork_storage_appledouble;
+			
+			open_appledouble();
+		}
+	}
+	
+	void fork_writer::open_appledouble()
+	{
+		its_sidecar = p7::openat( p7::fd_t( its_dir ),
+		                          appledouble_name( its_info.name ),
+		                          p7::o_wronly | p7::o_creat | p7::o_excl );
+		
+		unsigned char prefix[ appledouble_prefix_size ] = { 0 };
+		
+		set_u32( prefix,     appledouble_magic   );
+		set_u32( prefix + 4, appledouble_version );
+		
+		prefix[ 25 ] = 3;  // entries
+		
+		unsigned char* p = prefix + appledouble_header_size;
+		
+		std::size_t offset = appledouble_header_size + appledouble_entry_size * 3;
+		
+		p = set_entry( p, kFinderInfoEntry, offset, finder_info_size );
+		
+		offset += finder_info_size;
+		
+		p = set_entry( p, kFileDatesEntry, offset, appledouble_dates_size );
+		
+		offset += appledouble_dates_size;
+		
+		p = set_entry( p, kResourceForkEntry, offset, its_info.rsrc_length );
+		
+		memcpy( p, its_info.finder, finder_info_size );
+		
+		p += finder_info_size;
+		
+		set_u32( p,      its_info.creation_date     - mac_2000_epoch_delta );
+		set_u32( p +  4, its_info.modification_date - mac_2000_epoch_delta );
+		set_u32( p +  8, appledouble_unknown_date );  // backup
+		set_u32( p + 12, its_info.modification_date - mac_2000_epoch_delta );
+		
+		p7::write_all( its_sidecar, (const char*) prefix, sizeof prefix );
+	}
+	
+	void fork_writer::write( const char* data, std::size_t n )
+	{
+		if ( its_storage == fork_storage_appledouble )
+		{
+			p7::write_all( its_sidecar, data, n );
+		}
+		else
+		{
+			its_bytes.insert( its_bytes.end(), data, data + n );
+		}
+	}
+	
+	bool fork_writer::set_xattrs()
+	{
+		if ( has_finder_info( its_info.finder ) )
+		{
+			if ( set_xattr( its_item, finder_info_xattr, its_info.finder, finder_info_size ) < 0 )
+			{
+				return false;
+			}
+		}
+		
+		if ( !its_bytes.empty() )
+		{
+			if ( set_xattr( its_item, rsrc_fork_xattr, &its_bytes[ 0 ], its_bytes.size() ) < 0 )
+			{
+				return false;
+			}
+		}
+		
+		return true;
+	}
+	
+	void fork_writer::close()
+	{
+		if ( its_storage == fork_storage_xattr  &&  !set_xattrs() )
+		{
+			const int error = errno;
+			
+			if ( !is_too_big_for_xattr( error ) )
+			{
+				p7::throw_errno( error );
+			}
+			
+			open_appledouble();
+			
+			if ( !its_bytes.empty() )
+			{
+				p7::write_all( its_sidecar, &its_bytes[ 0 ], its_bytes.size() );
+			}
+		}
+		
+		its_sidecar.reset();
+		its_bytes.clear();
+	}
+	
+}
@@ -0,0 +1,89 @@
+/*
+	mbin/forks.hh
+	-------------
+*/
+
+#ifndef MBIN_FORKS_HH
+#define MBIN_FORKS_HH
+
+// Standard C++
+#include <vector>
+
+// poseven
+#ifndef POSEVEN_FUNCTIONS_CLOSE_HH
+#include "poseven/functions/close.hh"
+#endif
+
+// mbin
+#ifndef MBIN_HEADER_HH
+#include "mbin/header.hh"
+#endif
+
+
+namespace mbin
+{
+	
+	/*
+		POSIX files have no resource fork or Finder info of their own.  They
+		can be kept in an AppleDouble file named "._" plus the file's name,
+		beside it (as Mac OS X does on foreign volumes), or in extended
+		attributes (as Mac OS X does natively, and as Samba and netatalk can).
+		
+		Reading takes whichever is there.  Writing uses the storage asked
+		for, except that a resource fork too large for an extended attribute
+		goes into an AppleDouble file instead.
+	*/
+	
+	enum fork_storage
+	{
+		fork_storage_appledouble,
+		fork_storage_xattr
+	};
+	
+	bool is_appledouble_name( const char* name );
+	
+	class fork_reader
+	{
+		private:
+			nucleus::owned< poseven::fd_t >  its_sidecar;
+			off_t                            its_offset;
+			std::vector< char >              its_bytes;
+			
+			bool open_xattrs( poseven::fd_t item, item_info& info );
+			bool open_appledouble( poseven::fd_t dir, const char* name, item_info& info );
+			
+		public:
+			// Sets info.finder, info.rsrc_length, and info.creation_date, if known.
+			void open( poseven::fd_t dir, const char* name, poseven::fd_t item, item_info& info );
+			
+			// Writes length bytes of resource fork, zero-filled if it's shrunk.
+			void copy( poseven::fd_t output, unsigned long length );
+	};
+	
+	class fork_writer
+	{
+		private:
+			fork_storage                     its_storage;
+			int                              its_dir;
+			int                              its_item;
+			item_info                        its_info;
+			nucleus::owned< poseven::fd_t >  its_sidecar;
+			std::vector< char >              its_bytes;
+			
+			void open_appledouble();
+			bool set_xattrs();
+			
+		public:
+			void open( fork_storage     storage,
+			           poseven::fd_t    dir,
+			           poseven::fd_t    item,
+			           const item_info& info );
+			
+			void write( const char* data, std::size_t n );
+			
+			void close();
+	};
+	
+}
+
+#endif
@@ -0,0 +1,294 @@
+/*
+	mbin/header.cc
+	--------------
+*/
+
+#include "mbin/header.hh"
+
+// Standard C++
+#include <algorithm>
+
+// Standard C
+#include <string.h>
+
+// chars
+#include "conv/mac_utf8.hh"
+
+// CRC16
+#include "CRC16.hh"
+
+
+namespace mbin
+{
+	
+	enum
+	{
+		kOldVersion            =   0,
+		kFileName              =   1,
+		kFileType              =  65,  // FInfo starts here
+		kFileCreator           =  69,
+		kFinderFlagsHigh       =  73,
+		kZeroByte74            =  74,
+		kZeroByte82            =  82,
+		kDataForkLength        =  83,
+		kResourceForkLength    =  87,
+		kFileCreationDate      =  91,
+		kFileModificationDate  =  95,
+		kGetInfoCommentLength  =  99,
+		kFinderFlagsLow        = 101,
+		kMacBinaryIIISignature = 102,
+		kFileNameScript        = 106,
+		kExtendedFinderFlags   = 107,
+		kSecondaryHeaderLength = 120,
+		kCurrentVersion        = 122,
+		kMinimumVersion        = 123,
+		kCRC                   = 124
+	};
+	
+	// Offsets in finder_info
+	
+	enum
+	{
+		kFInfoSize          = 16,
+		kFinderFlagsLowInfo =  9,
+		kScriptInfo         = 24,
+		kXFlagsInfo         = 25
+	};
+	
+	const unsigned char kVersionMacBinaryII  = 129;
+	const unsigned char kVersionMacBinaryIII = 130;
+	
+	const unsigned long kFolderType    = 0x666f6c64;  // 'fold'
+	const unsigned long kFolderCreator = 0xFFFFFFFF;
+	const unsigned long kFolderEnd     = 0xFFFFFFFE;
+	const unsigned long kSignature     = 0x6d42494e;  // 'mBIN'
+	
+	static inline unsigned long get_u32( const unsigned char* p )
+	{
+		return (unsigned long) p[ 0 ] << 24 | p[ 1 ] << 16 | p[ 2 ] << 8 | p[ 3 ];
+	}
+	
+	static inline unsigned get_u16( const unsigned char* p )
+	{
+		return p[ 0 ] << 8 | p[ 1 ];
+	}
+	
+	static inline void set_u32( unsigned char* p, unsigned long x )
+	{
+		p[ 0 ] = x >> 24;
+		p[ 1 ] = x >> 16;
+		p[ 2 ] = x >>  8;
+		p[ 3 ] = x;
+	}
+	
+	static inline void set_u16( unsigned char* p, unsigned x )
+	{
+		p[ 0 ] = x >> 8;
+		p[ 1 ] = x;
+	}
+	
+	static unsigned header_crc( const header& h )
+	{
+		return CRC16::Checksum( h.data, kCRC );
+	}
+	
+	void clear_item_info( item_info& info )
+	{
+		info.name.reset();
+		
+		memset( info.finder, '\0', sizeof info.finder );
+		
+		info.data_length             = 0;
+		info.rsrc_length             = 0;
+		info.creation_date           = 0;
+		info.modification_date       = 0;
+		info.comment_length          = 0;
+		info.secondary_header_length = 0;
+	}
+	
+	static plus::string posix_name( const unsigned char* mac_name )
+	{
+		const char* name = (const char*) mac_name + 1;
+		
+		const std::size_t length = mac_name[ 0 ];
+		
+		char buffer[ 63 * 3 ];
+		
+		const std::size_t n = conv::utf8_from_mac( buffer, sizeof buffer, name, length );
+		
+		std::replace( buffer, buffer + n, '/', ':' );
+		
+		const bool dots = n <= 2  &&  memcmp( buffer, "..", n ) == 0;
+		
+		if ( dots  ||  memchr( buffer, '\0', n ) != NULL )
+		{
+			throw invalid_header();
+		}
+		
+		return plus::string( buffer, n );
+	}
+	
+	static void set_mac_name( unsigned char* mac_name, const plus::string& name )
+	{
+		char* buffer = (char*) mac_name + 1;
+		
+		std::size_t n;
+		
+		try
+		{
+			n = conv::mac_from_utf8( buffer, 63, name.data(), name.size() );
+		}
+		catch ( const conv::utf8_decoding_error& )
+		{
+			// Not UTF-8 -- take the bytes as they are.
+			
+			n = std::min< std::size_t >( name.size(), 63 );
+			
+			memcpy( buffer, name.data(), n );
+		}
+		
+		std::replace( buffer, buffer + n, ':', '/' );
+		
+		mac_name[ 0 ] = n;
+	}
+	
+	static void get_finder_info( const header& h, item_info& info )
+	{
+		memcpy( info.finder, h.data + kFileType, kFInfoSize );
+		
+		info.finder[ kFinderFlagsLowInfo ] = h.data[ kFinderFlagsLow      ];
+		info.finder[ kScriptInfo         ] = h.data[ kFileNameScript      ];
+		info.finder[ kXFlagsInfo         ] = h.data[ kExtendedFinderFlags ];
+	}
+	
+	static void set_finder_info( header& h, const item_info& info )
+	{
+		memcpy( h.data + kFileType, info.finder, kFInfoSize );
+		
+		h.data[ kZeroByte74          ] = 0;
+		h.data[ kFinderFlagsLow      ] = info.finder[ kFinderFlagsLowInfo ];
+		h.data[ kFileNameScript      ] = info.finder[ kScriptInfo         ];
+		h.data[ kExtendedFinderFlags ] = info.finder[ kXFlagsInfo         ];
+	}
+	
+	// Contrary to <http://www.lazerware.com/formats/macbinary/macbinary_iii.html>,
+	// we will not be satisfied with the presence of 'mBIN' at offset 102.
+	// See MacBinary.cc for the reasoning.
+	
+	static item_kind check_header( const header& h )
+	{
+		const bool has_name = h.data[ kFileName ] != 0  &&  h.data[ kFileName ] <= 63;
+		const bool crc_ok   = get_u16( h.data + kCRC ) == header_crc( h );
+		
+		if ( !has_name )
+		{
+			throw invalid_header();
+		}
+		
+		if ( h.data[ kOldVersion ] == 0  &&  h.data[ kZeroByte74 ] == 0 )
+		{
+			// MacBinary II or III if the CRC matches, otherwise MacBinary I
+			
+			if ( crc_ok  ||  h.data[ kZeroByte82 ] == 0 )
+			{
+				return item_file;
+			}
+		}
+		
+		// Not a MacBinary-encoded file, check for a directory tree
+		
+		const unsigned long type    = get_u32( h.data + kFileType    );
+		const unsigned long creator = get_u32( h.data + kFileCreator );
+		
+		if ( h.data[ kOldVersion ] == 1  &&  crc_ok  &&  type == kFolderType )
+		{
+			if ( creator == kFolderCreator )
+			{
+				return item_folder;
+			}
+			
+			if ( creator == kFolderEnd )
+			{
+				return item_folder_end;
+			}
+		}
+		
+		throw invalid_header();
+	}
+	
+	item_kind parse_header( const header& h, item_info& info )
+	{
+		const item_kind kind = check_header( h );
+		
+		clear_item_info( info );
+		
+		if ( kind == item_folder_end )
+		{
+			return kind;
+		}
+		
+		if ( h.data[ kMinimumVersion ] > kVersionMacBinaryIII )
+		{
+			throw incompatible_header();
+		}
+		
+		info.name = posix_name( h.data + kFileName );
+		
+		get_finder_info( h, info );
+		
+		if ( kind == item_folder )
+		{
+			// The type and creator mark a folder; they aren't its Finder info.
+			
+			memset( info.finder, '\0', 8 );
+		}
+		
+		if ( kind == item_file )
+		{
+			info.data_length = get_u32( h.data + kDataForkLength     );
+			info.rsrc_length = get_u32( h.data + kResourceForkLength );
+		}
+		
+		info.creation_date     = get_u32( h.data + kFileCreationDate     );
+		info.modification_date = get_u32( h.data + kFileModificationDate );
+		
+		info.comment_length          = get_u16( h.data + kGetInfoCommentLength  );
+		info.secondary_header_length = get_u16( h.data + kSecondaryHeaderLength );
+		
+		return kind;
+	}
+	
+	void make_header( header& h, item_kind kind, const item_info& info )
+	{
+		memset( h.data, '\0', sizeof h.data );
+		
+		set_mac_name( h.data + kFileName, info.name );
+		
+		set_finder_info( h, info );
+		
+		set_u32( h.data + kFileCreationDate,     info.creation_date     );
+		set_u32( h.data + kFileModificationDate, info.modification_date );
+		
+		set_u32( h.data + kMacBinaryIIISignature, kSignature );
+		
+		h.data[ kCurrentVersion ] = kVersionMacBinaryIII;
+		h.data[ kMinimumVersion ] = kVersionMacBinaryII;
+		
+		if ( kind == item_file )
+		{
+			set_u32( h.data + kDataForkLength,     info.data_length );
+			set_u32( h.data + kResourceForkLength, info.rsrc_length );
+		}
+		else
+		{
+			h.data[ kOldVersion ] = 1;
+			
+			set_u32( h.data + kFileType,    kFolderType );
+			set_u32( h.data + kFileCreator, kind == item_folder ? kFolderCreator
+			                                                    : kFolderEnd );
+		}
+		
+		set_u16( h.data + kCRC, header_crc( h ) );
+	}
+	
+}
@@ -0,0 +1,81 @@
+/*
+	mbin/header.hh
+	--------------
+*/
+
+#ifndef MBIN_HEADER_HH
+#define MBIN_HEADER_HH
+
+// plus
+#ifndef PLUS_STRING_HH
+#include "plus/string.hh"
+#endif
+
+
+namespace mbin
+{
+	
+	/*
+		The MacBinary header layout is tabulated in MacBinary.cc, next door.
+		Here it's read and written a byte at a time, with no Mac types, so
+		that archives can be handled on any host.
+	*/
+	
+	const std::size_t block_size  = 128;
+	const std::size_t header_size = 128;
+	
+	inline unsigned long padded_length( unsigned long length )
+	{
+		return (length + block_size - 1) & ~(block_size - 1);
+	}
+	
+	class invalid_header      {};  // The stream lacks a valid MacBinary header.
+	class incompatible_header {};  // The header says we're too old to decode it.
+	class too_many_end_blocks {};  // Directory end block received without start
+	
+	const std::size_t finder_info_size = 32;
+	
+	// FInfo and FXInfo together, as AppleDouble and Mac OS X xattrs store them
+	typedef unsigned char finder_info[ finder_info_size ];
+	
+	enum item_kind
+	{
+		item_file,
+		item_folder,
+		item_folder_end
+	};
+	
+	struct item_info
+	{
+		plus::string   name;  // UTF-8, with any '/' from the Mac name as ':'
+		finder_info    finder;
+		unsigned long  data_length;
+		unsigned long  rsrc_length;
+		unsigned long  creation_date;      // seconds since 1904
+		unsigned long  modification_date;
+		unsigned       comment_length;
+		unsigned       secondary_header_length;
+	};
+	
+	void clear_item_info( item_info& info );
+	
+	struct header
+	{
+		unsigned char data[ header_size ];
+	};
+	
+	/*
+		parse_header() throws invalid_header or incompatible_header, and
+		also invalid_header for names that can't be a directory entry.
+	*/
+	
+	item_kind parse_header( const header& h, item_info& info );
+	
+	void make_header( header& h, item_kind kind, const item_info& info );
+	
+	// Seconds between the Mac epoch (1904) and the Unix epoch (1970)
+	const unsigned long mac_unix_epoch_delta = 2082844800u;
+	
+}
+
+#endif
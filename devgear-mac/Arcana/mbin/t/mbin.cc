@@ -0,0 +1,339 @@
+/*
+	t/mbin.cc
+	---------
+*/
+
+// Standard C++
+#include <vector>
+
+// Standard C
+#include <stdlib.h>
+#include <string.h>
+
+// POSIX
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// plus
+#include "plus/string/concat.hh"
+#include "plus/var_string.hh"
+
+// poseven
+#include "poseven/extras/write_all.hh"
+#include "poseven/functions/futimens.hh"
+#include "poseven/functions/mkdir.hh"
+#include "poseven/functions/open.hh"
+#include "poseven/functions/openat.hh"
+#include "poseven/functions/read.hh"
+#include "poseven/functions/stat.hh"
+
+// mbin
+#include "mbin/decoder.hh"
+#include "mbin/encode.hh"
+#include "mbin/forks.hh"
+#include "mbin/header.hh"
+
+// tap-out
+#include "tap/test.hh"
+
+
+static const unsigned n_tests = 4 + 4 + 3;
+
+
+using tap::ok_if;
+
+
+namespace n = nucleus;
+namespace p7 = poseven;
+
+
+static std::vector< char > gData;
+
+static void fill_data()
+{
+	srand( 1 );
+	
+	gData.resize( 300 * 1000 );
+	
+	for ( unsigned i = 0;  i < gData.size();  ++i )
+	{
+		gData[ i ] = rand() >> 4;
+	}
+}
+
+static mbin::item_info file_info( const char* name )
+{
+	mbin::item_info info;
+	
+	mbin::clear_item_info( info );
+	
+	info.name = name;
+	
+	memcpy( info.finder, "TEXTttxt", 8 );
+	
+	info.data_length       = 1234;
+	info.rsrc_length       = 567;
+	info.creation_date     = 3000000000u;
+	info.modification_date = 3100000000u;
+	
+	return info;
+}
+
+static bool same_info( const mbin::item_info& a, const mbin::item_info& b )
+{
+	return a.name == b.name
+	       &&  memcmp( a.finder, b.finder, sizeof a.finder ) == 0
+	       &&  a.data_length       == b.data_length
+	       &&  a.rsrc_length       == b.rsrc_length
+	       &&  a.creation_date     == b.creation_date
+	       &&  a.modification_date == b.modification_date;
+}
+
+static void headers()
+{
+	const mbin::item_info info = file_info( "a:b" );  // "a/b" on a Mac
+	
+	mbin::header h;
+	
+	mbin::make_header( h, mbin::item_file, info );
+	
+	mbin::item_info parsed;
+	
+	const mbin::item_kind kind = mbin::parse_header( h, parsed );
+	
+	ok_if( kind == mbin::item_file  &&  same_info( info, parsed ), "header round trip" );
+	
+	ok_if( memcmp( h.data + 2, "a/b", 3 ) == 0, "Mac names use slashes" );
+	
+	h.data[ 74 ] = 1;  // must be zero
+	
+	bool thrown = false;
+	
+	try
+	{
+		mbin::parse_header( h, parsed );
+	}
+	catch ( const mbin::invalid_header& )
+	{
+		thrown = true;
+	}
+	
+	ok_if( thrown, "nonzero byte 74 is rejected" );
+	
+	mbin::make_header( h, mbin::item_folder_end, info );
+	
+	thrown = false;
+	
+	try
+	{
+		mbin::decoder decoder( "/tmp", mbin::fork_storage_appledouble );
+		
+		decoder.write( (const char*) h.data, sizeof h.data );
+	}
+	catch ( const mbin::too_many_end_blocks& )
+	{
+		thrown = true;
+	}
+	
+	ok_if( thrown, "folder end without start is rejected" );
+}
+
+static plus::string gTemp;
+
+static plus::string temp_path( const char* name )
+{
+	return gTemp + "/" + name;
+}
+
+static void write_file( const plus::string& path, const char* data, std::size_t n, time_t date )
+{
+	n::owned< p7::fd_t > fd = p7::open( path, p7::o_wronly | p7::o_creat | p7::o_trunc );
+	
+	p7::write_all( fd, data, n );
+	
+	p7::futimens( fd, date );
+}
+
+static plus::string read_file( const plus::string& path )
+{
+	n::owned< p7::fd_t > fd = p7::open( path, p7::o_rdonly );
+	
+	plus::var_string result;
+	
+	char buffer[ 4096 ];
+	
+	while ( ssize_t n = p7::read( fd, buffer, sizeof buffer ) )
+	{
+		result.append( buffer, n );
+	}
+	
+	return result;
+}
+
+// A resource fork and Finder info, in an AppleDouble file
+
+static void add_forks( const plus::string& dir, const char* name, unsigned long rsrc_length, time_t date )
+{
+	n::owned< p7::fd_t > parent = p7::open( dir, p7::o_rdonly | p7::o_directory );
+	n::owned< p7::fd_t > item   = p7::openat( parent, name, p7::o_rdonly );
+	
+	mbin::item_info info = file_info( name );
+	
+	info.rsrc_length       = rsrc_length;
+	info.creation_date     = date + mbin::mac_unix_epoch_delta;
+	info.modification_date = date + mbin::mac_unix_epoch_delta;
+	
+	mbin::fork_writer forks;
+	
+	forks.open( mbin::fork_storage_appledouble, parent, item, info );
+	
+	forks.write( &gData[ 7 ], info.rsrc_length );
+	
+	forks.close();
+}
+
+static void make_tree()
+{
+	p7::mkdir( temp_path( "in" ) );
+	p7::mkdir( temp_path( "in/top" ) );
+	p7::mkdir( temp_path( "in/top/sub" ) );
+	
+	write_file( temp_path( "in/top/a" ), &gData[ 0 ], 1000, 1000000000 );
+	write_file( temp_path( "in/top/b" ), "",          0,    1100000000 );
+	
+	write_file( temp_path( "in/top/sub/c" ), &gData[ 0 ], gData.size(), 1200000000 );
+	
+	add_forks( temp_path( "in/top"     ), "a", 1000,       1000000000 );
+	add_forks( temp_path( "in/top/sub" ), "c", 100 * 1000, 1200000000 );
+	
+	p7::futimens( p7::open( temp_path( "in/top/sub" ), p7::o_rdonly | p7::o_directory ), time_t( 1300000000 ) );
+}
+
+static plus::string encode( const plus::string& path, const char* archive_name )
+{
+	const plus::string archive = temp_path( archive_name );
+	
+	n::owned< p7::fd_t > fd = p7::open( archive, p7::o_wronly | p7::o_creat | p7::o_trunc );
+	
+	mbin::encode( path.c_str(), fd );
+	
+	return read_file( archive );
+}
+
+static void decode( const plus::string& archive, const char* dest, mbin::fork_storage storage )
+{
+	p7::mkdir( temp_path( dest ) );
+	
+	mbin::decoder decoder( temp_path( dest ).c_str(), storage );
+	
+	// Pieces of every size, from single bytes to more than a header
+	
+	for ( std::size_t n = 0;  n < archive.size();  )
+	{
+		std::size_t piece = rand() % 2 ? rand() % 300 : rand() % 100000;
+		
+		piece = std::min( piece, archive.size() - n );
+		
+		decoder.write( archive.data() + n, piece );
+		
+		n += piece;
+	}
+}
+
+static bool has_forks( const plus::string& dir, const char* name, unsigned long rsrc_length )
+{
+	n::owned< p7::fd_t > parent = p7::open( dir, p7::o_rdonly | p7::o_directory );
+	n::owned< p7::fd_t > item   = p7::openat( parent, name, p7::o_rdonly );
+	
+	mbin::item_info info;
+	
+	mbin::clear_item_info( info );
+	
+	mbin::fork_reader reader;
+	
+	reader.open( parent, name, item, info );
+	
+	const plus::string rsrc_path = temp_path( "rsrc" );
+	
+	{
+		n::owned< p7::fd_t > rsrc = p7::open( rsrc_path, p7::o_wronly | p7::o_creat | p7::o_trunc );
+		
+		reader.copy( rsrc, info.rsrc_length );
+	}
+	
+	return info.rsrc_length == rsrc_length
+	       &&  memcmp( info.finder, "TEXTttxt", 8 ) == 0
+	       &&  read_file( rsrc_path ) == plus::string( &gData[ 7 ], rsrc_length );
+}
+
+static time_t mtime( const plus::string& path )
+{
+	struct stat st;
+	
+	p7::stat( path, st );
+	
+	return st.st_mtime;
+}
+
+static void round_trip()
+{
+	make_tree();
+	
+	const plus::string archive = encode( temp_path( "in/top" ), "top.bin" );
+	
+	decode( archive, "out", mbin::fork_storage_appledouble );
+	
+	ok_if( read_file( temp_path( "out/top/a" ) ) == plus::string( &gData[ 0 ], 1000 )
+	       &&  read_file( temp_path( "out/top/b" ) ).empty()
+	       &&  read_file( temp_path( "out/top/sub/c" ) ) == plus::string( &gData[ 0 ], gData.size() ),
+	       "data forks" );
+	
+	ok_if( has_forks( temp_path( "out/top"     ), "a", 1000       )
+	       &&  has_forks( temp_path( "out/top/sub" ), "c", 100 * 1000 ), "resource forks and Finder info" );
+	
+	ok_if( mtime( temp_path( "out/top/a" ) ) == 1000000000
+	       &&  mtime( temp_path( "out/top/sub" ) ) == 1300000000, "modification dates" );
+	
+	ok_if( encode( temp_path( "out/top" ), "again.bin" ) == archive, "re-encoding is identical" );
+}
+
+static void xattrs()
+{
+	const plus::string archive = encode( temp_path( "in/top" ), "top.bin" );
+	
+	decode( archive, "xattrs", mbin::fork_storage_xattr );
+	
+	// Wherever the file system allows, which may be nowhere
+	
+	ok_if( has_forks( temp_path( "xattrs/top" ), "a", 1000 ), "small resource fork" );
+	
+	// Too big for an extended attribute, so it's in an AppleDouble file
+	
+	ok_if( has_forks( temp_path( "xattrs/top/sub" ), "c", 100 * 1000 ), "large resource fork" );
+	
+	ok_if( encode( temp_path( "xattrs/top" ), "xattrs.bin" ) == archive, "re-encoding is identical" );
+}
+
+int main( int argc, const char *const *argv )
+{
+	tap::start( "mbin", n_tests );
+	
+	fill_data();
+	
+	char temp[] = "/tmp/mbin-test.XXXXXX";
+	
+	gTemp = mkdtemp( temp );
+	
+	headers();
+	
+	round_trip();
+	
+	xattrs();
+	
+	const plus::string command = "rm -rf " + gTemp;
+	
+	system( command.c_str() );
+	
+	return 0;
+}
@@ -0,0 +1,2732 @@
+/*
+	disassembler.cc
+	---------------
+*/
+
+#include "dis68k/disassembler.hh"
+
+// Standard C++
+#include <algorithm>
+#include <vector>
+
+// Standard C
+#include <ctype.h>
+#include <stdarg.h>
+#include <string.h>
+
+// C99
+#include <stdint.h>
+
+// Iota
+#include "iota/strings.hh"
+
+// gear
+#include "gear/hexidecimal.hh"
+#include "gear/inscribe_decimal.hh"
+
+// plus
+#include "plus/var_string.hh"
+
+// v68k
+#include "v68k/endian.hh"
+
+
+/*
+	A 68K disassembler.
+	
+	Line 0:  complete
+	Line 1:  complete  (MOVE.B)
+	Line 2:  complete  (MOVE.L)
+	Line 3:  complete  (MOVE.W)
+	Line 4:  complete
+	Line 5:  complete  (ADDQ, SUBQ, DBcc)
+	Line 6:  complete  (Bcc)
+	Line 7:  complete  (MOVEQ)
+	Line 8:  complete
+	Line 9:  complete (SUB)
+	Line A:  A-Traps
+	Line B:  complete
+	Line C:  complete
+	Line D:  complete (ADD)
+	Line E:  complete (shift/rotate)
+	Line F:  F-Traps
+*/
+
+
+namespace dis68k
+{
+	
+	#define COMMENT  "    ; "
+	
+	
+	struct str_len
+	{
+		const char*  string;
+		size_t       length;
+	};
+	
+	struct string_length
+	{
+		const char*  string;
+		size_t       length;
+		
+		string_length( const char* s, size_t len ) : string( s ), length( len )
+		{
+		}
+	};
+	
+	static inline int sign_extend_char( signed char x )
+	{
+		return x;
+	}
+	
+	static void append_hex( plus::var_string& s, unsigned long x, int min_bytes )
+	{
+		const unsigned short min_digits = min_bytes * 2;
+		
+		const unsigned short magnitude = gear::hexidecimal_magnitude( x );
+		
+		const unsigned short even_magnitude = magnitude + (magnitude & 0x1 );
+		
+		const unsigned short n_bytes = std::max( even_magnitude, min_digits );
+		
+		s.resize( s.size() + n_bytes );
+		
+		char* buf = &*s.end() - n_bytes;
+		
+		gear::inscribe_n_hex_digits( buf, x, n_bytes );
+	}
+	
+	// gear::inscribe_decimal() returns a static buffer, which isn't reentrant.
+	
+	static void append_decimal( plus::var_string& s, int x )
+	{
+		char buffer[ sizeof "-1234567890" ];
+		
+		s.append( buffer, gear::inscribe_decimal_r( x, buffer ) );
+	}
+	
+	static void append_signed_decimal( plus::var_string& s, int x )
+	{
+		char sign = '+';
+		
+		if ( x < 0 )
+		{
+			sign = '-';
+			
+			x = -x;
+		}
+		
+		s += sign;
+		
+		append_decimal( s, x );
+	}
+	
+	
+	class end_of_file {};
+	
+	class illegal_instruction {};
+	
+	class illegal_operand {};
+	
+	
+	static char size_codes[] =
+	{
+		'B',
+		'W',
+		'L'
+	};
+	
+	static char sizes[] =
+	{
+		1,
+		2,
+		4
+	};
+	
+	static const char* bit_ops[] =
+	{
+		"TST",
+		"CHG",
+		"CLR",
+		"SET"
+	};
+	
+	static const char* bit_slide_ops[] =
+	{
+		"AS",
+		"LS",
+		"ROX",
+		"RO"
+	};
+	
+	static const char* condition_codes[] =
+	{
+		"T ",
+		"F ",
+		"HI",
+		"LS",
+		"CC",
+		"CS",
+		"NE",
+		"EQ",
+		"VC",
+		"VS",
+		"PL",
+		"MI",
+		"GE",
+		"LT",
+		"GT",
+		"LE"
+	};
+	
+	
+	static bool globally_prefix_address         = true;
+	static bool globally_attach_target_comments = true;
+	
+	
+	static const unsigned short indexed_jump_code[] =
+	{
+		//0xd040,  // ADD.W    D0,D0
+		
+		//0x303b,  // MOVE.W   (6,PC,D0.W),D0
+		//0x0006,
+		
+		0x4efb,  // JMP      (2,PC,D0.W)
+		0x0002
+	};
+	
+	
+	static const unsigned short lswtch_code[] =
+	{
+		0x205f,
+		0x2248,
+		0xd2d8,
+		0xb098,
+		0x6c02,
+		0x4ed1,
+		0xb098,
+		0x6f02,
+		0x4ed1,
+		0x3218,
+		0xb098,
+		0x6604,
+		0xd0d0,
+		0x4ed0,
+		0x5448,
+		0x51c9,
+		0xfff4,
+		0x4ed1
+	};
+	
+	
+	class decoder
+	{
+		private:
+			friend class disassembler;
+			
+			typedef void (decoder::*decode_function)( unsigned short op );
+			
+			static const decode_function mask_of_4_bits[];
+			
+			const unsigned char*  its_image;
+			size_t                its_size;
+			trap_namer            its_trap_names;
+			
+			bool its_quiet;
+			bool its_started;
+			bool its_at_end;
+			
+			plus::var_string its_output;
+			
+			size_t its_bytes_read;
+			
+			size_t its_pc;
+			
+			unsigned short its_last_op;
+			
+			unsigned its_last_CMPI_operand;
+			
+			size_t its_last_branch_target;
+			size_t its_last_pc_relative_target;
+			size_t its_successor_of_last_exit;
+			
+			std::vector< size_t > its_branch_targets;
+			
+			int   its_indexed_jump_state;
+			bool  its_at_indexed_jump;
+			
+			int     its_lswtch_state;
+			size_t  its_lswtch_offset;
+			
+			unsigned its_last_absolute_addr_from_ea;
+			unsigned its_last_immediate_data_from_ea;
+			
+			char its_name[ 256 ];
+			
+			// Set instead of throwing, by decoders called from decode_one()
+			const char* its_rejection;
+			
+			decoder( const unsigned char* image, size_t size, trap_namer names );
+			
+			void print( const char* format, ... );
+			
+			void reject( const char* message )  { its_rejection = message; }
+			
+			const char* get_aTrap_name( unsigned short trap_word ) const;
+			
+			void add_branch_target( size_t address );
+			bool check_branch_target( size_t address );
+			
+			unsigned short read_word( bool peeking = false );
+			unsigned short peek_word();
+			short read_word_signed();
+			unsigned int read_long();
+			
+			int read_extended_displacement( unsigned short size_code );
+			
+			plus::string read_ea( short mode_reg, short immediate_size );
+			
+			void decode_default( unsigned short op );
+			void decode_compare( unsigned short op );
+			void decode_Immediate( unsigned short op );
+			void decode_Bit_op( unsigned short op, bool dynamic );
+			void decode_MOVE( unsigned short op, short size_index );
+			void decode_unary( unsigned short op );
+			void decode_4_line_special( unsigned short op );
+			
+			bool jump_breaks_routine( unsigned short mode_reg );
+			
+			void print_comment( unsigned long pc_relative_target );
+			
+			void decode_jump_table();
+			void decode_switch_table();
+			
+			void decode_Jump( unsigned short op );
+			void decode_long_mul_div( unsigned short op );
+			void decode_MOVEM( unsigned short op );
+			void decode_MOVEC( unsigned short op );
+			void decode_4e_misc( unsigned short op );
+			
+			void decode_data( unsigned short op );
+			bool decoded_data( unsigned short op );
+			
+			void decode_MOVEP( unsigned short op );
+			void decode_MOVES( unsigned short op );
+			
+			void decode_0_line( unsigned short op );
+			void decode_MOVE_Byte( unsigned short op );
+			void decode_MOVE_Long( unsigned short op );
+			void decode_MOVE_Word( unsigned short op );
+			void decode_4_line( unsigned short op );
+			void decode_Quick( unsigned short op );
+			void decode_Branch( unsigned short op );
+			void decode_MOVEQ( unsigned short op );
+			void decode_8_line( unsigned short op );
+			void decode_B_line( unsigned short op );
+			void decode_C_line( unsigned short op );
+			void decode_ADD_SUB( unsigned short op );
+			void decode_shift_rotate( unsigned short op );
+			void decode_A_line( unsigned short op );
+			void decode_F_line( unsigned short op );
+			
+			const char* get_name( unsigned short word );
+			
+			void skip_resource_header();
+			
+			void decode_one();
+	};
+	
+	decoder::decoder( const unsigned char* image, size_t size, trap_namer names )
+	:
+		its_image( image ),
+		its_size( size ),
+		its_trap_names( names ),
+		its_quiet(),
+		its_started(),
+		its_at_end(),
+		its_bytes_read(),
+		its_pc(),
+		its_last_op( 0xFFFF ),
+		its_last_CMPI_operand(),
+		its_last_branch_target(),
+		its_last_pc_relative_target(),
+		its_successor_of_last_exit(),
+		its_indexed_jump_state(),
+		its_at_indexed_jump(),
+		its_lswtch_state(),
+		its_lswtch_offset(),
+		its_last_absolute_addr_from_ea(),
+		its_last_immediate_data_from_ea(),
+		its_rejection()
+	{
+	}
+	
+	/*
+		Disassembly spends most of its time formatting, so print() takes
+		only the printf() conversions used here -- %s, %c, %d, and %x, with
+		the '#' and '+' flags and a precision.  It formats into a buffer on
+		the stack, which it appends to its_output once it's full or done.
+	*/
+	
+	class formatter
+	{
+		private:
+			plus::var_string& its_output;
+			
+			char   its_buffer[ 256 ];
+			char*  its_mark;
+			
+			// non-copyable
+			formatter           ( const formatter& );
+			formatter& operator=( const formatter& );
+		
+		public:
+			formatter( plus::var_string& output ) : its_output( output ),
+			                                        its_mark( its_buffer )
+			{
+			}
+			
+			~formatter()  { flush(); }
+			
+			void flush()
+			{
+				its_output.append( its_buffer, its_mark );
+				
+				its_mark = its_buffer;
+			}
+			
+			void put( char c )
+			{
+				if ( its_mark == its_buffer + sizeof its_buffer )
+				{
+					flush();
+				}
+				
+				*its_mark++ = c;
+			}
+			
+			void put( const char* p, size_t n );
+			
+			void put_digits( const char* begin, const char* end, int precision );
+			
+			void put_decimal( unsigned long x, int precision );
+			void put_hex    ( unsigned long x, int precision );
+	};
+	
+	void formatter::put( const char* p, size_t n )
+	{
+		if ( n > size_t( its_buffer + sizeof its_buffer - its_mark ) )
+		{
+			flush();
+			
+			if ( n > sizeof its_buffer )
+			{
+				its_output.append( p, n );
+				
+				return;
+			}
+		}
+		
+		memcpy( its_mark, p, n );
+		
+		its_mark += n;
+	}
+	
+	void formatter::put_digits( const char* begin, const char* end, int precision )
+	{
+		for ( int n = precision - (end - begin);  n > 0;  --n )
+		{
+			put( '0' );
+		}
+		
+		put( begin, end - begin );
+	}
+	
+	void formatter::put_decimal( unsigned long x, int precision )
+	{
+		char buffer[ 24 ];
+		
+		char* end = buffer + sizeof buffer;
+		char* p   = end;
+		
+		for ( ;  x != 0;  x /= 10 )
+		{
+			*--p = '0' + x % 10;
+		}
+		
+		put_digits( p, end, precision );
+	}
+	
+	void formatter::put_hex( unsigned long x, int precision )
+	{
+		char buffer[ 24 ];
+		
+		char* end = buffer + sizeof buffer;
+		char* p   = end;
+		
+		for ( ;  x != 0;  x >>= 4 )
+		{
+			*--p = "0123456789abcdef"[ x & 0xf ];
+		}
+		
+		put_digits( p, end, precision );
+	}
+	
+	void decoder::print( const char* format, ... )
+	{
+		if ( its_quiet )
+		{
+			return;
+		}
+		
+		formatter f( its_output );
+		
+		va_list args;
+		
+		va_start( args, format );
+		
+		while ( const char* percent = strchr( format, '%' ) )
+		{
+			f.put( format, percent - format );
+			
+			const char* p = percent + 1;
+			
+			bool alternate = false;
+			bool plus_sign = false;
+			
+			for ( ;;  ++p )
+			{
+				if ( *p == '#' )
+				{
+					alternate = true;
+				}
+				else if ( *p == '+' )
+				{
+					plus_sign = true;
+				}
+				else
+				{
+					break;
+				}
+			}
+			
+			int precision = 1;
+			
+			if ( *p == '.' )
+			{
+				precision = 0;
+				
+				while ( isdigit( *++p ) )
+				{
+					precision = precision * 10 + *p - '0';
+				}
+			}
+			
+			switch ( *p++ )
+			{
+				case 's':
+					{
+						const char* string = va_arg( args, const char* );
+						
+						if ( string == NULL )
+						{
+							string = "(null)";
+						}
+						
+						f.put( string, strlen( string ) );
+					}
+					
+					break;
+				
+				case 'c':
+					f.put( char( va_arg( args, int ) ) );
+					break;
+				
+				case 'd':
+					{
+						const int x = va_arg( args, int );
+						
+						if ( x < 0 )
+						{
+							f.put( '-' );
+						}
+						else if ( plus_sign )
+						{
+							f.put( '+' );
+						}
+						
+						f.put_decimal( x < 0 ? 0ul - x : x, precision );
+					}
+					
+					break;
+				
+				case 'x':
+					{
+						const unsigned x = va_arg( args, unsigned );
+						
+						if ( alternate  &&  x != 0 )
+						{
+							f.put( STR_LEN( "0x" ) );
+						}
+						
+						f.put_hex( x, precision );
+					}
+					
+					break;
+				
+				default:
+					f.put( '%' );
+					break;
+			}
+			
+			format = p;
+		}
+		
+		f.put( format, strlen( format ) );
+		
+		va_end( args );
+	}
+	
+	const char* decoder::get_aTrap_name( unsigned short trap_word ) const
+	{
+		return its_trap_names ? its_trap_names( trap_word ) : NULL;
+	}
+	
+	
+	void decoder::add_branch_target( size_t address )
+	{
+		typedef std::vector< size_t >::iterator iterator;
+		
+		const iterator it = std::lower_bound( its_branch_targets.begin(),
+		                                      its_branch_targets.end(),
+		                                      address );
+		
+		const bool found = it != its_branch_targets.end()  &&  *it == address;
+		
+		if ( !found )
+		{
+			its_branch_targets.insert( it, address );
+		}
+	}
+	
+	bool decoder::check_branch_target( size_t address )
+	{
+		typedef std::vector< size_t >::iterator iterator;
+		
+		const iterator it = std::lower_bound( its_branch_targets.begin(),
+		                                      its_branch_targets.end(),
+		                                      address );
+		
+		const bool found = it != its_branch_targets.end()  &&  *it == address;
+		
+		its_branch_targets.erase( its_branch_targets.begin(), it );
+		
+		return found;
+	}
+	
+	unsigned short decoder::read_word( bool peeking )
+	{
+		if ( its_size - its_bytes_read < sizeof (unsigned short) )
+		{
+			// An odd last byte is dropped.
+			
+			throw end_of_file();
+		}
+		
+		uint16_t word;
+		
+		memcpy( &word, its_image + its_bytes_read, sizeof word );
+		
+		const unsigned short result = v68k::word_from_big( word );
+		
+		if ( !peeking )
+		{
+			its_bytes_read += sizeof (unsigned short);
+			
+			if ( !its_at_indexed_jump )
+			{
+				if ( result == indexed_jump_code[ its_indexed_jump_state ] )
+				{
+					if ( ++its_indexed_jump_state == sizeof indexed_jump_code / sizeof indexed_jump_code[0] )
+					{
+						its_at_indexed_jump = true;
+						
+						its_indexed_jump_state = 0;
+					}
+				}
+				else
+				{
+					its_indexed_jump_state = 0;
+				}
+			}
+			
+			if ( its_lswtch_offset == 0 )
+			{
+				if ( const bool match = result == lswtch_code[ its_lswtch_state ] )
+				{
+					if ( ++its_lswtch_state == sizeof lswtch_code / sizeof lswtch_code[0] )
+					{
+						its_lswtch_offset = its_bytes_read - sizeof lswtch_code;
+					}
+				}
+				else
+				{
+					its_lswtch_state = 0;
+				}
+			}
+		}
+		
+		return result;
+	}
+	
+	unsigned short decoder::peek_word()
+	{
+		return read_word( true );
+	}
+	
+	short decoder::read_word_signed()
+	{
+		return read_word();
+	}
+	
+	unsigned int decoder::read_long()
+	{
+		const unsigned int high = read_word();
+		const unsigned int low  = read_word();
+		
+		return high << 16 | low;
+	}
+	
+	
+	static void set_register_name( char* name, short mode, short n )
+	{
+		name[0] = mode == 0 ? 'D' : 'A';
+		name[1] = '0' + n;
+	}
+	
+	int decoder::read_extended_displacement( unsigned short size_code )
+	{
+		switch ( size_code )
+		{
+			case 1:
+				return 0;
+			
+			case 2:
+				return read_word_signed();
+			
+			case 3:
+				return read_long();
+		}
+		
+		// Error if reached
+		return 0;
+	}
+	
+	plus::string decoder::read_ea( short mode_reg, short immediate_size )
+	{
+		const short mode = mode_reg >> 3;
+		
+		const short reg = mode_reg & 0x7;
+		
+		char reg_name[3] = "PC";
+		
+		if ( mode != 7 )
+		{
+			set_register_name( reg_name, mode, reg );
+		}
+		
+		if ( mode <= 1 )
+		{
+			// Data Register Direct
+			// Address Register Direct
+			
+			return reg_name;
+		}
+		
+		plus::var_string result;
+		
+		if ( mode <= 4 )
+		{
+			// Address Register Indirect
+			// Address Register Indirect with Postincrement
+			// Address Register Indirect with Predecrement
+			
+			if ( mode == 4 )
+			{
+				result += "-";
+			}
+			
+			result += "(";
+			result += reg_name;
+			result += ")";
+			
+			if ( mode == 3 )
+			{
+				result += "+";
+			}
+			
+			return result;
+		}
+		
+		unsigned short extension = read_word();
+		
+		if ( mode == 5  ||  mode == 7 && reg == 2 )
+		{
+			// Address Register Indirect with Displacement
+			// Program Counter Indirect with Displacement
+			
+			const short displacement = extension;
+			
+			if ( const bool pc_relative = mode == 7  &&  immediate_size == 0 )
+			{
+				result += '*';
+				
+				append_signed_decimal( result, displacement );
+				
+				its_last_pc_relative_target = its_pc + displacement;
+			}
+			else
+			{
+				result += "(";
+				
+				if ( displacement )
+				{
+					append_decimal( result, displacement );
+					
+					result += ",";
+				}
+				
+				result += reg_name;
+				result += ")";
+			}
+		}
+		else if ( mode == 6  ||  mode == 7 && reg == 3 )
+		{
+			// Address Register Indirect with Index (8-bit Displacement)
+			// Address Register Indirect with Index (Base Displacement)
+			// Memory Indirect Postindexed
+			// Memory Indirect Preindexed
+			
+			// Program Counter Indirect with Index (8-bit Displacement)
+			// Program Counter Indirect with Index (Base Displacement)
+			// Program Counter Memory Indirect Postindexed
+			// Program Counter Memory Indirect Preindexed
+			
+			const short index_reg = extension >> 12;
+			
+			char index_reg_name[3] = "Rn";
+			
+			set_register_name( index_reg_name, index_reg & 0x8, index_reg & 0x7 );
+			
+			const bool full_format = extension & 0x0100;
+			
+			const bool base_suppress  = full_format * extension & 0x80;
+			const bool index_suppress = full_format * extension & 0x40;
+			
+			const int base_displacement = full_format ? read_extended_displacement( extension >> 4 & 0x3 )
+			                                          : sign_extend_char( extension & 0xff );
+			
+			const int iis = full_format * extension & 0x7;
+			
+			const bool memory_indirect = iis != 0;
+			
+			result += "(";
+			
+			if ( memory_indirect )
+			{
+				result += "[";
+			}
+			
+			bool needs_comma = false;
+			
+			if ( base_displacement )
+			{
+				append_decimal( result, base_displacement );
+				
+				needs_comma = true;
+			}
+			
+			if ( !base_suppress )
+			{
+				if ( needs_comma )
+				{
+					result += ",";
+				}
+				
+				needs_comma = true;
+				
+				result += reg_name;
+			}
+			
+			const bool postindexed = iis & 0x4;
+			
+			if ( postindexed )
+			{
+				if ( !base_displacement  &&  base_suppress )
+				{
+					result += "0";
+					
+					needs_comma = true;
+				}
+				
+				result += "]";
+			}
+			
+			if ( !index_suppress )
+			{
+				if ( needs_comma )
+				{
+					result += ",";
+				}
+				
+				const int index_width = extension >> 11 & 0x1;
+				
+				const char *widths = "WL";
+				
+				const int scale_bits = extension >> 9 & 0x3;
+				
+				result += index_reg_name;
+				result += ".";
+				result += widths[ index_width ];
+				
+				if ( scale_bits )
+				{
+					const int scale = 1 << scale_bits;
+					
+					result += "*";
+					result += '0' + scale;
+				}
+				
+				needs_comma = true;
+			}
+			
+			if ( memory_indirect  &&  index_suppress  &&  !postindexed )
+			{
+				result += "]";
+			}
+			
+			const int outer_displacement = full_format ? read_extended_displacement( iis & 0x3 )
+			                                           : 0;
+			
+			if ( outer_displacement )
+			{
+				result += "," "0x";
+				append_hex( result, outer_displacement, 2 );
+			}
+			
+			result += ")";
+		}
+		else if ( mode == 7 )
+		{
+			// Absolute Short Address
+			// Absolute Long Address
+			// Immediate
+			
+			switch ( reg )
+			{
+				case 0:
+				case 1:
+					immediate_size = reg + 1 << 1;
+					
+					break;
+				
+				case 4:
+					result += "#";
+					
+					break;
+				
+				default:
+					throw illegal_operand();
+					break;
+			}
+			
+			unsigned& marker = reg <= 1 ? its_last_absolute_addr_from_ea
+			                            : its_last_immediate_data_from_ea;
+			
+			result += "0x";
+			
+			const unsigned data = immediate_size == 1 ? extension & 0xff
+			                    : immediate_size == 2 ? extension
+			                    :                       extension << 16 | read_word();
+			
+			marker = data;
+			
+			append_hex( result, data, immediate_size );
+		}
+		
+		return result;
+	}
+	
+	
+	void decoder::decode_default( unsigned short op )
+	{
+		print( "%#.4x\n", op );
+	}
+	
+	
+	static const char* immediate_ops[] =
+	{
+		"ORI",
+		"ANDI",
+		"SUBI",
+		"ADDI",
+		NULL,
+		"EORI",
+		"CMPI",
+		NULL
+	};
+	
+#pragma mark -
+#pragma mark ** Line 0 **
+	
+	void decoder::decode_compare( unsigned short op )
+	{
+		const bool compare_and_swap = op & 0x0800;
+		
+		const short size_index = (op >> 9 & 0x3) - compare_and_swap;
+		
+		if ( unsigned( size_index & 0x3 ) == 0x3 )
+		{
+			throw illegal_instruction();
+		}
+		
+		const short mode_reg = op & 0x3f;
+		
+		const bool is_cas2 = mode_reg == 0x3c;
+		
+		const unsigned short ext1 =           read_word();
+		const unsigned short ext2 = is_cas2 ? read_word() : 0;
+		
+		const bool is_chk2 = ext1 & 0x0800;
+		
+		const char* op_name = compare_and_swap ? is_cas2 ? "CAS2"
+		                                                 : "CAS "
+		                                       : is_chk2 ? "CHK2"
+		                                                 : "CMP2";
+		
+		print( "%s     ...\n", op_name );
+	}
+	
+	void decoder::decode_Immediate( unsigned short op )
+	{
+		const short size_index = op >> 6 & 0x3;
+		
+		if ( size_index == 3 )
+		{
+			decode_compare( op );
+			
+			return;
+		}
+		
+		const char* format = "%s%s%s#%#x,%s" "\n";
+		
+		const char* name = immediate_ops[ op >> 9 & 0x7 ];
+		
+		if ( op & 0x0100  ||  name == NULL )
+		{
+			throw illegal_instruction();
+		}
+		
+		const char* space = "      ";
+		
+		if ( name[ STRLEN( "AND" ) ] == 'I' )
+		{
+			++space;
+		}
+		
+		const short immediate_size = sizes[ size_index ];
+		
+		const short mode_reg = op & 0x3f;
+		
+		unsigned immediate_data = read_word();
+		
+		if ( mode_reg == 0x3c )
+		{
+			print( format, name, "", space, immediate_data, size_index ? "SR" : "CCR" );
+		}
+		else
+		{
+			const char qualifier[] = { '.', size_codes[ size_index ], '\0' };
+			
+			space += 2;
+			
+			if ( size_index == 2 )
+			{
+				immediate_data = immediate_data << 16 | read_word();
+			}
+			
+			if ( (op >> 9 & 0x7) == 6 )
+			{
+				// needed for index jumps
+				its_last_CMPI_operand = immediate_data;
+			}
+			
+			const plus::string ea = read_ea( mode_reg, immediate_size );
+			
+			print( format, name, qualifier, space, immediate_data, ea.c_str() );
+		}
+	}
+	
+	void decoder::decode_Bit_op( unsigned short op, bool dynamic )
+	{
+		char dynamic_format[] = "Bfoo     D%d,%s"  "\n";
+		char static_format [] = "Bfoo     #%#x,%s" "\n";
+		
+		char* format = dynamic ? dynamic_format
+		                       : static_format;
+		
+		const char* name = bit_ops[ op >> 6 & 0x3 ];
+		
+		const size_t name_len = STRLEN( "foo" );
+		
+		memcpy( format + STRLEN( "B" ), name, name_len );
+		
+		const short mode_reg = op & 0x3f;
+		
+		const int data = dynamic ? op >> 9       // data register
+		                         : read_word();  // immediate data
+		
+		const short immediate_size = 1;
+		
+		const plus::string ea = read_ea( mode_reg, immediate_size );
+		
+		print( format, data, ea.c_str() );
+	}
+	
+#pragma mark -
+#pragma mark ** Line 1-3 **
+	
+	void decoder::decode_MOVE( unsigned short op, short size_index )
+	{
+		const short immediate_size = sizes[ size_index ];
+		
+		const short source_mode_reg = op & 0x3f;
+		
+		const short dest_mode_reg = (op >> 3 & 0x38) | (op >> 9 & 0x07);
+		
+		plus::var_string comment;
+		
+		if ( immediate_size == 2  &&  dest_mode_reg == 0  &&  source_mode_reg == 0x3c )
+		{
+			const unsigned short data = peek_word();
+			
+			if ( (data & 0xf000) == 0xa000 )
+			{
+				if ( const char* name = get_aTrap_name( data ) )
+				{
+					comment = COMMENT;
+					
+					comment += name;
+				}
+			}
+		}
+		
+		const plus::string source = read_ea( source_mode_reg, immediate_size );
+		
+		if ( immediate_size == 4  &&  source_mode_reg == 0x3c )
+		{
+			const unsigned data = its_last_immediate_data_from_ea;
+			
+			if (     isprint( data >> 24        )
+			     &&  isprint( data >> 16 & 0xff )
+			     &&         ( data >>  8 & 0xff ) >= ' '
+			     &&         ( data       & 0xff ) >= ' ' )
+			{
+				comment = COMMENT;
+				
+				const char osType[] =
+				{
+					'\'',
+					data >> 24,
+					data >> 16 & 0xff,
+					data >>  8 & 0xff,
+					data       & 0xff,
+					'\'',
+					'\0'
+				};
+				
+				comment += osType;
+			}
+		}
+		
+		const plus::string dest = read_ea( dest_mode_reg, immediate_size );
+		
+		const bool address = (dest_mode_reg >> 3) == 1;
+		
+		const char* format = address ? "MOVEA.%c  %s,%s%s" "\n"
+		                             : "MOVE.%c   %s,%s%s" "\n";
+		
+		print( format, size_codes[ size_index ], source.c_str(),
+		                                          dest.c_str(),
+		                                          comment.c_str() );
+	}
+	
+#pragma mark -
+#pragma mark ** Line 4 **
+	
+	static const str_len unary_ops[] =
+	{
+		{ STR_LEN( "NEGX" ) },
+		{ STR_LEN( "CLR"  ) },
+		{ STR_LEN( "NEG"  ) },
+		{ STR_LEN( "NOT"  ) },
+		{ STR_LEN( ""     ) },
+		{ STR_LEN( "TST"  ) },
+		{ STR_LEN( ""     ) },
+		{ STR_LEN( ""     ) }
+	};
+	
+	void decoder::decode_unary( unsigned short op )
+	{
+		const short size_index = op >> 6 & 0x3;
+		
+		if ( size_index == 3 )
+		{
+			throw illegal_instruction();
+		}
+		
+		char format[] = "%s.%c    %s" "\n";
+		
+		const str_len name = unary_ops[ op >> 9 & 0x7 ];
+		
+		if ( op & 0x0100  ||  name.length == 0 )
+		{
+			throw illegal_instruction();
+		}
+		
+		const short immediate_size = sizes[ size_index ];
+		
+		const plus::string ea = read_ea( op & 0x3f, immediate_size );
+		
+		print( format, name.string, size_codes[ size_index ], ea.c_str() );
+	}
+	
+	static const char* move_ccr_sr[] =
+	{
+		"MOVE     SR,%s"  "\n",
+		"MOVE     CCR,%s" "\n",
+		"MOVE     %s,CCR" "\n",
+		"MOVE     %s,SR"  "\n"
+	};
+	
+	void decoder::decode_4_line_special( unsigned short op )
+	{
+		if ( op == 0x4afc )
+		{
+			print( "%s" "\n", "ILLEGAL" );
+			
+			return;
+		}
+		
+		const bool tas = op & 0x0f00 == 0x0a00;
+		
+		const unsigned short immediate_size = tas ? 1 : 2;
+		
+		const plus::string ea = read_ea( op & 0x3f, immediate_size );
+		
+		const char* format = tas ? "TAS.B    %s" "\n"
+		                         : move_ccr_sr[ op >> 9 & 0x3 ];
+		
+		print( format, ea.c_str() );
+	}
+	
+	bool decoder::jump_breaks_routine( unsigned short mode_reg )
+	{
+		// Whether a jump marks the end of routine:
+		// * only JMP breaks a routine, not JSR
+		// * source == 0x3b is used for machine-specific branching, not a break
+		// * a jump followed by the last branch target's entry point is not a break
+		
+		if ( mode_reg == 0x3b )
+		{
+			return false;
+		}
+		
+		const bool resumes =  its_bytes_read == its_last_branch_target;
+		
+		return !resumes;
+	}
+	
+	void decoder::print_comment( unsigned long pc_relative_target )
+	{
+		print( COMMENT "%#.6x", pc_relative_target );
+	}
+	
+	void decoder::decode_jump_table()
+	{
+		print( "; indexed jump table\n" );
+		
+		const size_t jump_table = its_bytes_read;
+		
+		int n_jumps = its_last_CMPI_operand;
+		
+		while ( n_jumps-- >= 0 )
+		{
+			print( "; goto $%.6x\n", jump_table + read_word() );
+		}
+	}
+	
+	void decoder::decode_switch_table()
+	{
+		print( "; __lswtch__ table\n" );
+		
+		const size_t table_start = its_bytes_read;
+		
+		const size_t default_case = table_start + read_word();
+		
+		print( "; default:  goto $%.6x\n", default_case );
+		
+		const unsigned min = read_long();
+		
+		print( "; min: %#x, %d\n", min, min );
+		
+		const unsigned max = read_long();
+		
+		print( "; max: %#x, %d\n", max, max );
+		
+		int n = read_word();
+		
+		while ( n-- >= 0 )
+		{
+			const unsigned value = read_long();
+			
+			size_t target = its_bytes_read;
+			
+			const unsigned short offset = read_word();
+			
+			target += offset;
+			
+			print( "; case %#x, %d:  goto $%.6x\n", value, value, target );
+		}
+	}
+	
+	void decoder::decode_Jump( unsigned short op )
+	{
+		const unsigned short source = op & 0x3f;
+		
+		const bool jump = op & 0x0040;
+		
+		const char* format = "%s      %s";
+		
+		const char* op_name = jump ? "JMP" : "JSR";
+		
+		const plus::string ea = read_ea( source, 0 );
+		
+		print( format, op_name, ea.c_str() );
+		
+		if ( globally_attach_target_comments  &&  source == 0x3a )
+		{
+			print_comment( its_last_pc_relative_target );
+		}
+		
+		const char* newlines = "\n\n";
+		
+		const bool breaks = jump  &&  jump_breaks_routine( source );
+		
+		if ( !breaks )
+		{
+			++newlines;
+		}
+		
+		print( newlines );
+		
+		if ( jump )
+		{
+			if ( its_at_indexed_jump )
+			{
+				const bool fpu_selector = its_last_op == 0xc0fc;
+				
+				if ( !fpu_selector )
+				{
+					decode_jump_table();
+				}
+				
+				its_at_indexed_jump = false;
+			}
+			else
+			{
+				its_successor_of_last_exit = its_bytes_read;
+			}
+		}
+		else if ( its_lswtch_offset  &&  its_last_absolute_addr_from_ea == its_lswtch_offset )
+		{
+			decode_switch_table();
+		}
+	}
+	
+	static const char *const swap_ext[] =
+	{
+		"",
+		"SWAP ",
+		"EXT.W",
+		"EXT.L"
+	};
+	
+	static const char *const ops_4e7x[] =
+	{
+		"RESET" "\n",
+		"NOP" "\n",
+		"STOP     #%#x" "\n",
+		"RTE" "\n",
+		"RTD      #%d"  "\n",
+		"RTS" "\n",
+		"TRAPV" "\n",
+		"RTR" "\n"
+	};
+	
+	static char* get_register_sequence( char* buffer, unsigned short mask, char c )
+	{
+		char* p = buffer;
+		
+		int first_in_run = -1;
+		int last_set     = -1;
+		
+		for ( int i = 0;  i <= 8;  ++i, mask >>= 1 )
+		{
+			if ( mask & 1 )
+			{
+				// This register's bit is set in the mask
+				
+				const bool first = last_set < 0;
+				
+				const bool consecutive = !first  &&  last_set == i - 1;
+				
+				if ( consecutive  &&  last_set == first_in_run )
+				{
+					*p++ = '-';
+				}
+				
+				if ( !consecutive )
+				{
+					if ( !first )
+					{
+						*p++ = '/';
+					}
+					
+					*p++ = c;
+					*p++ = '0' + i;
+					
+					first_in_run = i;
+				}
+				
+				last_set = i;
+			}
+			else if ( first_in_run >= 0  &&  last_set > first_in_run )
+			{
+				*p++ = c;
+				*p++ = '0' + last_set;
+				
+				first_in_run = -1;
+			}
+			
+			if ( mask == 0 )
+			{
+				break;
+			}
+		}
+		
+		*p = '\0';
+		
+		return p;
+	}
+	
+	static char* get_register_set( char* buffer, unsigned short mask, bool reverse )
+	{
+		if ( reverse )
+		{
+			mask = mask << 15
+			     | mask << 13 & 0x4000
+			     | mask << 11 & 0x2000
+			     | mask <<  9 & 0x1000
+			     | mask <<  7 & 0x0800
+			     | mask <<  5 & 0x0400
+			     | mask <<  3 & 0x0200
+			     | mask <<  1 & 0x0100
+			     | mask >>  1 & 0x0080
+			     | mask >>  3 & 0x0040
+			     | mask >>  5 & 0x0020
+			     | mask >>  7 & 0x0010
+			     | mask >>  9 & 0x0008
+			     | mask >> 11 & 0x0004
+			     | mask >> 13 & 0x0002
+			     | mask >> 15;
+		}
+		
+		const unsigned short low  = mask & 0xff;
+		const unsigned short high = mask >>   8;
+		
+		char *p = buffer;
+		
+		p = get_register_sequence( p, low,  'D' );
+		
+		if ( !low == !high )
+		{
+			*p++ = '/';
+		}
+		
+		p = get_register_sequence( p, high, 'A' );
+		
+		return p;
+	}
+	
+	void decoder::decode_long_mul_div( unsigned short op )
+	{
+		const unsigned short extension = read_word();
+		
+		const bool division = op & 0x0040;
+		
+		const bool is_signed = extension & 0x0800;
+		const bool is_64_bit = extension & 0x0400;
+		
+		const char* qualifier = division && !is_64_bit ? "L.L" : ".L ";
+		
+		const unsigned short mode_reg = op & 0x3f;
+		
+		const unsigned short d_base = extension >> 24 & 0x7;
+		const unsigned short d_more = extension       & 0x7;
+		
+		const plus::string ea = read_ea( mode_reg, 4 );
+		
+		char other_reg_name[] = "Dm:";
+		
+		other_reg_name[ 1 ] = '0' + d_more;
+		
+		const char* extra = is_64_bit  ||  d_more != d_base ? other_reg_name
+		                                                    : "";
+		
+		const char* basename = division ? "DIV" : "MUL";
+		
+		char sign = is_signed ? 'S' : 'U';
+		
+		const char* format = "%s%c%s  %s,%sD%c" "\n";
+		
+		print( format, basename, sign, qualifier, ea.c_str(), extra, '0' + d_base );
+	}
+	
+	void decoder::decode_MOVEM( unsigned short op )
+	{
+		const bool restore = op & 0x0400;
+		const bool longs   = op & 0x0040;
+		
+		const unsigned short mode_reg = op & 0x3f;
+		
+		const bool reversed = !restore  &&  (mode_reg >> 3) == 4;
+		
+		const short size_index = longs + 1;
+		
+		const unsigned short mask = read_word();
+		
+		const size_t buffer_size = 16 * 3;  // 3 bytes per register max
+		
+		char buffer[ buffer_size ];
+		
+		char* end = get_register_set( buffer, mask, reversed );
+		
+		const char size_code = size_codes[ size_index ];
+		
+		const char* format = "MOVEM.%c  %s,%s" "\n";
+		
+		const plus::string ea = read_ea( mode_reg, sizes[ size_index ] );
+		
+		const char* source =  restore ? ea.c_str() : buffer;
+		const char* dest   = !restore ? ea.c_str() : buffer;
+		
+		print( format, size_code, source, dest );
+	}
+	
+	static const char* const control_registers_000[] =
+	{
+		"SFC",
+		"DFC",
+		"CACR",
+		"TC",    // 68040
+		"ITT0",  // 68040
+		"ITT1",  // 68040
+		"DTT0",  // 68040
+		"DTT1"   // 68040
+	};
+	
+	static const char* const control_registers_800[] =
+	{
+		"USP",
+		"VBR",
+		"CAAR",   // 68020, 68030
+		"MSP",
+		"ISP",
+		"MMUSR",  // 68040
+		"URP",    // 68040
+		"SRP"     // 68040
+	};
+	
+	void decoder::decode_MOVEC( unsigned short op )
+	{
+		const bool to = op & 0x0001;
+		
+		const unsigned short extension = read_word();
+		
+		const char bank = extension & 0x8000 ? 'A' : 'D';
+		
+		const unsigned short reg = extension >> 12 & 0x7;
+		
+		const unsigned short control = extension & 0x0FFF;
+		
+		if ( control & ~0x0807 )
+		{
+			throw illegal_instruction();
+		}
+		
+		const char* const* register_set = control & 0x0800 ? control_registers_800
+		                                                   : control_registers_000;
+		
+		const char* control_register_name = register_set[ control & 0x7 ];
+		
+		if ( to )
+		{
+			print( "MOVEC    %c%d,%s" "\n", bank, reg, control_register_name );
+		}
+		else
+		{
+			print( "MOVEC    %s,%c%d" "\n", control_register_name, bank, reg );
+		}
+	}
+	
+	void decoder::decode_4e_misc( unsigned short op )
+	{
+		switch ( op & 0x0038 )
+		{
+			case 0x00:
+			case 0x08:
+				print( "TRAP     #%#x" "\n", op & 0xf );
+				break;
+			
+			case 0x10:
+				print( "LINK     A%d,#%d" "\n", op & 0x7, read_word_signed() );
+				break;
+			
+			case 0x18:
+				print( "UNLK     A%d" "\n", op & 0x7 );
+				break;
+			
+			case 0x20:
+				print( "MOVE     A%d,USP" "\n", op & 0x7 );
+				break;
+			
+			case 0x28:
+				print( "MOVE     USP,A%d" "\n", op & 0x7 );
+				break;
+			
+			case 0x30:
+				const char* name;
+				
+				int arg;
+				
+				name = ops_4e7x[ op & 0x7 ];
+				
+				switch ( op & 0x7 )
+				{
+					case 2:  // STOP
+					case 4:  // RTD
+						arg = read_word_signed();
+						break;
+				}
+				
+				print( name, arg );
+				
+				switch ( op & 0x7 )
+				{
+					case 5:  // RTS
+						if ( check_branch_target( its_bytes_read ) )
+						{
+							// Don't insert a newline if the next instruction is
+							// a branch target
+							break;
+						}
+						
+						// fall through
+					
+					case 3:  // RTE
+					case 4:  // RTD
+					case 7:  // RTR
+						its_successor_of_last_exit = its_bytes_read;
+					
+						print( "\n" );
+						break;
+				}
+				
+				break;
+			
+			case 0x38:
+				if ( (op & 0x000E) == 0x000A )
+				{
+					decode_MOVEC( op );
+					break;
+				}
+				
+			default:
+				decode_default( op );
+				break;
+		}
+	}
+	
+#pragma mark -
+#pragma mark ** High-order **
+	
+	void decoder::decode_data( unsigned short op )
+	{
+		print( "%.6x:  DC.W     %#.4x  ; %d bytes of data\n", its_bytes_read - 2, op, op );
+		
+		int n_words = (op + 1) / 2;
+		
+		while ( --n_words >= 0 )
+		{
+			const size_t bytes_read = its_bytes_read;
+			
+			if ( n_words-- )
+			{
+				print( "%.6x:  DC.L     %#.8x\n", bytes_read, read_long() );
+			}
+			else
+			{
+				print( "%.6x:  DC.W     %#.4x\n", bytes_read, read_word() );
+			}
+		}
+		
+		print( "\n" );
+	}
+	
+	bool decoder::decoded_data( unsigned short op )
+	{
+		switch ( its_last_op )
+		{
+			case 0x4e75:  // RTS
+			case 0xa9f4:  // _ExitToShell
+				if ( op < 256 )
+				{
+					break;
+				}
+				else
+				{
+					// fall through
+				}
+			
+			default:
+				return false;
+		}
+		
+		if ( op == 0  &&  peek_word() == 0 )
+		{
+			(void) read_word();
+			
+			print( "DC.L     0x00000000\n\n" );
+		}
+		else if ( op != 0 )
+		{
+			decode_data( op );
+		}
+		else
+		{
+			return false;
+		}
+		
+		return true;
+	}
+	
+	void decoder::decode_MOVEP( unsigned short op )
+	{
+		const bool store_to_mem = op & 0x80;
+		const bool long_mode    = op & 0x40;
+		
+		const unsigned short data_reg = op >> 9 & 0x7;
+		const unsigned short addr_reg = op >> 0 & 0x7;
+		
+		const unsigned short displacement = read_word();
+		
+		const char register_operand[ STRLEN( "Dx" ) ] = { 'D', '0' + data_reg };
+		
+		plus::var_string memory_operand = "(";
+		
+		append_decimal( memory_operand, displacement );
+		
+		memory_operand += ",A";
+		
+		memory_operand += '0' + addr_reg;
+		
+		memory_operand += ')';
+		
+		plus::var_string out = "MOVEP.";
+		
+		out += size_codes[ long_mode + 1 ];
+		
+		out += "  ";
+		
+		if ( store_to_mem )
+		{
+			out.append( register_operand, sizeof register_operand );
+			
+			out += ',';
+			
+			out += memory_operand;
+		}
+		else
+		{
+			out += memory_operand;
+			
+			out += ',';
+			
+			out.append( register_operand, sizeof register_operand );
+		}
+		
+		print( "%s\n", out.c_str() );
+	}
+	
+	void decoder::decode_MOVES( unsigned short op )
+	{
+		const unsigned short extension = read_word();
+		
+		const unsigned short mode_reg = op & 0x3f;
+		
+		const short size_index = op >> 6 & 0x3;
+		
+		if ( size_index == 3 )
+		{
+			throw illegal_instruction();
+		}
+		
+		const char size_code = size_codes[ size_index ];
+		
+		const char bank = extension & 0x8000 ? 'A' : 'D';
+		
+		const unsigned short reg = extension >> 12 & 0x7;
+		
+		const plus::string ea = read_ea( mode_reg, sizes[ size_index ] );
+		
+		const bool to = extension & 0x0800;
+		
+		if ( to )
+		{
+			print( "MOVES.%c  %c%d,%s\n", size_code, bank, reg, ea.c_str() );
+		}
+		else
+		{
+			print( "MOVES.%c  %s,%c%d\n", size_code, ea.c_str(), bank, reg );
+		}
+	}
+	
+	void decoder::decode_0_line( unsigned short op )
+	{
+		if ( const bool data = decoded_data( op ) )
+		{
+			return;
+		}
+		
+		if ( op & 0x0100 )
+		{
+			if ( (op & 0x0038) == 0x0008 )
+			{
+				decode_MOVEP( op );
+				
+				return;
+			}
+			
+			decode_Bit_op( op, true );  // BTST/BCHG/BCLR/BSET dynamic
+			
+			return;
+		}
+		
+		switch ( op >> 8 & 0xf )
+		{
+			case 0x0:  // ORI
+			case 0x2:  // ANDI
+			case 0x4:  // SUBI
+			case 0x6:  // ADDI
+			case 0xa:  // EORI
+			case 0xc:  // CMPI
+				decode_Immediate( op );  // also CMP2/CHK2/CAS/CAS2
+				break;
+			
+			case 0x8:  // BTST/BCHG/BCLR/BSET static
+				decode_Bit_op( op, false );
+				break;
+			
+			case 0xe:  // MOVES
+				decode_MOVES( op );
+				break;
+			
+			default:
+				decode_default( op );
+				break;
+		};
+	}
+	
+	void decoder::decode_MOVE_Byte( unsigned short op )
+	{
+		decode_MOVE( op, 0 );
+	}
+	
+	void decoder::decode_MOVE_Long( unsigned short op )
+	{
+		decode_MOVE( op, 2 );
+	}
+	
+	void decoder::decode_MOVE_Word( unsigned short op )
+	{
+		decode_MOVE( op, 1 );
+	}
+	
+	void decoder::decode_4_line( unsigned short op )
+	{
+		const unsigned short source = op & 0x3f;
+		
+		if ( (op & 0xfff8) == 0x49c0 )
+		{
+			print( "EXTB.L   D%d" "\n", op & 0x7 );
+			
+			return;
+		}
+		
+		if ( (op & 0x4180) == 0x4180 )
+		{
+			const bool lea = op & 0x0040;
+			
+			const unsigned short immediate_size = lea ? 0 : 2;
+			
+			const char* format = lea ? "LEA      %s,A%d"
+			                         : "CHK.W    %s,D%d";
+			
+			const plus::string ea = read_ea( source, immediate_size );
+			
+			print( format, ea.c_str(), op >> 9 & 0x7 );
+			
+			if ( globally_attach_target_comments  &&  lea  &&  source == 0x3a )
+			{
+				print_comment( its_last_pc_relative_target );
+			}
+			
+			print( "\n" );
+			
+			return;
+		}
+		
+		if ( op & 0x0100 )
+		{
+			reject( "Illegal instruction" );
+			
+			return;
+		}
+		
+		switch ( op >> 8 & 0xf )
+		{
+			case 0x0:  // NEGX
+			case 0x2:  // CLR
+			case 0x4:  // NEG
+			case 0x6:  // NOT
+			case 0xa:  // TST
+				if ( (op & 0x00c0) == 0x00c0 )
+				{
+					decode_4_line_special( op );
+				}
+				else
+				{
+					decode_unary( op );
+				}
+				
+				break;
+			
+			case 0x8:
+				if ( (op & 0x00c0) == 0x0000 )
+				{
+					const plus::string ea = read_ea( source, 1 );
+					
+					print( "NBCD.B   %s" "\n", ea.c_str() );
+					
+					break;
+				}
+				else if ( (op & 0x38) == 0x00 )
+				{
+					// SWAP, EXT.[WL]
+					const char* name = swap_ext[ op >> 6 & 0x3 ];
+					
+					print( "%s    D%d" "\n", name, op & 0x7 );
+					
+					break;
+				}
+				else if ( (op & 0x00c0) == 0x0040 )
+				{
+					if ( const bool is_bkpt = (op & 0xFFF8) == 0x4848 )
+					{
+						// BKPT
+						const unsigned short vector = op & 0x7;
+						
+						print( "BKPT     #%d" "\n", vector );
+						
+						break;
+					}
+					
+					// PEA
+					const plus::string ea = read_ea( source, 0 );
+					
+					print( "PEA      %s" "\n", ea.c_str() );
+					
+					break;
+				}
+				// else fall through
+			case 0xc:
+				
+				if ( (op & 0xff80) == 0x4c00 )
+				{
+					decode_long_mul_div( op );
+				}
+				else if ( (op & 0xfb80) == 0x4880 )
+				{
+					decode_MOVEM( op );
+				}
+				else
+				{
+					throw illegal_instruction();
+				}
+				break;
+			
+			case 0xe:
+				if ( op & 0x0080 )
+				{
+					decode_Jump( op );
+				}
+				else if ( op & 0x0040 )
+				{
+					decode_4e_misc( op );
+				}
+				else
+				{
+					throw illegal_instruction();
+				}
+				
+				break;
+			
+			default:
+				decode_default( op );
+				break;
+		};
+	}
+	
+	static inline unsigned short get_quick_data( unsigned short x )
+	{
+		return (x - 1 & 0x7) + 1;
+	}
+	
+	void decoder::decode_Quick( unsigned short op )
+	{
+		const short size_index = op >> 6 & 0x3;
+		
+		if ( size_index == 3 )
+		{
+			const char* ccode = condition_codes[ op >> 8 & 0xf ];
+			
+			if ( (op & 0x38) == 0x08 )
+			{
+				// DBcc
+				
+				const short displacement = read_word();
+				
+				print( "DB%s     D%d,*%+d", ccode, op & 0x7, displacement );
+				
+				if ( globally_attach_target_comments )
+				{
+					print_comment( its_pc + displacement );
+				}
+				
+				print( "\n" );
+			}
+			else
+			{
+				const plus::string ea = read_ea( op & 0x3f, 1 );
+				
+				print( "S%s.B    %s" "\n", ccode, ea.c_str() );
+			}
+			
+			return;
+		}
+		
+		const unsigned short quick_data = get_quick_data( op >> 9 );
+		
+		const bool subtract = op & 0x0100;
+		
+		const char* name = subtract ? "SUB" : "ADD";
+		
+		const char* format = "%sQ.%c   #%d,%s" "\n";
+		
+		const plus::string ea = read_ea( op & 0x3f, sizes[ size_index ] );
+		
+		print( format, name, size_codes[ size_index ], quick_data, ea.c_str() );
+	}
+	
+	void decoder::decode_Branch( unsigned short op )
+	{
+		const size_t bytes_read = its_bytes_read;
+		
+		const char index = op >> 8 & 0xf;
+		
+		const char* ccode = index == 0 ? "RA"
+		                  : index == 1 ? "SR"
+		                  :              condition_codes[ index ];
+		
+		const unsigned char inline_arg = op & 0xff;
+		
+		const char* qualifier = inline_arg == 0xff ? ".L"
+		                      : inline_arg == 0x00 ? "  "
+		                      :                      ".S";
+		
+		const int arg = inline_arg == 0xff ? read_long()
+		              : inline_arg == 0x00 ? read_word_signed()
+		              :                      sign_extend_char( inline_arg );
+		
+		if ( arg & 1 )
+		{
+			reject( "Illegal operand" );
+			
+			return;
+		}
+		
+		/*
+		const int sign_mask = inline_arg == 0xff ? 0x80000000
+		                    : inline_arg == 0x00 ? 0x8000
+		                    :                      0x80;
+		
+		const bool negative = arg & sign_mask;
+		
+		const char sign = negative ? '-' : '+';
+		*/
+		
+		const size_t target = bytes_read + arg;
+		
+		its_last_branch_target = target;
+		
+		print( "B%s%s    *%+d", ccode, qualifier, arg + 2 );
+		
+		if ( globally_attach_target_comments )
+		{
+			print_comment( target );
+		}
+		
+		print( "\n" );
+		
+		if ( index != 1 )
+		{
+			add_branch_target( target );
+		}
+		
+	}
+	
+	void decoder::decode_MOVEQ( unsigned short op )
+	{
+		if ( op & 0x0100 )
+		{
+			reject( "Illegal instruction" );
+			
+			return;
+		}
+		
+		const signed char inline_arg = op & 0xff;
+		
+		const int arg = inline_arg;
+		
+		const int reg = op >> 9 & 0x7;
+		
+		print( "MOVEQ    #%d,D%d" "\n", arg, reg );
+	}
+	
+	static const char* sbcd_ops[] =
+	{
+		"SBCD.B   D%d,D%d"       "\n",
+		"SBCD.B   -(A%d),-(A%d)" "\n"
+	};
+	
+	void decoder::decode_8_line( unsigned short op )
+	{
+		const unsigned short size_index = op >> 6 & 0x3;
+		
+		const unsigned short reg = op >> 9 & 0x7;
+		
+		if ( size_index == 3 )
+		{
+			const bool signed_math = op & 0x0100;
+			
+			const char sign_code = signed_math ? 'S' : 'U';
+			
+			const plus::string ea = read_ea( op & 0x3f, 2 );
+			
+			print( "DIV%c.W   %s,D%d" "\n", sign_code, ea.c_str(), reg );
+			
+			return;
+		}
+		
+		if ( op & 0x0100 )
+		{
+			unsigned short op_mode = op >> 3 & 0x1f;
+			
+			const char* format = NULL;
+			
+			switch ( op_mode )
+			{
+				case  0:  // SBCD.B
+				case  1:  // SBCD.B
+					format = sbcd_ops[ op_mode ];
+					break;
+				
+				default:
+					break;
+			}
+			
+			if ( format )
+			{
+				print( format, op & 0x7, reg );
+				
+				return;
+			}
+		}
+		
+		const char size_code = size_codes[ size_index ];
+		
+		const plus::string ea = read_ea( op & 0x3f, sizes[ size_index ] );
+		
+		if ( op & 0x0100 )
+		{
+			print( "OR.%c     D%d,%s" "\n", size_code, reg, ea.c_str() );
+		}
+		else
+		{
+			print( "OR.%c     %s,D%d" "\n", size_code, ea.c_str(), reg );
+		}
+	}
+	
+	void decoder::decode_B_line( unsigned short op )
+	{
+		unsigned short size_index = op >> 6 & 0x3;
+		
+		const unsigned short reg = op >> 9 & 0x7;
+		
+		if ( size_index == 3 )
+		{
+			size_index = op & 0x0100 ? 2 : 1;
+		}
+		
+		const char size_code = size_codes[ size_index ];
+		
+		if ( size_index != 3  &&  (op & 0x0138) == 0x0108 )
+		{
+			print( "CMPM.%c   (A%d)+,(A%d)+" "\n", size_code, op & 0x7, reg );
+			
+			return;
+		}
+		
+		const plus::string ea = read_ea( op & 0x3f, sizes[ size_index ] );
+		
+		if ( size_index == 3 )
+		{
+			print( "CMPA.%c   %s,A%d" "\n", size_code, ea.c_str(), reg );
+		}
+		else if ( op & 0x0100 )
+		{
+			print( "EOR.%c    D%d,%s" "\n", size_code, reg, ea.c_str() );
+		}
+		else
+		{
+			print( "CMP.%c    %s,D%d" "\n", size_code, ea.c_str(), reg );
+		}
+	}
+	
+	static const char* exg_abcd_ops[] =
+	{
+		"ABCD.B   D%d,D%d" "\n",
+		"ABCD.B   -(A%d),-(A%d)" "\n",
+		"EXG      D%d,D%d" "\n",
+		"EXG      A%d,A%d" "\n",
+		"",
+		"EXG      D%d,A%d" "\n",
+	};
+	
+	void decoder::decode_C_line( unsigned short op )
+	{
+		const unsigned short size_index = op >> 6 & 0x3;
+		
+		const unsigned short reg = op >> 9 & 0x7;
+		
+		if ( size_index == 3 )
+		{
+			const bool signed_math = op & 0x0100;
+			
+			const char sign_code = signed_math ? 'S' : 'U';
+			
+			const plus::string ea = read_ea( op & 0x3f, 2 );
+			
+			print( "MUL%c.W   %s,D%d" "\n", sign_code, ea.c_str(), reg );
+			
+			return;
+		}
+		
+		if ( op & 0x0100 )
+		{
+			const unsigned short op_mode = op >> 3 & 0x1f;
+			
+			const char* format = NULL;
+			
+			switch ( op_mode )
+			{
+				case  0:  // ABCD.B
+				case  1:  // ABCD.B
+				case  8:  // EXG
+				case  9:  // EXG
+				case 17:  // EXG
+					format = exg_abcd_ops[ op_mode >> 2 | op_mode & 1 ];
+					break;
+				
+				default:
+					break;
+			}
+			
+			if ( format )
+			{
+				if ( op_mode >> 1 )
+				{
+					print( format, reg, op & 0x7 );
+				}
+				else
+				{
+					print( format, op & 0x7, reg );
+				}
+				
+				return;
+			}
+		}
+		
+		const char size_code = size_codes[ size_index ];
+		
+		const plus::string ea = read_ea( op & 0x3f, sizes[ size_index ] );
+		
+		if ( op & 0x0100 )
+		{
+			print( "AND.%c    D%d,%s" "\n", size_code, reg, ea.c_str() );
+		}
+		else
+		{
+			print( "AND.%c    %s,D%d" "\n", size_code, ea.c_str(), reg );
+		}
+	}
+	
+	void decoder::decode_ADD_SUB( unsigned short op )
+	{
+		const bool adding = op & 0x4000;
+		
+		const char* name = adding ? "ADD" : "SUB";
+		
+		const unsigned short reg = op >> 9 & 0x7;
+		
+		unsigned short size_index = op >> 6 & 0x3;
+		
+		const bool adda = size_index == 3;
+		
+		if ( adda )
+		{
+			size_index = (op >> 8 & 0x01) + 1;
+		}
+		
+		const char size_code = size_codes[ size_index ];
+		
+		if ( const bool addx = (op & 0x0130) == 0x0100  &&  !adda )
+		{
+			const char* format = op & 0x08 ? "%sX.%c   -(A%d),-(A%d)" "\n"
+			                               : "%sX.%c   D%d,D%d" "\n";
+			
+			print( format, name, size_code, op & 0x7, reg );
+			
+			return;
+		}
+		
+		const plus::string ea = read_ea( op & 0x3f, sizes[ size_index ] );
+		
+		if ( adda )
+		{
+			const char* format = "%sA.%c   %s,A%d" "\n";
+			
+			print( format, name, size_code, ea.c_str(), reg );
+			
+			return;
+		}
+		
+		if ( const bool reversed = op & 0x0100 )
+		{
+			print( "%s.%c    D%d,%s" "\n", name, size_code, reg, ea.c_str() );
+		}
+		else
+		{
+			print( "%s.%c    %s,D%d" "\n", name, size_code, ea.c_str(), reg );
+		}
+	}
+	
+	void decoder::decode_shift_rotate( unsigned short op )
+	{
+		const short size_index = op >> 6 & 0x3;
+		
+		if ( size_index == 3  &&  op & 0x800 )
+		{
+			reject( "Illegal instruction" );
+			
+			return;
+		}
+		
+		const bool left = op & 0x100;
+		
+		const bool uses_ea = size_index == 3;
+		
+		const short op_index = op >> (uses_ea ? 9 : 3 ) & 0x3;
+		
+		const char* op_name = bit_slide_ops[ op_index ];
+		
+		const char direction = left ? 'L' : 'R';
+		
+		const char* space = "      ";
+		
+		if ( op_index == 2 )
+		{
+			++space;  // ROX
+		}
+		
+		print( "%s%c", op_name, direction );
+		
+		if ( !uses_ea )
+		{
+			print( ".%c", size_codes[ size_index ] );
+			
+			space += 2;
+		}
+		
+		print( "%s", space );
+		
+		if ( uses_ea )
+		{
+			const plus::string ea = read_ea( op & 0x3f, 0 );
+			
+			print( "%s", ea.c_str() );
+		}
+		else
+		{
+			const bool count_in_Dn = op & 0x20;
+			
+			const char* format = count_in_Dn ? "D%d,D%d" : "#%d,D%d";
+			
+			const unsigned short source = op >> 9 & 0x7;
+			
+			const unsigned short count = count_in_Dn ? source : get_quick_data( source );
+			
+			print( format, count, op & 0x7 );
+		}
+		
+		print( "\n" );
+	}
+	
+	void decoder::decode_A_line( unsigned short op )
+	{
+		const char* name = get_aTrap_name( op );
+		
+		if ( name )
+		{
+			print( "%s" "\n", name );
+		}
+		else
+		{
+			decode_default( op );
+		}
+		
+		if ( op == 0xa9f4 )
+		{
+			its_successor_of_last_exit = its_bytes_read;
+		}
+	}
+	
+	void decoder::decode_F_line( unsigned short op )
+	{
+		if ( op == 0xf210 )
+		{
+			const unsigned short extension = read_word();
+			
+			if ( (extension & 0xfc7f) == 0x4800 )
+			{
+				const short fp = extension >> 7 & 0x7;
+				
+				print( "FMOVE.X  (A0),FP%d\n", fp );
+				
+				return;
+			}
+		}
+		
+		decode_default( op );
+	}
+	
+	
+	
+	static const uint32_t name_validity[] =
+	{
+		0,  // no control chars
+		
+		            1 << (' ' & 31) |  // 0x20
+		            1 << ('%' & 31) |  // 0x25
+		            1 << ('.' & 31) |  // 0x2e
+		(1 << 10) - 1 << ('0' & 31),   // 0x30 - 0x39
+		
+		(1 << 26) - 1 << ('A' & 31) |  // 0x41 - 0x5A
+		            1 << ('_' & 31),   // 0x5f
+		
+		(1 << 26) - 1 << ('a' & 31)    // 0x61 - 0x7A
+	};
+	
+	static inline bool valid_name_char( unsigned char c )
+	{
+		return name_validity[ c >> 5 & 0x3 ] & 1 << (c & 0x1f);
+	}
+	
+	const char* decoder::get_name( unsigned short word )
+	{
+		const unsigned short byte_0 = word >> 8;
+		const unsigned short byte_1 = word & 0xff;
+		
+		if ( byte_0 < 0x80 )
+		{
+			return NULL;
+		}
+		
+		char* p = its_name;
+		
+		size_t length = 0;
+		
+		const bool try_fixed = false;
+		
+		if ( const bool is_fixed_length = byte_0 >= (0x80 | 0x20) )
+		{
+			if ( !valid_name_char( byte_0 )  ||  !valid_name_char( byte_1 ) )
+			{
+				return NULL;
+			}
+			
+			const bool is_method = byte_1 & 0x80;
+			
+			*p++ = byte_0 & 0x7f;
+			*p++ = byte_1 & 0x7f;
+			
+			length = 8 + 8 * is_method - 2;
+		}
+		else if ( const size_t length_byte = byte_0 & 0x1f )
+		{
+			if ( !valid_name_char( byte_1 ) )
+			{
+				return NULL;
+			}
+			
+			*p++ = byte_1;
+			
+			length = length_byte - 1;
+		}
+		else
+		{
+			length = byte_1;
+		}
+		
+		(void) read_word();
+		
+		for ( p[ length ] = '\0';  length > 1;  length -= 2 )
+		{
+			const unsigned short pair = read_word();
+			
+			*p++ = pair >> 8;
+			*p++ = pair & 0xff;
+		}
+		
+		if ( length )
+		{
+			*p++ = read_word() >> 8;
+		}
+		
+		return its_name;
+	}
+	
+	const decoder::decode_function decoder::mask_of_4_bits[] =
+	{
+		&decoder::decode_0_line,
+		&decoder::decode_MOVE_Byte,
+		&decoder::decode_MOVE_Long,
+		&decoder::decode_MOVE_Word,
+		&decoder::decode_4_line,
+		&decoder::decode_Quick,
+		&decoder::decode_Branch,
+		&decoder::decode_MOVEQ,
+		&decoder::decode_8_line,
+		&decoder::decode_ADD_SUB,  // SUB
+		&decoder::decode_A_line,
+		&decoder::decode_B_line,
+		&decoder::decode_C_line,
+		&decoder::decode_ADD_SUB,  // ADD
+		&decoder::decode_shift_rotate,
+		&decoder::decode_F_line,
+	};
+	
+	void decoder::decode_one()
+	{
+		if ( its_bytes_read == its_successor_of_last_exit )
+		{
+			// Check for Macsbug symbol names
+			
+			const unsigned short word_0 = peek_word();
+			
+			if ( const char* name = get_name( word_0 ) )
+			{
+				print( "; ^^^ %s\n\n", name );
+				
+				decode_data( read_word() );
+				
+				return;
+			}
+		}
+		
+		if ( globally_prefix_address )
+		{
+			print( "%.6x:  ", its_bytes_read );
+		}
+		
+		const unsigned short word = read_word();
+		
+		its_pc = its_bytes_read;
+		
+		if ( const decode_function decode = mask_of_4_bits[ word >> 12 ] )
+		{
+			try
+			{
+				(this->*decode)( word );
+				
+				if ( const char* rejection = its_rejection )
+				{
+					its_rejection = NULL;
+					
+					print( "%s" "\n", rejection );
+				}
+				else
+				{
+					its_last_op = word;
+					
+					return;
+				}
+			}
+			catch ( const illegal_instruction& )
+			{
+				print( "Illegal instruction" "\n" );
+			}
+			catch ( const illegal_operand& )
+			{
+				print( "Illegal operand" "\n" );
+			}
+		}
+		
+		decode_default( word );
+	}
+	
+	void decoder::skip_resource_header()
+	{
+		const unsigned short  flags   = read_word();
+		const unsigned long   type    = read_long();
+		const unsigned short  id      = read_word();
+		const unsigned short  version = read_word();
+		
+		print( "; Flags:          %d" "\n", flags   );
+		
+		print( "; Resource type:  '%c%c%c%c'" "\n", char( type >> 24 ),
+		                                            char( type >> 16 ),
+		                                            char( type >>  8 ),
+		                                            char( type       ) );
+		
+		print( "; Resource id:    %d" "\n", id      );
+		print( "; Version:        %d" "\n", version );
+	}
+	
+	
+	disassembler::disassembler( const void* image, size_t size, trap_namer names )
+	:
+		its_decoder( new decoder( (const unsigned char*) image, size, names ) )
+	{
+	}
+	
+	disassembler::disassembler( const disassembler& that )
+	:
+		its_decoder( new decoder( *that.its_decoder ) )
+	{
+	}
+	
+	disassembler& disassembler::operator=( const disassembler& that )
+	{
+		if ( &that != this )
+		{
+			*its_decoder = *that.its_decoder;
+		}
+		
+		return *this;
+	}
+	
+	disassembler::~disassembler()
+	{
+		delete its_decoder;
+	}
+	
+	size_t disassembler::position() const
+	{
+		return its_decoder->its_bytes_read;
+	}
+	
+	bool disassembler::at_end() const
+	{
+		return its_decoder->its_at_end;
+	}
+	
+	void disassembler::set_quiet( bool quiet )
+	{
+		its_decoder->its_quiet = quiet;
+	}
+	
+	plus::var_string& disassembler::output()
+	{
+		return its_decoder->its_output;
+	}
+	
+	void disassembler::disassemble( size_t stop )
+	{
+		decoder& d = *its_decoder;
+		
+		if ( d.its_at_end )
+		{
+			return;
+		}
+		
+		try
+		{
+			if ( !d.its_started )
+			{
+				d.its_started = true;
+				
+				d.decode_one();
+				
+				if ( d.its_last_branch_target == 12 )
+				{
+					d.skip_resource_header();
+				}
+			}
+			
+			while ( d.its_bytes_read < stop )
+			{
+				d.decode_one();
+			}
+		}
+		catch ( const end_of_file& )
+		{
+			d.print( "\n" );
+			
+			d.its_at_end = true;
+		}
+	}
+	
+}
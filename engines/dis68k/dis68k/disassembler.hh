@@ -0,0 +1,64 @@
+/*
+	disassembler.hh
+	---------------
+*/
+
+#ifndef DIS68K_DISASSEMBLER_HH
+#define DIS68K_DISASSEMBLER_HH
+
+// Standard C
+#include <stddef.h>
+
+
+namespace plus
+{
+	
+	class var_string;
+	
+}
+
+namespace dis68k
+{
+	
+	typedef const char* (*trap_namer)( unsigned short trap_word );
+	
+	class decoder;
+	
+	/*
+		A disassembler holds all of its decoding state, so a copy taken
+		between calls to disassemble() is a checkpoint:  disassembling from
+		a copy produces the same text that continuing the original would.
+	*/
+	
+	class disassembler
+	{
+		private:
+			decoder* its_decoder;
+		
+		public:
+			disassembler( const void* image, size_t size, trap_namer names = NULL );
+			
+			disassembler( const disassembler& that );
+			
+			disassembler& operator=( const disassembler& that );
+			
+			~disassembler();
+			
+			size_t position() const;
+			
+			bool at_end() const;
+			
+			// Decoding continues, but nothing is appended to the output.
+			
+			void set_quiet( bool quiet );
+			
+			// Decodes whole instructions until reaching stop or the end.
+			
+			void disassemble( size_t stop );
+			
+			plus::var_string& output();
+	};
+	
+}
+
+#endif
@@ -0,0 +1,128 @@
+/*
+	t/dis68k.cc
+	-----------
+*/
+
+// Standard C
+#include <stdlib.h>
+#include <string.h>
+
+// plus
+#include "plus/var_string.hh"
+
+// dis68k
+#include "dis68k/disassembler.hh"
+
+// tap-out
+#include "tap/test.hh"
+
+
+static const unsigned n_tests = 5 + 3;
+
+
+using tap::ok_if;
+
+
+static const char* trap_name( unsigned short trap_word )
+{
+	return trap_word == 0xA9F4 ? "_ExitToShell" : NULL;
+}
+
+static plus::string disassembly( const char* data, size_t size )
+{
+	dis68k::disassembler dis( data, size, &trap_name );
+	
+	dis.disassemble( size_t( -1 ) );
+	
+	return dis.output();
+}
+
+#define DISASSEMBLY( data )  disassembly( data, sizeof data - 1 )
+
+static void instructions()
+{
+	ok_if( DISASSEMBLY( "" ) == "\n", "empty input" );
+	
+	ok_if( DISASSEMBLY( "\x4e\x75" "\x4e" ) == "000000:  RTS\n"
+	                                          "\n"
+	                                          "\n", "odd last byte is dropped" );
+	
+	ok_if( DISASSEMBLY( "\x70\x01" "\x70\xff" ) == "000000:  MOVEQ    #1,D0\n"
+	                                               "000002:  MOVEQ    #-1,D0\n"
+	                                               "000004:  \n" );
+	
+	ok_if( DISASSEMBLY( "\xd1\x81" "\xd3\x48" ) == "000000:  ADDX.L   D1,D0\n"
+	                                               "000002:  ADDX.W   -(A0),-(A1)\n"
+	                                               "000004:  \n" );
+	
+	ok_if( DISASSEMBLY( "\xa9\xf4" ) == "000000:  _ExitToShell\n"
+	                                    "\n", "trap names" );
+}
+
+static char gData[ 64 * 1024 ];
+
+static void fill_data()
+{
+	srand( 1 );
+	
+	for ( unsigned i = 0;  i < sizeof gData;  ++i )
+	{
+		gData[ i ] = rand() >> 4;
+	}
+}
+
+static void checkpoints()
+{
+	const plus::string serial = disassembly( gData, sizeof gData );
+	
+	dis68k::disassembler dis( gData, sizeof gData, &trap_name );
+	
+	dis.set_quiet( true );
+	
+	plus::var_string chunked;
+	
+	size_t quiet_output = 0;
+	
+	while ( !dis.at_end() )
+	{
+		dis68k::disassembler checkpoint = dis;
+		
+		dis.disassemble( dis.position() + 1000 + rand() % 1000 );
+		
+		quiet_output += dis.output().size();
+		
+		checkpoint.set_quiet( false );
+		
+		checkpoint.disassemble( dis.at_end() ? size_t( -1 ) : dis.position() );
+		
+		chunked += checkpoint.output();
+	}
+	
+	ok_if( quiet_output == 0, "quiet decoding has no output" );
+	
+	ok_if( chunked == serial, "chunks from checkpoints match serial output" );
+	
+	dis68k::disassembler a( gData, sizeof gData );
+	
+	a.disassemble( 3000 );
+	
+	dis68k::disassembler b = a;
+	
+	a.disassemble( 6000 );
+	b.disassemble( 6000 );
+	
+	ok_if( a.position() == b.position()  &&  a.output() == b.output(), "copies continue alike" );
+}
+
+int main( int argc, const char *const *argv )
+{
+	tap::start( "dis68k", n_tests );
+	
+	instructions();
+	
+	fill_data();
+	
+	checkpoints();
+	
+	return 0;
+}
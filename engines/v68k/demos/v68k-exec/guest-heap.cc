@@ -0,0 +1,238 @@
+/*
+	guest-heap.cc
+	-------------
+*/
+
+#include "guest-heap.hh"
+
+// v68k
+#include "v68k/endian.hh"
+
+
+#pragma exceptions off
+
+
+const uint32_t header_size = 8;
+const uint32_t granularity = 8;
+
+const uint32_t in_use_flag = 0x80000000;
+
+static uint8_t*  heap_base = 0;  // NULL
+static uint32_t  heap_addr = 0;
+static uint32_t  heap_size = 0;
+
+
+static inline uint32_t get_long( uint32_t offset )
+{
+	return v68k::longword_from_big( *(const uint32_t*) (heap_base + offset) );
+}
+
+static inline void set_long( uint32_t offset, uint32_t x )
+{
+	*(uint32_t*) (heap_base + offset) = v68k::big_longword( x );
+}
+
+// Block headers are at offsets from heap_base; block contents follow them.
+
+static inline uint32_t get_physical( uint32_t offset )  { return get_long( offset     ); }
+static inline uint32_t get_logical ( uint32_t offset )  { return get_long( offset + 4 ); }
+
+static inline void set_physical( uint32_t offset, uint32_t x )  { set_long( offset,     x ); }
+static inline void set_logical ( uint32_t offset, uint32_t x )  { set_long( offset + 4, x ); }
+
+static inline uint32_t rounded_block_size( uint32_t size )
+{
+	return header_size + (size + granularity - 1 & ~(granularity - 1));
+}
+
+/*
+	Headers live in guest memory, so the guest can write anything there.
+	Before a block's size is used, it must be whole granules (at least
+	the header's) and end within the heap.  The caller ensures that the
+	offset is within the heap.
+*/
+
+static inline bool is_valid_block( uint32_t offset, uint32_t physical )
+{
+	const uint32_t size = physical & ~in_use_flag;
+	
+	return size != 0  &&  size % granularity == 0  &&  size <= heap_size - offset;
+}
+
+static uint32_t merge_free_blocks( uint32_t offset, uint32_t physical )
+{
+	uint32_t next;
+	
+	while ( (next = offset + physical) < heap_size )
+	{
+		const uint32_t next_physical = get_physical( next );
+		
+		if ( next_physical & in_use_flag  ||  !is_valid_block( next, next_physical ) )
+		{
+			break;
+		}
+		
+		physical += next_physical;
+	}
+	
+	set_physical( offset, physical );
+	
+	return physical;
+}
+
+// Splits off the free remainder of a block, if it's big enough to use.
+static uint32_t trim_block( uint32_t offset, uint32_t available, uint32_t needed )
+{
+	if ( available - needed < header_size + granularity )
+	{
+		return available;
+	}
+	
+	set_physical( offset + needed, available - needed );
+	
+	return needed;
+}
+
+static uint32_t find_block( uint32_t addr )
+{
+	// Returns the header offset of an allocated block, or heap_size
+	
+	const uint32_t offset = addr - heap_addr - header_size;
+	
+	if ( addr < heap_addr + header_size  ||  offset >= heap_size  ||  offset % granularity != 0 )
+	{
+		return heap_size;
+	}
+	
+	const uint32_t physical = get_physical( offset );
+	
+	if ( !(physical & in_use_flag)  ||  !is_valid_block( offset, physical ) )
+	{
+		return heap_size;
+	}
+	
+	return offset;
+}
+
+void guest_heap_init( uint8_t* host_base, uint32_t guest_addr, uint32_t size )
+{
+	heap_base = host_base;
+	heap_addr = guest_addr;
+	heap_size = size & ~(granularity - 1);
+	
+	set_physical( 0, heap_size );
+}
+
+uint32_t guest_heap_allocate( uint32_t size )
+{
+	if ( size > heap_size )
+	{
+		return 0;
+	}
+	
+	const uint32_t needed = rounded_block_size( size );
+	
+	uint32_t offset = 0;
+	
+	while ( offset < heap_size )
+	{
+		uint32_t physical = get_physical( offset );
+		
+		if ( !is_valid_block( offset, physical ) )
+		{
+			break;  // the guest has trashed the heap
+		}
+		
+		if ( !(physical & in_use_flag) )
+		{
+			physical = merge_free_blocks( offset, physical );
+			
+			if ( physical >= needed )
+			{
+				physical = trim_block( offset, physical, needed );
+				
+				set_physical( offset, physical | in_use_flag );
+				set_logical ( offset, size );
+				
+				return heap_addr + offset + header_size;
+			}
+		}
+		
+		offset += physical & ~in_use_flag;
+	}
+	
+	return 0;
+}
+
+bool guest_heap_dispose( uint32_t addr )
+{
+	const uint32_t offset = find_block( addr );
+	
+	if ( offset == heap_size )
+	{
+		return false;
+	}
+	
+	set_physical( offset, get_physical( offset ) & ~in_use_flag );
+	
+	return true;
+}
+
+int32_t guest_heap_block_size( uint32_t addr )
+{
+	const uint32_t offset = find_block( addr );
+	
+	if ( offset == heap_size )
+	{
+		return -1;
+	}
+	
+	return get_logical( offset );
+}
+
+bool guest_heap_resize( uint32_t addr, uint32_t size )
+{
+	const uint32_t offset = find_block( addr );
+	
+	if ( offset == heap_size  ||  size > heap_size )
+	{
+		return false;
+	}
+	
+	const uint32_t needed = rounded_block_size( size );
+	
+	uint32_t physical = get_physical( offset ) & ~in_use_flag;
+	
+	if ( needed > physical )
+	{
+		const uint32_t next = offset + physical;
+		
+		if ( next >= heap_size )
+		{
+			return false;
+		}
+		
+		const uint32_t next_physical = get_physical( next );
+		
+		if ( next_physical & in_use_flag  ||  !is_valid_block( next, next_physical ) )
+		{
+			return false;
+		}
+		
+		physical += merge_free_blocks( next, next_physical );
+		
+		if ( needed > physical )
+		{
+			set_physical( offset, (next - offset) | in_use_flag );
+			
+			return false;
+		}
+	}
+	
+	physical = trim_block( offset, physical, needed );
+	
+	set_physical( offset, physical | in_use_flag );
+	set_logical ( offset, size );
+	
+	return true;
+}
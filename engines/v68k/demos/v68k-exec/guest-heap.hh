@@ -0,0 +1,35 @@
+/*
+	guest-heap.hh
+	-------------
+*/
+
+#ifndef GUESTHEAP_HH
+#define GUESTHEAP_HH
+
+// C99
+#include <stdint.h>
+
+
+/*
+	A first-fit allocator for a region of guest memory, backing both
+	NewPtr() and mmap().  As in a Mac OS heap, each block is preceded by
+	a header in guest memory (its physical size and in-use flag, then its
+	logical size, both big-endian).  Adjacent free blocks are merged as
+	allocation walks past them.  Addresses are guest addresses, and 0
+	means failure.
+*/
+
+void guest_heap_init( uint8_t* host_base, uint32_t guest_addr, uint32_t size );
+
+uint32_t guest_heap_allocate( uint32_t size );
+
+bool guest_heap_dispose( uint32_t addr );
+
+// Returns -1 if addr isn't an allocated block
+int32_t guest_heap_block_size( uint32_t addr );
+
+// Grows or shrinks a block in place; returns false if it can't grow.
+bool guest_heap_resize( uint32_t addr, uint32_t size );
+
+
+#endif
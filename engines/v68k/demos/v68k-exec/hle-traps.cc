@@ -0,0 +1,276 @@
+/*
+	hle-traps.cc
+	------------
+*/
+
+// Standard C
+#include <string.h>
+
+// POSIX
+#include <sys/time.h>
+
+// v68k-exec
+#include "guest-heap.hh"
+#include "hle-traps.hh"
+
+
+#pragma exceptions off
+
+
+// Mac OS result codes
+const int16_t noErr      =    0;
+const int16_t memFullErr = -108;
+const int16_t memWZErr   = -111;
+
+// Trap word bits
+const uint16_t toolbox_bit = 0x0800;
+const uint16_t clear_bit   = 0x0200;  // e.g. NewPtrClear
+
+const uint16_t supervisor_bit = 0x2000;  // in the SR
+
+
+struct trap_call
+{
+	uint16_t                trap_word;
+	v68k::function_code_t   data_space;  // the caller's
+	uint32_t                caller_sp;
+};
+
+typedef bool (*trap_handler)( v68k::emulator& emu, const trap_call& call );
+
+
+static inline uint32_t read_big_long( const uint8_t* p )
+{
+	return p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+static inline void write_big_long( uint8_t* p, uint32_t x )
+{
+	p[0] = x >> 24;
+	p[1] = x >> 16;
+	p[2] = x >>  8;
+	p[3] = x;
+}
+
+static inline bool set_result( v68k::emulator& emu, int16_t result )
+{
+	emu.regs.d[0] = int32_t( result );
+	
+	return true;
+}
+
+static bool BlockMove( v68k::emulator& emu, const trap_call& call )
+{
+	const uint32_t src   = emu.regs.a[0];
+	const uint32_t dest  = emu.regs.a[1];
+	const uint32_t count = emu.regs.d[0];
+	
+	if ( count != 0 )
+	{
+		const uint8_t* p = emu.mem.translate( src,  count, call.data_space, v68k::mem_read  );
+		uint8_t*       q = emu.mem.translate( dest, count, call.data_space, v68k::mem_write );
+		
+		if ( p == NULL  ||  q == NULL )
+		{
+			return false;
+		}
+		
+		memmove( q, p, count );
+	}
+	
+	return set_result( emu, noErr );
+}
+
+static bool NewPtr( v68k::emulator& emu, const trap_call& call )
+{
+	const int32_t size = emu.regs.d[0];
+	
+	const uint32_t addr = size >= 0 ? guest_heap_allocate( size ) : 0;
+	
+	emu.regs.a[0] = addr;
+	
+	if ( addr == 0 )
+	{
+		return set_result( emu, memFullErr );
+	}
+	
+	if ( call.trap_word & clear_bit )
+	{
+		uint8_t* p = emu.mem.translate( addr, size, call.data_space, v68k::mem_write );
+		
+		if ( p == NULL )
+		{
+			return false;
+		}
+		
+		memset( p, '\0', size );
+	}
+	
+	return set_result( emu, noErr );
+}
+
+static bool DisposePtr( v68k::emulator& emu, const trap_call& call )
+{
+	const bool ok = guest_heap_dispose( emu.regs.a[0] );
+	
+	return set_result( emu, ok ? noErr : memWZErr );
+}
+
+static bool GetPtrSize( v68k::emulator& emu, const trap_call& call )
+{
+	const int32_t size = guest_heap_block_size( emu.regs.a[0] );
+	
+	emu.regs.d[0] = size >= 0 ? size : memWZErr;
+	
+	return true;
+}
+
+static bool SetPtrSize( v68k::emulator& emu, const trap_call& call )
+{
+	const uint32_t addr = emu.regs.a[0];
+	
+	if ( guest_heap_block_size( addr ) < 0 )
+	{
+		return set_result( emu, memWZErr );
+	}
+	
+	const bool ok = guest_heap_resize( addr, emu.regs.d[0] );
+	
+	return set_result( emu, ok ? noErr : memFullErr );
+}
+
+static bool TickCount( v68k::emulator& emu, const trap_call& call )
+{
+	// Pascal-style:  the caller has pushed space for the result.
+	
+	uint8_t* p = emu.mem.translate( call.caller_sp, sizeof (uint32_t), call.data_space, v68k::mem_write );
+	
+	if ( p == NULL )
+	{
+		return false;
+	}
+	
+	timeval tv;
+	
+	gettimeofday( &tv, NULL );
+	
+	const uint32_t ticks = tv.tv_sec * 60 + tv.tv_usec / (1000000 / 60);
+	
+	write_big_long( p, ticks );
+	
+	return true;
+}
+
+struct trap_entry
+{
+	uint16_t      trap_word;
+	trap_handler  handler;
+};
+
+static const trap_entry hle_traps[] =
+{
+	{ 0xA01F, &DisposePtr },
+	{ 0xA020, &SetPtrSize },
+	{ 0xA021, &GetPtrSize },
+	{ 0xA02E, &BlockMove  },
+	{ 0xA11E, &NewPtr     },
+	{ 0xA975, &TickCount  },
+};
+
+/*
+	OS traps are numbered by their low byte (bits 9 and 10 are flags),
+	and Toolbox traps by their low ten bits.
+*/
+
+static trap_handler os_traps     [ 0x100 ];
+static trap_handler toolbox_traps[ 0x400 ];
+
+static void install_hle_traps()
+{
+	const size_t n = sizeof hle_traps / sizeof hle_traps[0];
+	
+	for ( size_t i = 0;  i < n;  ++i )
+	{
+		const uint16_t trap_word = hle_traps[i].trap_word;
+		
+		if ( trap_word & toolbox_bit )
+		{
+			toolbox_traps[ trap_word & 0x03FF ] = hle_traps[i].handler;
+		}
+		else
+		{
+			os_traps[ trap_word & 0x00FF ] = hle_traps[i].handler;
+		}
+	}
+}
+
+static inline trap_handler find_handler( uint16_t trap_word )
+{
+	return trap_word & toolbox_bit ? toolbox_traps[ trap_word & 0x03FF ]
+	                               : os_traps     [ trap_word & 0x00FF ];
+}
+
+bool hle_trap( v68k::emulator& emu )
+{
+	static bool installed = false;
+	
+	if ( !installed )
+	{
+		install_hle_traps();
+		
+		installed = true;
+	}
+	
+	// Format 0 exception frame:  SR, then the PC of the trap word
+	
+	const uint32_t ssp = emu.regs.a[7];
+	
+	uint8_t* frame = emu.mem.translate( ssp, 6, v68k::supervisor_data_space, v68k::mem_write );
+	
+	if ( frame == NULL )
+	{
+		return emu.bus_error();
+	}
+	
+	const uint16_t sr = frame[0] << 8 | frame[1];
+	const uint32_t pc = read_big_long( frame + 2 );
+	
+	const bool supervisor = sr & supervisor_bit;
+	
+	uint16_t trap_word;
+	
+	if ( !emu.mem.get_word( pc, trap_word, supervisor ? v68k::supervisor_program_space
+	                                                  : v68k::user_program_space ) )
+	{
+		return emu.bus_error();
+	}
+	
+	if ( trap_handler handler = find_handler( trap_word ) )
+	{
+		trap_call call;
+		
+		call.trap_word  = trap_word;
+		call.data_space = supervisor ? v68k::supervisor_data_space : v68k::user_data_space;
+		call.caller_sp  = supervisor ? ssp + 6 : emu.regs.alt_sp;
+		
+		if ( !handler( emu, call ) )
+		{
+			return emu.bus_error();
+		}
+		
+		if ( !(trap_word & toolbox_bit) )
+		{
+			// The OS trap dispatcher returns with TST.W D0.
+			
+			const int16_t result = emu.regs.d[0];
+			
+			const uint8_t nz = (result < 0) << 3 | (result == 0) << 2;
+			
+			frame[1] = (frame[1] & ~0x0F) | nz;
+		}
+	}
+	
+	write_big_long( frame + 2, pc + 2 );
+	
+	return true;
+}
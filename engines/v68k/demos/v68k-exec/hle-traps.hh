@@ -0,0 +1,24 @@
+/*
+	hle-traps.hh
+	------------
+*/
+
+#ifndef HLETRAPS_HH
+#define HLETRAPS_HH
+
+// v68k
+#include "v68k/emulator.hh"
+
+
+/*
+	High-level emulation of Mac OS A-line traps.  The Line A exception
+	handler is a breakpoint, at which hle_trap() runs the trap natively if
+	it's in the table (e.g. BlockMove, NewPtr, DisposePtr), and in any case
+	advances the stacked PC past the trap word, so unknown traps are no-ops.
+	Returns false on a bus error.
+*/
+
+bool hle_trap( v68k::emulator& emu );
+
+
+#endif
@@ -6,35 +6,61 @@
 // Standard C
 #include <errno.h>
 #include <stdlib.h>
+#include <string.h>
 
 // POSIX
+#include <fcntl.h>
 #include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
 #include <sys/uio.h>
 
 // v68k
 #include "v68k/endian.hh"
 
 // v68k-exec
+#include "guest-heap.hh"
 #include "syscall-bridge.hh"
 
 
 #pragma exceptions off
 
 
+static inline uint32_t read_big_long( const uint8_t* p )
+{
+	return p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+static inline void write_big_long( uint8_t* p, uint32_t x )
+{
+	p[0] = x >> 24;
+	p[1] = x >> 16;
+	p[2] = x >>  8;
+	p[3] = x;
+}
+
 static bool get_stacked_args( const v68k::emulator& emu, uint32_t* out, int n )
 {
-	uint32_t sp = emu.regs.a[7];
+	// The arguments follow the return address; translate them all at once.
+	
+	const uint32_t args_addr = emu.regs.a[7] + sizeof (uint32_t);
+	
+	const uint8_t* p = emu.mem.translate( args_addr,
+	                                      n * sizeof (uint32_t),
+	                                      emu.data_space(),
+	                                      v68k::mem_read );
+	
+	if ( p == NULL )
+	{
+		return false;
+	}
 	
 	while ( n > 0 )
 	{
-		sp += 4;
+		*out++ = read_big_long( p );
 		
-		if ( !emu.mem.get_long( sp, *out, emu.data_space() ) )
-		{
-			return false;
-		}
+		p += sizeof (uint32_t);
 		
-		++out;
 		--n;
 	}
 	
@@ -223,15 +249,348 @@ end:
 	return set_result( emu, result );
 }
 
+static const uint8_t* get_path( const v68k::emulator& emu, uint32_t addr )
+{
+	// Find the NUL, then make sure the whole string is mapped.
+	
+	const uint32_t max_length = 4096;
+	
+	for ( uint32_t length = 0;  length < max_length;  ++length )
+	{
+		uint8_t c;
+		
+		if ( !emu.mem.get_byte( addr + length, c, emu.data_space() ) )
+		{
+			break;
+		}
+		
+		if ( c == '\0' )
+		{
+			return emu.mem.translate( addr, length + 1, emu.data_space(), v68k::mem_read );
+		}
+	}
+	
+	return NULL;
+}
+
+// Relix's values (as in m68k Linux), which the guest uses
+const int32_t  guest_AT_FDCWD = -100;
+const uint32_t guest_MAP_FIXED = 0x0010;
+const uint32_t guest_MAP_ANON  = 0x1000;
+
+struct open_flag_mapping
+{
+	uint32_t  guest;
+	int       host;
+};
+
+static const open_flag_mapping open_flags[] =
+{
+	{ 0x0004,     O_NONBLOCK  },
+	{ 0x0008,     O_APPEND    },
+	{ 0x0100,     O_NOFOLLOW  },
+	{ 0x0200,     O_CREAT     },
+	{ 0x0400,     O_TRUNC     },
+	{ 0x0800,     O_EXCL      },
+	{ 0x4000,     O_DIRECTORY },
+	{ 0x00080000, O_CLOEXEC   },
+};
+
+static int host_open_flags( uint32_t guest_flags )
+{
+	// The guest's O_RDONLY, O_WRONLY, and O_RDWR are 1, 2, and 3.
+	
+	const int access_modes[] = { -1, O_RDONLY, O_WRONLY, O_RDWR };
+	
+	int flags = access_modes[ guest_flags & 0x0003 ];
+	
+	if ( flags < 0 )
+	{
+		return -1;
+	}
+	
+	const size_t n = sizeof open_flags / sizeof open_flags[0];
+	
+	for ( size_t i = 0;  i < n;  ++i )
+	{
+		if ( guest_flags & open_flags[i].guest )
+		{
+			flags |= open_flags[i].host;
+		}
+	}
+	
+	return flags;
+}
+
+static bool emu_open( v68k::emulator& emu )
+{
+	uint32_t args[4];  // dirfd, path, flags, mode
+	
+	if ( !get_stacked_args( emu, args, 4 ) )
+	{
+		return emu.bus_error();
+	}
+	
+	const int32_t dirfd = int32_t( args[0] );
+	
+	const uint8_t* path = get_path( emu, args[1] );
+	
+	const int flags = host_open_flags( args[2] );
+	
+	int result = -1;
+	
+	if ( path == NULL )
+	{
+		errno = EFAULT;
+	}
+	else if ( flags < 0 )
+	{
+		errno = EINVAL;
+	}
+	else
+	{
+		result = openat( dirfd == guest_AT_FDCWD ? AT_FDCWD : dirfd,
+		                 (const char*) path,
+		                 flags,
+		                 args[3] );
+	}
+	
+	return set_result( emu, result );
+}
+
+static bool emu_close( v68k::emulator& emu )
+{
+	uint32_t args[1];  // fd
+	
+	if ( !get_stacked_args( emu, args, 1 ) )
+	{
+		return emu.bus_error();
+	}
+	
+	return set_result( emu, close( int32_t( args[0] ) ) );
+}
+
+static bool emu_lseek( v68k::emulator& emu )
+{
+	uint32_t args[3];  // fd, offset, whence
+	
+	if ( !get_stacked_args( emu, args, 3 ) )
+	{
+		return emu.bus_error();
+	}
+	
+	off_t result = lseek( int32_t( args[0] ), int32_t( args[1] ), int32_t( args[2] ) );
+	
+	if ( result > 0x7FFFFFFF )
+	{
+		result = -1;
+		
+		errno = EOVERFLOW;
+	}
+	
+	return set_result( emu, result );
+}
+
+struct timespec_68k
+{
+	uint32_t tv_sec;
+	uint32_t tv_nsec;
+};
+
+// Relix's struct stat, with 32-bit fields
+struct stat_68k
+{
+	uint32_t      st_dev;
+	uint32_t      st_ino;
+	uint32_t      st_mode;
+	uint32_t      st_nlink;
+	uint32_t      st_uid;
+	uint32_t      st_gid;
+	uint32_t      st_rdev;
+	timespec_68k  st_atim;
+	timespec_68k  st_mtim;
+	timespec_68k  st_ctim;
+	timespec_68k  st_birthtim;
+	timespec_68k  st_checktim;
+	uint32_t      st_size;
+	uint32_t      st_blocks;
+	uint32_t      st_blksize;
+	uint32_t      st_flags;
+	uint8_t       st_name[ 32 ];
+};
+
+static bool emu_fstat( v68k::emulator& emu )
+{
+	uint32_t args[2];  // fd, sb
+	
+	if ( !get_stacked_args( emu, args, 2 ) )
+	{
+		return emu.bus_error();
+	}
+	
+	uint8_t* p = emu.mem.translate( args[1], sizeof (stat_68k), emu.data_space(), v68k::mem_write );
+	
+	struct stat sb;
+	
+	int result = -1;
+	
+	if ( p == NULL )
+	{
+		errno = EFAULT;
+	}
+	else if ( (result = fstat( int32_t( args[0] ), &sb )) == 0 )
+	{
+		stat_68k guest_sb;
+		
+		memset( &guest_sb, '\0', sizeof guest_sb );
+		
+		using v68k::big_longword;
+		
+		guest_sb.st_dev   = big_longword( sb.st_dev   );
+		guest_sb.st_ino   = big_longword( sb.st_ino   );
+		guest_sb.st_mode  = big_longword( sb.st_mode  );
+		guest_sb.st_nlink = big_longword( sb.st_nlink );
+		guest_sb.st_uid   = big_longword( sb.st_uid   );
+		guest_sb.st_gid   = big_longword( sb.st_gid   );
+		guest_sb.st_rdev  = big_longword( sb.st_rdev  );
+		
+		guest_sb.st_atim.tv_sec = big_longword( sb.st_atime );
+		guest_sb.st_mtim.tv_sec = big_longword( sb.st_mtime );
+		guest_sb.st_ctim.tv_sec = big_longword( sb.st_ctime );
+		
+		guest_sb.st_size    = big_longword( sb.st_size    );
+		guest_sb.st_blocks  = big_longword( sb.st_blocks  );
+		guest_sb.st_blksize = big_longword( sb.st_blksize );
+		
+		memcpy( p, &guest_sb, sizeof guest_sb );
+	}
+	
+	return set_result( emu, result );
+}
+
+static bool emu_gettimeofday( v68k::emulator& emu )
+{
+	uint32_t args[2];  // tv, tz
+	
+	if ( !get_stacked_args( emu, args, 2 ) )
+	{
+		return emu.bus_error();
+	}
+	
+	uint8_t* p = emu.mem.translate( args[0], 2 * sizeof (uint32_t), emu.data_space(), v68k::mem_write );
+	
+	int result = -1;
+	
+	if ( p == NULL )
+	{
+		errno = EFAULT;
+	}
+	else
+	{
+		timeval tv;
+		
+		result = gettimeofday( &tv, NULL );
+		
+		write_big_long( p,                     tv.tv_sec  );
+		write_big_long( p + sizeof (uint32_t), tv.tv_usec );
+	}
+	
+	return set_result( emu, result );
+}
+
+static bool emu_mmap( v68k::emulator& emu )
+{
+	uint32_t args[6];  // addr, len, prot, flags, fd, offset
+	
+	if ( !get_stacked_args( emu, args, 6 ) )
+	{
+		return emu.bus_error();
+	}
+	
+	const uint32_t length = args[1];
+	const uint32_t flags  = args[3];
+	const int      fd     = int32_t( args[4] );
+	const off_t    offset = int32_t( args[5] );
+	
+	/*
+		Guest memory is one flat region, so mappings come from the guest
+		heap and a file's contents are read into them in one pread().
+		Like Relix's own mmap(), changes aren't written back to the file.
+	*/
+	
+	if ( length == 0  ||  flags & guest_MAP_FIXED )
+	{
+		errno = EINVAL;
+		
+		return set_result( emu, -1 );
+	}
+	
+	const uint32_t addr = guest_heap_allocate( length );
+	
+	uint8_t* p = addr ? emu.mem.translate( addr, length, emu.data_space(), v68k::mem_write )
+	                  : NULL;
+	
+	if ( p == NULL )
+	{
+		errno = ENOMEM;
+		
+		return set_result( emu, -1 );
+	}
+	
+	ssize_t n_read = 0;
+	
+	if ( !(flags & guest_MAP_ANON)  &&  (n_read = pread( fd, p, length, offset )) < 0 )
+	{
+		guest_heap_dispose( addr );
+		
+		return set_result( emu, -1 );
+	}
+	
+	memset( p + n_read, '\0', length - n_read );
+	
+	emu.regs.d[0] = addr;
+	
+	return true;
+}
+
+static bool emu_munmap( v68k::emulator& emu )
+{
+	uint32_t args[2];  // addr, len
+	
+	if ( !get_stacked_args( emu, args, 2 ) )
+	{
+		return emu.bus_error();
+	}
+	
+	int result = 0;
+	
+	if ( !guest_heap_dispose( args[0] ) )
+	{
+		result = -1;
+		
+		errno = EINVAL;
+	}
+	
+	return set_result( emu, result );
+}
+
 bool bridge_call( v68k::emulator& emu )
 {
 	const uint16_t call_number = emu.regs.d[0];
 	
 	switch ( call_number )
 	{
-		case 1:  return emu_exit ( emu );
-		case 3:  return emu_read ( emu );
-		case 4:  return emu_write( emu );
+		case  1:  return emu_exit ( emu );
+		case  3:  return emu_read ( emu );
+		case  4:  return emu_write( emu );
+		case  5:  return emu_open ( emu );  // openat
+		case  6:  return emu_close( emu );
+		case 19:  return emu_lseek( emu );
+		case 28:  return emu_fstat( emu );
+		
+		case 78:  return emu_gettimeofday( emu );
+		case 90:  return emu_mmap        ( emu );  // _relix_mmap
+		case 91:  return emu_munmap      ( emu );
 		
 		case 146:  return emu_writev( emu );
 		
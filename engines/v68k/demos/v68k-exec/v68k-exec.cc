@@ -12,10 +12,15 @@
 #include <fcntl.h>
 #include <unistd.h>
 
+// Recall
+#include "recall/profiler.hh"
+
 // v68k
 #include "v68k/endian.hh"
 
 // v68k-exec
+#include "guest-heap.hh"
+#include "hle-traps.hh"
 #include "syscall-bridge.hh"
 
 
@@ -28,13 +33,15 @@ using v68k::big_longword;
 
 const uint32_t params_max_size = 4096;
 const uint32_t code_max_size   = 32768;
+const uint32_t heap_size       = 1024 * 1024;
 
 const uint32_t os_address   = 1024;
 const uint32_t initial_SSP  = 2048;
 const uint32_t initial_USP  = 12288;
 const uint32_t code_address = 12288;
+const uint32_t heap_address = code_address + code_max_size;
 
-const uint32_t mem_size = code_address + code_max_size;
+const uint32_t mem_size = heap_address + heap_size;
 
 const uint32_t user_pb_addr   = params_addr +  0;  // 20 bytes
 const uint32_t system_pb_addr = params_addr + 20;  // 20 bytes
@@ -48,7 +55,7 @@ static const uint16_t os[] =
 {
 	// Jump over handlers
 	
-	0x601A,  // BRA.S  *+28
+	0x6016,  // BRA.S  *+24
 	
 	// Illegal Instruction,
 	// Privilege Violation
@@ -76,10 +83,7 @@ static const uint16_t os[] =
 	
 	// Line A Emulator
 	
-	0x54AF,  // ADDQ.L  #2,(2,A7)
-	0x0002,
-	
-	0x4E73,  // RTE
+	0x484B,  // BKPT  #3  ; high-level emulation, then RTE
 	
 	// OS resumes here
 	
@@ -176,6 +180,8 @@ static int execute_68k( int argc, char** argv )
 	load_vectors( mem );
 	load_n_words( mem, os_address, os, sizeof os / 2 );
 	
+	guest_heap_init( mem + heap_address, heap_address, heap_size );
+	
 	(uint32_t&) mem[ argc_addr ] = big_longword( argc - 1 );
 	(uint32_t&) mem[ argv_addr ] = big_longword( args_addr );
 	
@@ -248,6 +254,16 @@ step_loop:
 		goto step_loop;
 	}
 	
+	if ( emu.condition == v68k::bkpt_3 )
+	{
+		if ( hle_trap( emu ) )
+		{
+			emu.acknowledge_breakpoint( 0x4E73 );  // RTE
+		}
+		
+		goto step_loop;
+	}
+	
 	if ( emu.condition == v68k::finished )
 	{
 		return emu.regs.d[0];
@@ -281,6 +297,10 @@ step_loop:
 
 int main( int argc, char** argv )
 {
+	// Not an Orion tool, so it starts the profiler itself.
+	
+	recall::start_profiling_from_environment();
+	
 	if ( const char* path = argv[1] )
 	{
 		return execute_68k( argc, argv );
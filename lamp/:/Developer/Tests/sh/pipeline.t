@@ -0,0 +1,74 @@
+#!/usr/bin/env jtest
+
+$ echo foo | cat
+
+1 >= foo
+
+%%
+
+$ echo foo | tr a-z A-Z | cat
+
+1 >= FOO
+
+%%
+
+$ /bin/echo foo | cat >&2
+
+1 >> 'NIL'
+NIL
+
+2 >= foo
+
+%%
+
+$ exit 3 | cat
+
+%%
+
+$ true | exit 3
+
+? 3
+
+%%
+
+$ FOO=bar printenv FOO | cat
+
+1 >= bar
+
+%%
+
+$ FOO=bar; echo $FOO | cat
+
+1 >= bar
+
+%%
+
+$ FOO=bar | true; echo "[$FOO]"
+
+1 >= []
+
+%%
+
+$ nonesuch | cat
+
+2 >= 'sh: nonesuch: command not found'
+
+%%
+
+$ echo foo | nonesuch
+
+? 127
+
+2 >= 'sh: nonesuch: command not found'
+
+%%
+
+$ echo foo | cat >&9
+
+? 1
+
+1 >> 'NIL'
+NIL
+
+2 >= 'sh: 9: Bad file descriptor'
+
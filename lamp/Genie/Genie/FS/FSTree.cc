@@ -19,6 +19,9 @@
 // poseven
 #include "poseven/types/errno_t.hh"
 
+// vfs
+#include "vfs/lookup_cache.hh"
+
 // Genie
 #include "Genie/FS/node_method_set.hh"
 #include "Genie/IO/VirtualDirectory.hh"
@@ -38,6 +41,17 @@ namespace Genie
 	const FSTreePtr null_FSTreePtr = FSTreePtr();
 	
 	
+	typedef vfs::lookup_cache< FSTreePtr, plus::string > LookupCache;
+	
+	static LookupCache gLookupCache;
+	
+	void InvalidateCachedLookups()
+	{
+		// Release the entries' nodes too, rather than waiting for replacements.
+		gLookupCache.clear();
+	}
+	
+	
 	FSTree::FSTree() : itsParent(), itsName(), itsMode(), its_methods()
 	{
 	}
@@ -383,7 +397,47 @@ namespace Genie
 			return Parent();
 		}
 		
-		return Lookup_Child( name, parent );
+		/*
+			Premapped directories are made anew for each lookup, but one that
+			caches appears at only one path (even as the top layer of the
+			root), so its pathname stands for it however it was reached.
+		*/
+		
+		const plus::string* key = LookupCacheKey();
+		
+		if ( key == NULL )
+		{
+			return Lookup_Child( name, parent );
+		}
+		
+		FSTreePtr result;
+		
+		int error;
+		
+		if ( gLookupCache.find( *key, name, result, error ) )
+		{
+			return result;
+		}
+		
+		result = Lookup_Child( name, parent );
+		
+		/*
+			Whether an entry exists, or where a symlink points, can change
+			without the namespace changing (e.g. /sys/app/window/front), so
+			only entries that exist and aren't symlinks are cached.
+		*/
+		
+		if ( result->Exists()  &&  !result->IsLink() )
+		{
+			gLookupCache.insert( *key, name, result );
+		}
+		
+		return result;
+	}
+	
+	const plus::string* FSTree::LookupCacheKey() const
+	{
+		return NULL;
 	}
 	
 	FSTreePtr FSTree::Lookup_Child( const plus::string& name, const FSTree* parent ) const
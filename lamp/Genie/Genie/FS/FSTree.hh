@@ -40,6 +40,9 @@ namespace Genie
 	
 	const FSTreePtr& FSRoot();
 	
+	// Forget cached lookups; call after anything that changes the namespace.
+	void InvalidateCachedLookups();
+	
 	
 	class FSTree : public plus::ref_count< FSTree >
 	{
@@ -123,6 +126,9 @@ namespace Genie
 			
 			FSTreePtr Lookup( const plus::string& name, const FSTree* parent = NULL ) const;
 			
+			// The pathname Lookup() caches this directory's children under, if any
+			virtual const plus::string* LookupCacheKey() const;
+			
 			virtual FSTreePtr Lookup_Child( const plus::string& name, const FSTree* parent ) const;
 			
 			virtual void IterateIntoCache( FSTreeCache& cache ) const;
@@ -5,6 +5,9 @@
 
 #include "Genie/FS/FSTree_Directory.hh"
 
+// plus
+#include "plus/string/concat.hh"
+
 // Genie
 #include "Genie/FS/file-tests.hh"
 #include "Genie/FS/FSTreeCache.hh"
@@ -34,6 +37,45 @@ namespace Genie
 		return NULL;
 	}
 	
+	static bool parent_is_permanent( const FSTreePtr& parent, const plus::string& name )
+	{
+		/*
+			A cached child keeps its ancestors alive, so a directory whose
+			destruction does something (e.g. closing a window) mustn't have
+			any, and neither may anything beneath it.  The root is always
+			there (and its top layer has no parent); otherwise, only premapped
+			directories without destructors cache lookups, and only beneath
+			others like them.
+		*/
+		
+		if ( parent.get() == NULL )
+		{
+			return name.empty();
+		}
+		
+		return parent == FSRoot()  ||  parent->LookupCacheKey() != NULL;
+	}
+	
+	FSTree_Premapped::FSTree_Premapped( const FSTreePtr&     parent,
+	                                    const plus::string&  name,
+	                                    Mappings             mappings,
+	                                    Destructor           dtor )
+	:
+		FSTree( parent, name, S_IFDIR | 0700 ),
+		itsMappings( mappings ),
+		itsDestructor( dtor ),
+		itCachesLookups( dtor == NULL  &&  parent_is_permanent( parent, name ) )
+	{
+		// The root's top layer keeps the root's key, which is empty.
+		
+		if ( itCachesLookups  &&  parent.get() != NULL )
+		{
+			const plus::string* parent_key = parent->LookupCacheKey();
+			
+			itsLookupCacheKey = (parent_key ? *parent_key : plus::string::null) + "/" + Name();
+		}
+	}
+	
 	FSTree_Premapped::~FSTree_Premapped()
 	{
 		if ( itsDestructor )
@@ -42,6 +84,11 @@ namespace Genie
 		}
 	}
 	
+	const plus::string* FSTree_Premapped::LookupCacheKey() const
+	{
+		return itCachesLookups ? &itsLookupCacheKey : NULL;
+	}
+	
 	void FSTree_Premapped::Delete() const
 	{
 		if ( itsDestructor )
@@ -38,25 +38,23 @@ namespace Genie
 			
 			typedef void (*Destructor)( const FSTree* );
 			
-			Destructor  itsDestructor;
-			Mappings    itsMappings;
+			Destructor    itsDestructor;
+			Mappings      itsMappings;
+			bool          itCachesLookups;
+			plus::string  itsLookupCacheKey;
 		
 		public:
 			FSTree_Premapped( const FSTreePtr&     parent,
 			                  const plus::string&  name,
 			                  Mappings             mappings = empty_mappings,
-			                  Destructor           dtor     = NULL )
-			:
-				FSTree( parent, name, S_IFDIR | 0700 ),
-				itsMappings( mappings ),
-				itsDestructor( dtor )
-			{
-			}
+			                  Destructor           dtor     = NULL );
 			
 			~FSTree_Premapped();
 			
 			void Delete() const;
 			
+			const plus::string* LookupCacheKey() const;
+			
 			FSTreePtr Lookup_Child( const plus::string& name, const FSTree* parent ) const;
 			
 			void IterateIntoCache( FSTreeCache& cache ) const;
@@ -9,11 +9,8 @@
 #include <errno.h>
 #include <signal.h>
 
-// Standard C++
-#include <algorithm>
-
-// Debug
-#include "debug/assert.hh"
+// POSIX
+#include <limits.h>
 
 // poseven
 #include "poseven/types/errno_t.hh"
@@ -29,50 +26,11 @@ namespace Genie
 	namespace p7 = poseven;
 	
 	
-	Page::Page( const Page& other )
-	:
-		written( other.written ),
-		read   ( other.read    )
-	{
-		ASSERT( read    <= written  );
-		ASSERT( written <= capacity );
-		
-		std::copy( &other.data[ read    ],
-		           &other.data[ written ],
-		           &      data[ read    ] );
-	}
-	
-	void Page::Write( const char* buffer, std::size_t n_bytes )
-	{
-		ASSERT( n_bytes <= Writable() );
-		
-		std::copy( buffer, buffer + n_bytes, &data[ written ] );
-		
-		written += n_bytes;
-	}
-	
-	std::size_t Page::Read( char* buffer, std::size_t max_bytes )
+	static void broken_pipe()
 	{
-		max_bytes = std::min( max_bytes, Readable() );
-		
-		const char* start = &data[ read ];
-		
-		std::copy( start, start + max_bytes, buffer );
+		send_signal_to_current_process( SIGPIPE );
 		
-		read += max_bytes;
-		
-		return max_bytes;
-	}
-	
-	
-	bool Conduit::IsReadable() const
-	{
-		return itsIngressHasClosed || !itsPages.empty();
-	}
-	
-	bool Conduit::IsWritable() const
-	{
-		return itsEgressHasClosed || itsPages.size() < 20;
+		p7::throw_errno( EPIPE );
 	}
 	
 	int Conduit::Read( char* buffer, std::size_t max_bytes, bool nonblocking )
@@ -83,91 +41,65 @@ namespace Genie
 		}
 		
 		// Wait until we have some data or the stream is closed
-		while ( itsPages.empty() && !itsIngressHasClosed )
+		while ( !itsCore.is_readable() )
 		{
 			try_again( nonblocking );
 		}
 		
-		// Either a page was written, or input was closed,
-		// or possibly both, so check itsPages rather than itsIngressHasClosed
-		// so we don't miss data.
-		
-		// If the page queue is still empty then input must have closed.
-		if ( itsPages.empty() )
-		{
-			return 0;
-		}
-		
-		// Only reached if a page is available.
-		
-		const std::size_t readable = itsPages.front().Readable();
-		
-		ASSERT( readable > 0 );
-		
-		const bool consumed = max_bytes >= readable;
-		
-		itsPages.front().Read( buffer, max_bytes );
-		
-		if ( consumed )
-		{
-			itsPages.pop_front();
-			
-			return readable;
-		}
+		// Any data still buffered is read before EOF is reported.
 		
-		return max_bytes;
+		return itsCore.read( buffer, max_bytes );
 	}
 	
 	int Conduit::Write( const char* buffer, std::size_t n_bytes, bool nonblocking )
 	{
-		while ( !IsWritable() )
+		// Writes of PIPE_BUF bytes or less aren't interleaved with others.
+		
+		const std::size_t needed = n_bytes <= PIPE_BUF ? n_bytes : 1;
+		
+		while ( !itsCore.egress_has_closed()  &&  itsCore.writable() < needed )
 		{
 			try_again( nonblocking );
 		}
 		
-		if ( itsEgressHasClosed )
+		if ( itsCore.egress_has_closed() )
 		{
-			send_signal_to_current_process( SIGPIPE );
-			
-			p7::throw_errno( EPIPE );
+			broken_pipe();
 		}
 		
-		if ( n_bytes == 0 )
-		{
-			return 0;
-		}
+		const std::size_t written = itsCore.write( buffer, n_bytes );
 		
-		if ( itsPages.empty() )
+		if ( written == n_bytes  ||  nonblocking )
 		{
-			itsPages.push_back( Page() );
-		}
-		else if ( n_bytes > itsPages.back().Writable()  &&  n_bytes <= Page::capacity )
-		{
-			itsPages.push_back( Page() );
-			
-			itsPages.back().Write( buffer, n_bytes );
-			
-			return n_bytes;
+			return written;
 		}
 		
-		const char* end = buffer + n_bytes;
+		/*
+			Rather than copy the rest into the ring a piece at a time, lend
+			it to the reader, who copies it straight out of our buffer.  Our
+			caller is blocked until the reader has taken all of it, so the
+			buffer stays put.
+		*/
 		
-		std::size_t writable = 0;
+		itsCore.lend( buffer + written, n_bytes - written );
 		
-		while ( end - buffer > (writable = itsPages.back().Writable()) )
+		try
 		{
-			itsPages.back().Write( buffer, writable );
-			
-			buffer += writable;
+			while ( itsCore.loan_outstanding()  &&  !itsCore.egress_has_closed() )
+			{
+				try_again( false );
+			}
+		}
+		catch ( ... )
+		{
+			// Interrupted by a signal, after at least a partial write
 			
-			itsPages.push_back( Page() );
+			return written + itsCore.reclaim();
 		}
 		
-		itsPages.back().Write( buffer, end - buffer );
-		
+		// If the reader went away, the next write gets EPIPE.
 		
-		return n_bytes;
+		return written + itsCore.reclaim();
 	}
 	
 }
-
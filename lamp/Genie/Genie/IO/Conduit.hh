@@ -6,66 +6,35 @@
 #ifndef GENIE_IO_CONDUIT_HH
 #define GENIE_IO_CONDUIT_HH
 
-// Standard C++
-#include <list>
-
 // plus
 #include "plus/ref_count.hh"
 
+// conduit
+#include "conduit/pipe_core.hh"
+
 
 namespace Genie
 {
 	
-	class Page
-	{
-		public:
-			static const std::size_t capacity = 4096;
-		
-		private:
-			std::size_t written;
-			std::size_t read;
-			
-			char data[ capacity ];
-		
-		public:
-			Page() : written(), read()
-			{
-			}
-			
-			Page( const Page& other );
-			
-			std::size_t Writable() const  { return capacity - written; }
-			std::size_t Readable() const  { return written  - read;    }
-			
-			bool Whole() const  { return read == 0  &&  written == capacity; }
-			
-			void Write( const char* buffer, std::size_t n_bytes );
-			
-			std::size_t Read ( char* buffer, std::size_t max_bytes );
-	};
+	/*
+		A pipe's data is kept in a conduit::pipe_core; Conduit adds blocking
+		(via try_again()), SIGPIPE, and atomic small writes.
+	*/
 	
 	class Conduit : public plus::ref_count< Conduit >
 	{
 		private:
-			std::list< Page > itsPages;
-			
-			bool itsIngressHasClosed;
-			bool itsEgressHasClosed;
+			conduit::pipe_core itsCore;
 		
 		public:
-			Conduit() : itsIngressHasClosed ( false ),
-			            itsEgressHasClosed( false )
-			{
-			}
-			
-			bool IsReadable() const;
-			bool IsWritable() const;
+			bool IsReadable() const  { return itsCore.is_readable(); }
+			bool IsWritable() const  { return itsCore.is_writable(); }
 			
-			bool IngressHasClosed() const  { return itsIngressHasClosed; }
-			bool EgressHasClosed()  const  { return itsEgressHasClosed;  }
+			bool IngressHasClosed() const  { return itsCore.ingress_has_closed(); }
+			bool EgressHasClosed()  const  { return itsCore.egress_has_closed();  }
 			
-			bool CloseIngress()  { itsIngressHasClosed = true;  return itsEgressHasClosed;  }
-			bool CloseEgress()   { itsEgressHasClosed  = true;  return itsIngressHasClosed; }
+			bool CloseIngress()  { return itsCore.close_ingress(); }
+			bool CloseEgress()   { return itsCore.close_egress();  }
 			
 			int Read (       char* data, std::size_t byteCount, bool nonblocking );
 			int Write( const char* data, std::size_t byteCount, bool nonblocking );
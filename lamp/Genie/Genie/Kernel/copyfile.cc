@@ -26,6 +26,8 @@ namespace Genie
 			// Do not resolve links
 			
 			srcFile->CopyFile( destFile );
+			
+			InvalidateCachedLookups();
 		}
 		catch ( ... )
 		{
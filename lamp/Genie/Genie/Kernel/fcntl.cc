@@ -14,6 +14,7 @@
 #include "Genie/FileDescriptor.hh"
 #include "Genie/FileDescriptors.hh"
 #include "Genie/FS/file-tests.hh"
+#include "Genie/FS/FSTree.hh"
 #include "Genie/FS/ResolvePathAt.hh"
 #include "Genie/FS/ResolvePathname.hh"
 #include "Genie/IO/RegularFile.hh"
@@ -63,6 +64,11 @@ namespace Genie
 			IOPtr opened = directory ? file->OpenDirectory()
 			                         : file->Open( flags, mode );
 			
+			if ( flags & O_CREAT )
+			{
+				InvalidateCachedLookups();
+			}
+			
 			const bool truncating = flags & O_TRUNC;
 			
 			if ( truncating )
@@ -66,6 +66,8 @@ namespace Genie
 			{
 				oldFile->HardLink( newFile );
 			}
+			
+			InvalidateCachedLookups();
 		}
 		catch ( ... )
 		{
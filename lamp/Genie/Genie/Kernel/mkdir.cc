@@ -25,6 +25,8 @@ namespace Genie
 			// Do not resolve links
 			
 			location->CreateDirectory( mode );
+			
+			InvalidateCachedLookups();
 		}
 		catch ( ... )
 		{
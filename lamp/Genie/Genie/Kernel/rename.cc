@@ -23,6 +23,8 @@ namespace Genie
 			// Do not resolve links
 			
 			srcFile->Rename( destFile );
+			
+			InvalidateCachedLookups();
 		}
 		catch ( ... )
 		{
@@ -34,6 +34,8 @@ namespace Genie
 			}
 			
 			link->SymLink( target_path );
+			
+			InvalidateCachedLookups();
 		}
 		catch ( ... )
 		{
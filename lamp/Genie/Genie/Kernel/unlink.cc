@@ -43,6 +43,8 @@ namespace Genie
 			if ( remove_any || remove_dir == is_directory( file ) )
 			{
 				file->Delete();
+				
+				InvalidateCachedLookups();
 			}
 			else
 			{
@@ -0,0 +1,102 @@
+/*
+	lookups.cc
+	----------
+*/
+
+// Standard C
+#include <errno.h>
+#include <string.h>
+
+// POSIX
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+// tap-out
+#include "tap/check.hh"
+#include "tap/test.hh"
+
+
+static const unsigned n_tests = 3 + 2 + 2;
+
+
+using tap::ok_if;
+
+
+/*
+	/sys is a premapped directory in the root's union, made anew for each
+	lookup, so these go through the lookup cache the way everything does.
+*/
+
+static void found()
+{
+	struct stat a;
+	struct stat b;
+	
+	ok_if( stat( "/sys/app/window", &a ) == 0  &&  S_ISDIR( a.st_mode ) );
+	
+	ok_if( stat( "/sys/app/window", &b ) == 0  &&  b.st_ino == a.st_ino, "again" );
+	
+	ok_if( stat( "/sys/mac", &a ) == 0  &&  S_ISDIR( a.st_mode ) );
+}
+
+static void not_found()
+{
+	struct stat sb;
+	
+	ok_if( lstat( "/sys/nonesuch", &sb ) < 0  &&  errno == ENOENT );
+	
+	ok_if( lstat( "/sys/nonesuch", &sb ) < 0  &&  errno == ENOENT, "again" );
+}
+
+static ssize_t read_front( char* buffer, size_t size )
+{
+	// There might not be a front window, which is fine.
+	
+	return readlink( "/sys/app/window/front", buffer, size );
+}
+
+static bool same( const char* a, ssize_t n_a, const char* b, ssize_t n_b )
+{
+	return n_a == n_b  &&  (n_a < 0  ||  memcmp( a, b, n_a ) == 0);
+}
+
+static void front_window()
+{
+	char before[ 64 ];
+	char during[ 64 ];
+	char after [ 64 ];
+	
+	const ssize_t n_before = read_front( before, sizeof before );
+	
+	// A new port's window comes to the front...
+	
+	CHECK( chdir( "/gui/new/port" ) );
+	
+	CHECK( utime( "window", NULL ) );
+	
+	const ssize_t n_during = read_front( during, sizeof during );
+	
+	ok_if( n_during > 0  &&  !same( before, n_before, during, n_during ), "front follows a new window" );
+	
+	// ...and closes when the port goes away.
+	
+	CHECK( chdir( "/" ) );
+	
+	const ssize_t n_after = read_front( after, sizeof after );
+	
+	ok_if( same( before, n_before, after, n_after ), "and its departure" );
+}
+
+int main( int argc, char** argv )
+{
+	tap::start( "lookups", n_tests );
+	
+	found();
+	
+	not_found();
+	
+	front_window();
+	
+	return 0;
+}
@@ -0,0 +1,461 @@
+// ========
+// Spool.cc
+// ========
+
+#include "MailSpool/Spool.hh"
+
+// Standard C
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+// POSIX
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// gear
+#include "gear/inscribe_decimal.hh"
+#include "gear/parse_decimal.hh"
+
+// plus
+#include "plus/var_string.hh"
+
+// poseven
+#include "poseven/extras/write_all.hh"
+#include "poseven/functions/fstat.hh"
+#include "poseven/functions/fstatat.hh"
+#include "poseven/functions/open.hh"
+#include "poseven/functions/openat.hh"
+#include "poseven/functions/pread.hh"
+#include "poseven/functions/pwrite.hh"
+#include "poseven/functions/write.hh"
+#include "poseven/types/errno_t.hh"
+
+
+namespace MailSpool
+{
+	
+	namespace n = nucleus;
+	namespace p7 = poseven;
+	
+	
+	struct spool_state
+	{
+		unsigned long  generation;
+		off_t          committed;  // bytes of the index
+	};
+	
+	class lock_scope
+	{
+		private:
+			int its_fd;
+			
+			// non-copyable
+			lock_scope           ( const lock_scope& );
+			lock_scope& operator=( const lock_scope& );
+			
+		public:
+			lock_scope( int fd ) : its_fd( fd )
+			{
+				while ( its_fd >= 0  &&  flock( its_fd, LOCK_EX ) < 0 )
+				{
+					if ( errno != EINTR )
+					{
+						p7::throw_errno( errno );
+					}
+				}
+			}
+			
+			~lock_scope()
+			{
+				if ( its_fd >= 0 )
+				{
+					flock( its_fd, LOCK_UN );
+				}
+			}
+	};
+	
+	static const p7::open_flags_t index_flags = p7::o_rdwr | p7::o_creat | p7::o_append;
+	
+	static spool_state read_state( p7::fd_t commit )
+	{
+		spool_state state = { 0 };
+		
+		if ( p7::pread( commit, (char*) &state, sizeof state, 0 ) != sizeof state )
+		{
+			state.generation = 0;
+			state.committed  = 0;
+		}
+		
+		return state;
+	}
+	
+	static void write_state( p7::fd_t commit, const spool_state& state )
+	{
+		// Not synced:  after a crash, the index is simply committed again.
+		
+		p7::pwrite( commit, (const char*) &state, sizeof state, 0 );
+	}
+	
+	static void sync_or_throw( int fd )
+	{
+		if ( fsync( fd ) < 0 )
+		{
+			p7::throw_errno( errno );
+		}
+	}
+	
+	static void sync_directory( int fd )
+	{
+		// Not every filesystem can sync a directory, and those say so.
+		
+		if ( fsync( fd ) < 0  &&  errno != EINVAL  &&  errno != EBADF )
+		{
+			p7::throw_errno( errno );
+		}
+	}
+	
+	static plus::string read_from( p7::fd_t fd, off_t offset, off_t end )
+	{
+		plus::var_string result;
+		
+		char* p = result.reset( end - offset );
+		
+		for ( size_t n_read = 0;  n_read < result.size();  )
+		{
+			const ssize_t n = p7::pread( fd, p + n_read, result.size() - n_read, offset + n_read );
+			
+			if ( n == 0 )
+			{
+				result.resize( n_read );
+			}
+			
+			n_read += n;
+		}
+		
+		return result;
+	}
+	
+	/*
+		Parses whole records, returning the end of the last one.  A record
+		still being appended is left for later.
+	*/
+	
+	static const char* parse_records( const char* p, const char* end, std::vector< Record >& records )
+	{
+		while ( const char* eol = (const char*) memchr( p, '\n', end - p ) )
+		{
+			if ( const char* space = (const char*) memchr( p, ' ', eol - p ) )
+			{
+				Record record;
+				
+				record.name = plus::string( p, space );
+				record.size = gear::parse_unsigned_decimal( space + 1 );
+				
+				records.push_back( record );
+			}
+			
+			p = eol + 1;
+		}
+		
+		return p;
+	}
+	
+	/*
+		On Linux, writeback is started for every message before waiting for
+		any of them, so they share the disk writes and the journal commit.
+		A message that's gone has been delivered since it was recorded.
+	*/
+	
+	static void sync_messages( p7::fd_t dir, const std::vector< Record >& records )
+	{
+		std::vector< int > fds;
+		
+		fds.reserve( records.size() );
+		
+		int error = 0;
+		
+		for ( size_t i = 0;  i < records.size();  ++i )
+		{
+			const int fd = openat( dir, records[ i ].name.c_str(), O_RDONLY );
+			
+			if ( fd < 0 )
+			{
+				if ( errno != ENOENT )
+				{
+					error = errno;
+				}
+				
+				continue;
+			}
+			
+		#ifdef SYNC_FILE_RANGE_WRITE
+			
+			(void) sync_file_range( fd, 0, 0, SYNC_FILE_RANGE_WRITE );
+			
+		#endif
+			
+			fds.push_back( fd );
+		}
+		
+		for ( size_t i = 0;  i < fds.size();  ++i )
+		{
+			if ( fsync( fds[ i ] ) < 0  &&  error == 0 )
+			{
+				error = errno;
+			}
+			
+			close( fds[ i ] );
+		}
+		
+		if ( error )
+		{
+			p7::throw_errno( error );
+		}
+	}
+	
+	// Syncs everything recorded since the last commit.  Needs the commit lock.
+	
+	static void commit_pending( p7::fd_t dir, p7::fd_t index, spool_state& state )
+	{
+		const off_t size = p7::fstat( index ).st_size;
+		
+		if ( state.committed > size )
+		{
+			state.committed = 0;  // stale after a crash
+		}
+		
+		const plus::string pending = read_from( index, state.committed, size );
+		
+		std::vector< Record > records;
+		
+		const char* end = parse_records( pending.data(), pending.data() + pending.size(), records );
+		
+		sync_messages( dir, records );
+		
+		sync_directory( dir );
+		
+		sync_or_throw( index );
+		
+		state.committed += end - pending.data();
+	}
+	
+	static bool is_complete( p7::fd_t dir, const Record& record )
+	{
+		struct stat sb;
+		
+		return p7::fstatat( dir, record.name, sb )  &&  sb.st_size == record.size;
+	}
+	
+	Spool::Spool( const char* path )
+	:
+		its_dir   ( p7::open( path, p7::o_rdonly | p7::o_directory ) ),
+		its_index ( p7::openat( its_dir, "index",  index_flags,               p7::_600 ) ),
+		its_commit( p7::openat( its_dir, "commit", p7::o_rdwr | p7::o_creat, p7::_600 ) )
+	{
+		// MacRelix has no flock(); each message is committed by itself.
+		
+		its_locking = flock( its_commit, LOCK_SH ) == 0;
+		
+		if ( its_locking )
+		{
+			flock( its_commit, LOCK_UN );
+		}
+	}
+	
+	bool Spool::index_is_current() const
+	{
+		struct stat named;
+		
+		const struct stat opened = p7::fstat( its_index );
+		
+		return    p7::fstatat( its_dir, "index", named )
+		       && named.st_dev == opened.st_dev
+		       && named.st_ino == opened.st_ino;
+	}
+	
+	void Spool::reopen_index()
+	{
+		its_index = p7::openat( its_dir, "index", index_flags, p7::_600 );
+	}
+	
+	Ticket Spool::append( const plus::string& name, off_t size )
+	{
+		plus::var_string record = name;
+		
+		record += " ";
+		record += gear::inscribe_unsigned_decimal( size );
+		record += "\n";
+		
+		while ( true )
+		{
+			{
+				lock_scope lock( its_locking ? its_index.get() : p7::fd_t( -1 ) );
+				
+				if ( !its_locking  ||  index_is_current() )
+				{
+					p7::write( its_index, record );
+					
+					Ticket ticket;
+					
+					// The generation only changes with the index lock held.
+					
+					ticket.generation = read_state( its_commit ).generation;
+					ticket.end        = lseek( its_index, 0, SEEK_CUR );
+					ticket.name       = name;
+					
+					return ticket;
+				}
+			}
+			
+			reopen_index();  // The queue runner replaced it
+		}
+	}
+	
+	void Spool::commit_alone( const Ticket& ticket )
+	{
+		Record record = { ticket.name };
+		
+		sync_messages( its_dir, std::vector< Record >( 1, record ) );
+		
+		sync_directory( its_dir );
+		
+		sync_or_throw( its_index );
+	}
+	
+	void Spool::commit( const Ticket& ticket )
+	{
+		if ( !its_locking )
+		{
+			commit_alone( ticket );
+			
+			return;
+		}
+		
+		lock_scope lock( its_commit );
+		
+		spool_state state = read_state( its_commit );
+		
+		if ( state.generation != ticket.generation  ||  state.committed >= ticket.end )
+		{
+			// Someone else's batch included us (or the index has since been
+			// replaced, which happens only once it's all committed).
+			
+			return;
+		}
+		
+		// Same generation, so its_index is still the one we appended to.
+		
+		commit_pending( its_dir, its_index, state );
+		
+		write_state( its_commit, state );
+	}
+	
+	std::vector< Record > Spool::queued() const
+	{
+		n::owned< p7::fd_t > index = p7::openat( its_dir, "index", p7::o_rdonly );
+		
+		const plus::string contents = read_from( index, 0, p7::fstat( index ).st_size );
+		
+		std::vector< Record > records;
+		
+		parse_records( contents.data(), contents.data() + contents.size(), records );
+		
+		std::vector< Record > result;
+		
+		for ( size_t i = 0;  i < records.size();  ++i )
+		{
+			if ( is_complete( its_dir, records[ i ] ) )
+			{
+				result.push_back( records[ i ] );
+			}
+		}
+		
+		return result;
+	}
+	
+	bool Spool::compact_locked()
+	{
+		lock_scope lock( its_commit );
+		
+		spool_state state = read_state( its_commit );
+		
+		commit_pending( its_dir, its_index, state );
+		
+		const plus::string contents = read_from( its_index, 0, state.committed );
+		
+		std::vector< Record > records;
+		
+		parse_records( contents.data(), contents.data() + contents.size(), records );
+		
+		plus::var_string kept;
+		
+		for ( size_t i = 0;  i < records.size();  ++i )
+		{
+			if ( is_complete( its_dir, records[ i ] ) )
+			{
+				kept += records[ i ].name;
+				kept += " ";
+				kept += gear::inscribe_unsigned_decimal( records[ i ].size );
+				kept += "\n";
+			}
+		}
+		
+		if ( kept.size() == contents.size() )
+		{
+			write_state( its_commit, state );
+			
+			return true;  // nothing to drop
+		}
+		
+		// The new index is on disk before it replaces the old one.
+		
+		n::owned< p7::fd_t > replacement = p7::openat( its_dir,
+		                                               "index.new",
+		                                               p7::o_wronly | p7::o_creat | p7::o_trunc,
+		                                               p7::_600 );
+		
+		p7::write_all( replacement, kept.data(), kept.size() );
+		
+		sync_or_throw( replacement );
+		
+		if ( renameat( its_dir, "index.new", its_dir, "index" ) < 0 )
+		{
+			p7::throw_errno( errno );
+		}
+		
+		sync_directory( its_dir );
+		
+		state.generation += 1;
+		state.committed   = kept.size();
+		
+		write_state( its_commit, state );
+		
+		return true;
+	}
+	
+	bool Spool::compact()
+	{
+		if ( !its_locking )
+		{
+			return false;
+		}
+		
+		while ( true )
+		{
+			{
+				lock_scope lock( its_index );
+				
+				if ( index_is_current() )
+				{
+					return compact_locked();
+				}
+			}
+			
+			reopen_index();
+		}
+	}
+	
+}
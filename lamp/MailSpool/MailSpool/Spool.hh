@@ -0,0 +1,103 @@
+// ========
+// Spool.hh
+// ========
+
+#ifndef MAILSPOOL_SPOOL_HH
+#define MAILSPOOL_SPOOL_HH
+
+// Standard C++
+#include <vector>
+
+// POSIX
+#include <sys/types.h>
+
+// plus
+#include "plus/string.hh"
+
+// poseven
+#include "poseven/functions/close.hh"
+
+
+/*
+	The queue is a directory of message files, plus an index.
+	
+	A message is one file, written only by appending:  its envelope (a
+	line "From <reverse-path>", a line "To <forward-path>" per recipient,
+	and an empty line) followed by the data exactly as received, up to but
+	not including the terminating ".".
+	
+	When a message file is complete, the record "<name> <size>\n" is
+	appended to "index".  A message is queued if it has a record and its
+	file has that size.  A file without one is still being received, or
+	was abandoned before its sender was told it was accepted.
+	
+	Records are made durable in batches (group commit).  "commit" holds
+	how much of the index is known to be on disk, and whoever takes its
+	lock and finds their record beyond that syncs every message named
+	since, then the index, for all the waiting senders at once.
+	
+	The queue runner drops the records of messages it has removed by
+	writing a new index and renaming it over the old one, holding the
+	old one's lock and the commit lock.  Anyone holding a replaced index
+	notices under its lock and reopens it.
+*/
+
+namespace MailSpool
+{
+	
+	struct Ticket
+	{
+		unsigned long  generation;  // of the index
+		off_t          end;         // of our record in it
+		plus::string   name;
+	};
+	
+	struct Record
+	{
+		plus::string  name;
+		off_t         size;
+	};
+	
+	class Spool
+	{
+		private:
+			nucleus::owned< poseven::fd_t >  its_dir;
+			nucleus::owned< poseven::fd_t >  its_index;
+			nucleus::owned< poseven::fd_t >  its_commit;
+			bool                             its_locking;  // flock() works here
+			
+			// non-copyable
+			Spool           ( const Spool& );
+			Spool& operator=( const Spool& );
+			
+			bool index_is_current() const;
+			
+			void reopen_index();
+			
+			void commit_alone( const Ticket& ticket );
+			
+			bool compact_locked();
+			
+		public:
+			explicit Spool( const char* path );
+			
+			poseven::fd_t dir() const  { return its_dir; }
+			
+			Ticket append( const plus::string& name, off_t size );
+			
+			// Returns once the message named by the ticket is on disk.
+			void commit( const Ticket& ticket );
+			
+			// Complete messages, in the order they were queued.
+			std::vector< Record > queued() const;
+			
+			/*
+				Drops the records of messages that have been removed.  Returns
+				false if it can't be done safely here (i.e. without flock()).
+			*/
+			bool compact();
+	};
+	
+}
+
+#endif
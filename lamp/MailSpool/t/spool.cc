@@ -0,0 +1,125 @@
+/*
+	t/spool.cc
+	----------
+*/
+
+// Standard C
+#include <stdio.h>
+#include <string.h>
+
+// POSIX
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// MailSpool
+#include "MailSpool/Spool.hh"
+
+// tap-out
+#include "tap/test.hh"
+
+
+#define TMP_DIR  "/tmp/mail-spool-tests-" __TIME__
+
+
+static const unsigned n_tests = 3 + 3;
+
+
+using tap::ok_if;
+
+
+static off_t write_message( const char* name, const char* contents )
+{
+	const int fd = open( name, O_WRONLY | O_CREAT | O_TRUNC, 0600 );
+	
+	const size_t size = strlen( contents );
+	
+	(void) write( fd, contents, size );
+	
+	close( fd );
+	
+	return size;
+}
+
+static off_t index_size()
+{
+	struct stat sb;
+	
+	return stat( "index", &sb ) == 0 ? sb.st_size : -1;
+}
+
+static bool queued( const MailSpool::Spool& spool, const char* a, const char* b )
+{
+	const std::vector< MailSpool::Record > records = spool.queued();
+	
+	const size_t n = (a != NULL) + (b != NULL);
+	
+	return    records.size() == n
+	       && (a == NULL  ||  records[ 0 ].name == a)
+	       && (b == NULL  ||  records[ 1 ].name == b);
+}
+
+static void queueing( MailSpool::Spool& spool )
+{
+	const off_t size_a = write_message( "a", "From <x>\nTo <y>\n\nHi\r\n" );
+	const off_t size_b = write_message( "b", "From <x>\nTo <z>\n\nBye\r\n" );
+	
+	spool.commit( spool.append( "a", size_a ) );
+	spool.commit( spool.append( "b", size_b ) );
+	
+	ok_if( queued( spool, "a", "b" ), "committed messages are queued" );
+	
+	write_message( "c", "From <x>\n" );
+	
+	(void) spool.append( "c", 100 );
+	
+	ok_if( queued( spool, "a", "b" ), "a short file isn't queued" );
+	
+	unlink( "c" );
+	
+	write_message( "d", "From <x>" );
+	
+	ok_if( queued( spool, "a", "b" ), "an unrecorded file isn't queued" );
+}
+
+static void compacting( MailSpool::Spool& spool, MailSpool::Spool& other )
+{
+	const off_t before = index_size();
+	
+	unlink( "a" );
+	
+	ok_if( spool.compact()  &&  index_size() < before  &&  queued( spool, "b", NULL ), "compaction drops removed messages" );
+	
+	const off_t size_d = write_message( "d", "From <x>\nTo <y>\n\n" );
+	
+	other.commit( other.append( "d", size_d ) );
+	
+	ok_if( queued( spool, "b", "d" ), "a replaced index is reopened" );
+	
+	ok_if( spool.compact()  &&  queued( other, "b", "d" ), "compaction keeps what's queued" );
+}
+
+int main( int argc, const char *const *argv )
+{
+	tap::start( "spool", n_tests );
+	
+	mkdir( TMP_DIR, 0700 );
+	
+	chdir( TMP_DIR );
+	
+	MailSpool::Spool spool( "." );
+	MailSpool::Spool other( "." );  // as if in another process
+	
+	queueing( spool );
+	
+	compacting( spool, other );
+	
+	unlink( "b" );
+	unlink( "d" );
+	unlink( "index" );
+	unlink( "commit" );
+	
+	rmdir( TMP_DIR );
+	
+	return 0;
+}
@@ -16,6 +16,7 @@
 
 // Recall
 #include "recall/backtrace.hh"
+#include "recall/profiler.hh"
 #include "recall/stack_crawl.hh"
 
 // poseven
@@ -90,6 +91,8 @@ namespace Orion
 	{
 		const void* stackBottom = recall::get_stack_frame_pointer();
 		
+		recall::start_profiling_from_environment();
+		
 		try
 		{
 			return tool::Main( argc, argv );
@@ -10,10 +10,12 @@
 #include <cstring>
 
 // Standard C++
+#include <algorithm>
 #include <functional>
 
 // POSIX
-#include "dirent.h"
+#include <dirent.h>
+#include <sys/stat.h>
 
 // gear
 #include "gear/find.hh"
@@ -26,6 +28,9 @@
 #include "plus/var_string.hh"
 #include "plus/string/concat.hh"
 
+// ShellShock
+#include "ShellShock/Glob.hh"
+
 
 namespace ShellShock
 {
@@ -381,126 +386,164 @@ namespace ShellShock
 		return vec;
 	}
 	
-	static bool NameMatchesPattern( const char* name, const char* pattern )
+	static const char* EndOfPathnameComponent( const char* path )
 	{
-		while ( *name && *pattern && *pattern != '*' )
+		char quote = '\0';
+		
+		for ( ;  *path != '\0';  ++path )
 		{
-			// Breaks on ? or [
-			if ( *name != *pattern  )
+			if ( *path == '\\'  &&  quote != '\''  &&  path[ 1 ] != '\0' )
 			{
-				return false;
+				++path;
+			}
+			else if ( quote != '\0' )
+			{
+				if ( *path == quote )
+				{
+					quote = '\0';
+				}
+			}
+			else if ( *path == '\''  ||  *path == '"' )
+			{
+				quote = *path;
+			}
+			else if ( *path == '/' )
+			{
+				break;
 			}
-			
-			++name;
-			++pattern;
-		}
-		
-		if ( pattern[0] == '\0' || pattern[1] == '\0' )
-		{
-			return true;
 		}
 		
-		const char* name_end    = name    + std::strlen( name    ) - 1;
-		const char* pattern_end = pattern + std::strlen( pattern ) - 1;
+		return path;
+	}
+	
+	// Matched names undergo quote removal along with the rest of the word.
+	
+	static plus::string EscapeQuoteChars( const char* name )
+	{
+		plus::var_string result;
 		
-		while ( name_end >= name && pattern_end >= pattern && *pattern_end != '*' )
+		for ( ;  *name != '\0';  ++name )
 		{
-			// Breaks on ? or [
-			if ( *name_end != *pattern_end  )
+			if ( IsAShellQuoteChar( *name ) )
 			{
-				return false;
+				result += '\\';
 			}
 			
-			--name_end;
-			--pattern_end;
+			result += *name;
 		}
 		
-		if ( pattern == pattern_end )
-		{
-			// one char left, and must be *
-			return true;
-		}
+		return result;
+	}
+	
+	static bool Exists( const plus::string& path )
+	{
+		struct stat sb;
 		
-		// Assume no match
-		return false;
+		return lstat( path.c_str(), &sb ) == 0;
 	}
 	
-	static void MatchPathnames( const plus::string& in_dir, const char* pattern, std::vector< plus::string >& result )
+	static bool IsDirectory( const plus::string& dir, const dirent& entry )
 	{
-		const char* dir_pathname = in_dir.empty() ? "." : in_dir.c_str();
+	#ifdef DT_UNKNOWN
 		
-		DIR* dir = opendir( dir_pathname );
+		// Only a symlink or an unknown type needs a stat().
 		
-		if ( dir == NULL )
+		if ( entry.d_type != DT_UNKNOWN  &&  entry.d_type != DT_LNK )
 		{
-			//P7::ThrowErrno( ENOENT );
-			return;
+			return entry.d_type == DT_DIR;
 		}
 		
-		bool match_dotfiles = pattern[0] == '.';
+	#endif
 		
-		while ( dirent* entry = readdir( dir ) )
-		{
-			const char* name = entry->d_name;
-			
-			bool matched = (match_dotfiles || name[0] != '.')  &&  NameMatchesPattern( name, pattern );
-			
-			if ( matched )
-			{
-				result.push_back( in_dir + name );
-			}
-		}
+		struct stat sb;
 		
-		closedir( dir );
+		return stat( (dir + entry.d_name).c_str(), &sb ) == 0  &&  S_ISDIR( sb.st_mode );
 	}
 	
-	static void ExpandPathnames( const plus::string& from_dir, const char* path, std::vector< plus::string >& result )
+	/*
+		Expands a path one component at a time.  'dir' is where we are in
+		the filesystem, and 'word_dir' is the same, but as it will appear in
+		the result, still quoted.  Each directory's matches are sorted before
+		descending into them -- with the slash that follows, so that "a-b/x"
+		sorts before "a/x" -- and the results come out in order.
+	*/
+	
+	static void ExpandPathnames( const plus::string&           dir,
+	                             const plus::string&           word_dir,
+	                             const char*                   path,
+	                             std::vector< plus::string >&  result )
 	{
-		//while ( *path == '/' ) continue;  // e.g. /foo//bar
+		const char* end = EndOfPathnameComponent( path );
 		
-		bool have_meta = false;
-		const char* slash = NULL;
+		const GlobPattern pattern( path, end );
 		
-		const char* p = path;
+		// A trailing slash matches only directories, and is kept.
 		
-		for ( p = path;  slash == NULL && *p != '\0';  ++p )
+		const bool last = end[ 0 ] == '\0'  ||  end[ 1 ] == '\0';
+		
+		const char* slash = end[ 0 ] == '/' ? "/" : "";
+		
+		if ( !pattern.HasMeta() )
 		{
-			switch ( *p )
+			const plus::string next_dir      = dir      + pattern.Literal();
+			const plus::string next_word_dir = word_dir + plus::string( path, end );
+			
+			if ( !last )
 			{
-				case '/':
-					slash = p;
-					break;
-				case '*':  // fall through
-				case '?':  // fall through
-				case '[':
-					have_meta = true;
-					break;
-				default:
-					// do nothing
-					break;
+				ExpandPathnames( next_dir + "/", next_word_dir + "/", end + 1, result );
+			}
+			else if ( Exists( next_dir + slash ) )
+			{
+				result.push_back( next_word_dir + slash );
 			}
+			
+			return;
 		}
 		
-		if ( !have_meta )
+		DIR* d = opendir( dir.empty() ? "." : dir.c_str() );
+		
+		if ( d == NULL )
+		{
+			return;
+		}
+		
+		const bool dotfiles = pattern.MatchesDotfiles();
+		
+		std::vector< plus::string > names;
+		
+		while ( const dirent* entry = readdir( d ) )
 		{
-			if ( slash != NULL )
+			const char* name = entry->d_name;
+			
+			if ( name[ 0 ] == '.'  &&  !dotfiles )
 			{
-				const char* remainder = slash + 1;
-				plus::string this_dir( path, remainder );
-				
-				ExpandPathnames( from_dir + this_dir, remainder, result );
+				continue;
 			}
-			else
+			
+			if ( pattern.Matches( name, std::strlen( name ) )  &&  (*slash == '\0'  ||  IsDirectory( dir, *entry )) )
 			{
-				result.push_back( from_dir + path );
+				names.push_back( plus::string( name ) + slash );
 			}
-			
-			return;
 		}
 		
-		if ( slash == NULL )
+		closedir( d );
+		
+		std::sort( names.begin(), names.end() );
+		
+		typedef std::vector< plus::string >::const_iterator Iter;
+		
+		for ( Iter it = names.begin();  it != names.end();  ++it )
 		{
-			MatchPathnames( from_dir, path, result );
+			const plus::string name = EscapeQuoteChars( it->c_str() );
+			
+			if ( last )
+			{
+				result.push_back( word_dir + name );
+			}
+			else
+			{
+				ExpandPathnames( dir + *it, word_dir + name, end + 1, result );
+			}
 		}
 	}
 	
@@ -518,7 +561,7 @@ namespace ShellShock
 			
 			//if ( getcwd( path, 1024 ) == NULL throw N::ParamErr() );
 			
-			ExpandPathnames( "", word.c_str(), result );
+			ExpandPathnames( "", "", word.c_str(), result );
 		}
 		
 		if ( result.empty() )
@@ -0,0 +1,390 @@
+// =======
+// Glob.cc
+// =======
+
+#include "ShellShock/Glob.hh"
+
+// Standard C/C++
+#include <cctype>
+#include <cstring>
+
+
+namespace ShellShock
+{
+	
+	static inline void AddChar( unsigned char* bits, unsigned char c )
+	{
+		bits[ c / 8 ] |= 1 << c % 8;
+	}
+	
+	static inline bool HasChar( const unsigned char* bits, unsigned char c )
+	{
+		return bits[ c / 8 ] & 1 << c % 8;
+	}
+	
+	static int IsBlank( int c )
+	{
+		return c == ' '  ||  c == '\t';
+	}
+	
+	struct NamedClass
+	{
+		const char*  name;
+		int        (*test)( int );
+	};
+	
+	static const NamedClass gNamedClasses[] =
+	{
+		{ "alnum",  &isalnum  },
+		{ "alpha",  &isalpha  },
+		{ "blank",  &IsBlank  },
+		{ "cntrl",  &iscntrl  },
+		{ "digit",  &isdigit  },
+		{ "graph",  &isgraph  },
+		{ "lower",  &islower  },
+		{ "print",  &isprint  },
+		{ "punct",  &ispunct  },
+		{ "space",  &isspace  },
+		{ "upper",  &isupper  },
+		{ "xdigit", &isxdigit },
+	};
+	
+	// Adds e.g. "[:alpha:]", returning the end, or NULL if it isn't one.
+	
+	static const char* AddNamedClass( unsigned char* bits, const char* p, const char* end )
+	{
+		const char* name = p + 2;
+		
+		for ( const char* q = name;  q + 1 < end;  ++q )
+		{
+			if ( q[ 0 ] == ':'  &&  q[ 1 ] == ']' )
+			{
+				const std::size_t length = q - name;
+				
+				const NamedClass* it  = gNamedClasses;
+				const NamedClass* top = it + sizeof gNamedClasses / sizeof gNamedClasses[ 0 ];
+				
+				for ( ;  it != top;  ++it )
+				{
+					if ( std::strlen( it->name ) == length  &&  std::memcmp( it->name, name, length ) == 0 )
+					{
+						for ( int c = 1;  c < 256;  ++c )
+						{
+							if ( it->test( c ) )
+							{
+								AddChar( bits, c );
+							}
+						}
+						
+						return q + 2;
+					}
+				}
+				
+				break;
+			}
+		}
+		
+		return NULL;
+	}
+	
+	/*
+		Compiles a bracket expression after its '[', returning the position
+		of its closing ']', or NULL if there isn't one (in which case the
+		'[' is literal).
+	*/
+	
+	static const char* CompileCharSet( unsigned char* bits, const char* p, const char* end )
+	{
+		std::memset( bits, '\0', 256 / 8 );
+		
+		const bool negated = p != end  &&  (*p == '!'  ||  *p == '^');
+		
+		if ( negated )
+		{
+			++p;
+		}
+		
+		// A ']' first is literal.
+		
+		const char* first = p;
+		
+		while ( p != end  &&  (*p != ']'  ||  p == first) )
+		{
+			if ( p[ 0 ] == '['  &&  p + 1 != end  &&  p[ 1 ] == ':' )
+			{
+				if ( const char* next = AddNamedClass( bits, p, end ) )
+				{
+					p = next;
+					
+					continue;
+				}
+			}
+			
+			if ( *p == '\\'  &&  p + 1 != end )
+			{
+				++p;
+			}
+			
+			unsigned char low  = *p++;
+			unsigned char high = low;
+			
+			if ( p + 1 < end  &&  p[ 0 ] == '-'  &&  p[ 1 ] != ']' )
+			{
+				p += 1 + (p[ 1 ] == '\\'  &&  p + 2 != end);
+				
+				high = *p++;
+			}
+			
+			for ( unsigned c = low;  c <= high;  ++c )
+			{
+				AddChar( bits, c );
+			}
+		}
+		
+		if ( p == end )
+		{
+			return NULL;
+		}
+		
+		if ( negated )
+		{
+			for ( unsigned i = 0;  i < 256 / 8;  ++i )
+			{
+				bits[ i ] = ~bits[ i ];
+			}
+		}
+		
+		return p;
+	}
+	
+	GlobPattern::GlobPattern( const char* begin, const char* end )
+	:
+		itsPrefixLength( 0 ),
+		itsHasStar( false ),
+		itsHasMeta( false )
+	{
+		Run run = { 0, 0 };
+		
+		char quote = '\0';
+		
+		bool in_prefix = true;
+		
+		for ( const char* p = begin;  p != end;  ++p )
+		{
+			Element element = { kLiteral, (unsigned char) *p, 0 };
+			
+			if ( quote == '\'' )
+			{
+				if ( *p == '\'' )
+				{
+					quote = '\0';
+					
+					continue;
+				}
+			}
+			else if ( *p == '\\'  &&  p + 1 != end )
+			{
+				element.c = *++p;
+			}
+			else if ( quote == '"' )
+			{
+				if ( *p == '"' )
+				{
+					quote = '\0';
+					
+					continue;
+				}
+			}
+			else if ( *p == '\''  ||  *p == '"' )
+			{
+				quote = *p;
+				
+				continue;
+			}
+			else if ( *p == '*' )
+			{
+				run.end = itsElements.size();
+				
+				itsRuns.push_back( run );
+				
+				run.begin = run.end;
+				
+				itsHasStar = true;
+				itsHasMeta = true;
+				
+				in_prefix = false;
+				
+				continue;
+			}
+			else if ( *p == '?' )
+			{
+				element.kind = kAnyChar;
+			}
+			else if ( *p == '[' )
+			{
+				CharSet set;
+				
+				if ( const char* close = CompileCharSet( set.bits, p + 1, end ) )
+				{
+					element.kind = kCharSet;
+					element.set  = itsSets.size();
+					
+					itsSets.push_back( set );
+					
+					p = close;
+				}
+			}
+			
+			if ( element.kind == kLiteral )
+			{
+				itsLiteral += (char) element.c;
+				
+				itsPrefixLength += in_prefix;
+			}
+			else
+			{
+				itsHasMeta = true;
+				
+				in_prefix = false;
+			}
+			
+			itsElements.push_back( element );
+		}
+		
+		run.end = itsElements.size();
+		
+		itsRuns.push_back( run );
+	}
+	
+	bool GlobPattern::RunMatches( const Run& run, const unsigned char* p ) const
+	{
+		const Element* it  = &itsElements[ 0 ] + run.begin;
+		const Element* end = &itsElements[ 0 ] + run.end;
+		
+		for ( ;  it != end;  ++it, ++p )
+		{
+			switch ( it->kind )
+			{
+				case kLiteral:
+					if ( *p != it->c )
+					{
+						return false;
+					}
+					
+					break;
+				
+				case kCharSet:
+					if ( !HasChar( itsSets[ it->set ].bits, *p ) )
+					{
+						return false;
+					}
+					
+					break;
+			}
+		}
+		
+		return true;
+	}
+	
+	// Finds the leftmost match of a run, or NULL.
+	
+	const unsigned char* GlobPattern::FindRun( const Run&            run,
+	                                           const unsigned char*  begin,
+	                                           const unsigned char*  end ) const
+	{
+		const std::size_t width = run.end - run.begin;
+		
+		if ( std::size_t( end - begin ) < width )
+		{
+			return NULL;
+		}
+		
+		if ( width == 0 )
+		{
+			return begin;
+		}
+		
+		const unsigned char* last = end - width;
+		
+		const Element& first = itsElements[ run.begin ];
+		
+		for ( const unsigned char* p = begin;  p <= last;  ++p )
+		{
+			if ( first.kind == kLiteral )
+			{
+				p = (const unsigned char*) std::memchr( p, first.c, last - p + 1 );
+				
+				if ( p == NULL )
+				{
+					return NULL;
+				}
+			}
+			
+			if ( RunMatches( run, p ) )
+			{
+				return p;
+			}
+		}
+		
+		return NULL;
+	}
+	
+	/*
+		The runs between stars each match a fixed number of characters, so
+		the first and last runs are anchored, and taking the leftmost match
+		of each run in between never needs to be undone.
+	*/
+	
+	bool GlobPattern::Matches( const char* name, std::size_t length ) const
+	{
+		if ( length < itsPrefixLength  ||  std::memcmp( name, itsLiteral.data(), itsPrefixLength ) != 0 )
+		{
+			return false;
+		}
+		
+		const unsigned char* p   = (const unsigned char*) name;
+		const unsigned char* end = p + length;
+		
+		const Run& first = itsRuns.front();
+		const Run& last  = itsRuns.back();
+		
+		const std::size_t first_width = first.end - first.begin;
+		
+		if ( !itsHasStar )
+		{
+			return length == first_width  &&  RunMatches( first, p );
+		}
+		
+		const std::size_t last_width = last.end - last.begin;
+		
+		if ( length < first_width + last_width )
+		{
+			return false;
+		}
+		
+		if ( !RunMatches( first, p )  ||  !RunMatches( last, end - last_width ) )
+		{
+			return false;
+		}
+		
+		p   += first_width;
+		end -= last_width;
+		
+		for ( std::size_t i = 1;  i + 1 < itsRuns.size();  ++i )
+		{
+			const Run& run = itsRuns[ i ];
+			
+			p = FindRun( run, p, end );
+			
+			if ( p == NULL )
+			{
+				return false;
+			}
+			
+			p += run.end - run.begin;
+		}
+		
+		return true;
+	}
+	
+}
@@ -0,0 +1,87 @@
+// =======
+// Glob.hh
+// =======
+
+#ifndef SHELLSHOCK_GLOB_HH
+#define SHELLSHOCK_GLOB_HH
+
+// Standard C++
+#include <vector>
+
+// plus
+#include "plus/var_string.hh"
+
+
+namespace ShellShock
+{
+	
+	/*
+		One pathname component of a pattern, compiled once for matching
+		against every name in a directory.  Quoted (or backslash-escaped)
+		characters are literal, as they'll be after quote removal.
+	*/
+	
+	class GlobPattern
+	{
+		private:
+			enum ElementKind
+			{
+				kLiteral,
+				kAnyChar,
+				kCharSet
+			};
+			
+			struct Element
+			{
+				unsigned char   kind;
+				unsigned char   c;    // a literal
+				unsigned short  set;  // an index into itsSets
+			};
+			
+			struct CharSet
+			{
+				unsigned char bits[ 256 / 8 ];
+			};
+			
+			// Elements between stars, each matching one character
+			struct Run
+			{
+				unsigned short begin;
+				unsigned short end;
+			};
+			
+			std::vector< Element >  itsElements;
+			std::vector< CharSet >  itsSets;
+			std::vector< Run >      itsRuns;
+			
+			// The unquoted text, for a pattern without metacharacters
+			plus::var_string  itsLiteral;
+			
+			// The literal characters the pattern starts with
+			std::size_t  itsPrefixLength;
+			
+			bool  itsHasStar;
+			bool  itsHasMeta;
+			
+			bool RunMatches( const Run& run, const unsigned char* p ) const;
+			
+			const unsigned char* FindRun( const Run&            run,
+			                              const unsigned char*  begin,
+			                              const unsigned char*  end ) const;
+		
+		public:
+			GlobPattern( const char* begin, const char* end );
+			
+			bool HasMeta() const  { return itsHasMeta; }
+			
+			const plus::string& Literal() const  { return itsLiteral; }
+			
+			// A name starting with '.' only matches a literal '.'.
+			bool MatchesDotfiles() const  { return itsPrefixLength > 0  &&  Literal()[ 0 ] == '.'; }
+			
+			bool Matches( const char* name, std::size_t length ) const;
+	};
+	
+}
+
+#endif
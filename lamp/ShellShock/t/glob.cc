@@ -0,0 +1,60 @@
+/*
+	t/glob.cc
+	---------
+*/
+
+// Standard C
+#include <string.h>
+
+// ShellShock
+#include "ShellShock/Glob.hh"
+
+// tap-out
+#include "tap/test.hh"
+
+
+static const unsigned n_tests = 4 + 4;
+
+
+using tap::ok_if;
+
+
+static bool matches( const char* pattern, const char* name )
+{
+	ShellShock::GlobPattern glob( pattern, pattern + strlen( pattern ) );
+	
+	return glob.Matches( name, strlen( name ) );
+}
+
+static void stars()
+{
+	ok_if( matches( "*.c", "foo.c" )  &&  !matches( "*.c", "foo.h" )  &&  matches( "*.c", ".c" ), "suffix" );
+	
+	ok_if( matches( "a*b*c", "aXbXc" )  &&  matches( "a*b*c", "abc" )  &&  !matches( "a*b*c", "acb" ), "runs between stars" );
+	
+	ok_if( matches( "*abc", "abcabc" )  &&  matches( "a*bc*bc", "abcbc" )  &&  !matches( "a*bc*bc", "abc" ), "overlapping runs" );
+	
+	ok_if( matches( "**", "" )  &&  matches( "*", "anything" )  &&  !matches( "x", "" ), "empty names" );
+}
+
+static void sets()
+{
+	ok_if( matches( "x?", "x1" )  &&  !matches( "x?", "x" )  &&  !matches( "x?", "x12" ), "any char" );
+	
+	ok_if( matches( "x[0-9]", "x5" )  &&  !matches( "x[!0-9]", "x5" )  &&  matches( "x[]a]", "x]" ), "bracket expressions" );
+	
+	ok_if( matches( "[[:upper:]]*", "Makefile" )  &&  !matches( "[[:upper:]]*", "makefile" ), "character classes" );
+	
+	ok_if( matches( "x[", "x[" )  &&  matches( "\\*'?'\"[a]\"", "*?[a]" )  &&  !matches( "'*'", "x" ), "quoted and unclosed" );
+}
+
+int main( int argc, const char *const *argv )
+{
+	tap::start( "glob", n_tests );
+	
+	stars();
+	
+	sets();
+	
+	return 0;
+}
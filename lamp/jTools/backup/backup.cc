@@ -21,17 +21,23 @@
 #include "poseven/Directory.hh"
 #include "poseven/Pathnames.hh"
 #include "poseven/extras/pump.hh"
+#include "poseven/extras/walk_tree.hh"
 #include "poseven/functions/basename.hh"
+#include "poseven/functions/dup.hh"
 #include "poseven/functions/fchmod.hh"
+#include "poseven/functions/fdopendir.hh"
 #include "poseven/functions/fstat.hh"
+#include "poseven/functions/fstatat.hh"
 #include "poseven/functions/mkdir.hh"
 #include "poseven/functions/open.hh"
+#include "poseven/functions/openat.hh"
 #include "poseven/functions/read.hh"
 #include "poseven/functions/rename.hh"
 #include "poseven/functions/stat.hh"
 #include "poseven/functions/symlink.hh"
 #include "poseven/functions/utime.hh"
 #include "poseven/functions/write.hh"
+#include "poseven/sequences/directory_contents.hh"
 #include "poseven/types/exit_t.hh"
 
 // Orion
@@ -85,17 +91,35 @@ namespace tool
 	}
 	
 	
-	static void copy_file( const std::string& source, const std::string& dest )
+	static inline n::owned< p7::fd_t > open_dir( p7::fd_t dirfd, const char* name )
 	{
-		if ( filter_file( source ) )
-		{
-			return;
-		}
+		return p7::openat( dirfd, name, p7::o_rdonly | p7::o_directory );
+	}
+	
+	static inline n::owned< p7::fd_t > open_dir( const std::string& path )
+	{
+		return p7::open( path, p7::o_rdonly | p7::o_directory );
+	}
+	
+	static p7::directory_contents_container dirfd_contents( p7::fd_t fd )
+	{
+		return p7::directory_contents_container( p7::fdopendir( p7::dup( fd ) ) );
+	}
+	
+	static bool is_directory( p7::fd_t dirfd, const char* name )
+	{
+		struct stat sb;
 		
+		return p7::fstatat( dirfd, name, sb, p7::at_symlink_nofollow )  &&  S_ISDIR( sb.st_mode );
+	}
+	
+	
+	static void copy_file( const p7::walk_entry& file, const std::string& dest )
+	{
 		//p7::copyfile( source, dest );
 		
-		n::owned< p7::fd_t > in  = p7::open( source, p7::o_rdonly );
-		n::owned< p7::fd_t > out = p7::open( dest,   p7::o_wronly | p7::o_creat | p7::o_excl, p7::_400 );
+		n::owned< p7::fd_t > in  = p7::openat( file.dirfd(), file.name(), p7::o_rdonly );
+		n::owned< p7::fd_t > out = p7::open( dest, p7::o_wronly | p7::o_creat | p7::o_excl, p7::_400 );
 		
 		p7::pump( in, out );
 		
@@ -108,69 +132,65 @@ namespace tool
 		p7::utime( dest, p7::fstat( in ).st_mtime );
 	}
 	
-	class directory_maker
+	class backup_copier : public p7::tree_visitor
 	{
 		private:
-			const std::string& its_source;
+			const std::string& its_source;  // ends in a slash
 			const std::string& its_dest;
-		
-		public:
-			directory_maker( const std::string& source,
-			                 const std::string& dest ) : its_source( source ),
-			                                             its_dest  ( dest   )
-			{
-			}
 			
-			bool operator()( const std::string& path, unsigned depth ) const
+			std::string dest_path( const p7::walk_entry& entry ) const
 			{
-				if ( filter_directory( path ) )
-				{
-					return false;
-				}
+				const plus::string& path = entry.path();
 				
 				std::string new_path = its_dest;
 				
-				new_path.append( path.begin() + its_source.size(), path.end() );
+				// Keep the slash that ends the source.
+				new_path.append( path.begin() + its_source.size() - 1, path.end() );
 				
-				p7::mkdir( new_path );
-				
-				return true;
+				return new_path;
 			}
-	};
-	
-	class file_copier
-	{
-		private:
-			const std::string& its_source;
-			const std::string& its_dest;
 		
 		public:
-			file_copier( const std::string& source,
-			             const std::string& dest ) : its_source( source ),
-			                                         its_dest  ( dest   )
+			backup_copier( const std::string& source,
+			               const std::string& dest ) : its_source( source ),
+			                                           its_dest  ( dest   )
 			{
 			}
 			
-			void operator()( const std::string& path, unsigned depth ) const
+			bool enter_directory( const p7::walk_entry& dir )
 			{
-				if ( filter_file( path ) )
+				if ( dir.depth() == 0 )
 				{
-					return;
+					return true;  // the destination already exists
 				}
 				
-				std::string new_path = its_dest;
+				if ( filter_directory( dir.name() ) )
+				{
+					return false;
+				}
 				
-				new_path.append( path.begin() + its_source.size(), path.end() );
+				p7::mkdir( dest_path( dir ) );
 				
-				copy_file( path, new_path );
+				return true;
+			}
+			
+			void visit_file( const p7::walk_entry& file )
+			{
+				if ( !filter_file( file.name() ) )
+				{
+					copy_file( file, dest_path( file ) );
+				}
 			}
 	};
 	
 	
-	static void compare_files( const std::string& a, const std::string& b )
+	static void compare_files( p7::fd_t            a_dirfd,
+	                           p7::fd_t            b_dirfd,
+	                           const char*         name,
+	                           const std::string&  a )
 	{
-		n::owned< p7::fd_t > a_fd = p7::open( a, p7::o_rdonly );
-		n::owned< p7::fd_t > b_fd = p7::open( b, p7::o_rdonly );
+		n::owned< p7::fd_t > a_fd = p7::openat( a_dirfd, name, p7::o_rdonly );
+		n::owned< p7::fd_t > b_fd = p7::openat( b_dirfd, name, p7::o_rdonly );
 		
 		const std::size_t buffer_size = 4096;
 		
@@ -198,22 +218,27 @@ namespace tool
 		}
 	}
 	
-	static void recursively_compare_directories( const std::string& a, const std::string& b );
+	static void recursively_compare_directories( p7::fd_t a_dirfd, p7::fd_t b_dirfd, const std::string& a );
 	
-	static void recursively_compare( const std::string& a, const std::string& b )
+	static void recursively_compare( p7::fd_t            a_dirfd,
+	                                 p7::fd_t            b_dirfd,
+	                                 const char*         name,
+	                                 const std::string&  a )
 	{
-		bool a_is_dir = io::directory_exists( a );
-		bool b_is_dir = io::directory_exists( b );
+		bool a_is_dir = is_directory( a_dirfd, name );
+		bool b_is_dir = is_directory( b_dirfd, name );
 		
 		if ( bool matched = a_is_dir == b_is_dir )
 		{
 			if ( a_is_dir )
 			{
-				recursively_compare_directories( a, b );
+				recursively_compare_directories( open_dir( a_dirfd, name ),
+				                                 open_dir( b_dirfd, name ),
+				                                 a );
 			}
 			else
 			{
-				compare_files( a, b );
+				compare_files( a_dirfd, b_dirfd, name, a );
 			}
 		}
 		else
@@ -240,12 +265,14 @@ namespace tool
 		odd_item( path, false );
 	}
 	
-	static void recursively_compare_directory_contents( const std::string& a_dir, const std::string& b_dir )
+	static void recursively_compare_directory_contents( p7::fd_t            a_dirfd,
+	                                                    p7::fd_t            b_dirfd,
+	                                                    const std::string&  a_dir )
 	{
 		typedef p7::directory_contents_container directory_container;
 		
-		directory_container a_contents = io::directory_contents( a_dir );
-		directory_container b_contents = io::directory_contents( b_dir );
+		directory_container a_contents = dirfd_contents( a_dirfd );
+		directory_container b_contents = dirfd_contents( b_dirfd );
 		
 		std::vector< std::string > a;
 		std::vector< std::string > b;
@@ -285,7 +312,7 @@ namespace tool
 			
 			if ( cmp == 0 )
 			{
-				recursively_compare( a_dir / a_name, b_dir / b_name );
+				recursively_compare( a_dirfd, b_dirfd, a_name.c_str(), a_dir / a_name );
 				
 				++aa;
 				++bb;
@@ -327,11 +354,11 @@ namespace tool
 		}
 	}
 	
-	static void recursively_compare_directories( const std::string& a, const std::string& b )
+	static void recursively_compare_directories( p7::fd_t a_dirfd, p7::fd_t b_dirfd, const std::string& a )
 	{
 		// compare any relevant metadata, like Desktop comment
 		
-		recursively_compare_directory_contents( a, b );
+		recursively_compare_directory_contents( a_dirfd, b_dirfd, a );
 	}
 	
 	
@@ -367,10 +394,13 @@ namespace tool
 		
 		gmtime_r( &mod_time, &backup_time );
 		
-		io::recursively_walk_subtrees( target,
-		                               directory_maker( target, in_progress ),
-		                               file_copier    ( target, in_progress ),
-		                               io::walk_noop() );
+		// The slash follows the target, which should be a link.
+		
+		const std::string source = target + "/";
+		
+		backup_copier copier( source, in_progress );
+		
+		p7::walk_tree( source.c_str(), copier );
 		
 		char name[ sizeof "2008-10-02 01:30:00" ];  // 19 + 1 = 20
 		
@@ -440,7 +470,9 @@ namespace tool
 		
 		if ( comparing )
 		{
-			recursively_compare_directories( backup_target, backup_storage / "Active" );
+			recursively_compare_directories( open_dir( backup_target ),
+			                                 open_dir( backup_storage / "Active" ),
+			                                 backup_target );
 		}
 		
 		if ( backing_up )
@@ -450,6 +482,6 @@ namespace tool
 		
 		return 0;
 	}
-
+	
 }
 
@@ -3,22 +3,57 @@
  *	===========
  */
 
+// Standard C
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+// POSIX
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
 // gear
 #include "gear/parse_float.hh"
 
+// plus
+#include "plus/string.hh"
+
 // poseven
-#include "poseven/extras/slurp.hh"
+#include "poseven/extras/write_all.hh"
+#include "poseven/functions/fstat.hh"
 #include "poseven/functions/ftruncate.hh"
+#include "poseven/functions/open.hh"
+#include "poseven/functions/pread.hh"
 #include "poseven/functions/pwrite.hh"
+#include "poseven/functions/read.hh"
+#include "poseven/functions/stat.hh"
 
 // Orion
 #include "Orion/get_options.hh"
 #include "Orion/Main.hh"
 
 
+/*
+	follower [--sleep seconds] [--poll] [file]
+	
+	The output mirrors the file.  Bytes appended to the file are copied to
+	the end of the output, so following a growing log costs only what's
+	new.  If the file shrinks, is replaced (e.g. by log rotation), or
+	changes without growing, the output is rewritten from the start.
+	
+	Where inotify is available, the file is checked only when it (or an
+	entry in its directory by the same name) changes; otherwise, or with
+	--poll, it's checked every --sleep seconds.
+*/
+
 namespace tool
 {
 	
+	namespace n = nucleus;
 	namespace p7 = poseven;
 	namespace o = orion;
 	
@@ -39,18 +74,240 @@ namespace tool
 		return pathname;
 	}
 	
+	struct Followed
+	{
+		const char*           pathname;
+		n::owned< p7::fd_t >  file;
+		bool                  opened;
+		dev_t                 device;
+		ino_t                 inode;
+		time_t                modified;
+		off_t                 offset;  // bytes copied to the output
+		bool                  seekable_output;
+		bool                  rewritten;  // since the output was truncated
+	};
+	
+	static void write_output( Followed& f, const char* buffer, size_t n )
+	{
+		if ( !f.seekable_output )
+		{
+			p7::write_all( p7::stdout_fileno, buffer, n );
+			
+			return;
+		}
+		
+		for ( size_t n_written = 0;  n_written < n;  )
+		{
+			n_written += p7::pwrite( p7::stdout_fileno,
+			                         buffer + n_written,
+			                         n - n_written,
+			                         f.offset + n_written );
+		}
+	}
+	
+	static void copy_appended( Followed& f )
+	{
+		char buffer[ 64 * 1024 ];
+		
+		while ( const ssize_t n = p7::pread( f.file, buffer, sizeof buffer, f.offset ) )
+		{
+			write_output( f, buffer, n );
+			
+			f.offset += n;
+		}
+		
+		if ( f.rewritten  &&  f.seekable_output )
+		{
+			// Cut off whatever's left of the previous contents.
+			
+			p7::ftruncate( p7::stdout_fileno, f.offset );
+		}
+		
+		f.rewritten = false;
+	}
+	
+	static void rewind( Followed& f )
+	{
+		f.offset    = 0;
+		f.rewritten = true;
+	}
+	
+	// Returns true if the file was (re)opened.
+	
+	static bool update( Followed& f )
+	{
+		struct stat st;
+		
+		if ( !p7::stat( f.pathname, st ) )
+		{
+			return false;  // Not there yet, or mid-rotation
+		}
+		
+		const bool replaced = !f.opened  ||  st.st_dev != f.device
+		                                 ||  st.st_ino != f.inode;
+		
+		if ( replaced )
+		{
+			f.file = p7::open( f.pathname, p7::o_rdonly );
+			
+			st = p7::fstat( f.file );
+			
+			f.opened = true;
+			f.device = st.st_dev;
+			f.inode  = st.st_ino;
+			
+			rewind( f );
+		}
+		else if ( st.st_size < f.offset )
+		{
+			rewind( f );  // truncated
+		}
+		else if ( st.st_size == f.offset  &&  st.st_mtime != f.modified )
+		{
+			rewind( f );  // changed in place
+		}
+		
+		copy_appended( f );
+		
+		f.modified = p7::fstat( f.file ).st_mtime;
+		
+		return replaced;
+	}
+	
+	static void poll( Followed& f, const timespec& interval )
+	{
+		while ( true )
+		{
+			update( f );
+			
+			nanosleep( &interval, NULL );
+		}
+	}
+	
+#ifdef __linux__
+
+	static bool is_our_event( const inotify_event& event, int dir_wd, const char* name )
+	{
+		if ( event.mask & IN_Q_OVERFLOW )
+		{
+			return true;
+		}
+		
+		if ( event.wd != dir_wd )
+		{
+			return true;  // the file itself
+		}
+		
+		return event.len != 0  &&  strcmp( event.name, name ) == 0;
+	}
+	
+	static void wait_for_event( int fd, int dir_wd, const char* name )
+	{
+		union
+		{
+			inotify_event  event;
+			char           buffer[ 4096 ];
+		} u;
+		
+		while ( true )
+		{
+			const ssize_t n_read = p7::read( p7::fd_t( fd ), u.buffer, sizeof u.buffer );
+			
+			for ( const char* p = u.buffer;  p < u.buffer + n_read;  )
+			{
+				const inotify_event& event = *(const inotify_event*) p;
+				
+				if ( is_our_event( event, dir_wd, name ) )
+				{
+					return;
+				}
+				
+				p += sizeof (inotify_event) + event.len;
+			}
+		}
+	}
+	
+	/*
+		The directory is watched for the file's name being created or moved
+		in, and the file itself for changes.  A replacement file gets a new
+		watch, and is checked again in case it changed before the watch.
+	*/
+	
+	static bool follow_with_inotify( Followed& f )
+	{
+		const int fd = inotify_init();
+		
+		if ( fd < 0 )
+		{
+			return false;
+		}
+		
+		const char* slash = strrchr( f.pathname, '/' );
+		
+		const char* name = slash ? slash + 1 : f.pathname;
+		
+		const plus::string dir = slash == NULL     ? plus::string( "." )
+		                       : slash == f.pathname ? plus::string( "/" )
+		                       :                       plus::string( f.pathname, slash );
+		
+		const int dir_wd = inotify_add_watch( fd, dir.c_str(), IN_CREATE | IN_MOVED_TO );
+		
+		const uint32_t file_mask = IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF;
+		
+		int file_wd = -1;
+		
+		while ( true )
+		{
+			if ( update( f )  ||  file_wd < 0 )
+			{
+				if ( file_wd >= 0 )
+				{
+					inotify_rm_watch( fd, file_wd );
+				}
+				
+				file_wd = inotify_add_watch( fd, f.pathname, file_mask );
+				
+				update( f );
+			}
+			
+			if ( file_wd < 0  &&  dir_wd < 0 )
+			{
+				close( fd );
+				
+				return false;
+			}
+			
+			wait_for_event( fd, dir_wd, name );
+		}
+	}
+	
+#endif
+
+	static void copy_stream( const char* pathname )
+	{
+		n::owned< p7::fd_t > file = p7::open( pathname, p7::o_rdonly );
+		
+		char buffer[ 64 * 1024 ];
+		
+		while ( const ssize_t n = p7::read( file, buffer, sizeof buffer ) )
+		{
+			p7::write_all( p7::stdout_fileno, buffer, n );
+		}
+	}
+	
 	int Main( int argc, char** argv )
 	{
 		const char* sleep_arg = NULL;
 		
+		bool polling = false;
+		
 		o::bind_option_to_variable( "--sleep", sleep_arg );
+		o::bind_option_to_variable( "--poll",  polling   );
 		
 		o::get_options( argc, argv );
 		
 		char const *const *free_args = o::free_arguments();
 		
-		std::size_t n_args = o::free_argument_count();
-		
 		const char* pathname = EvaluateMetaFilename( free_args[0] ? free_args[0] : "-" );
 		
 		float sleep_time = 1.0;
@@ -65,30 +322,33 @@ namespace tool
 		
 		timespec time = { seconds, nanoseconds };
 		
-		plus::string output;
-		plus::string previous;
+		struct stat st;
 		
-	again:
-		
-		output = p7::slurp( pathname );
-		
-		if ( output != previous )
+		if ( p7::stat( pathname, st )  &&  !S_ISREG( st.st_mode ) )
 		{
-			p7::pwrite( p7::stdout_fileno, output, 0 );
-			
-			p7::ftruncate( p7::stdout_fileno, output.size() );
+			// A pipe or device can't be reread, so it's simply copied.
 			
-			using std::swap;
+			copy_stream( pathname );
 			
-			swap( output, previous );
+			return 0;
 		}
 		
-		nanosleep( &time, NULL );
+		Followed followed = { pathname };
 		
-		goto again;
+		followed.seekable_output = lseek( STDOUT_FILENO, 0, SEEK_CUR ) != -1;
+		
+	#ifdef __linux__
+		
+		if ( !polling  &&  follow_with_inotify( followed ) )
+		{
+			return 0;
+		}
+		
+	#endif
+		
+		poll( followed, time );
 		
 		return 0;
 	}
 	
 }
-
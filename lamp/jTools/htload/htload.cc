@@ -0,0 +1,393 @@
+/*	=========
+ *	htload.cc
+ *	=========
+ */
+
+// Standard C++
+#include <algorithm>
+#include <vector>
+
+// Standard C/C++
+#include <cstdio>
+#include <cstdlib>
+
+// Standard C
+#include <errno.h>
+#include <string.h>
+
+// POSIX
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Iota
+#include "iota/strings.hh"
+
+// gear
+#include "gear/parse_decimal.hh"
+
+// plus
+#include "plus/var_string.hh"
+
+// poseven
+#include "poseven/bundles/inet.hh"
+#include "poseven/functions/gettimeofday.hh"
+#include "poseven/functions/socket.hh"
+#include "poseven/functions/write.hh"
+#include "poseven/types/exit_t.hh"
+
+// Arcana
+#include "HTTP.hh"
+
+// Orion
+#include "Orion/get_options.hh"
+#include "Orion/Main.hh"
+
+
+/*
+	htload is a local load generator for httpd --listen.  It keeps a
+	number of persistent connections busy with back-to-back GET requests
+	and reports throughput and latency percentiles.
+	
+	E.g.  htload -c 64 -n 100000 http://127.0.0.1:8080/index.html
+*/
+
+namespace tool
+{
+	
+	namespace n = nucleus;
+	namespace p7 = poseven;
+	namespace o = orion;
+	
+	
+	typedef unsigned long long microseconds;
+	
+	static microseconds now()
+	{
+		const timeval tv = p7::gettimeofday();
+		
+		return tv.tv_sec * 1000000ull + tv.tv_usec;
+	}
+	
+	
+	struct Client
+	{
+		int                  fd;
+		HTTP::MessageParser  response;
+		plus::var_string     received;  // header only
+		std::size_t          sent;
+		microseconds         start;
+		
+		Client() : fd( -1 ), response( true ), sent( 0 ), start( 0 )
+		{
+		}
+	};
+	
+	
+	static plus::string gRequest;
+	
+	static std::size_t gRequestsToStart;
+	static std::size_t gErrors = 0;
+	
+	static std::vector< microseconds > gLatencies;
+	
+	
+	static bool StartRequest( Client& client )
+	{
+		if ( gRequestsToStart == 0 )
+		{
+			return false;
+		}
+		
+		--gRequestsToStart;
+		
+		client.received.clear();
+		
+		client.response.Reset();
+		
+		client.sent  = 0;
+		client.start = now();
+		
+		return true;
+	}
+	
+	static bool SendRequest( Client& client )
+	{
+		while ( client.sent < gRequest.size() )
+		{
+			ssize_t n = write( client.fd, gRequest.data() + client.sent, gRequest.size() - client.sent );
+			
+			if ( n < 0 )
+			{
+				return errno == EAGAIN;
+			}
+			
+			client.sent += n;
+		}
+		
+		return true;
+	}
+	
+	// Returns false on error or EOF
+	static bool ReceiveResponse( Client& client )
+	{
+		char buffer[ 64 * 1024 ];
+		
+		ssize_t n = read( client.fd, buffer, sizeof buffer );
+		
+		if ( n <= 0 )
+		{
+			return n < 0  &&  errno == EAGAIN;
+		}
+		
+		const char* data = buffer;
+		
+		HTTP::MessageParser& response = client.response;
+		
+		if ( !response.HasCompleteHeader() )
+		{
+			client.received.append( buffer, n );
+			
+			if ( !response.ParseHeader( client.received.data(), client.received.size() ) )
+			{
+				return true;
+			}
+			
+			const std::size_t header_size = response.GetHeaderSize();
+			
+			const unsigned status = gear::parse_unsigned_decimal( client.received.data() + STRLEN( "HTTP/1.1 " ) );
+			
+			if ( response.GetBodyFraming() == HTTP::body_until_eof  ||  status != 200 )
+			{
+				// Can't reuse a connection without a known message length
+				return false;
+			}
+			
+			data = buffer + n - (client.received.size() - header_size);
+		}
+		
+		const char* end = buffer + n;
+		
+		while ( data < end  &&  !response.IsComplete() )
+		{
+			const char* payload;
+			std::size_t payload_size;
+			
+			data += response.ParseBody( data, end - data, payload, payload_size );
+		}
+		
+		if ( response.IsComplete() )
+		{
+			gLatencies.push_back( now() - client.start );
+			
+			if ( StartRequest( client ) )
+			{
+				return SendRequest( client );
+			}
+			
+			close( client.fd );
+			
+			client.fd = -1;
+		}
+		
+		return true;
+	}
+	
+	static int Connect( p7::in_addr_t addr, p7::in_port_t port )
+	{
+		const int fd = p7::connect( addr, port ).release();
+		
+		int on = 1;
+		
+		setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on );
+		
+		fcntl( fd, F_SETFL, fcntl( fd, F_GETFL, 0 ) | O_NONBLOCK );
+		
+		return fd;
+	}
+	
+	static double percentile( const std::vector< microseconds >& sorted, unsigned pct )
+	{
+		if ( sorted.empty() )
+		{
+			return 0;
+		}
+		
+		std::size_t i = (sorted.size() - 1) * pct / 100;
+		
+		return sorted[ i ] / 1000.0;
+	}
+	
+	int Main( int argc, char** argv )
+	{
+		std::size_t n_connections = 16;
+		std::size_t n_requests    = 10000;
+		
+		o::bind_option_to_variable( "-c", n_connections );
+		o::bind_option_to_variable( "-n", n_requests    );
+		
+		o::alias_option( "-c", "--connections" );
+		o::alias_option( "-n", "--requests"    );
+		
+		o::get_options( argc, argv );
+		
+		char const *const *freeArgs = o::free_arguments();
+		
+		if ( o::free_argument_count() == 0 )
+		{
+			p7::write( p7::stderr_fileno, STR_LEN( "Usage: htload [-c connections] [-n requests] http://host:port/path\n" ) );
+			
+			return 2;
+		}
+		
+		const char* url = freeArgs[ 0 ];
+		
+		if ( strncmp( url, STR_LEN( "http://" ) ) != 0 )
+		{
+			p7::write( p7::stderr_fileno, STR_LEN( "htload: only http:// URLs are supported\n" ) );
+			
+			return 2;
+		}
+		
+		const char* host = url + STRLEN( "http://" );
+		const char* path = strchr( host, '/' );
+		const char* end  = path ? path : host + strlen( host );
+		const char* port = std::find( host, end, ':' );
+		
+		const plus::string hostname( host, port );
+		
+		p7::in_port_t port_number = p7::in_port_t( port != end ? gear::parse_unsigned_decimal( port + 1 ) : 80 );
+		
+		hostent* hosts = gethostbyname( hostname.c_str() );
+		
+		if ( hosts == NULL )
+		{
+			p7::write( p7::stderr_fileno, STR_LEN( "htload: host lookup failed\n" ) );
+			
+			return 1;
+		}
+		
+		const p7::in_addr_t addr = p7::in_addr_t( ((in_addr*) hosts->h_addr)->s_addr );
+		
+		plus::var_string request = "GET ";
+		
+		request += path ? path : "/";
+		request += " HTTP/1.1\r\n";
+		
+		request += HTTP::HeaderFieldLine( "Host", plus::string( host, end ) );
+		request += "\r\n";
+		
+		gRequest = request;
+		
+		gRequestsToStart = n_requests;
+		
+		gLatencies.reserve( n_requests );
+		
+		n_connections = std::min( n_connections, n_requests );
+		
+		std::vector< Client > clients( n_connections );
+		
+		std::vector< pollfd > pollfds( n_connections );
+		
+		const microseconds t0 = now();
+		
+		for ( std::size_t i = 0;  i < n_connections;  ++i )
+		{
+			clients[ i ].fd = Connect( addr, port_number );
+			
+			StartRequest( clients[ i ] );
+			
+			SendRequest( clients[ i ] );
+		}
+		
+		std::size_t n_open = n_connections;
+		
+		while ( n_open > 0 )
+		{
+			for ( std::size_t i = 0;  i < n_connections;  ++i )
+			{
+				const Client& client = clients[ i ];
+				
+				pollfds[ i ].fd      = client.fd;
+				pollfds[ i ].events  = client.sent < gRequest.size() ? POLLOUT : POLLIN;
+				pollfds[ i ].revents = 0;
+			}
+			
+			if ( poll( &pollfds[ 0 ], n_connections, -1 ) < 0 )
+			{
+				if ( errno == EINTR )
+				{
+					continue;
+				}
+				
+				std::perror( "htload: poll" );
+				
+				return 1;
+			}
+			
+			for ( std::size_t i = 0;  i < n_connections;  ++i )
+			{
+				Client& client = clients[ i ];
+				
+				if ( client.fd < 0  ||  pollfds[ i ].revents == 0 )
+				{
+					continue;
+				}
+				
+				const bool ok = client.sent < gRequest.size() ? SendRequest    ( client )
+				                                              : ReceiveResponse( client );
+				
+				if ( !ok )
+				{
+					++gErrors;
+					
+					close( client.fd );
+					
+					client.fd = -1;
+				}
+				
+				if ( client.fd < 0 )
+				{
+					--n_open;
+				}
+			}
+		}
+		
+		const microseconds elapsed = now() - t0;
+		
+		std::vector< microseconds >& latencies = gLatencies;
+		
+		std::sort( latencies.begin(), latencies.end() );
+		
+		microseconds total = 0;
+		
+		for ( std::size_t i = 0;  i < latencies.size();  ++i )
+		{
+			total += latencies[ i ];
+		}
+		
+		const std::size_t completed = latencies.size();
+		
+		std::printf( "requests:    %lu completed, %lu errors, %lu connections\n",
+		             (unsigned long) completed,
+		             (unsigned long) gErrors,
+		             (unsigned long) n_connections );
+		
+		std::printf( "elapsed:     %.3f s\n", elapsed / 1000000.0 );
+		
+		std::printf( "throughput:  %.0f requests/s\n", completed * 1000000.0 / (elapsed ? elapsed : 1) );
+		
+		std::printf( "latency:     mean %.3f ms, p50 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+		             completed ? total / 1000.0 / completed : 0.0,
+		             percentile( latencies, 50 ),
+		             percentile( latencies, 99 ),
+		             percentile( latencies, 100 ) );
+		
+		return gErrors ? 1 : 0;
+	}
+	
+}
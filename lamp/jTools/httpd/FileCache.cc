@@ -0,0 +1,278 @@
+/*	============
+ *	FileCache.cc
+ *	============
+ */
+
+#include "FileCache.hh"
+
+// Standard C
+#include <string.h>
+#include <time.h>
+
+// POSIX
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// gear
+#include "gear/hexidecimal.hh"
+#include "gear/inscribe_decimal.hh"
+
+// plus
+#include "plus/var_string.hh"
+
+// Arcana
+#include "HTTP.hh"
+
+// httpd
+#include "httpd.hh"
+
+
+namespace tool
+{
+	
+	void retain( CachedFile* file )
+	{
+		++file->refs;
+	}
+	
+	void release( CachedFile* file )
+	{
+		if ( --file->refs == 0 )
+		{
+			close( file->fd );
+			
+			delete file;
+		}
+	}
+	
+	
+	static void append_hex( plus::var_string& out, unsigned long long x )
+	{
+		// gear's hex helpers stop at 32 bits; sizes and mtimes don't.
+		
+		char buffer[ 16 ];
+		
+		char* p = buffer + sizeof buffer;
+		
+		do
+		{
+			*--p = gear::encoded_hex_char( x & 0xf );
+			
+			x >>= 4;
+		}
+		while ( x != 0 );
+		
+		out.append( p, buffer + sizeof buffer );
+	}
+	
+	static plus::string make_etag( const struct stat& sb )
+	{
+		// E.g. "5f3a-1c9b2e40", from the size and mtime
+		
+		plus::var_string etag = "\"";
+		
+		append_hex( etag, sb.st_size  );
+		etag += "-";
+		append_hex( etag, sb.st_mtime );
+		etag += "\"";
+		
+		return etag;
+	}
+	
+	static plus::string http_date( time_t t )
+	{
+		char buffer[ sizeof "Sun, 06 Nov 1994 08:49:37 GMT" ];
+		
+		const size_t length = strftime( buffer, sizeof buffer, "%a, %d %b %Y %H:%M:%S GMT", gmtime( &t ) );
+		
+		return plus::string( buffer, length );
+	}
+	
+	static inline bool same_file( const CachedFile& file, const struct stat& sb )
+	{
+		return    sb.st_mtime == file.mtime
+		       && sb.st_size  == file.size
+		       && sb.st_ino   == file.inode
+		       && sb.st_dev   == file.device;
+	}
+	
+	
+	FileCache::~FileCache()
+	{
+		while ( !itsIndex.empty() )
+		{
+			Evict( itsIndex.begin() );
+		}
+	}
+	
+	void FileCache::Evict( Index::iterator it )
+	{
+		LRU_list::iterator entry = it->second;
+		
+		release( *entry );
+		
+		itsLRU.erase( entry );
+		
+		itsIndex.erase( it );
+	}
+	
+	void FileCache::SetCapacity( std::size_t capacity )
+	{
+		itsCapacity = capacity;
+		
+		while ( itsLRU.size() > itsCapacity )
+		{
+			Evict( itsIndex.find( itsLRU.back()->resource ) );
+		}
+	}
+	
+	CachedFile* FileCache::Lookup( const plus::string& resource, time_t now )
+	{
+		Index::iterator it = itsIndex.find( resource );
+		
+		if ( it == itsIndex.end() )
+		{
+			return NULL;
+		}
+		
+		CachedFile* file = *it->second;
+		
+		if ( file->validated != now )
+		{
+			struct stat sb;
+			
+			if ( stat( file->pathname.c_str(), &sb ) < 0  ||  !same_file( *file, sb ) )
+			{
+				Evict( it );
+				
+				return NULL;
+			}
+			
+			file->validated = now;
+		}
+		
+		// Move to the front, without reallocating the node
+		
+		itsLRU.splice( itsLRU.begin(), itsLRU, it->second );
+		
+		return file;
+	}
+	
+	CachedFile* FileCache::Insert( const plus::string&  resource,
+	                               const Resource&      resolved,
+	                               time_t               now )
+	{
+		const int fd = open( resolved.pathname.c_str(), O_RDONLY );
+		
+		if ( fd < 0 )
+		{
+			return NULL;
+		}
+		
+		struct stat sb;
+		
+		if ( fstat( fd, &sb ) < 0  ||  !S_ISREG( sb.st_mode ) )
+		{
+			close( fd );
+			
+			return NULL;
+		}
+		
+		fcntl( fd, F_SETFD, FD_CLOEXEC );
+		
+		CachedFile* file = new CachedFile;
+		
+		file->fd        = fd;
+		file->refs      = 1;  // the cache's own reference
+		file->size      = sb.st_size;
+		file->mtime     = sb.st_mtime;
+		file->device    = sb.st_dev;
+		file->inode     = sb.st_ino;
+		file->validated = now;
+		file->resource  = resource;
+		file->pathname  = resolved.pathname;
+		
+		file->etag          = make_etag( sb );
+		file->last_modified = http_date( sb.st_mtime );
+		
+		plus::var_string header;
+		
+		header += HTTP::HeaderFieldLine( "Content-Type",   resolved.content_type );
+		header += HTTP::HeaderFieldLine( "Content-Length", gear::inscribe_unsigned_wide_decimal( sb.st_size ) );
+		header += HTTP::HeaderFieldLine( "Last-Modified",  file->last_modified );
+		header += HTTP::HeaderFieldLine( "ETag",           file->etag );
+		
+		header += resolved.extra_header_lines;
+		
+		file->header_lines = header;
+		
+		Index::iterator it = itsIndex.find( resource );
+		
+		if ( it != itsIndex.end() )
+		{
+			Evict( it );
+		}
+		
+		itsLRU.push_front( file );
+		
+		itsIndex[ resource ] = itsLRU.begin();
+		
+		if ( itsLRU.size() > itsCapacity )
+		{
+			SetCapacity( itsCapacity );
+		}
+		
+		return file;
+	}
+	
+	
+	static bool has_etag( const char* p, const char* end, const plus::string& etag )
+	{
+		// If-None-Match is a list of (possibly weak) entity tags, or "*".
+		
+		const std::size_t length = etag.size();
+		
+		for ( ;  p < end;  ++p )
+		{
+			if ( *p == '*' )
+			{
+				return true;
+			}
+			
+			if ( *p == '"'  &&  end - p >= std::ptrdiff_t( length )  &&  memcmp( p, etag.data(), length ) == 0 )
+			{
+				return true;
+			}
+		}
+		
+		return false;
+	}
+	
+	bool is_not_modified( const CachedFile&  file,
+	                      const char*        if_none_match,
+	                      std::size_t        if_none_match_length,
+	                      const char*        if_modified_since,
+	                      std::size_t        if_modified_since_length )
+	{
+		if ( if_none_match != NULL )
+		{
+			// If-None-Match takes precedence, per RFC 7232
+			
+			return has_etag( if_none_match, if_none_match + if_none_match_length, file.etag );
+		}
+		
+		if ( if_modified_since != NULL )
+		{
+			// Clients echo back the Last-Modified value we sent them.
+			
+			const plus::string& date = file.last_modified;
+			
+			return    if_modified_since_length == date.size()
+			       && memcmp( if_modified_since, date.data(), date.size() ) == 0;
+		}
+		
+		return false;
+	}
+	
+}
@@ -0,0 +1,101 @@
+/*	============
+ *	FileCache.hh
+ *	============
+ */
+
+#ifndef FILECACHE_HH
+#define FILECACHE_HH
+
+// Standard C++
+#include <list>
+#include <map>
+
+// POSIX
+#include <sys/types.h>
+
+// plus
+#include "plus/string.hh"
+
+
+namespace tool
+{
+	
+	struct Resource;
+	
+	/*
+		An open regular file, with everything needed to answer a request
+		for it except the status line and connection-specific fields.
+		Connections sending its contents hold a reference, so an entry
+		evicted (or found stale) mid-transfer stays open until they finish.
+	*/
+	
+	struct CachedFile
+	{
+		int           fd;
+		std::size_t   refs;
+		off_t         size;
+		time_t        mtime;
+		dev_t         device;
+		ino_t         inode;
+		time_t        validated;      // when we last checked it with stat()
+		plus::string  resource;       // the cache key
+		plus::string  pathname;
+		plus::string  header_lines;   // Content-Type through ETag, plus extras
+		plus::string  etag;
+		plus::string  last_modified;
+	};
+	
+	void retain ( CachedFile* file );
+	void release( CachedFile* file );
+	
+	/*
+		A bounded LRU cache mapping request resources to open files.  An
+		entry is revalidated with stat() at most once per second, and is
+		dropped if the file's mtime, size, or inode has changed.
+	*/
+	
+	class FileCache
+	{
+		private:
+			typedef std::list< CachedFile* >  LRU_list;
+			
+			typedef std::map< plus::string, LRU_list::iterator > Index;
+			
+			LRU_list     itsLRU;  // most recently used first
+			Index        itsIndex;
+			std::size_t  itsCapacity;
+			
+			void Evict( Index::iterator it );
+			
+			// non-copyable
+			FileCache           ( const FileCache& );
+			FileCache& operator=( const FileCache& );
+			
+		public:
+			explicit FileCache( std::size_t capacity = 256 ) : itsCapacity( capacity )
+			{
+			}
+			
+			~FileCache();
+			
+			void SetCapacity( std::size_t capacity );
+			
+			// Returns NULL on a miss, or if the cached file has changed.
+			CachedFile* Lookup( const plus::string& resource, time_t now );
+			
+			// Opens and caches a resolved static file, or returns NULL.
+			CachedFile* Insert( const plus::string&  resource,
+			                    const Resource&      resolved,
+			                    time_t               now );
+	};
+	
+	// Matches If-None-Match, or else If-Modified-Since, against the file.
+	bool is_not_modified( const CachedFile&  file,
+	                      const char*        if_none_match,
+	                      std::size_t        if_none_match_length,
+	                      const char*        if_modified_since,
+	                      std::size_t        if_modified_since_length );
+	
+}
+
+#endif
@@ -0,0 +1,217 @@
+/*	=========
+ *	Poller.cc
+ *	=========
+ */
+
+#include "Poller.hh"
+
+// Standard C
+#include <errno.h>
+
+// POSIX
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
+// poseven
+#include "poseven/types/errno_t.hh"
+
+
+namespace tool
+{
+	
+	namespace p7 = poseven;
+	
+	
+#ifdef __linux__
+
+	static inline unsigned epoll_events_from_interest( unsigned interest )
+	{
+		return   (interest & poll_read  ? EPOLLIN  : 0)
+		       | (interest & poll_write ? EPOLLOUT : 0);
+	}
+	
+	static void control( int epfd, int op, int fd, unsigned interest )
+	{
+		epoll_event event = { 0 };
+		
+		event.events  = epoll_events_from_interest( interest );
+		event.data.fd = fd;
+		
+		p7::throw_posix_result( epoll_ctl( epfd, op, fd, &event ) );
+	}
+	
+	Poller::Poller() : itsEpollFD( p7::throw_posix_result( epoll_create( 64 ) ) )
+	{
+	}
+	
+	Poller::~Poller()
+	{
+		if ( itsEpollFD >= 0 )
+		{
+			close( itsEpollFD );
+		}
+	}
+	
+	void Poller::forget()
+	{
+		close( itsEpollFD );
+		
+		itsEpollFD = -1;
+	}
+	
+	void Poller::add( int fd, unsigned interest )
+	{
+		control( itsEpollFD, EPOLL_CTL_ADD, fd, interest );
+	}
+	
+	void Poller::modify( int fd, unsigned interest )
+	{
+		control( itsEpollFD, EPOLL_CTL_MOD, fd, interest );
+	}
+	
+	void Poller::remove( int fd )
+	{
+		epoll_event event = { 0 };  // non-NULL for pre-2.6.9 kernels
+		
+		(void) epoll_ctl( itsEpollFD, EPOLL_CTL_DEL, fd, &event );
+	}
+	
+	std::size_t Poller::wait( poll_event* events, std::size_t capacity, int timeout_ms )
+	{
+		const std::size_t max_events = 256;
+		
+		epoll_event ready[ max_events ];
+		
+		if ( capacity > max_events )
+		{
+			capacity = max_events;
+		}
+		
+		int n = epoll_wait( itsEpollFD, ready, capacity, timeout_ms );
+		
+		if ( n < 0 )
+		{
+			if ( errno == EINTR )
+			{
+				return 0;
+			}
+			
+			p7::throw_errno( errno );
+		}
+		
+		for ( int i = 0;  i < n;  ++i )
+		{
+			const unsigned flags = ready[ i ].events;
+			
+			events[ i ].fd    = ready[ i ].data.fd;
+			events[ i ].ready =   (flags & EPOLLIN                ? poll_read   : 0)
+			                    | (flags & EPOLLOUT               ? poll_write  : 0)
+			                    | (flags & (EPOLLHUP | EPOLLERR)  ? poll_hangup : 0);
+		}
+		
+		return n;
+	}
+	
+#else
+
+	static inline short poll_events_from_interest( unsigned interest )
+	{
+		return   (interest & poll_read  ? POLLIN  : 0)
+		       | (interest & poll_write ? POLLOUT : 0);
+	}
+	
+	Poller::Poller()
+	{
+	}
+	
+	Poller::~Poller()
+	{
+	}
+	
+	void Poller::forget()
+	{
+	}
+	
+	void Poller::add( int fd, unsigned interest )
+	{
+		pollfd pfd = { fd, poll_events_from_interest( interest ), 0 };
+		
+		itsIndex[ fd ] = itsPollFDs.size();
+		
+		itsPollFDs.push_back( pfd );
+	}
+	
+	void Poller::modify( int fd, unsigned interest )
+	{
+		itsPollFDs[ itsIndex[ fd ] ].events = poll_events_from_interest( interest );
+	}
+	
+	void Poller::remove( int fd )
+	{
+		std::map< int, std::size_t >::iterator it = itsIndex.find( fd );
+		
+		if ( it == itsIndex.end() )
+		{
+			return;
+		}
+		
+		const std::size_t i = it->second;
+		
+		itsIndex.erase( it );
+		
+		// Move the last entry into the vacated slot
+		
+		if ( i + 1 != itsPollFDs.size() )
+		{
+			itsPollFDs[ i ] = itsPollFDs.back();
+			
+			itsIndex[ itsPollFDs[ i ].fd ] = i;
+		}
+		
+		itsPollFDs.pop_back();
+	}
+	
+	std::size_t Poller::wait( poll_event* events, std::size_t capacity, int timeout_ms )
+	{
+		pollfd* pfds = itsPollFDs.empty() ? NULL : &itsPollFDs[ 0 ];
+		
+		int n = poll( pfds, itsPollFDs.size(), timeout_ms );
+		
+		if ( n < 0 )
+		{
+			if ( errno == EINTR )
+			{
+				return 0;
+			}
+			
+			p7::throw_errno( errno );
+		}
+		
+		std::size_t count = 0;
+		
+		for ( std::size_t i = 0;  i < itsPollFDs.size()  &&  count < capacity;  ++i )
+		{
+			const short flags = itsPollFDs[ i ].revents;
+			
+			if ( flags == 0 )
+			{
+				continue;
+			}
+			
+			events[ count ].fd    = itsPollFDs[ i ].fd;
+			events[ count ].ready =   (flags & POLLIN                          ? poll_read   : 0)
+			                        | (flags & POLLOUT                         ? poll_write  : 0)
+			                        | (flags & (POLLHUP | POLLERR | POLLNVAL)  ? poll_hangup : 0);
+			
+			++count;
+		}
+		
+		return count;
+	}
+	
+#endif
+
+}
@@ -0,0 +1,75 @@
+/*	=========
+ *	Poller.hh
+ *	=========
+ */
+
+#ifndef POLLER_HH
+#define POLLER_HH
+
+// Standard C++
+#include <map>
+#include <vector>
+
+// POSIX
+#include <poll.h>
+
+
+namespace tool
+{
+	
+	enum poll_interest
+	{
+		poll_none   = 0,
+		poll_read   = 1,
+		poll_write  = 2,
+		poll_hangup = 4  // reported whatever the interest, even poll_none
+	};
+	
+	struct poll_event
+	{
+		int       fd;
+		unsigned  ready;  // poll_read, poll_write, and/or poll_hangup
+	};
+	
+	/*
+		A readiness notifier for many file descriptors.  On Linux it's
+		backed by epoll, so the cost of a wait doesn't grow with the number
+		of idle connections.  Elsewhere, poll() is used.
+	*/
+	
+	class Poller
+	{
+		private:
+		#ifdef __linux__
+			
+			int itsEpollFD;
+			
+		#else
+			
+			std::vector< pollfd >         itsPollFDs;
+			std::map< int, std::size_t >  itsIndex;
+			
+		#endif
+			
+			// non-copyable
+			Poller           ( const Poller& );
+			Poller& operator=( const Poller& );
+			
+		public:
+			Poller();
+			
+			~Poller();
+			
+			// Closes the kernel-side state in a forked child (no-op for poll())
+			void forget();
+			
+			void add   ( int fd, unsigned interest );
+			void modify( int fd, unsigned interest );
+			void remove( int fd );
+			
+			std::size_t wait( poll_event* events, std::size_t capacity, int timeout_ms );
+	};
+	
+}
+
+#endif
@@ -0,0 +1,902 @@
+/*	=========
+ *	Server.cc
+ *	=========
+ */
+
+#include "Server.hh"
+
+// Standard C++
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <vector>
+
+// Standard C
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+// POSIX
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+// iota
+#include "iota/strings.hh"
+
+// gear
+#include "gear/inscribe_decimal.hh"
+
+// plus
+#include "plus/var_string.hh"
+
+// poseven
+#include "poseven/bundles/inet.hh"
+#include "poseven/functions/listen.hh"
+#include "poseven/functions/perror.hh"
+#include "poseven/functions/sigaction.hh"
+#include "poseven/functions/socket.hh"
+#include "poseven/types/errno_t.hh"
+
+// Arcana
+#include "HTTP.hh"
+
+// httpd
+#include "FileCache.hh"
+#include "httpd.hh"
+#include "Poller.hh"
+
+
+namespace tool
+{
+	
+	namespace p7 = poseven;
+	
+	
+	static const std::size_t max_header_size   = 64 * 1024;
+	static const std::size_t max_buffered_input = 1024 * 1024;
+	
+	static const std::size_t read_chunk_size  = 64 * 1024;
+	static const std::size_t send_chunk_size  = 1024 * 1024;
+	static const std::size_t accept_batch_size = 64;
+	
+	static const int idle_timeout = 15;  // seconds
+	
+	
+	struct Connection
+	{
+		int                  fd;
+		HTTP::MessageParser  request;  // reused across keep-alive requests
+		plus::var_string     input;
+		plus::var_string     output;
+		std::size_t          output_mark;  // bytes of output already sent
+		CachedFile*          body;  // referenced while sending
+		off_t                body_offset;
+		off_t                body_end;
+		time_t               last_active;
+		unsigned             interest;
+		bool                 keep_alive;
+		bool                 awaiting_worker;
+		bool                 reached_eof;
+		
+		Connection() : fd             ( -1    ),
+		               output_mark    ( 0     ),
+		               body           ( NULL  ),
+		               body_offset    ( 0     ),
+		               body_end       ( 0     ),
+		               last_active    ( 0     ),
+		               interest       ( poll_none ),
+		               keep_alive     ( true  ),
+		               awaiting_worker( false ),
+		               reached_eof    ( false )
+		{
+		}
+		
+		bool sending() const
+		{
+			return output_mark < output.size()  ||  body != NULL;
+		}
+		
+		bool busy() const
+		{
+			return sending()  ||  awaiting_worker;
+		}
+	};
+	
+	typedef std::map< int, Connection > Connections;
+	
+	
+	static Poller       gPoller;
+	static Connections  gConnections;
+	
+	static int gListener = -1;
+	
+	static std::size_t gMaxWorkers    = 1;
+	static std::size_t gActiveWorkers = 0;
+	
+	static std::deque< int > gWaitingForWorker;
+	
+	static FileCache gFileCache;
+	
+	static time_t gNow;
+	
+	static volatile sig_atomic_t gChildSignalled = false;
+	
+	
+	static void HandleSIGCHLD( int )
+	{
+		gChildSignalled = true;
+	}
+	
+	static void set_nonblocking( int fd, bool nonblocking )
+	{
+		const int flags = fcntl( fd, F_GETFL, 0 );
+		
+		fcntl( fd, F_SETFL, nonblocking ? flags |  O_NONBLOCK
+		                                : flags & ~O_NONBLOCK );
+	}
+	
+	static void set_interest( Connection& c, unsigned interest )
+	{
+		if ( interest != c.interest )
+		{
+			gPoller.modify( c.fd, interest );
+			
+			c.interest = interest;
+		}
+	}
+	
+	static void CloseConnection( Connection& c )
+	{
+		const int fd = c.fd;
+		
+		if ( c.body != NULL )
+		{
+			release( c.body );
+		}
+		
+		if ( c.awaiting_worker )
+		{
+			std::deque< int >& q = gWaitingForWorker;
+			
+			q.erase( std::remove( q.begin(), q.end(), fd ), q.end() );
+		}
+		
+		gPoller.remove( fd );
+		
+		close( fd );
+		
+		gConnections.erase( fd );
+	}
+	
+	
+	static bool wants_keep_alive( const ParsedRequest&  parsed,
+	                              const Connection&     c )
+	{
+		const HTTP::HeaderFieldEntry* connection = c.request.Find( HTTP::field_connection );
+		
+		const char* header = c.input.data() + c.request.GetStartOfHeaderFields();
+		
+		if ( parsed.version == "HTTP/1.1" )
+		{
+			// Persistent unless the client asks otherwise
+			
+			return connection == NULL  ||  strncasecmp( header + connection->value_offset, STR_LEN( "close" ) ) != 0;
+		}
+		
+		return connection != NULL  &&  strncasecmp( header + connection->value_offset, STR_LEN( "keep-alive" ) ) == 0;
+	}
+	
+	static void QueueHeader( Connection& c, const char* status, std::size_t status_length )
+	{
+		c.output += "HTTP/1.1 ";
+		c.output.append( status, status_length );
+		c.output += "\r\n";
+	}
+	
+	static void QueueEndOfHeader( Connection& c )
+	{
+		if ( !c.keep_alive )
+		{
+			c.output += "Connection: close\r\n";
+		}
+		
+		c.output += "\r\n";
+	}
+	
+	static void QueueError( Connection& c, const char* status, std::size_t status_length )
+	{
+		plus::var_string body = "<title>";
+		
+		body.append( status, status_length );
+		body += "</title>\r\n<p>";
+		body.append( status, status_length );
+		body += "</p>\r\n";
+		
+		QueueHeader( c, status, status_length );
+		
+		c.output += HTTP::HeaderFieldLine( "Content-Type",   "text/html" );
+		c.output += HTTP::HeaderFieldLine( "Content-Length", gear::inscribe_decimal( body.size() ) );
+		
+		QueueEndOfHeader( c );
+		
+		c.output += body;
+	}
+	
+	static void QueueFile( Connection& c, CachedFile* file, bool head_only )
+	{
+		QueueHeader( c, STR_LEN( "200 OK" ) );
+		
+		c.output += file->header_lines;
+		
+		QueueEndOfHeader( c );
+		
+		if ( !head_only  &&  file->size != 0 )
+		{
+			retain( file );
+			
+			c.body        = file;
+			c.body_offset = 0;
+			c.body_end    = file->size;
+		}
+	}
+	
+	static void QueueNotModified( Connection& c, const CachedFile* file )
+	{
+		QueueHeader( c, STR_LEN( "304 Not Modified" ) );
+		
+		c.output += HTTP::HeaderFieldLine( "Last-Modified", file->last_modified );
+		c.output += HTTP::HeaderFieldLine( "ETag",          file->etag          );
+		
+		QueueEndOfHeader( c );
+	}
+	
+	static bool is_not_modified( const Connection& c, const CachedFile* file )
+	{
+		const char* header = c.input.data() + c.request.GetStartOfHeaderFields();
+		
+		const HTTP::HeaderFieldEntry* etags = c.request.Find( HTTP::field_if_none_match     );
+		const HTTP::HeaderFieldEntry* since = c.request.Find( HTTP::field_if_modified_since );
+		
+		return is_not_modified( *file,
+		                        etags ? header + etags->value_offset : NULL,
+		                        etags ? etags->crlf_offset - etags->value_offset : 0,
+		                        since ? header + since->value_offset : NULL,
+		                        since ? since->crlf_offset - since->value_offset : 0 );
+	}
+	
+	
+	static bool StartWorker( Connection& c, std::size_t request_length )
+	{
+		const pid_t pid = fork();
+		
+		if ( pid < 0 )
+		{
+			return false;
+		}
+		
+		if ( pid == 0 )
+		{
+			// Worker process:  Serve this one request inetd-style and exit.
+			
+			const int fd = c.fd;
+			
+			gPoller.forget();
+			
+			close( gListener );
+			
+			for ( Connections::iterator it = gConnections.begin();  it != gConnections.end();  ++it )
+			{
+				if ( it->first != fd )
+				{
+					close( it->first );
+				}
+			}
+			
+			signal( SIGPIPE, SIG_DFL );
+			signal( SIGCHLD, SIG_DFL );
+			
+			set_nonblocking( fd, false );
+			
+			dup2( fd, p7::stdin_fileno  );
+			dup2( fd, p7::stdout_fileno );
+			
+			close( fd );
+			
+			try
+			{
+				HTTP::MessageReceiver request;
+				
+				request.ReceiveData( c.input.data(), request_length );
+				
+				SendResponse( request );
+			}
+			catch ( ... )
+			{
+			}
+			
+			_exit( 0 );
+		}
+		
+		++gActiveWorkers;
+		
+		CloseConnection( c );
+		
+		return true;
+	}
+	
+	
+	static bool DiscardRequestBody( Connection& c )
+	{
+		// Returns true once the previous request's body has been consumed.
+		
+		while ( !c.request.IsComplete()  &&  !c.input.empty() )
+		{
+			const char* payload;
+			std::size_t payload_size;
+			
+			const std::size_t consumed = c.request.ParseBody( c.input.data(), c.input.size(), payload, payload_size );
+			
+			c.input.erase( 0, consumed );
+		}
+		
+		return c.request.IsComplete();
+	}
+	
+	static bool HandleRequest( Connection& c )
+	{
+		// Returns true if a response was queued.
+		
+		HTTP::MessageParser& request = c.request;
+		
+		ParsedRequest parsed;
+		
+		try
+		{
+			if ( request.HasCompleteHeader() )
+			{
+				if ( !DiscardRequestBody( c ) )
+				{
+					return false;
+				}
+				
+				request.Reset();
+			}
+			
+			// Resumes scanning where the previous call stopped
+			
+			if ( !request.ParseHeader( c.input.data(), c.input.size() ) )
+			{
+				if ( c.input.size() > max_header_size )
+				{
+					c.keep_alive = false;
+					
+					QueueError( c, STR_LEN( "413 Request Entity Too Large" ) );
+					
+					return true;
+				}
+				
+				return false;
+			}
+			
+			const std::size_t line_length = request.GetStartOfHeaderFields() - STRLEN( "\r\n" );
+			
+			parsed = ParseRequest( plus::string( c.input.data(), line_length ) );
+		}
+		catch ( ... )
+		{
+			c.keep_alive = false;
+			
+			QueueError( c, STR_LEN( "400 Bad Request" ) );
+			
+			return true;
+		}
+		
+		const std::size_t header_size = request.GetHeaderSize();
+		
+		// Hot static files are served from the cache without touching the
+		// filesystem, apart from an occasional stat() to revalidate.
+		
+		CachedFile* file = gFileCache.Lookup( parsed.resource, gNow );
+		
+		if ( file == NULL )
+		{
+			Resource resource;
+			
+			bool found;
+			
+			try
+			{
+				found = ResolveResource( parsed.resource, resource );
+			}
+			catch ( const p7::errno_t& err )
+			{
+				// E.g. the file went away before stat(), or we can't search it
+				
+				c.keep_alive = wants_keep_alive( parsed, c );
+				
+				if ( err == EACCES  ||  err == EPERM )
+				{
+					QueueError( c, STR_LEN( "403 Forbidden" ) );
+				}
+				else
+				{
+					QueueError( c, STR_LEN( "404 Not Found" ) );
+				}
+				
+				return true;
+			}
+			catch ( ... )
+			{
+				c.keep_alive = wants_keep_alive( parsed, c );
+				
+				QueueError( c, STR_LEN( "404 Not Found" ) );
+				
+				return true;
+			}
+			
+			if ( found  &&  (resource.is_cgi  ||  resource.is_dir) )
+			{
+				// Potentially blocking, so hand the connection to a worker.
+				
+				if ( gActiveWorkers >= gMaxWorkers )
+				{
+					c.awaiting_worker = true;
+					
+					gWaitingForWorker.push_back( c.fd );
+					
+					// The request is parsed again when a worker frees up.
+					request.Reset();
+					
+					return false;
+				}
+				
+				std::size_t request_length = c.input.size();
+				
+				if ( request.GetBodyFraming() != HTTP::body_chunked )
+				{
+					request_length = std::min( request_length, header_size + request.GetContentLength() );
+				}
+				
+				if ( StartWorker( c, request_length ) )
+				{
+					return false;
+				}
+				
+				c.keep_alive = false;
+				
+				QueueError( c, STR_LEN( "503 Service Unavailable" ) );
+				
+				return true;
+			}
+			
+			if ( found )
+			{
+				file = gFileCache.Insert( parsed.resource, resource, gNow );
+			}
+		}
+		
+		c.keep_alive = wants_keep_alive( parsed, c );
+		
+		if ( file == NULL )
+		{
+			QueueError( c, STR_LEN( "404 Not Found" ) );
+		}
+		else if ( is_not_modified( c, file ) )
+		{
+			QueueNotModified( c, file );
+		}
+		else
+		{
+			QueueFile( c, file, parsed.method == "HEAD" );
+		}
+		
+		// Any message body is ignored, and discarded before the next request.
+		
+		c.input.erase( 0, header_size );
+		
+		return true;
+	}
+	
+	
+	static ssize_t SendBody( Connection& c )
+	{
+		const std::size_t remaining = c.body_end - c.body_offset;
+		
+		const std::size_t n = std::min( remaining, send_chunk_size );
+		
+	#ifdef __linux__
+		
+		ssize_t n_sent = sendfile( c.fd, c.body->fd, &c.body_offset, n );
+		
+		if ( n_sent == 0 )
+		{
+			errno = EIO;  // file shrank underneath us
+			
+			return -1;
+		}
+		
+		return n_sent;
+		
+	#else
+		
+		const std::size_t buffer_size = 64 * 1024;
+		
+		char buffer[ buffer_size ];
+		
+		ssize_t n_read = pread( c.body->fd, buffer, std::min( n, buffer_size ), c.body_offset );
+		
+		if ( n_read <= 0 )
+		{
+			if ( n_read == 0 )
+			{
+				errno = EIO;  // file shrank underneath us
+			}
+			
+			return -1;
+		}
+		
+		ssize_t n_written = write( c.fd, buffer, n_read );
+		
+		if ( n_written > 0 )
+		{
+			c.body_offset += n_written;
+		}
+		
+		return n_written;
+		
+	#endif
+	}
+	
+	enum send_status
+	{
+		send_done,
+		send_blocked,
+		send_failed
+	};
+	
+	static send_status WriteOut( Connection& c )
+	{
+		while ( c.output_mark < c.output.size() )
+		{
+			ssize_t n = write( c.fd, c.output.data() + c.output_mark, c.output.size() - c.output_mark );
+			
+			if ( n < 0 )
+			{
+				return errno == EAGAIN  ||  errno == EINTR ? send_blocked : send_failed;
+			}
+			
+			c.output_mark += n;
+		}
+		
+		c.output.clear();
+		
+		c.output_mark = 0;
+		
+		while ( c.body != NULL )
+		{
+			if ( c.body_offset >= c.body_end )
+			{
+				release( c.body );
+				
+				c.body = NULL;
+				
+				break;
+			}
+			
+			if ( SendBody( c ) < 0 )
+			{
+				return errno == EAGAIN  ||  errno == EINTR ? send_blocked : send_failed;
+			}
+		}
+		
+		return send_done;
+	}
+	
+	static void HandleRequests( Connection& c )
+	{
+		// Responses to pipelined requests are sent in order, one at a time.
+		
+		const int fd = c.fd;
+		
+		while ( true )
+		{
+			if ( c.sending() )
+			{
+				const send_status status = WriteOut( c );
+				
+				if ( status == send_failed )
+				{
+					CloseConnection( c );
+					
+					return;
+				}
+				
+				if ( status == send_blocked )
+				{
+					set_interest( c, poll_write );
+					
+					return;
+				}
+			}
+			
+			if ( !c.keep_alive )
+			{
+				CloseConnection( c );
+				
+				return;
+			}
+			
+			if ( c.awaiting_worker  ||  !HandleRequest( c ) )
+			{
+				break;
+			}
+		}
+		
+		if ( !gConnections.count( fd ) )
+		{
+			// Handed off to a worker
+			return;
+		}
+		
+		if ( c.awaiting_worker )
+		{
+			set_interest( c, poll_none );
+			
+			return;
+		}
+		
+		if ( c.reached_eof )
+		{
+			CloseConnection( c );
+			
+			return;
+		}
+		
+		set_interest( c, poll_read );
+	}
+	
+	static void Receive( Connection& c )
+	{
+		char buffer[ read_chunk_size ];
+		
+		while ( c.input.size() < max_buffered_input )
+		{
+			ssize_t n = read( c.fd, buffer, sizeof buffer );
+			
+			if ( n < 0 )
+			{
+				if ( errno == EAGAIN  ||  errno == EINTR )
+				{
+					break;
+				}
+				
+				CloseConnection( c );
+				
+				return;
+			}
+			
+			if ( n == 0 )
+			{
+				c.reached_eof = true;
+				
+				break;
+			}
+			
+			c.input.append( buffer, n );
+			
+			if ( (std::size_t) n < sizeof buffer )
+			{
+				break;
+			}
+		}
+		
+		HandleRequests( c );
+	}
+	
+	static void AcceptConnections( time_t now )
+	{
+		for ( std::size_t i = 0;  i < accept_batch_size;  ++i )
+		{
+			const int fd = accept( gListener, NULL, NULL );
+			
+			if ( fd < 0 )
+			{
+				if ( errno != EAGAIN  &&  errno != EINTR  &&  errno != ECONNABORTED )
+				{
+					p7::perror( "httpd: accept()" );
+				}
+				
+				return;
+			}
+			
+			set_nonblocking( fd, true );
+			
+			fcntl( fd, F_SETFD, FD_CLOEXEC );
+			
+			int on = 1;
+			
+			setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on );
+			
+			Connection& c = gConnections[ fd ];
+			
+			c.fd          = fd;
+			c.last_active = now;
+			c.interest    = poll_read;
+			
+			gPoller.add( fd, poll_read );
+		}
+	}
+	
+	static void ReapWorkers()
+	{
+		gChildSignalled = false;
+		
+		int stat;
+		
+		while ( waitpid( -1, &stat, WNOHANG ) > 0 )
+		{
+			--gActiveWorkers;
+		}
+		
+		while ( gActiveWorkers < gMaxWorkers  &&  !gWaitingForWorker.empty() )
+		{
+			const int fd = gWaitingForWorker.front();
+			
+			gWaitingForWorker.pop_front();
+			
+			Connections::iterator it = gConnections.find( fd );
+			
+			if ( it != gConnections.end() )
+			{
+				it->second.awaiting_worker = false;
+				
+				HandleRequests( it->second );
+			}
+		}
+	}
+	
+	static void CloseIdleConnections( time_t now )
+	{
+		std::vector< int > idle;
+		
+		for ( Connections::iterator it = gConnections.begin();  it != gConnections.end();  ++it )
+		{
+			const Connection& c = it->second;
+			
+			if ( !c.busy()  &&  now - c.last_active > idle_timeout )
+			{
+				idle.push_back( it->first );
+			}
+		}
+		
+		for ( std::size_t i = 0;  i < idle.size();  ++i )
+		{
+			CloseConnection( gConnections[ idle[ i ] ] );
+		}
+	}
+	
+	static int Listen( unsigned short port )
+	{
+		const int fd = p7::socket( p7::pf_inet, p7::sock_stream ).release();
+		
+		int on = 1;
+		
+		setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on );
+		
+		p7::bind( p7::fd_t( fd ), p7::inaddr_any, p7::in_port_t( port ) );
+		
+		p7::listen( p7::fd_t( fd ), SOMAXCONN );
+		
+		set_nonblocking( fd, true );
+		
+		fcntl( fd, F_SETFD, FD_CLOEXEC );
+		
+		return fd;
+	}
+	
+	void RunServer( unsigned short port, std::size_t n_workers, std::size_t n_cached_files )
+	{
+		gMaxWorkers = std::max( n_workers, std::size_t( 1 ) );
+		
+		gFileCache.SetCapacity( std::max( n_cached_files, std::size_t( 1 ) ) );
+		
+		gListener = Listen( port );
+		
+		p7::sigaction( p7::sigpipe, p7::sig_ign );
+		
+		p7::sigaction( p7::sigchld, HandleSIGCHLD );
+		
+		gPoller.add( gListener, poll_read );
+		
+		const std::size_t max_events = 256;
+		
+		poll_event events[ max_events ];
+		
+		time_t last_sweep = time( NULL );
+		
+		while ( true )
+		{
+			const std::size_t n = gPoller.wait( events, max_events, 1000 );
+			
+			const time_t now = gNow = time( NULL );
+			
+			if ( gChildSignalled )
+			{
+				ReapWorkers();
+			}
+			
+			for ( std::size_t i = 0;  i < n;  ++i )
+			{
+				const int fd = events[ i ].fd;
+				
+				if ( fd == gListener )
+				{
+					AcceptConnections( now );
+					
+					continue;
+				}
+				
+				Connections::iterator it = gConnections.find( fd );
+				
+				if ( it == gConnections.end() )
+				{
+					continue;  // closed by an earlier event in this batch
+				}
+				
+				Connection& c = it->second;
+				
+				const unsigned ready = events[ i ].ready;
+				
+				if ( c.interest == poll_none )
+				{
+					/*
+						Waiting for a worker, so only a hangup or error gets
+						here, and it's reported until the fd is closed.  The
+						client is gone, so drop it from the queue now rather
+						than spin on the event.
+					*/
+					
+					if ( ready & poll_hangup )
+					{
+						CloseConnection( c );
+					}
+					
+					continue;
+				}
+				
+				c.last_active = now;
+				
+				// After a hangup, the read or write reports the failure.
+				
+				if ( c.interest == poll_read  &&  ready & (poll_read | poll_hangup) )
+				{
+					Receive( c );
+				}
+				else if ( c.interest == poll_write  &&  ready & (poll_write | poll_hangup) )
+				{
+					HandleRequests( c );
+				}
+			}
+			
+			if ( now != last_sweep )
+			{
+				CloseIdleConnections( now );
+				
+				last_sweep = now;
+			}
+		}
+	}
+	
+}
@@ -0,0 +1,29 @@
+/*	=========
+ *	Server.hh
+ *	=========
+ */
+
+#ifndef SERVER_HH
+#define SERVER_HH
+
+// Standard C/C++
+#include <cstddef>
+
+
+namespace tool
+{
+	
+	/*
+		Listens on the given TCP port and serves HTTP/1.1 with keep-alive
+		and pipelining from a single event loop.  Requests that may block
+		(CGI and directory listings) are handed off, along with their
+		connection, to at most n_workers forked worker processes.  Up to
+		n_cached_files static files are kept open, with their response
+		headers, and conditional GETs for them are answered from memory.
+	*/
+	
+	void RunServer( unsigned short port, std::size_t n_workers, std::size_t n_cached_files );
+	
+}
+
+#endif
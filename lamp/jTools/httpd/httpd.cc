@@ -3,24 +3,32 @@
  *	========
  */
 
+#include "httpd.hh"
+
 // Standard C/C++
 #include <cctype>
 #include <cstdio>
 #include <cstdlib>
 
 // Standard C
+#include <errno.h>
+#include <signal.h>
 #include <stdlib.h>
+#include <string.h>
 
 // POSIX
 #include <arpa/inet.h>
+#include <fcntl.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
+#include <unistd.h>
 
 // iota
 #include "iota/strings.hh"
 
 // gear
 #include "gear/hexidecimal.hh"
+#include "gear/parse_decimal.hh"
 
 // plus
 #include "plus/hexidecimal.hh"
@@ -53,6 +61,9 @@ typedef unsigned int OSType;
 // Arcana
 #include "HTTP.hh"
 
+// httpd
+#include "Server.hh"
+
 // Orion
 #include "Orion/get_options.hh"
 #include "Orion/Main.hh"
@@ -71,7 +82,9 @@ namespace tool
 	using namespace io::path_descent_operators;
 	
 	
-	static const char* gDocumentRoot = "/var/www";
+	const char* gDocumentRoot = "/var/www";
+	
+	static bool gPooled = false;
 	
 	
 	static char ToCGI( char c )
@@ -142,10 +155,16 @@ namespace tool
 		p7::fd_t reader = p7::fd_t( pipe_ends[0] );
 		p7::fd_t writer = p7::fd_t( pipe_ends[1] );
 		
-		p7::pid_t pid = POSEVEN_VFORK();
+		// A pooled worker serves again, so the CGI variables mustn't stay
+		// behind in its environment, as they would after vfork().
+		
+		p7::pid_t pid = gPooled ? p7::pid_t( p7::throw_posix_result( fork() ) )
+		                        : POSEVEN_VFORK();
 		
 		if ( pid == 0 )
 		{
+			signal( SIGPIPE, SIG_DFL );
+			
 			if ( partial_data_exist )
 			{
 				close( writer );
@@ -179,16 +198,7 @@ namespace tool
 	}
 	
 	
-	struct ParsedRequest
-	{
-		plus::string  method;
-		plus::string  resource;
-		plus::string  version;
-	};
-	
-	class bad_http_request {};
-	
-	static ParsedRequest ParseRequest( const plus::string& request )
+	ParsedRequest ParseRequest( const plus::string& request )
 	{
 		// E.g.  "GET / HTTP/1.0"
 		
@@ -218,7 +228,7 @@ namespace tool
 			throw bad_http_request();
 		}
 		
-		parsed.resource.assign( request, resource - begin, space - begin );  // e.g. "/logo.png"
+		parsed.resource.assign( request, resource - begin, space - resource );  // e.g. "/logo.png"
 		
 		// HTTP version string starts after the second space
 		const char* version = space + 1;
@@ -438,7 +448,85 @@ namespace tool
 		"<p>"     error "</p>"      "\r\n"
 	
 	
-	static void SendResponse( const HTTP::MessageReceiver& request )
+	bool ResolveResource( const plus::string& resource, Resource& result )
+	{
+		try
+		{
+			result.pathname = LocateResource( resource );
+		}
+		catch ( ... )
+		{
+			return false;
+		}
+		
+		result.is_cgi = strncmp( resource.c_str(), STR_LEN( "/cgi-bin/" ) ) == 0;
+		result.is_dir = false;
+		
+		result.content_type = NULL;
+		
+		if ( result.is_cgi )
+		{
+			return true;
+		}
+		
+		plus::string& pathname = result.pathname;
+		
+		if ( p7::s_isdir( p7::stat( pathname ) ) )
+		{
+			if ( *(pathname.end() - 1) != '/' )
+			{
+				return false;
+			}
+			
+			plus::string index_html = pathname / "index.html";
+			
+			if ( io::file_exists( index_html ) )
+			{
+				pathname = index_html;
+			}
+			else
+			{
+				result.is_dir = true;
+			}
+		}
+		
+		const bool is_dir = result.is_dir;
+		
+		OSType type = 0;
+		
+	#if TARGET_OS_MAC
+		
+		type = kUnknownType;
+		
+		FInfo info = { 0 };
+		
+		if ( !is_dir )
+		{
+			FSSpec file = Divergence::ResolvePathToFSSpec( pathname.c_str() );
+			
+			::OSErr err = FSpGetFInfo( &file, &info );
+			
+			if ( err == noErr )
+			{
+				type = info.fdType;
+			}
+		}
+		
+		plus::var_string extra_header_lines;
+		
+		extra_header_lines += HTTP::HeaderFieldLine( "X-Mac-Type",    plus::encode_32_bit_hex( info.fdType    ) );
+		extra_header_lines += HTTP::HeaderFieldLine( "X-Mac-Creator", plus::encode_32_bit_hex( info.fdCreator ) );
+		
+		result.extra_header_lines = extra_header_lines;
+		
+	#endif
+		
+		result.content_type = is_dir ? "text/plain" : GuessContentType( pathname, type );
+		
+		return true;
+	}
+	
+	void SendResponse( const HTTP::MessageReceiver& request )
 	{
 		plus::string status_line = request.GetStatusLine();
 		
@@ -447,13 +535,9 @@ namespace tool
 		
 		ParsedRequest parsed = ParseRequest( status_line );
 		
-		plus::string pathname;
+		Resource resource;
 		
-		try
-		{
-			pathname = LocateResource( parsed.resource );
-		}
-		catch ( ... )
+		if ( !ResolveResource( parsed.resource, resource ) )
 		{
 			p7::write( p7::stdout_fileno,
 			           STR_LEN( HTTP_ERROR( "404 Not Found" ) ) );
@@ -461,7 +545,9 @@ namespace tool
 			return;
 		}
 		
-		if ( strncmp( parsed.resource.c_str(), STR_LEN( "/cgi-bin/" ) ) == 0 )
+		const plus::string& pathname = resource.pathname;
+		
+		if ( resource.is_cgi )
 		{
 			const char* path = pathname.c_str();
 			
@@ -471,64 +557,11 @@ namespace tool
 		}
 		else
 		{
-			bool is_dir = false;
-			
-			if ( p7::s_isdir( p7::stat( pathname ) ) )
-			{
-				if ( *(pathname.end() - 1) != '/' )
-				{
-					p7::write( p7::stdout_fileno,
-					           STR_LEN( HTTP_ERROR( "404 Not Found" ) ) );
-					
-					return;
-				}
-				
-				plus::string index_html = pathname / "index.html";
-				
-				if ( io::file_exists( index_html ) )
-				{
-					pathname = index_html;
-				}
-				else
-				{
-					is_dir = true;
-				}
-			}
-			
-			OSType type = 0;
-			
-		#if TARGET_OS_MAC
-			
-			type = kUnknownType;
-			
-			FInfo info = { 0 };
-			
-			if ( !is_dir )
-			{
-				FSSpec file = Divergence::ResolvePathToFSSpec( pathname.c_str() );
-				
-				::OSErr err = FSpGetFInfo( &file, &info );
-				
-				if ( err == noErr )
-				{
-					type = info.fdType;
-				}
-			}
-			
-		#endif
-			
-			const char* contentType = is_dir ? "text/plain" : GuessContentType( pathname, type );
-			
 			plus::var_string responseHeader = HTTP_VERSION " 200 OK\r\n";
 			
-			responseHeader += HTTP::HeaderFieldLine( "Content-Type",  contentType                   );
-			
-		#if TARGET_OS_MAC
-			
-			responseHeader += HTTP::HeaderFieldLine( "X-Mac-Type",    plus::encode_32_bit_hex( info.fdType    ) );
-			responseHeader += HTTP::HeaderFieldLine( "X-Mac-Creator", plus::encode_32_bit_hex( info.fdCreator ) );
+			responseHeader += HTTP::HeaderFieldLine( "Content-Type", resource.content_type );
 			
-		#endif
+			responseHeader += resource.extra_header_lines;
 			
 			responseHeader += "\r\n";
 			
@@ -536,17 +569,13 @@ namespace tool
 			
 			if ( parsed.method != "HEAD" )
 			{
-				is_dir ? ListDir( pathname ) : DumpFile( pathname );
+				resource.is_dir ? ListDir( pathname ) : DumpFile( pathname );
 			}
 		}
 	}
 	
-	int Main( int argc, char** argv )
+	static void ServeConnection()
 	{
-		o::bind_option_to_variable( "--doc-root", gDocumentRoot );
-		
-		o::get_options( argc, argv );
-		
 		sockaddr_in peer;
 		socklen_t peerlen = sizeof peer;
 		
@@ -564,9 +593,144 @@ namespace tool
 		SendResponse( request );
 		
 		p7::write( p7::stderr_fileno, STR_LEN( "\n" ) );
+	}
+	
+#ifndef __RELIX__
+
+	// Returns a connection sent by inetd, or -1 once it hangs up.
+	
+	static int ReceiveConnection( int control )
+	{
+		char byte;
+		
+		iovec iov = { &byte, 1 };
+		
+		union
+		{
+			cmsghdr  header;
+			char     buffer[ CMSG_SPACE( sizeof (int) ) ];
+		} u;
+		
+		msghdr message = { 0 };
+		
+		message.msg_iov        = &iov;
+		message.msg_iovlen     = 1;
+		message.msg_control    = u.buffer;
+		message.msg_controllen = sizeof u.buffer;
+		
+		ssize_t n_received;
+		
+		while ( (n_received = recvmsg( control, &message, 0 )) < 0  &&  errno == EINTR )
+		{
+			continue;
+		}
+		
+		const cmsghdr* header = n_received > 0 ? CMSG_FIRSTHDR( &message ) : NULL;
+		
+		if ( header == NULL  ||  header->cmsg_type != SCM_RIGHTS )
+		{
+			return -1;
+		}
+		
+		int fd;
+		
+		memcpy( &fd, CMSG_DATA( header ), sizeof fd );
+		
+		return fd;
+	}
+	
+	/*
+		As a member of an inetd worker pool, standard input is a socket
+		from inetd that brings one connection at a time.  Each is served
+		inetd-style and hung up, and then a byte is written back to say
+		we're ready for the next.
+	*/
+	
+	static void ServePooled()
+	{
+		gPooled = true;
+		
+		const int control = p7::throw_posix_result( dup( p7::stdin_fileno ) );
+		
+		const int null = p7::throw_posix_result( open( "/dev/null", O_RDWR ) );
+		
+		fcntl( control, F_SETFD, FD_CLOEXEC );
+		fcntl( null,    F_SETFD, FD_CLOEXEC );
+		
+		// A client that hangs up early mustn't cost us the worker.
+		
+		signal( SIGPIPE, SIG_IGN );
+		
+		int fd;
+		
+		while ( (fd = ReceiveConnection( control )) >= 0 )
+		{
+			dup2( fd, p7::stdin_fileno  );
+			dup2( fd, p7::stdout_fileno );
+			
+			close( fd );
+			
+			try
+			{
+				ServeConnection();
+			}
+			catch ( ... )
+			{
+			}
+			
+			dup2( null, p7::stdin_fileno  );
+			dup2( null, p7::stdout_fileno );
+			
+			if ( write( control, "", 1 ) != 1 )
+			{
+				break;
+			}
+		}
+	}
+	
+#endif
+	
+	int Main( int argc, char** argv )
+	{
+		const char* listen_port = NULL;
+		
+		std::size_t n_workers      = 4;
+		std::size_t n_cached_files = 256;
+		
+		bool pooled = false;
+		
+		o::bind_option_to_variable( "--doc-root",   gDocumentRoot  );
+		o::bind_option_to_variable( "--listen",     listen_port    );
+		o::bind_option_to_variable( "--workers",    n_workers      );
+		o::bind_option_to_variable( "--file-cache", n_cached_files );
+		o::bind_option_to_variable( "--pooled",     pooled         );
+		
+		o::get_options( argc, argv );
+		
+		if ( listen_port != NULL )
+		{
+			// Standalone, persistent HTTP/1.1 server
+			
+			RunServer( gear::parse_unsigned_decimal( listen_port ), n_workers, n_cached_files );
+			
+			return 0;
+		}
+		
+	#ifndef __RELIX__
+		
+		if ( pooled )
+		{
+			ServePooled();
+			
+			return 0;
+		}
+		
+	#endif
+		
+		ServeConnection();
 		
 		return 0;
 	}
-
+	
 }
 
@@ -0,0 +1,55 @@
+/*	========
+ *	httpd.hh
+ *	========
+ */
+
+#ifndef HTTPD_HH
+#define HTTPD_HH
+
+// plus
+#include "plus/string.hh"
+
+
+namespace HTTP
+{
+	
+	class MessageReceiver;
+	
+}
+
+namespace tool
+{
+	
+	extern const char* gDocumentRoot;
+	
+	
+	struct ParsedRequest
+	{
+		plus::string  method;
+		plus::string  resource;
+		plus::string  version;
+	};
+	
+	class bad_http_request {};
+	
+	ParsedRequest ParseRequest( const plus::string& request );
+	
+	
+	struct Resource
+	{
+		plus::string  pathname;
+		const char*   content_type;
+		plus::string  extra_header_lines;  // e.g. X-Mac-Type
+		bool          is_cgi;
+		bool          is_dir;
+	};
+	
+	// Returns false if the resource doesn't exist (404)
+	bool ResolveResource( const plus::string& resource, Resource& result );
+	
+	// Writes a complete HTTP/1.0 response to stdout (inetd-style)
+	void SendResponse( const HTTP::MessageReceiver& request );
+	
+}
+
+#endif
@@ -0,0 +1,73 @@
+#!/usr/bin/perl
+
+# Measures connections per second through inetd, one request per connection.
+#
+#   bench-inetd.pl [-c clients] [-n connections] host:port/path ...
+
+use warnings;
+use strict;
+
+use IO::Socket::INET;
+use Time::HiRes qw( time );
+
+my $clients = 4;
+my $count   = 2000;
+
+while ( @ARGV  &&  $ARGV[0] =~ /^-/ )
+{
+	my $option = shift;
+
+	$option eq "-c" and $clients = shift, next;
+	$option eq "-n" and $count   = shift, next;
+
+	die "Usage: bench-inetd.pl [-c clients] [-n connections] host:port/path ...\n";
+}
+
+sub fetch
+{
+	my ( $address, $path ) = @_;
+
+	my $socket = IO::Socket::INET->new( PeerAddr => $address ) or die "$address: $!\n";
+
+	print $socket "GET /$path HTTP/1.0\r\n\r\n";
+
+	my $response = do { local $/; <$socket> };
+
+	$response =~ m{^HTTP/1\.. 200 } or die "$address: bad response\n";
+}
+
+for my $url ( @ARGV )
+{
+	my ( $address, $path ) = $url =~ m{^([^/]+)/?(.*)$};
+
+	my $start = time;
+
+	my @pids;
+
+	for my $i ( 1 .. $clients )
+	{
+		my $pid = fork;
+
+		defined $pid or die "fork: $!\n";
+
+		if ( $pid == 0 )
+		{
+			fetch( $address, $path ) for 1 .. $count / $clients;
+
+			exit 0;
+		}
+
+		push @pids, $pid;
+	}
+
+	for my $pid ( @pids )
+	{
+		waitpid( $pid, 0 );
+
+		$? == 0 or die "$url: a client failed\n";
+	}
+
+	my $elapsed = time - $start;
+
+	printf "%-32s  %7.0f connections/s\n", $url, $count / $elapsed;
+}
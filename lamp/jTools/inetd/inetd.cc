@@ -4,12 +4,26 @@
  */
 
 // Standard C++
+#include <algorithm>
 #include <map>
+#include <set>
 #include <vector>
 
+// Standard C
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
 // POSIX
+#include <fcntl.h>
 #include <sys/select.h>
+#include <sys/socket.h>
 #include <sys/wait.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
 
 // iota
 #include "iota/strings.hh"
@@ -28,8 +42,6 @@
 // poseven
 #include "poseven/extras/fd_reader.hh"
 #include "poseven/bundles/inet.hh"
-#include "poseven/functions/accept.hh"
-#include "poseven/functions/execv.hh"
 #include "poseven/functions/fcntl.hh"
 #include "poseven/functions/listen.hh"
 #include "poseven/functions/open.hh"
@@ -41,14 +53,36 @@
 #include "poseven/types/exit_t.hh"
 
 // Orion
+#include "Orion/get_options.hh"
 #include "Orion/Main.hh"
 
 
+/*
+	Each line of inetd.conf names a port, a service executable, and its
+	arguments.  The fourth field says how connections are served:
+		
+		nowait        a new service process for each connection
+		nowait.max    the same, with at most max of them at once
+		pool.n        n long-lived workers, started up front
+		
+	A pool worker is started with a Unix socket as its standard input.
+	inetd sends each accepted connection down it (SCM_RIGHTS, one byte of
+	payload), and the worker writes back a byte when it's done with it.
+	A worker is only sent one connection at a time, so a pool of n serves
+	at most n at once.  Workers that exit are replaced, unless they exit
+	as soon as they start.
+	
+	When a service is at its limit, its listener is left out of the wait
+	and connections queue in the kernel until there's room.  Otherwise,
+	each wakeup accepts every pending connection, up to a batch limit.
+*/
+
 namespace tool
 {
 	
 	namespace n = nucleus;
 	namespace p7 = poseven;
+	namespace o = orion;
 	
 	
 	struct Record
@@ -56,89 +90,589 @@ namespace tool
 		short                        port;
 		plus::string                 path;
 		std::vector< plus::string >  argv;
+		unsigned                     max_active;  // 0 for no limit
+		unsigned                     pool_size;   // 0 for nowait
 	};
 	
-	static std::vector< Record > gRecords;
+	struct Worker
+	{
+		p7::pid_t  pid;
+		int        control;  // our end of its socket, or -1 once it's gone
+		bool       busy;
+		time_t     started;
+	};
+	
+	struct Service
+	{
+		Record                      record;
+		std::vector< const char* >  argv;
+		int                         listener;
+		unsigned                    n_active;  // service processes running
+		bool                        watching;
+		std::vector< Worker >       workers;
+	};
+	
+	static const char* gConfigPath = "/etc/inetd.conf";
+	
+	static std::map< int, Service > gServers;
 	
-	static std::map< int, Record > gServers;
+	static std::map< int, Service* > gControls;
 	
-	static bool gChildSignalled = false;
+	static std::map< p7::pid_t, Service* > gChildren;
+	
+	static int gSignalPipe[ 2 ];
+	
+	static const unsigned max_accept_batch = 64;
 	
 	
 	static void HandleSIGCHLD( int )
 	{
-		gChildSignalled = true;
+		const int saved_errno = errno;
+		
+		(void) write( gSignalPipe[ 1 ], "", 1 );
+		
+		errno = saved_errno;
+	}
+	
+	static void set_cloexec( int fd )
+	{
+		fcntl( fd, F_SETFD, FD_CLOEXEC );
+	}
+	
+	static void set_nonblocking( int fd, bool nonblocking )
+	{
+		const int flags = fcntl( fd, F_GETFL, 0 );
+		
+		fcntl( fd, F_SETFL, nonblocking ? flags |  O_NONBLOCK
+		                                : flags & ~O_NONBLOCK );
+	}
+	
+#ifdef __linux__
+
+	static int gEpollFD = -1;
+	
+	static void StartWatching()
+	{
+		gEpollFD = p7::throw_posix_result( epoll_create( 64 ) );
+		
+		set_cloexec( gEpollFD );
+	}
+	
+	static void Watch( int fd )
+	{
+		epoll_event event = { 0 };
+		
+		event.events  = EPOLLIN;
+		event.data.fd = fd;
+		
+		p7::throw_posix_result( epoll_ctl( gEpollFD, EPOLL_CTL_ADD, fd, &event ) );
+	}
+	
+	static void Unwatch( int fd )
+	{
+		epoll_event event = { 0 };  // non-NULL for pre-2.6.9 kernels
+		
+		(void) epoll_ctl( gEpollFD, EPOLL_CTL_DEL, fd, &event );
+	}
+	
+	static int WaitForEvents( int* ready, int capacity )
+	{
+		epoll_event events[ 64 ];
+		
+		const int n = epoll_wait( gEpollFD, events, std::min( capacity, 64 ), -1 );
+		
+		for ( int i = 0;  i < n;  ++i )
+		{
+			ready[ i ] = events[ i ].data.fd;
+		}
+		
+		return n;
+	}
+	
+#else
+
+	static std::set< int > gWatched;
+	
+	static void StartWatching()
+	{
+	}
+	
+	static void Watch( int fd )
+	{
+		gWatched.insert( fd );
+	}
+	
+	static void Unwatch( int fd )
+	{
+		gWatched.erase( fd );
+	}
+	
+	static int WaitForEvents( int* ready, int capacity )
+	{
+		fd_set readfds;
+		
+		FD_ZERO( &readfds );
+		
+		typedef std::set< int >::const_iterator Iter;
+		
+		for ( Iter it = gWatched.begin();  it != gWatched.end();  ++it )
+		{
+			FD_SET( *it, &readfds );
+		}
+		
+		const int maxFD = gWatched.empty() ? -1 : *gWatched.rbegin();
+		
+		// This blocks and yields to other threads
+		int selected = select( maxFD + 1, &readfds, NULL, NULL, NULL );
+		
+		if ( selected <= 0 )
+		{
+			return selected;
+		}
+		
+		int n = 0;
+		
+		for ( Iter it = gWatched.begin();  it != gWatched.end()  &&  n < capacity;  ++it )
+		{
+			if ( FD_ISSET( *it, &readfds ) )
+			{
+				ready[ n++ ] = *it;
+			}
+		}
+		
+		return n;
+	}
+	
+#endif
+
+	static bool HasIdleWorker( const Service& service )
+	{
+		for ( std::size_t i = 0;  i < service.workers.size();  ++i )
+		{
+			const Worker& worker = service.workers[ i ];
+			
+			if ( worker.control >= 0  &&  !worker.busy )
+			{
+				return true;
+			}
+		}
+		
+		return false;
+	}
+	
+	static bool CanAccept( const Service& service )
+	{
+		if ( service.record.pool_size )
+		{
+			return HasIdleWorker( service );
+		}
+		
+		const unsigned max = service.record.max_active;
+		
+		return max == 0  ||  service.n_active < max;
 	}
 	
-	static void ServiceClient( p7::fd_t client, const char *const argv[] )
+	static void UpdateWatch( Service& service )
 	{
+		const bool wanted = CanAccept( service );
+		
+		if ( wanted != service.watching )
+		{
+			wanted ? Watch  ( service.listener )
+			       : Unwatch( service.listener );
+			
+			service.watching = wanted;
+		}
+	}
+	
+	static p7::pid_t Launch( const Service& service, int stdin_fd, int stdout_fd )
+	{
+		const char* path = service.record.path.c_str();
+		
 		p7::pid_t pid = POSEVEN_VFORK();
 		
 		if ( pid == 0 )
 		{
-			dup2( client, 0 );
-			dup2( client, 1 );
-			//dup2( client, 2 );  // Keep error log.  login will dup2 1 -> 2.
+			dup2( stdin_fd, 0 );
+			
+			if ( stdout_fd >= 0 )
+			{
+				dup2( stdout_fd, 1 );
+				//dup2( client, 2 );  // Keep error log.  login will dup2 1 -> 2.
+			}
+			
+			if ( stdin_fd > 1 )
+			{
+				close( stdin_fd );
+			}
 			
-			int result = close( client );
+			execv( path, (char**) &service.argv[ 0 ] );
 			
-			p7::execv( argv );
+			_exit( 127 );
 		}
+		
+		return pid;
 	}
 	
-	static void WaitForClients()
+	static void ServiceClient( Service& service, int client )
+	{
+		const p7::pid_t pid = Launch( service, client, client );
+		
+		gChildren[ pid ] = &service;
+		
+		++service.n_active;
+	}
+	
+#ifndef __RELIX__
+
+	static void StartWorker( Service& service )
+	{
+		int fds[ 2 ];
+		
+		if ( socketpair( AF_UNIX, SOCK_STREAM, 0, fds ) < 0 )
+		{
+			p7::perror( "inetd: socketpair()" );
+			
+			return;
+		}
+		
+		set_cloexec( fds[ 0 ] );
+		
+		/*
+			A worker that dies is reaped and replaced in the middle of a batch
+			of events, and the new control socket can take the old one's fd.
+			The old fd's readiness then applies to the new socket, so reading
+			mustn't block.
+		*/
+		
+		set_nonblocking( fds[ 0 ], true );
+		
+	#ifdef SO_NOSIGPIPE
+		
+		int on = 1;
+		
+		setsockopt( fds[ 0 ], SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof on );
+		
+	#endif
+		
+		const p7::pid_t pid = Launch( service, fds[ 1 ], -1 );
+		
+		close( fds[ 1 ] );
+		
+		const Worker worker = { pid, fds[ 0 ], false, time( NULL ) };
+		
+		service.workers.push_back( worker );
+		
+		gControls[ worker.control ] = &service;
+		gChildren[ pid            ] = &service;
+		
+		Watch( worker.control );
+	}
+	
+	static bool SendDescriptor( int control, int fd )
+	{
+		char byte = 0;
+		
+		iovec iov = { &byte, 1 };
+		
+		union
+		{
+			cmsghdr  header;
+			char     buffer[ CMSG_SPACE( sizeof (int) ) ];
+		} u;
+		
+		msghdr message = { 0 };
+		
+		message.msg_iov        = &iov;
+		message.msg_iovlen     = 1;
+		message.msg_control    = u.buffer;
+		message.msg_controllen = sizeof u.buffer;
+		
+		cmsghdr* header = CMSG_FIRSTHDR( &message );
+		
+		header->cmsg_level = SOL_SOCKET;
+		header->cmsg_type  = SCM_RIGHTS;
+		header->cmsg_len   = CMSG_LEN( sizeof (int) );
+		
+		memcpy( CMSG_DATA( header ), &fd, sizeof (int) );
+		
+	#ifdef MSG_NOSIGNAL
+		
+		const int flags = MSG_NOSIGNAL;  // A dead worker mustn't take us with it
+		
+	#else
+		
+		const int flags = 0;
+		
+	#endif
+		
+		return sendmsg( control, &message, flags ) == 1;
+	}
+	
+	static void DropControl( Worker& worker )
 	{
-		int maxFD = -1;
+		// It's exiting; it'll be replaced when it's reaped.
+		
+		Unwatch( worker.control );
+		
+		close( worker.control );
+		
+		gControls.erase( worker.control );
+		
+		worker.control = -1;
+	}
+	
+	static void HandOff( Service& service, int client )
+	{
+		for ( std::size_t i = 0;  i < service.workers.size();  ++i )
+		{
+			Worker& worker = service.workers[ i ];
+			
+			if ( worker.control >= 0  &&  !worker.busy )
+			{
+				if ( SendDescriptor( worker.control, client ) )
+				{
+					worker.busy = true;
+					
+					return;
+				}
+				
+				const int error = errno;
+				
+				p7::perror( "inetd: sendmsg()", error );
+				
+				if ( error == EPIPE  ||  error == ECONNRESET  ||  error == ENOTCONN )
+				{
+					DropControl( worker );
+				}
+				
+				// Otherwise it's still idle.  Either way, try the next one.
+			}
+		}
 		
-		fd_set listeners;
+		// No worker took it, so the client is dropped.
+	}
+	
+	static void WorkerReady( Service& service, int control )
+	{
+		std::vector< Worker >& workers = service.workers;
 		
-		FD_ZERO( &listeners );
+		for ( std::size_t i = 0;  i < workers.size();  ++i )
+		{
+			Worker& worker = workers[ i ];
+			
+			if ( worker.control != control )
+			{
+				continue;
+			}
+			
+			char buffer[ 16 ];
+			
+			const ssize_t n_read = read( control, buffer, sizeof buffer );
+			
+			if ( n_read > 0 )
+			{
+				worker.busy = false;
+			}
+			else if ( n_read == 0  ||  (errno != EINTR  &&  errno != EAGAIN  &&  errno != EWOULDBLOCK) )
+			{
+				DropControl( worker );
+			}
+			
+			break;
+		}
 		
-		typedef std::map< int, Record >::const_iterator const_iterator;
+		UpdateWatch( service );
+	}
+	
+	static void WorkerExited( Service& service, p7::pid_t pid, const time_t& now )
+	{
+		std::vector< Worker >& workers = service.workers;
 		
-		for ( const_iterator it = gServers.begin();  it != gServers.end();  ++it )
+		for ( std::size_t i = 0;  i < workers.size();  ++i )
 		{
-			FD_SET( it->first, &listeners );
+			Worker& worker = workers[ i ];
+			
+			if ( worker.pid != pid )
+			{
+				continue;
+			}
+			
+			if ( worker.control >= 0 )
+			{
+				Unwatch( worker.control );
+				
+				close( worker.control );
+				
+				gControls.erase( worker.control );
+			}
+			
+			const bool promptly = now - worker.started < 2;
+			
+			workers.erase( workers.begin() + i );
+			
+			if ( promptly )
+			{
+				// Most likely it can't start at all, so don't spin.
+				
+				p7::perror( "inetd", service.record.path.c_str(), "worker exited on startup" );
+			}
+			else
+			{
+				StartWorker( service );
+			}
 			
-			maxFD = std::max( maxFD, it->first );
+			break;
 		}
+	}
+	
+#endif
+
+	static void ReapChildren()
+	{
+		char buffer[ 64 ];
 		
-		while ( true )
+		while ( read( gSignalPipe[ 0 ], buffer, sizeof buffer ) > 0 )
+		{
+			continue;
+		}
+		
+		const time_t now = time( NULL );
+		
+		int stat;
+		
+		while ( const p7::pid_t pid = p7::pid_t( waitpid( -1, &stat, WNOHANG ) ) )
 		{
-			fd_set readfds = listeners;
+			if ( pid < 0 )
+			{
+				break;
+			}
+			
+			std::map< p7::pid_t, Service* >::iterator it = gChildren.find( pid );
+			
+			if ( it == gChildren.end() )
+			{
+				continue;
+			}
+			
+			Service& service = *it->second;
+			
+			gChildren.erase( it );
+			
+		#ifndef __RELIX__
 			
-			// This blocks and yields to other threads
-			int selected = select( maxFD + 1, &readfds, NULL, NULL, NULL );
+			if ( service.record.pool_size )
+			{
+				WorkerExited( service, pid, now );
+			}
+			else
+			
+		#endif
 			
-			if ( selected == -1 && errno != EINTR )
 			{
-				p7::perror( "inetd: select()" );
+				--service.n_active;
+			}
+			
+			UpdateWatch( service );
+		}
+	}
+	
+	static void AcceptClients( Service& service )
+	{
+		for ( unsigned i = 0;  i < max_accept_batch  &&  CanAccept( service );  ++i )
+		{
+			const int client = accept( service.listener, NULL, NULL );
+			
+			if ( client < 0 )
+			{
+				if ( errno == ECONNABORTED  ||  errno == EINTR )
+				{
+					continue;
+				}
 				
-				return;
+				if ( errno != EAGAIN  &&  errno != EWOULDBLOCK )
+				{
+					p7::perror( "inetd: accept()" );
+				}
+				
+				break;
+			}
+			
+		#ifndef __linux__
+			
+			// Linux doesn't pass the listener's O_NONBLOCK on to the client.
+			
+			set_nonblocking( client, false );
+			
+		#endif
+		
+		#ifndef __RELIX__
+			
+			if ( service.record.pool_size )
+			{
+				HandOff( service, client );
 			}
+			else
+			
+		#endif
+			
+			{
+				ServiceClient( service, client );
+			}
+			
+			close( client );
+		}
+		
+		UpdateWatch( service );
+	}
+	
+	static void WaitForClients()
+	{
+		const int max_events = 64;
+		
+		int ready[ max_events ];
+		
+		while ( true )
+		{
+			const int n = WaitForEvents( ready, max_events );
 			
-			if ( gChildSignalled )
+			if ( n < 0  &&  errno != EINTR )
 			{
-				gChildSignalled = false;
+				p7::perror( "inetd: wait" );
 				
-				int stat;
-				while ( waitpid( -1, &stat, 1 ) > 0 ) continue;
+				return;
 			}
 			
-			if ( selected > 0 )
+			for ( int i = 0;  i < n;  ++i )
 			{
-				for ( int listener = 0;  listener <= maxFD;  ++listener )
+				const int fd = ready[ i ];
+				
+				if ( fd == gSignalPipe[ 0 ] )
 				{
-					if ( !FD_ISSET( listener, &readfds ) )  continue;
-					
-					const char* path = gServers[ listener ].path.c_str();
+					ReapChildren();
 					
-					const char* const argv[] = { path, NULL };
+					continue;
+				}
+				
+				std::map< int, Service >::iterator server = gServers.find( fd );
+				
+				if ( server != gServers.end() )
+				{
+					AcceptClients( server->second );
 					
-					// This won't block unless select() is broken
-					// FIXME:  Yes it will, due to a race condition
-					ServiceClient( p7::accept( p7::fd_t( listener ) ), argv );
+					continue;
 				}
+				
+			#ifndef __RELIX__
+				
+				std::map< int, Service* >::iterator control = gControls.find( fd );
+				
+				if ( control != gControls.end() )
+				{
+					WorkerReady( *control->second, fd );
+				}
+				
+			#endif
 			}
 		}
 	}
@@ -172,6 +706,29 @@ namespace tool
 		return result;
 	}
 	
+	static void ParseWait( const plus::string& field, Record& result )
+	{
+		const char* wait = field.c_str();
+		
+		const char* dot = strchr( wait, '.' );
+		
+		const unsigned count = dot ? gear::parse_unsigned_decimal( dot + 1 ) : 0;
+		
+		result.max_active = 0;
+		result.pool_size  = 0;
+		
+		if ( strncmp( wait, "pool.", 5 ) == 0 )
+		{
+			result.pool_size = std::max( count, 1u );
+		}
+		else
+		{
+			// "wait" isn't supported; it's treated as "nowait", as always.
+			
+			result.max_active = count;
+		}
+	}
+	
 	static Record MakeRecord( const std::vector< plus::string >& tokens )
 	{
 		enum
@@ -197,6 +754,8 @@ namespace tool
 		result.port = gear::parse_unsigned_decimal( tokens[ kPort ].c_str() );
 		result.path = tokens[ kPath ];
 		
+		ParseWait( tokens[ kWait ], result );
+		
 		std::size_t argc = tokens.size() - kArgv;
 		
 		result.argv.resize( argc );
@@ -215,6 +774,17 @@ namespace tool
 		
 		Record record = MakeRecord( Split( line ) );
 		
+	#ifdef __RELIX__
+		
+		if ( record.pool_size )
+		{
+			p7::perror( "inetd", record.path.c_str(), "worker pools aren't supported here" );
+			
+			return;
+		}
+		
+	#endif
+		
 		p7::in_port_t port = p7::in_port_t( record.port );
 		
 	#ifdef SOCK_CLOEXEC
@@ -227,7 +797,15 @@ namespace tool
 		
 	#endif
 		
-		const p7::fd_t listener = p7::bind( p7::inaddr_any, port, type ).release();
+		const p7::fd_t listener = p7::socket( p7::pf_inet, type ).release();
+		
+		// Don't wait out the previous run's connections in TIME_WAIT.
+		
+		int on = 1;
+		
+		setsockopt( listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on );
+		
+		p7::bind( listener, p7::inaddr_any, port );
 		
 	#ifndef SOCK_CLOEXEC
 		
@@ -235,16 +813,32 @@ namespace tool
 		
 	#endif
 		
-		gServers[ listener ] = record;
+		set_nonblocking( listener, true );
+		
+		Service& service = gServers[ listener ];
+		
+		service.record   = record;
+		service.listener = listener;
+		service.n_active = 0;
+		service.watching = false;
+		
+		const std::vector< plus::string >& argv = service.record.argv;
+		
+		for ( std::size_t i = 0;  i < argv.size();  ++i )
+		{
+			service.argv.push_back( argv[ i ].c_str() );
+		}
+		
+		service.argv.push_back( NULL );
 		
-		p7::listen( listener, 3 );
+		p7::listen( listener, SOMAXCONN );
 	}
 	
 	static void ReadInetdDotConf()
 	{
 		text_input::feed feed;
 		
-		n::owned< p7::fd_t > fd( p7::open( "/etc/inetd.conf", p7::o_rdonly ) );
+		n::owned< p7::fd_t > fd( p7::open( gConfigPath, p7::o_rdonly ) );
 		
 		p7::fd_reader reader( fd );
 		
@@ -256,17 +850,43 @@ namespace tool
 		}
 	}
 	
-	int Main( int argc, char** argv )
+	static void StartServices()
 	{
-		if ( false )
+		typedef std::map< int, Service >::iterator iterator;
+		
+		for ( iterator it = gServers.begin();  it != gServers.end();  ++it )
 		{
-			p7::write( p7::stderr_fileno, STR_LEN( "Usage: daemon port command\n" ) );
+			Service& service = it->second;
+			
+		#ifndef __RELIX__
 			
-			return 1;
+			for ( unsigned i = 0;  i < service.record.pool_size;  ++i )
+			{
+				StartWorker( service );
+			}
+			
+		#endif
+			
+			UpdateWatch( service );
 		}
+	}
+	
+	int Main( int argc, char** argv )
+	{
+		o::bind_option_to_variable( "--config", gConfigPath );
+		
+		o::get_options( argc, argv );
 		
 		p7::write( p7::stdout_fileno, STR_LEN( "Starting internet superserver: inetd" ) );
 		
+		p7::throw_posix_result( pipe( gSignalPipe ) );
+		
+		set_cloexec( gSignalPipe[ 0 ] );
+		set_cloexec( gSignalPipe[ 1 ] );
+		
+		set_nonblocking( gSignalPipe[ 0 ], true );
+		set_nonblocking( gSignalPipe[ 1 ], true );
+		
 		p7::sigaction( p7::sigchld, HandleSIGCHLD );
 		
 		ReadInetdDotConf();
@@ -275,6 +895,12 @@ namespace tool
 		
 		if ( gServers.size() > 0 )
 		{
+			StartWatching();
+			
+			Watch( gSignalPipe[ 0 ] );
+			
+			StartServices();
+			
 			WaitForClients();
 		}
 		
@@ -282,4 +908,3 @@ namespace tool
 	}
 	
 }
-
@@ -32,6 +32,7 @@
 
 // poseven
 #include "poseven/extras/pump.hh"
+#include "poseven/extras/walk_tree.hh"
 #include "poseven/functions/dup.hh"
 #include "poseven/functions/fchmod.hh"
 #include "poseven/functions/fdopendir.hh"
@@ -749,9 +750,27 @@ namespace tool
 		std::sort( sequence.begin(), sequence.end() );
 	}
 	
+	class deleter : public p7::tree_visitor
+	{
+		public:
+			void visit_file( const p7::walk_entry& file )
+			{
+				p7::unlinkat( file.dirfd(), file.name() );
+			}
+			
+			void leave_directory( const p7::walk_entry& dir )
+			{
+				p7::unlinkat( dir.dirfd(), dir.name(), p7::at_removedir );
+			}
+	};
+	
 	static void recursively_delete( const plus::string& path )
 	{
-		io::recursively_delete( path );
+		// Everything below path is unlinked relative to its directory.
+		
+		deleter d;
+		
+		p7::walk_tree( path, d );
 	}
 	
 	static void recursively_sync_directory_contents( p7::fd_t             a_dirfd,
@@ -0,0 +1,310 @@
+/*	===========
+ *	md5bench.cc
+ *	===========
+ */
+
+// Standard C/C++
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+// iota
+#include "iota/strings.hh"
+
+// poseven
+#include "poseven/functions/gettimeofday.hh"
+#include "poseven/functions/write.hh"
+
+// Arcana
+#include "MD5/MD5.hh"
+
+// Orion
+#include "Orion/get_options.hh"
+#include "Orion/Main.hh"
+
+
+/*
+	md5bench hashes a buffer in memory with the engine that MD5 used to
+	have (a sine table, rounds in loops, and a copy of every block), with
+	the current one a block at a time and in bulk, and with the current
+	one in 2, 4, and 8 lanes (the buffer split evenly among them), and
+	reports the best throughput of several rounds.
+	
+	E.g.  md5bench -s 256 -r 5
+*/
+
+namespace tool
+{
+	
+	namespace p7 = poseven;
+	namespace o = orion;
+	
+	
+	typedef unsigned long long microseconds;
+	
+	// Where the results go, so the work can't be skipped
+	static volatile MD5::Word gSink;
+	
+	static microseconds now()
+	{
+		const timeval tv = p7::gettimeofday();
+		
+		return tv.tv_sec * 1000000ull + tv.tv_usec;
+	}
+	
+	
+	namespace legacy
+	{
+		
+		// The old Engine::DoBlock(), less its operator templates
+		
+		typedef MD5::Word Word;
+		
+		static Word gTable[ 64 ];
+		
+		static void init_table()
+		{
+			for ( int i = 1;  i <= 64;  ++i )
+			{
+				gTable[ i - 1 ] = Word( 4294967296.0 * std::abs( std::sin( double( i ) ) ) );
+			}
+		}
+		
+		static inline Word byteswap4( Word word )
+		{
+			return (word &  0xFF)        << 24
+				 | (word & (0xFF <<  8)) <<  8
+				 | (word & (0xFF << 16)) >>  8
+				 | (word & (0xFF << 24)) >> 24;
+		}
+		
+		static inline Word HostFromLittle32( Word word )
+		{
+		#ifndef __LITTLE_ENDIAN__
+			
+			word = byteswap4( word );
+			
+		#endif
+			
+			return word;
+		}
+		
+		static inline Word rotate_left( Word x, unsigned char bits )
+		{
+			return (x << bits) | (x >> (32 - bits));
+		}
+		
+		static inline Word F( Word x, Word y, Word z )  { return (x & y)  |  (~x & z); }
+		static inline Word G( Word x, Word y, Word z )  { return (x & z)  |  (y & ~z); }
+		static inline Word H( Word x, Word y, Word z )  { return (x ^ y ^ z); }
+		static inline Word I( Word x, Word y, Word z )  { return (y ^ (x | ~z)); }
+		
+		typedef Word (*Munger)( Word, Word, Word );
+		
+		static const Munger gMungers[ 4 ] = { F, G, H, I };
+		
+		static const unsigned char gShifts[ 4 ][ 4 ] =
+		{
+			{ 7, 12, 17, 22 },
+			{ 5,  9, 14, 20 },
+			{ 4, 11, 16, 23 },
+			{ 6, 10, 15, 21 },
+		};
+		
+		static inline int word_index( int round, int i )
+		{
+			switch ( round )
+			{
+				case 0:  return i;
+				case 1:  return (5 * i + 1) % 16;
+				case 2:  return (3 * i + 5) % 16;
+				default: return (7 * i    ) % 16;
+			}
+		}
+		
+		static void DoBlock( MD5::Buffer& state, const void* input )
+		{
+			Word block[ 16 ];
+			const Word* leBlock = reinterpret_cast< const Word* >( input );
+			
+			for ( int j = 0;  j < 16;  ++j )
+			{
+				block[ j ] = HostFromLittle32( leBlock[ j ] );
+			}
+			
+			Word abcd[ 4 ] = { state.a, state.b, state.c, state.d };
+			
+			for ( int i = 0;  i < 64;  ++i )
+			{
+				const int round = i / 16;
+				
+				Word& a = abcd[ (0 - i) & 3 ];
+				Word  b = abcd[ (1 - i) & 3 ];
+				Word  c = abcd[ (2 - i) & 3 ];
+				Word  d = abcd[ (3 - i) & 3 ];
+				
+				a = b + rotate_left( a + gMungers[ round ]( b, c, d ) + block[ word_index( round, i % 16 ) ] + gTable[ i ],
+				                     gShifts[ round ][ i % 4 ] );
+			}
+			
+			std::fill( block, block + 16, 0 );
+			
+			state.a += abcd[ 0 ];
+			state.b += abcd[ 1 ];
+			state.c += abcd[ 2 ];
+			state.d += abcd[ 3 ];
+		}
+		
+	}
+	
+	
+	enum Method
+	{
+		kLegacy,
+		kDoBlock,
+		kDoBlocks,
+		kLanes2,
+		kLanes4,
+		kLanes8,
+		kMethodCount
+	};
+	
+	static const char* const gMethodNames[] =
+	{
+		"legacy",
+		"DoBlock",
+		"DoBlocks",
+		"2 lanes",
+		"4 lanes",
+		"8 lanes",
+	};
+	
+	static const unsigned gLaneCounts[] = { 1, 1, 1, 2, 4, 8 };
+	
+	// Returns a checksum of the final states
+	static MD5::Word Hash( Method method, const char* data, std::size_t n_blocks )
+	{
+		const unsigned n_lanes = gLaneCounts[ method ];
+		
+		const std::size_t lane_blocks = n_blocks / n_lanes;
+		
+		MD5::Buffer legacy_state;
+		
+		MD5::Engine  engines[ MD5::max_lanes ];
+		MD5::Engine* lanes  [ MD5::max_lanes ];
+		const void*  inputs [ MD5::max_lanes ];
+		
+		for ( unsigned j = 0;  j < n_lanes;  ++j )
+		{
+			lanes [ j ] = &engines[ j ];
+			inputs[ j ] = data + j * lane_blocks * 64;
+		}
+		
+		switch ( method )
+		{
+			case kLegacy:
+				for ( std::size_t i = 0;  i < n_blocks;  ++i )
+				{
+					legacy::DoBlock( legacy_state, data + i * 64 );
+				}
+				
+				return legacy_state.a;
+			
+			case kDoBlock:
+				for ( std::size_t i = 0;  i < n_blocks;  ++i )
+				{
+					engines[ 0 ].DoBlock( data + i * 64 );
+				}
+				
+				break;
+			
+			case kDoBlocks:
+				engines[ 0 ].DoBlocks( data, n_blocks );
+				break;
+			
+			default:
+				MD5::Engine::DoBlocks( lanes, inputs, n_lanes, lane_blocks );
+				break;
+		}
+		
+		MD5::Word sum = 0;
+		
+		for ( unsigned j = 0;  j < n_lanes;  ++j )
+		{
+			engines[ j ].Finish( "", 0 );
+			
+			sum ^= engines[ j ].GetResult().data[ 0 ];
+		}
+		
+		return sum;
+	}
+	
+	int Main( int argc, char** argv )
+	{
+		std::size_t size_in_MiB = 256;
+		std::size_t n_rounds    = 3;
+		
+		o::bind_option_to_variable( "-s", size_in_MiB );
+		o::bind_option_to_variable( "-r", n_rounds    );
+		
+		o::alias_option( "-s", "--size"   );
+		o::alias_option( "-r", "--rounds" );
+		
+		o::get_options( argc, argv );
+		
+		if ( o::free_argument_count() > 0  ||  size_in_MiB == 0  ||  n_rounds == 0 )
+		{
+			p7::write( p7::stderr_fileno, STR_LEN( "Usage: md5bench [-s MiB] [-r rounds]\n" ) );
+			
+			return 2;
+		}
+		
+		const std::size_t size = size_in_MiB * 1024 * 1024;
+		
+		char* data = new char[ size ];
+		
+		for ( std::size_t i = 0;  i < size;  ++i )
+		{
+			data[ i ] = char( i * 7 + (i >> 12) );
+		}
+		
+		legacy::init_table();
+		
+		std::printf( "%lu MiB, best of %lu rounds\n\n",
+		             (unsigned long) size_in_MiB,
+		             (unsigned long) n_rounds );
+		
+		for ( int m = 0;  m < kMethodCount;  ++m )
+		{
+			microseconds best = 0;
+			
+			for ( std::size_t round = 0;  round < n_rounds;  ++round )
+			{
+				const microseconds t0 = now();
+				
+				gSink ^= Hash( Method( m ), data, size / 64 );
+				
+				microseconds elapsed = now() - t0;
+				
+				if ( elapsed == 0 )
+				{
+					elapsed = 1;
+				}
+				
+				if ( best == 0  ||  elapsed < best )
+				{
+					best = elapsed;
+				}
+			}
+			
+			std::printf( "%-10s%8.0f MB/s\n", gMethodNames[ m ], double( size ) / best );
+			
+			std::fflush( stdout );
+		}
+		
+		delete [] data;
+		
+		return 0;
+	}
+	
+}
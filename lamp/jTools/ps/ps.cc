@@ -3,19 +3,31 @@
  *	=====
  */
 
+// Standard C++
+#include <algorithm>
+#include <map>
+#include <vector>
+
+// Standard C
+#include <string.h>
+#include <time.h>
+
 // POSIX
 #include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <unistd.h>
 
 // iota
 #include "iota/strings.hh"
 
 // gear
+#include "gear/inscribe_decimal.hh"
 #include "gear/parse_decimal.hh"
 #include "gear/parse_float.hh"
 
-// Debug
-#include "debug/assert.hh"
-
 // plus
 #include "plus/var_string.hh"
 
@@ -23,15 +35,32 @@
 #include "poseven/functions/ftruncate.hh"
 #include "poseven/functions/open.hh"
 #include "poseven/functions/openat.hh"
+#include "poseven/functions/pread.hh"
 #include "poseven/functions/pwrite.hh"
 #include "poseven/functions/read.hh"
 #include "poseven/functions/write.hh"
+#include "poseven/types/errno_t.hh"
 
 // Orion
 #include "Orion/get_options.hh"
 #include "Orion/Main.hh"
 
 
+/*
+	ps [--wide] [--monitor] [--sleep seconds] [--watch]
+	
+	--watch redraws a terminal every --sleep seconds (default 1), like
+	top.  Each process's /proc directory stays open between samples, and
+	on Linux so does its stat file, which is reread in place.  The %CPU
+	column is the process's share of the time since the last sample,
+	where the kernel reports CPU times (MacRelix doesn't).  Only the lines
+	that changed are rewritten.
+	
+	The descriptor limit is raised as far as it goes.  Processes beyond
+	what it allows are sampled by opening and closing their files each
+	time instead.
+*/
+
 static struct timespec timespec_from_seconds( float time )
 {
 	const unsigned long seconds     = time;
@@ -55,85 +84,123 @@ namespace tool
 	static p7::fd_t g_proc = p7::open( "/proc", p7::o_rdonly | p7::o_directory ).release();
 	
 	
-	static plus::string left_padded( const char* begin, const char* end, unsigned length )
+	static void append_left_padded( plus::var_string& s, const char* begin, const char* end, unsigned length )
 	{
-		length = std::max< unsigned >( length, end - begin );
-		
-		const size_t pad_length = length - (end - begin);
-		
-		plus::var_string result;
-		
-		result.reserve( length );
+		const size_t size = end - begin;
 		
-		result.resize( pad_length, ' ' );
-		
-		result.append( begin, end );
+		if ( size < length )
+		{
+			s.append( length - size, ' ' );
+		}
 		
-		return result;
+		s.append( begin, end );
 	}
 	
-	static plus::string right_padded( const char* begin, const char* end, unsigned length )
+	static void append_right_padded( plus::var_string& s, const char* begin, const char* end, unsigned length )
 	{
-		length = std::max< unsigned >( length, end - begin );
-		
-		const size_t pad_length = length - (end - begin);
-		
-		plus::var_string result;
+		const size_t size = end - begin;
 		
-		result.reserve( length );
+		s.append( begin, end );
 		
-		result.assign( begin, end );
-		
-		result.append( pad_length, ' ' );
-		
-		return result;
+		if ( size < length )
+		{
+			s.append( length - size, ' ' );
+		}
 	}
 	
-	static void report_process( plus::var_string& report, const char* pid_name )
+	enum
 	{
-		const size_t incoming_report_size = report.size();
-		
-		n::owned< p7::fd_t > proc_pid = p7::openat( g_proc, pid_name, p7::o_rdonly | p7::o_directory );
-		
-		char buffer[ 4096 ];
-		
-		const char* begin = buffer;
-		const char* end   = buffer + p7::read( p7::openat( proc_pid, "stat", p7::o_rdonly ), buffer, 4096 );
-		
-		const char* close_paren = std::find( begin, end, ')' );
-		
-		ASSERT( close_paren != end );
-		
-		const char* p_stat = close_paren + 2;
-		
-		const char* q_stat = std::find( p_stat, end, ' ' );
-		
-		plus::var_string stat_string( p_stat, q_stat );
-		
-		const char* p_ppid = q_stat + 1;
-		
-		const char* q_ppid = std::find( p_ppid, end, ' ' );
+		stat_pid,
+		stat_comm,
+		stat_state,
+		stat_ppid,
+		stat_pgid,
+		stat_sid,
+		stat_termname,  // tty_nr on Linux
+		stat_tpgid,
+		stat_utime = 13,  // Linux only
+		stat_stime,
+		stat_max
+	};
+	
+	struct stat_fields
+	{
+		const char*  begin[ stat_max ];
+		const char*  end  [ stat_max ];
+		unsigned     count;
+	};
+	
+	/*
+		Splits /proc/<pid>/stat in one pass.  The command name is whatever
+		lies between the first '(' and the last ')', since it may contain
+		spaces and parentheses itself.
+	*/
+	
+	static bool tokenize_stat( const char* p, const char* end, stat_fields& fields )
+	{
+		const char* open_paren  = (const char*) memchr( p, '(', end - p );
+		const char* close_paren = end;
 		
-		const char* p_pgid = q_ppid + 1;
+		while ( close_paren > p  &&  *--close_paren != ')' )
+		{
+			continue;
+		}
 		
-		const char* q_pgid = std::find( p_pgid, end, ' ' );
+		if ( open_paren == NULL  ||  close_paren <= open_paren )
+		{
+			return false;
+		}
 		
-		const char* p_sid = q_pgid + 1;
+		fields.begin[ stat_pid  ] = p;
+		fields.end  [ stat_pid  ] = open_paren - 1;
+		fields.begin[ stat_comm ] = open_paren + 1;
+		fields.end  [ stat_comm ] = close_paren;
 		
-		const char* q_sid = std::find( p_sid, end, ' ' );
+		unsigned count = stat_comm + 1;
 		
-		const char* p_termname = q_sid + 1;
+		p = close_paren + 1;
 		
-		const char* q_termname = std::find( p_termname, end, ' ' );
+		while ( count < stat_max )
+		{
+			while ( p < end  &&  (*p == ' '  ||  *p == '\n') )
+			{
+				++p;
+			}
+			
+			if ( p == end )
+			{
+				break;
+			}
+			
+			fields.begin[ count ] = p;
+			
+			while ( p < end  &&  *p != ' '  &&  *p != '\n' )
+			{
+				++p;
+			}
+			
+			fields.end[ count++ ] = p;
+		}
 		
-		const char* p_tpgid = q_termname + 1;
+		fields.count = count;
 		
-		pid_t pid = gear::parse_unsigned_decimal( pid_name );
+		return count > stat_tpgid;
+	}
+	
+	static inline unsigned long field_value( const stat_fields& fields, unsigned i )
+	{
+		return gear::parse_unsigned_decimal( fields.begin[ i ] );
+	}
+	
+	static void append_row( plus::var_string&    report,
+	                        const stat_fields&   fields,
+	                        const plus::string&  cmdline,
+	                        const char*          cpu )
+	{
+		const size_t incoming_report_size = report.size();
 		
-	//	pid_t ppid  = gear::parse_unsigned_decimal( p_ppid  );
-		pid_t pgid  = gear::parse_unsigned_decimal( p_pgid  );
-		pid_t sid   = gear::parse_unsigned_decimal( p_sid   );
-		pid_t tpgid = gear::parse_unsigned_decimal( p_tpgid );
+		const char* p_termname = fields.begin[ stat_termname ];
+		const char* q_termname = fields.end  [ stat_termname ];
 		
 		if ( q_termname - p_termname == STRLEN( "/gui/port/12345678/tty" ) )
 		{
@@ -145,49 +212,55 @@ namespace tool
 			p_termname += STRLEN( "/dev/" );
 		}
 		
-		if ( pid == sid )
+		char stat_string[ 8 ];
+		
+		size_t stat_length = std::min< size_t >( fields.end[ stat_state ] - fields.begin[ stat_state ], 4 );
+		
+		memcpy( stat_string, fields.begin[ stat_state ], stat_length );
+		
+		if ( field_value( fields, stat_pid ) == field_value( fields, stat_sid ) )
 		{
-			stat_string += 's';
+			stat_string[ stat_length++ ] = 's';
 		}
 		
-		if ( pgid == tpgid )
+		if ( field_value( fields, stat_pgid ) == field_value( fields, stat_tpgid ) )
 		{
-			stat_string += '+';
+			stat_string[ stat_length++ ] = '+';
 		}
 		
-		report += left_padded( pid_name, pid_name + strlen( pid_name ), 5 );
+		append_left_padded( report, fields.begin[ stat_pid ], fields.end[ stat_pid ], 5 );
 		
 		report += " ";
 		
-		report += right_padded( p_termname, q_termname, 8 );
+		append_right_padded( report, p_termname, q_termname, 8 );
 		
 		report += " ";
 		
-		report += right_padded( stat_string.begin(), stat_string.end(), 4 );
+		append_right_padded( report, stat_string, stat_string + stat_length, 4 );
 		
 		report += "  ";
 		
-		report += left_padded( p_ppid, q_ppid, 5 );
+		append_left_padded( report, fields.begin[ stat_ppid ], fields.end[ stat_ppid ], 5 );
 		
 		report += "  ";
 		
-		report += left_padded( p_pgid, q_pgid, 5 );
+		append_left_padded( report, fields.begin[ stat_pgid ], fields.end[ stat_pgid ], 5 );
 		
 		report += "  ";
 		
-		report += left_padded( p_sid, q_sid, 5 );
+		append_left_padded( report, fields.begin[ stat_sid ], fields.end[ stat_sid ], 5 );
 		
 		report += "  ";
 		
-		char* cmdline_end = buffer + p7::read( p7::openat( proc_pid, "cmdline", p7::o_rdonly ), buffer, 4096 );
-		
-		if ( cmdline_end > buffer )
+		if ( cpu != NULL )
 		{
-			std::replace( buffer, cmdline_end - 1, '\0', ' ' );  // replace NUL with space except last
+			append_left_padded( report, cpu, cpu + strlen( cpu ), 4 );
 			
-			report.append( buffer, cmdline_end - 1 );
+			report += "  ";
 		}
 		
+		report += cmdline;
+		
 		if ( !globally_wide  &&  report.size() > incoming_report_size + 80 )
 		{
 			report.resize( incoming_report_size + 80 );
@@ -196,9 +269,43 @@ namespace tool
 		report += "\n";
 	}
 	
+	static plus::string read_cmdline( p7::fd_t proc_pid )
+	{
+		char buffer[ 4096 ];
+		
+		char* cmdline_end = buffer + p7::read( p7::openat( proc_pid, "cmdline", p7::o_rdonly ), buffer, 4096 );
+		
+		if ( cmdline_end == buffer )
+		{
+			return plus::string::null;
+		}
+		
+		std::replace( buffer, cmdline_end - 1, '\0', ' ' );  // replace NUL with space except last
+		
+		return plus::string( buffer, cmdline_end - 1 );
+	}
+	
+	static void report_process( plus::var_string& report, const char* pid_name )
+	{
+		n::owned< p7::fd_t > proc_pid = p7::openat( g_proc, pid_name, p7::o_rdonly | p7::o_directory );
+		
+		char buffer[ 4096 ];
+		
+		const char* end = buffer + p7::read( p7::openat( proc_pid, "stat", p7::o_rdonly ), buffer, 4096 );
+		
+		stat_fields fields;
+		
+		if ( tokenize_stat( buffer, end, fields ) )
+		{
+			append_row( report, fields, read_cmdline( proc_pid ), NULL );
+		}
+	}
+	
+	static const char header[] = "  PID TERM     STAT   PPID   PGID    SID  COMMAND\n";
+	
 	static plus::string ps()
 	{
-		plus::var_string output = "  PID TERM     STAT   PPID   PGID    SID  COMMAND\n";
+		plus::var_string output = header;
 		
 		DIR* iter = opendir( "/proc" );
 		
@@ -222,14 +329,375 @@ namespace tool
 		return output;
 	}
 	
+	
+	struct Watched
+	{
+		int            dir;      // /proc/<pid>, or -1 if not kept open
+		int            stat;     // Linux only; reread in place
+		plus::string   comm;
+		plus::string   cmdline;
+		unsigned long  ticks;    // user + system, as of the last sample
+		bool           sampled;  // ticks is valid
+		bool           seen;     // in the current /proc listing
+	};
+	
+	typedef std::map< unsigned long, Watched > Watched_map;
+	
+	// How many descriptors the watched processes may keep, leaving some
+	// for everything else (including sampling the rest)
+	static size_t g_keepable = 0;
+	static size_t g_kept     = 0;
+	
+	static void raise_descriptor_limit()
+	{
+		struct rlimit limit;
+		
+		if ( getrlimit( RLIMIT_NOFILE, &limit ) < 0 )
+		{
+			return;
+		}
+		
+		if ( limit.rlim_cur < limit.rlim_max )
+		{
+			limit.rlim_cur = limit.rlim_max;
+			
+			setrlimit( RLIMIT_NOFILE, &limit );
+			
+			getrlimit( RLIMIT_NOFILE, &limit );
+		}
+		
+		const rlim_t reserve = 64;
+		
+		const rlim_t cap = 1024 * 1024;  // rlim_cur may be RLIM_INFINITY
+		
+		const rlim_t usable = std::min( limit.rlim_cur, cap );
+		
+		g_keepable = usable > reserve ? usable - reserve : 0;
+	}
+	
+	static inline bool out_of_descriptors( int error )
+	{
+		return error == EMFILE  ||  error == ENFILE;
+	}
+	
+	// Returns fd, or -1 (with the error in errno) if it can't be opened.
+	
+	static int open_kept( int dir, const char* name, int flags )
+	{
+		if ( g_kept >= g_keepable )
+		{
+			errno = EMFILE;
+			
+			return -1;
+		}
+		
+		const int fd = openat( dir, name, flags );
+		
+		if ( fd >= 0 )
+		{
+			fcntl( fd, F_SETFD, FD_CLOEXEC );
+			
+			++g_kept;
+		}
+		
+		return fd;
+	}
+	
+	static void close_kept( int fd )
+	{
+		if ( fd >= 0 )
+		{
+			close( fd );
+			
+			--g_kept;
+		}
+	}
+	
+	static ssize_t read_stat( Watched& process, p7::fd_t dir, char* buffer, size_t size )
+	{
+	#ifdef __linux__
+		
+		// Linux regenerates the contents on each read from the start.
+		
+		if ( process.stat < 0  &&  process.dir >= 0 )
+		{
+			process.stat = open_kept( process.dir, "stat", O_RDONLY );
+			
+			if ( process.stat < 0  &&  !out_of_descriptors( errno ) )
+			{
+				p7::throw_errno( errno );
+			}
+		}
+		
+		if ( process.stat >= 0 )
+		{
+			return p7::pread( p7::fd_t( process.stat ), buffer, size, 0 );
+		}
+		
+	#endif
+		
+		// MacRelix generates them once, when the file is looked up.
+		
+		return p7::read( p7::openat( dir, "stat", p7::o_rdonly ), buffer, size );
+	}
+	
+	static void sample_process( Watched&           process,
+	                            unsigned long      pid,
+	                            plus::var_string&  report,
+	                            unsigned long      elapsed_ticks )
+	{
+		n::owned< p7::fd_t > transient;
+		
+		if ( process.dir < 0 )
+		{
+			transient = p7::openat( g_proc,
+			                        gear::inscribe_unsigned_decimal( pid ),
+			                        p7::o_rdonly | p7::o_directory );
+		}
+		
+		const p7::fd_t dir = process.dir >= 0 ? p7::fd_t( process.dir ) : transient.get();
+		
+		char buffer[ 4096 ];
+		
+		const ssize_t n_read = read_stat( process, dir, buffer, sizeof buffer );
+		
+		stat_fields fields;
+		
+		if ( !tokenize_stat( buffer, buffer + n_read, fields ) )
+		{
+			return;
+		}
+		
+		const char* comm     = fields.begin[ stat_comm ];
+		const size_t comm_length = fields.end[ stat_comm ] - comm;
+		
+		// The command line changes only with the name, at exec.
+		
+		if ( process.comm.size() != comm_length  ||  memcmp( process.comm.data(), comm, comm_length ) != 0 )
+		{
+			process.comm    = plus::string( comm, comm_length );
+			process.cmdline = read_cmdline( dir );
+		}
+		
+		const char* cpu = "";
+		
+		if ( fields.count > stat_stime )
+		{
+			const unsigned long ticks = field_value( fields, stat_utime )
+			                          + field_value( fields, stat_stime );
+			
+			if ( process.sampled  &&  elapsed_ticks != 0 )
+			{
+				cpu = gear::inscribe_unsigned_decimal( (ticks - process.ticks) * 100 / elapsed_ticks );
+			}
+			
+			process.ticks   = ticks;
+			process.sampled = true;
+		}
+		
+		append_row( report, fields, process.cmdline, cpu );
+	}
+	
+	static void sample( Watched_map& processes, std::vector< plus::string >& lines, unsigned long elapsed_ticks )
+	{
+		typedef Watched_map::iterator Iter;
+		
+		for ( Iter it = processes.begin();  it != processes.end();  ++it )
+		{
+			it->second.seen = false;
+		}
+		
+		DIR* iter = opendir( "/proc" );
+		
+		while ( const dirent* ent = readdir( iter ) )
+		{
+			if ( unsigned long pid = gear::parse_unsigned_decimal( ent->d_name ) )
+			{
+				Iter it = processes.find( pid );
+				
+				if ( it == processes.end() )
+				{
+					const int dir = open_kept( g_proc, ent->d_name, O_RDONLY | O_DIRECTORY );
+					
+					if ( dir < 0  &&  !out_of_descriptors( errno ) )
+					{
+						continue;  // gone already
+					}
+					
+					// Without a kept descriptor, it's sampled by path.
+					
+					it = processes.insert( Watched_map::value_type( pid, Watched() ) ).first;
+					
+					it->second.dir     = dir;
+					it->second.stat    = -1;
+					it->second.sampled = false;
+				}
+				
+				it->second.seen = true;
+			}
+		}
+		
+		closedir( iter );
+		
+		lines.clear();
+		
+		lines.push_back( "  PID TERM     STAT   PPID   PGID    SID  %CPU  COMMAND" );
+		
+		plus::var_string row;
+		
+		for ( Iter it = processes.begin();  it != processes.end();  )
+		{
+			Watched& process = it->second;
+			
+			row.clear();
+			
+			if ( process.seen )
+			{
+				try
+				{
+					sample_process( process, it->first, row, elapsed_ticks );
+				}
+				catch ( const p7::errno_t& err )
+				{
+					// Anything else (e.g. EMFILE) skips just this sample.
+					
+					if ( err == ENOENT  ||  err == ESRCH )
+					{
+						process.seen = false;  // it exited
+					}
+				}
+				catch ( ... )
+				{
+				}
+			}
+			
+			if ( !process.seen )
+			{
+				// It exited.
+				
+				close_kept( process.dir  );
+				close_kept( process.stat );
+				
+				processes.erase( it++ );
+				
+				continue;
+			}
+			
+			if ( !row.empty() )
+			{
+				row.resize( row.size() - 1 );  // newline
+				
+				lines.push_back( row );
+			}
+			
+			++it;
+		}
+	}
+	
+	static unsigned terminal_rows()
+	{
+		struct winsize size = { 0 };
+		
+		if ( ioctl( p7::stdout_fileno, TIOCGWINSZ, &size ) < 0  ||  size.ws_row == 0 )
+		{
+			return 0;
+		}
+		
+		return size.ws_row;
+	}
+	
+	/*
+		Rewrites the lines that differ from what's on the screen, each in
+		place, and clears anything below the last one.
+	*/
+	
+	static void redraw( const std::vector< plus::string >& lines, std::vector< plus::string >& screen )
+	{
+		const unsigned rows = terminal_rows();
+		
+		const size_t n_lines = rows ? std::min< size_t >( lines.size(), rows - 1 ) : lines.size();
+		
+		plus::var_string output;
+		
+		for ( size_t i = 0;  i < n_lines;  ++i )
+		{
+			if ( i < screen.size()  &&  screen[ i ] == lines[ i ] )
+			{
+				continue;
+			}
+			
+			output += "\033[";
+			output += gear::inscribe_unsigned_decimal( i + 1 );
+			output += ";1H";
+			output += lines[ i ];
+			output += "\033[K";
+		}
+		
+		if ( n_lines < screen.size() )
+		{
+			output += "\033[";
+			output += gear::inscribe_unsigned_decimal( n_lines + 1 );
+			output += ";1H"
+			          "\033[J";
+		}
+		
+		screen.assign( lines.begin(), lines.begin() + n_lines );
+		
+		if ( !output.empty() )
+		{
+			p7::write( p7::stdout_fileno, output );
+		}
+	}
+	
+	static unsigned long elapsed_ticks( const timespec& then, const timespec& now )
+	{
+		static const long ticks_per_second = sysconf( _SC_CLK_TCK );
+		
+		const double seconds = (now.tv_sec - then.tv_sec) + (now.tv_nsec - then.tv_nsec) / 1e9;
+		
+		return (unsigned long) (seconds * ticks_per_second + 0.5);
+	}
+	
+	static void watch( const struct timespec& interval )
+	{
+		raise_descriptor_limit();
+		
+		Watched_map processes;
+		
+		std::vector< plus::string > lines;
+		std::vector< plus::string > screen;
+		
+		p7::write( p7::stdout_fileno, STR_LEN( "\033[H" "\033[2J" ) );
+		
+		timespec then = { 0 };
+		
+		while ( true )
+		{
+			timespec now;
+			
+			clock_gettime( CLOCK_MONOTONIC, &now );
+			
+			sample( processes, lines, then.tv_sec ? elapsed_ticks( then, now ) : 0 );
+			
+			then = now;
+			
+			redraw( lines, screen );
+			
+			nanosleep( &interval, NULL );
+		}
+	}
+	
 	int Main( int argc, char** argv )
 	{
 		bool monitor = false;
+		bool watching = false;
 		
 		const char* sleep_arg = NULL;
 		
 		o::bind_option_to_variable( "--monitor", monitor );
 		
+		o::bind_option_to_variable( "--watch", watching );
+		
 		o::bind_option_to_variable( "--wide", globally_wide );
 		
 		o::bind_option_to_variable( "--sleep", sleep_arg );
@@ -240,13 +708,20 @@ namespace tool
 		
 		if ( sleep_arg )
 		{
-			monitor = true;
+			monitor = !watching;
 			
 			min_sleep = gear::parse_float( sleep_arg );
 		}
 		
 		const struct timespec minimum = timespec_from_seconds( min_sleep );
 		
+		if ( watching )
+		{
+			watch( minimum );
+			
+			return 0;
+		}
+		
 		if ( !monitor )
 		{
 			p7::write( p7::stdout_fileno, ps() );
@@ -286,4 +761,3 @@ namespace tool
 	}
 	
 }
-
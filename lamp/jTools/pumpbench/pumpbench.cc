@@ -0,0 +1,352 @@
+/*	============
+ *	pumpbench.cc
+ *	============
+ */
+
+// Standard C/C++
+#include <cstdio>
+
+// Standard C
+#include <errno.h>
+#include <string.h>
+
+// POSIX
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Relix
+#include "relix/pump.h"
+
+// Iota
+#include "iota/strings.hh"
+
+// plus
+#include "plus/string/concat.hh"
+
+// poseven
+#include "poseven/functions/gettimeofday.hh"
+#include "poseven/functions/write.hh"
+
+// Orion
+#include "Orion/get_options.hh"
+#include "Orion/Main.hh"
+
+
+/*
+	pumpbench copies a scratch file to a file, a pipe, and a socket with
+	each of pump()'s transfer methods, plus the plain 4K read()/write()
+	loop that pump() used to be, and reports the best throughput of
+	several rounds.
+	
+	E.g.  pumpbench -s 1024 -r 5 /tmp
+*/
+
+namespace tool
+{
+	
+	namespace n = nucleus;
+	namespace p7 = poseven;
+	namespace o = orion;
+	
+	
+	typedef unsigned long long microseconds;
+	
+	static microseconds now()
+	{
+		const timeval tv = p7::gettimeofday();
+		
+		return tv.tv_sec * 1000000ull + tv.tv_usec;
+	}
+	
+	
+	struct Method
+	{
+		const char*  name;
+		unsigned     flags;
+		bool         legacy;
+	};
+	
+	static const Method gMethods[] =
+	{
+		{ "default",       0,                                          false },
+		{ "sendfile",      PUMP_NO_COPY_FILE_RANGE,                    false },
+		{ "splice",        PUMP_NO_COPY_FILE_RANGE | PUMP_NO_SENDFILE, false },
+		{ "pread/pwrite",  PUMP_BUFFERED,                              false },
+		{ "read/write 4K", 0,                                          true  },
+	};
+	
+	enum Destination
+	{
+		kToFile,
+		kToPipe,
+		kToSocket,
+		kDestinationCount
+	};
+	
+	static const char* const gDestinationNames[] = { "file", "pipe", "socket" };
+	
+	
+	static ssize_t CopyWithSmallBuffer( int in, int out )
+	{
+		char buffer[ 4096 ];
+		
+		ssize_t total = 0;
+		
+		while ( ssize_t n_read = read( in, buffer, sizeof buffer ) )
+		{
+			if ( n_read < 0  ||  write( out, buffer, n_read ) != n_read )
+			{
+				return -1;
+			}
+			
+			total += n_read;
+		}
+		
+		return total;
+	}
+	
+	static void Drain( int fd )
+	{
+		static char buffer[ 1024 * 1024 ];
+		
+		while ( read( fd, buffer, sizeof buffer ) > 0 )
+		{
+			continue;
+		}
+	}
+	
+	// Returns 0 on failure
+	static microseconds TimeCopy( const Method&  method,
+	                              int            source,
+	                              off_t          size,
+	                              Destination    destination,
+	                              const char*    dest_path )
+	{
+		int fds[ 2 ] = { -1, -1 };
+		
+		int result = 0;
+		
+		switch ( destination )
+		{
+			case kToFile:
+				fds[ 1 ] = open( dest_path, O_WRONLY | O_CREAT | O_TRUNC, 0666 );
+				
+				result = fds[ 1 ];
+				break;
+			
+			case kToPipe:
+				result = pipe( fds );
+				break;
+			
+			case kToSocket:
+				result = socketpair( AF_UNIX, SOCK_STREAM, 0, fds );
+				break;
+			
+			default:
+				break;
+		}
+		
+		if ( result < 0 )
+		{
+			std::perror( "pumpbench" );
+			
+			return 0;
+		}
+		
+		const int output = fds[ 1 ];
+		
+		pid_t child = 0;
+		
+		if ( fds[ 0 ] >= 0 )
+		{
+			child = fork();
+			
+			if ( child == 0 )
+			{
+				close( output );
+				
+				Drain( fds[ 0 ] );
+				
+				_exit( 0 );
+			}
+			
+			close( fds[ 0 ] );
+		}
+		
+		lseek( source, 0, SEEK_SET );
+		
+		const microseconds t0 = now();
+		
+		off_t offset = 0;
+		
+		const ssize_t copied = method.legacy ? CopyWithSmallBuffer( source, output )
+		                                     : pump( source, &offset, output, NULL, 0, method.flags );
+		
+		const int saved_errno = errno;
+		
+		close( output );
+		
+		if ( child > 0 )
+		{
+			waitpid( child, NULL, 0 );
+		}
+		
+		const microseconds elapsed = now() - t0;
+		
+		if ( copied != size )
+		{
+			std::fprintf( stderr, "pumpbench: %s to %s: %s\n",
+			                      method.name,
+			                      gDestinationNames[ destination ],
+			                      copied < 0 ? strerror( saved_errno ) : "short copy" );
+			
+			return 0;
+		}
+		
+		return elapsed ? elapsed : 1;
+	}
+	
+	static bool MakeSourceFile( const char* path, off_t size )
+	{
+		const int fd = open( path, O_WRONLY | O_CREAT | O_TRUNC, 0666 );
+		
+		if ( fd < 0 )
+		{
+			return false;
+		}
+		
+		static char block[ 1024 * 1024 ];
+		
+		for ( std::size_t i = 0;  i < sizeof block;  ++i )
+		{
+			block[ i ] = char( i * 7 + (i >> 12) );
+		}
+		
+		for ( off_t written = 0;  written < size;  written += sizeof block )
+		{
+			if ( write( fd, block, sizeof block ) != sizeof block )
+			{
+				close( fd );
+				
+				return false;
+			}
+		}
+		
+		return close( fd ) == 0;
+	}
+	
+	int Main( int argc, char** argv )
+	{
+		std::size_t size_in_MiB = 256;
+		std::size_t n_rounds    = 3;
+		
+		o::bind_option_to_variable( "-s", size_in_MiB );
+		o::bind_option_to_variable( "-r", n_rounds    );
+		
+		o::alias_option( "-s", "--size"   );
+		o::alias_option( "-r", "--rounds" );
+		
+		o::get_options( argc, argv );
+		
+		char const *const *freeArgs = o::free_arguments();
+		
+		if ( o::free_argument_count() > 1  ||  size_in_MiB == 0  ||  n_rounds == 0 )
+		{
+			p7::write( p7::stderr_fileno, STR_LEN( "Usage: pumpbench [-s MiB] [-r rounds] [scratch-dir]\n" ) );
+			
+			return 2;
+		}
+		
+		const plus::string dir = o::free_argument_count() ? freeArgs[ 0 ] : ".";
+		
+		const plus::string source_path = dir + "/pumpbench.src";
+		const plus::string dest_path   = dir + "/pumpbench.dst";
+		
+		const off_t size = off_t( size_in_MiB ) * 1024 * 1024;
+		
+		if ( !MakeSourceFile( source_path.c_str(), size ) )
+		{
+			std::perror( "pumpbench: can't create scratch file" );
+			
+			unlink( source_path.c_str() );
+			
+			return 1;
+		}
+		
+		const int source = open( source_path.c_str(), O_RDONLY );
+		
+		std::printf( "%lu MiB, best of %lu rounds, in MB/s\n\n",
+		             (unsigned long) size_in_MiB,
+		             (unsigned long) n_rounds );
+		
+		std::printf( "%-16s", "" );
+		
+		for ( int d = 0;  d < kDestinationCount;  ++d )
+		{
+			std::printf( "%10s", gDestinationNames[ d ] );
+		}
+		
+		std::printf( "\n" );
+		
+		int status = 0;
+		
+		const std::size_t n_methods = sizeof gMethods / sizeof gMethods[0];
+		
+		for ( std::size_t m = 0;  m < n_methods;  ++m )
+		{
+			std::printf( "%-16s", gMethods[ m ].name );
+			
+			std::fflush( stdout );
+			
+			for ( int d = 0;  d < kDestinationCount;  ++d )
+			{
+				microseconds best = 0;
+				
+				for ( std::size_t round = 0;  round < n_rounds;  ++round )
+				{
+					const microseconds elapsed = TimeCopy( gMethods[ m ],
+					                                       source,
+					                                       size,
+					                                       Destination( d ),
+					                                       dest_path.c_str() );
+					
+					if ( elapsed == 0 )
+					{
+						status = 1;
+						
+						best = 0;
+						break;
+					}
+					
+					if ( best == 0  ||  elapsed < best )
+					{
+						best = elapsed;
+					}
+				}
+				
+				if ( best == 0 )
+				{
+					std::printf( "%10s", "failed" );
+				}
+				else
+				{
+					std::printf( "%10.0f", double( size ) / best );
+				}
+				
+				std::fflush( stdout );
+			}
+			
+			std::printf( "\n" );
+		}
+		
+		close( source );
+		
+		unlink( source_path.c_str() );
+		unlink( dest_path  .c_str() );
+		
+		return status;
+	}
+	
+}
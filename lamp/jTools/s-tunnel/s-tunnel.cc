@@ -1,36 +1,49 @@
-/*	==========
- *	stunnel.cc
- *	==========
+/*	===========
+ *	s-tunnel.cc
+ *	===========
  */
 
+// Standard C++
+#include <algorithm>
+#include <map>
+
 // Standard C/C++
-#include <cstdlib>
-//#include <cstring>
+#include <cstdio>
 
 // Standard C
 #include <errno.h>
+#include <signal.h>
+#include <string.h>
 
 // POSIX
-#include <arpa/inet.h>
+#include <fcntl.h>
 #include <netdb.h>
 #include <netinet/in.h>
-#include <sys/ioctl.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
 // OpenSSL
 #include <openssl/crypto.h>
-//#include <openssl/x509.h>
-//#include <openssl/pem.h>
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 
+#if defined( _POSIX_THREADS )  &&  OPENSSL_VERSION_NUMBER >= 0x10100000L
+#define HANDSHAKE_THREAD 1
+#include <pthread.h>
+#endif
+
 // Iota
 #include "iota/strings.hh"
 
 // gear
-#include "gear/inscribe_decimal.hh"
+#include "gear/parse_decimal.hh"
 
 // poseven
 #include "poseven/functions/perror.hh"
@@ -43,6 +56,24 @@
 #include "Orion/Main.hh"
 
 
+/*
+	One process carries every session.  A session is a plaintext client
+	accepted on --lport and a TLS connection to the remote host, with a
+	buffer of one TLS record (16K of plaintext) in each direction.
+	
+	Neither buffer grows.  A client isn't read while its last record is
+	still being sent, and the remote isn't read while the client has yet
+	to take the last one received, so a slow reader stalls its own writer
+	(through TCP flow control) and nobody else.  Sockets are watched for
+	writability only while something is waiting to be sent on them.
+	
+	Connecting to the remote and the TLS handshake happen on a second
+	thread where there are threads, so that key exchanges for new
+	sessions never hold up data for established ones.  Finished sessions
+	come back to the main loop over a pipe.  Without threads, the main
+	loop does the handshakes itself, without blocking.
+*/
+
 namespace tool
 {
 	
@@ -50,220 +81,999 @@ namespace tool
 	namespace o = orion;
 	
 	
-	struct PeerClosedSocket {};
-	struct InvalidEOF       {};
+	enum
+	{
+		want_read  = 1,
+		want_write = 2
+	};
+	
+	enum
+	{
+		record_size = 16384  // the most plaintext a TLS record can carry
+	};
+	
+	struct Buffer
+	{
+		char         data[ record_size ];
+		std::size_t  begin;
+		std::size_t  end;
+		
+		bool empty() const  { return begin == end; }
+	};
+	
+	struct Session
+	{
+		int       local;   // the client
+		int       remote;
+		SSL*      ssl;
+		bool      connecting;
+		bool      established;
+		
+		unsigned  local_ready;   // what the sockets were last seen to allow
+		unsigned  remote_ready;
+		unsigned  read_waits;    // what SSL_read() last asked for
+		unsigned  write_waits;   // likewise SSL_write()
+		
+		bool      local_eof;
+		bool      remote_eof;
+		bool      notified;      // we've sent close_notify
+		bool      local_shut;    // we've shut down the client's receive side
+		bool      failed;
+		
+		Buffer    outbound;      // plaintext from the client
+		Buffer    inbound;       // plaintext from the remote
+		
+		explicit Session( int client );
+	};
+	
+	Session::Session( int client )
+	:
+		local       ( client ),
+		remote      ( -1 ),
+		ssl         ( NULL ),
+		connecting  ( false ),
+		established ( false ),
+		local_ready ( 0 ),
+		remote_ready( 0 ),
+		read_waits  ( want_read ),
+		write_waits ( want_write ),
+		local_eof   ( false ),
+		remote_eof  ( false ),
+		notified    ( false ),
+		local_shut  ( false ),
+		failed      ( false )
+	{
+		outbound.begin = outbound.end = 0;
+		inbound .begin = inbound .end = 0;
+	}
+	
+	struct Event
+	{
+		int       fd;
+		unsigned  ready;
+	};
+	
+	/*
+		A set of descriptors to wait on, each for reading, writing or both.
+		There's one per thread.
+	*/
+	
+	class Poller
+	{
+		private:
+			struct Watched
+			{
+				unsigned  interest;
+				Session*  session;
+			};
+			
+			typedef std::map< int, Watched > Map;
+			
+			Map its_watched;
+			
+		#ifdef __linux__
+			
+			int its_epoll_fd;
+			
+		#endif
+			
+			// non-copyable
+			Poller           ( const Poller& );
+			Poller& operator=( const Poller& );
+			
+		public:
+			Poller();
+			~Poller();
+			
+			// An interest of 0 stops watching fd.
+			void Set( int fd, unsigned interest, Session* session = NULL );
+			
+			Session* Find( int fd ) const;
+			
+			int Wait( Event* events, int capacity );
+	};
+	
+	Session* Poller::Find( int fd ) const
+	{
+		Map::const_iterator it = its_watched.find( fd );
+		
+		return it != its_watched.end() ? it->second.session : NULL;
+	}
+	
+#ifdef __linux__
+
+	Poller::Poller() : its_epoll_fd( p7::throw_posix_result( epoll_create( 64 ) ) )
+	{
+		fcntl( its_epoll_fd, F_SETFD, FD_CLOEXEC );
+	}
 	
-	class no_input_pending {};
+	Poller::~Poller()
+	{
+		close( its_epoll_fd );
+	}
 	
+	void Poller::Set( int fd, unsigned interest, Session* session )
+	{
+		Map::iterator it = its_watched.find( fd );
+		
+		const unsigned old = it != its_watched.end() ? it->second.interest : 0;
+		
+		if ( interest == old )
+		{
+			return;
+		}
+		
+		epoll_event event = { 0 };  // non-NULL for pre-2.6.9 kernels
+		
+		event.events  = (interest & want_read  ? EPOLLIN  : 0)
+		              | (interest & want_write ? EPOLLOUT : 0);
+		event.data.fd = fd;
+		
+		const int op = old      == 0 ? EPOLL_CTL_ADD
+		             : interest == 0 ? EPOLL_CTL_DEL
+		             :                 EPOLL_CTL_MOD;
+		
+		p7::throw_posix_result( epoll_ctl( its_epoll_fd, op, fd, &event ) );
+		
+		if ( interest == 0 )
+		{
+			its_watched.erase( it );
+		}
+		else
+		{
+			const Watched watched = { interest, session };
+			
+			its_watched[ fd ] = watched;
+		}
+	}
+	
+	int Poller::Wait( Event* events, int capacity )
+	{
+		epoll_event ready[ 64 ];
+		
+		const int n = epoll_wait( its_epoll_fd, ready, std::min( capacity, 64 ), -1 );
+		
+		for ( int i = 0;  i < n;  ++i )
+		{
+			const unsigned got = ready[ i ].events;
+			
+			// Errors and hangups are left for the next read or write to find.
+			
+			const bool broken = got & (EPOLLERR | EPOLLHUP);
+			
+			events[ i ].fd    = ready[ i ].data.fd;
+			events[ i ].ready = (got & EPOLLIN   ? want_read  : 0)
+			                  | (got & EPOLLOUT  ? want_write : 0)
+			                  | (broken ? want_read | want_write : 0);
+		}
+		
+		return n;
+	}
+	
+#else
+
+	Poller::Poller()
+	{
+	}
+	
+	Poller::~Poller()
+	{
+	}
+	
+	void Poller::Set( int fd, unsigned interest, Session* session )
+	{
+		if ( interest == 0 )
+		{
+			its_watched.erase( fd );
+		}
+		else
+		{
+			const Watched watched = { interest, session };
+			
+			its_watched[ fd ] = watched;
+		}
+	}
+	
+	int Poller::Wait( Event* events, int capacity )
+	{
+		fd_set readfds;
+		fd_set writefds;
+		
+		FD_ZERO( &readfds  );
+		FD_ZERO( &writefds );
+		
+		typedef Map::const_iterator Iter;
+		
+		for ( Iter it = its_watched.begin();  it != its_watched.end();  ++it )
+		{
+			if ( it->second.interest & want_read )
+			{
+				FD_SET( it->first, &readfds );
+			}
+			
+			if ( it->second.interest & want_write )
+			{
+				FD_SET( it->first, &writefds );
+			}
+		}
+		
+		const int maxFD = its_watched.empty() ? -1 : its_watched.rbegin()->first;
+		
+		// This blocks and yields to other threads
+		int selected = select( maxFD + 1, &readfds, &writefds, NULL, NULL );
+		
+		if ( selected <= 0 )
+		{
+			return selected;
+		}
+		
+		int n = 0;
+		
+		for ( Iter it = its_watched.begin();  it != its_watched.end()  &&  n < capacity;  ++it )
+		{
+			const unsigned ready = (FD_ISSET( it->first, &readfds  ) ? want_read  : 0)
+			                     | (FD_ISSET( it->first, &writefds ) ? want_write : 0);
+			
+			if ( ready )
+			{
+				events[ n ].fd    = it->first;
+				events[ n ].ready = ready;
+				
+				++n;
+			}
+		}
+		
+		return n;
+	}
+	
+#endif
+
 	static struct sockaddr_in gRemoteAddress;
 	
-	int gListenerSocket;
+	static SSL_CTX* gContext;
+	
+	static const int max_accept_batch = 64;
 	
 	
-	static int SSLRead( SSL* session, char* data, std::size_t byteCount )
+	static void set_nonblocking( int fd )
+	{
+		fcntl( fd, F_SETFL, fcntl( fd, F_GETFL, 0 ) | O_NONBLOCK );
+	}
+	
+	static void set_nodelay( int fd )
+	{
+		int on = 1;
+		
+		setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on );
+	}
+	
+	static void Close( Poller& poller, Session* session )
 	{
-		int received = SSL_read( session, data, byteCount );
-		int err = SSL_get_error( session, received );
+		poller.Set( session->local, 0 );
 		
-		switch ( err )
+		close( session->local );
+		
+		if ( session->remote >= 0 )
 		{
-			case SSL_ERROR_NONE:
-				return received;
-				break;
+			poller.Set( session->remote, 0 );
 			
-			case SSL_ERROR_ZERO_RETURN:
-				throw PeerClosedSocket();
-				break;
+			close( session->remote );
+		}
+		
+		if ( session->ssl )
+		{
+			SSL_free( session->ssl );
+		}
+		
+		delete session;
+	}
+	
+	static void Fail( Session& session, const char* side, int errnum )
+	{
+		// A client hanging up on us is business as usual.
+		
+		if ( errnum != EPIPE  &&  errnum != ECONNRESET )
+		{
+			p7::perror( "s-tunnel", side, errnum );
+		}
+		
+		session.failed = true;
+	}
+	
+	static void FailSSL( Session& session, int ssl_error, int errnum )
+	{
+		if ( ssl_error == SSL_ERROR_SSL )
+		{
+			ERR_print_errors_fp( stderr );
 			
+			session.failed = true;
+		}
+		else
+		{
+			Fail( session, "remote", errnum ? errnum : ECONNRESET );
+		}
+	}
+	
+	// Sets what an SSL call is waiting for, and returns false if it failed.
+	
+	static bool SSLWaits( Session& session, int result, unsigned& waits )
+	{
+		const int saved_errno = errno;
+		
+		const int ssl_error = SSL_get_error( session.ssl, result );
+		
+		switch ( ssl_error )
+		{
 			case SSL_ERROR_WANT_READ:
+				waits = want_read;
+				
+				session.remote_ready &= ~want_read;
+				
+				return true;
+			
 			case SSL_ERROR_WANT_WRITE:
-				throw no_input_pending();
-				break;
+				waits = want_write;
+				
+				session.remote_ready &= ~want_write;
+				
+				return true;
 			
-			case SSL_ERROR_SYSCALL:
-				if ( received == 0 )
-				{
-					// Invalid EOF
-					throw InvalidEOF();
-				}
-				else if ( received == -1 )
-				{
-					p7::throw_errno( errno );
-				}
-				break;
+			default:
+				FailSSL( session, ssl_error, saved_errno );
+				
+				ERR_clear_error();
+				
+				return false;
+		}
+	}
+	
+	/*
+		Each step below returns true if it got anywhere.  Reads are only
+		tried once their socket has been reported ready, and it's assumed
+		to stay that way until a read says otherwise.  Writes are tried as
+		soon as there's something to write.
+	*/
+	
+	static bool Receive( Session& s )
+	{
+		ERR_clear_error();
+		
+		const int n = SSL_read( s.ssl, s.inbound.data, sizeof s.inbound.data );
+		
+		if ( n > 0 )
+		{
+			s.inbound.begin = 0;
+			s.inbound.end   = n;
 			
-			case SSL_ERROR_SSL:
-				ERR_print_errors_fp( stderr );
-				break;
+			s.local_ready |= want_write;
+			
+			return true;
 		}
 		
-		p7::throw_errno( errno );
+		const int ssl_error = SSL_get_error( s.ssl, n );
 		
-		// Not reached
-		return 0;
+		if ( ssl_error == SSL_ERROR_ZERO_RETURN  ||  (ssl_error == SSL_ERROR_SYSCALL  &&  ERR_peek_error() == 0  &&  n == 0) )
+		{
+			// close_notify, or an EOF that many servers send instead
+			
+			s.remote_eof = true;
+			
+			return true;
+		}
+		
+		SSLWaits( s, n, s.read_waits );
+		
+		return false;
 	}
 	
-	static int SSLWrite( SSL* session, const char* data, std::size_t byteCount )
+	static bool Deliver( Session& s )
 	{
-		int sent = SSL_write( session, data, byteCount );
+		const ssize_t n = write( s.local, s.inbound.data + s.inbound.begin, s.inbound.end - s.inbound.begin );
 		
-		if ( sent < 0 )
+		if ( n < 0 )
 		{
-			p7::throw_errno( errno );
+			if ( errno == EAGAIN  ||  errno == EINTR )
+			{
+				s.local_ready &= ~want_write;
+			}
+			else
+			{
+				Fail( s, "client", errno );
+			}
+			
+			return false;
 		}
 		
-		return sent;
+		s.inbound.begin += n;
+		
+		if ( s.inbound.empty() )
+		{
+			s.inbound.begin = s.inbound.end = 0;
+		}
+		
+		return true;
 	}
 	
+	static bool Collect( Session& s )
+	{
+		const ssize_t n = read( s.local, s.outbound.data, sizeof s.outbound.data );
+		
+		if ( n < 0 )
+		{
+			if ( errno == EAGAIN  ||  errno == EINTR )
+			{
+				s.local_ready &= ~want_read;
+			}
+			else
+			{
+				Fail( s, "client", errno );
+			}
+			
+			return false;
+		}
+		
+		if ( n == 0 )
+		{
+			s.local_eof = true;
+		}
+		
+		s.outbound.begin = 0;
+		s.outbound.end   = n;
+		
+		s.remote_ready |= s.write_waits;
+		
+		return true;
+	}
 	
-	static void Startup( const struct sockaddr_in& listener_addr )
+	static bool Send( Session& s )
 	{
-		SSLeay_add_ssl_algorithms();
-		SSL_load_error_strings();
+		ERR_clear_error();
+		
+		// The whole buffer each time:  one record, and the same arguments
+		// when retrying, as OpenSSL requires.
 		
-		gListenerSocket = socket( PF_INET, SOCK_STREAM, IPPROTO_TCP );
+		const int n = SSL_write( s.ssl, s.outbound.data, s.outbound.end );
 		
-		if ( gListenerSocket == -1 )
+		if ( n > 0 )
 		{
-			std::fprintf( stderr, "Failed to open listener socket: %d\n", errno );
+			s.outbound.begin = s.outbound.end = 0;
+			
+			s.write_waits = want_write;
 			
-			std::exit( 1 );
+			return true;
 		}
 		
-		int bound = bind( gListenerSocket, (const sockaddr*)&listener_addr, sizeof (sockaddr_in) );
+		SSLWaits( s, n, s.write_waits );
 		
-		int listened = listen( gListenerSocket, 3 );
+		return false;
 	}
 	
-	static void Poll( SSL* client_session, int server_socket )
+	static bool Notify( Session& s )
 	{
-		bool active = false;
-		bool isComplete = false;  // FIXME:  Not used
+		ERR_clear_error();
+		
+		const int result = SSL_shutdown( s.ssl );
+		
+		if ( result < 0  &&  SSL_get_error( s.ssl, result ) == SSL_ERROR_WANT_WRITE )
+		{
+			s.remote_ready &= ~want_write;
+			
+			return false;
+		}
+		
+		// If it failed otherwise, the remote is gone and it doesn't matter.
 		
-		enum { dataSize = 1024 };
-		char data[dataSize];
-		int bytes;
+		ERR_clear_error();
 		
-		sleep( 0 );
+		s.notified = true;
 		
-		try
+		return true;
+	}
+	
+	static void UpdateInterest( Poller& poller, Session& s )
+	{
+		unsigned local  = 0;
+		unsigned remote = 0;
+		
+		if ( !s.local_eof  &&  s.outbound.empty() )
 		{
-			while ( true )
-			{
-				bytes = SSLRead( client_session, data, dataSize );
-				write( server_socket, data, bytes);
-				active = true;
-				if (bytes != dataSize)  break;
-			}
+			local |= want_read;
 		}
-		catch ( const no_input_pending& )
+		
+		if ( !s.inbound.empty() )
 		{
+			local |= want_write;
 		}
-		catch ( PeerClosedSocket& )
+		
+		if ( !s.remote_eof  &&  s.inbound.empty() )
 		{
-			p7::write( p7::stderr_fileno, STR_LEN( "Remote peer closed socket\n" ) );
-			isComplete = true;
+			remote |= s.read_waits;
 		}
-		catch ( InvalidEOF& )
+		
+		if ( !s.outbound.empty() )
 		{
-			p7::write( p7::stderr_fileno, STR_LEN( "EOF received in violation of SSL protocol\n" ) );
-			isComplete = true;
+			remote |= s.write_waits;
 		}
-		catch ( p7::errno_t& error )
+		
+		if ( s.local_eof  &&  s.outbound.empty()  &&  !s.notified )
 		{
-			p7::perror( "s-tunnel: Remote read error" );
-			
-			isComplete = true;
+			remote |= want_write;
 		}
 		
-		try
+		poller.Set( s.local,  local,  &s );
+		poller.Set( s.remote, remote, &s );
+	}
+	
+	static void Pump( Poller& poller, Session* session )
+	{
+		Session& s = *session;
+		
+		bool progress = true;
+		
+		while ( progress  &&  !s.failed )
 		{
-			while (  ( bytes = read( server_socket, data, dataSize ) )  >  0  )
+			progress = false;
+			
+			if ( s.inbound.empty()  &&  !s.remote_eof )
 			{
-				if ( SSLWrite( client_session, data, bytes ) != bytes )
+				if ( s.remote_ready & s.read_waits  ||  SSL_pending( s.ssl ) > 0 )
 				{
-					p7::write( p7::stderr_fileno, STR_LEN( "Remote underwrite\n" ) );
-					isComplete = true;
-					break;
+					progress |= Receive( s );
 				}
+			}
+			
+			if ( !s.inbound.empty()  &&  s.local_ready & want_write  &&  !s.failed )
+			{
+				progress |= Deliver( s );
+			}
+			
+			if ( s.outbound.empty()  &&  !s.local_eof  &&  s.local_ready & want_read  &&  !s.failed )
+			{
+				progress |= Collect( s );
+			}
+			
+			if ( !s.outbound.empty()  &&  s.remote_ready & s.write_waits  &&  !s.failed )
+			{
+				progress |= Send( s );
+			}
+			
+			if ( s.local_eof  &&  s.outbound.empty()  &&  !s.notified  &&  !s.failed )
+			{
+				progress |= Notify( s );
+			}
+			
+			if ( s.remote_eof  &&  s.inbound.empty()  &&  !s.local_shut )
+			{
+				shutdown( s.local, SHUT_WR );
+				
+				s.local_shut = true;
+			}
+		}
+		
+		const bool done = s.local_eof  &&  s.notified  &&  s.local_shut;
+		
+		if ( s.failed  ||  done )
+		{
+			Close( poller, session );
+		}
+		else
+		{
+			UpdateInterest( poller, s );
+		}
+	}
+	
+	static void StartPumping( Poller& poller, Session* session )
+	{
+		session->local_ready  = want_read;
+		session->remote_ready = want_read | want_write;
+		
+		Pump( poller, session );
+	}
+	
+	/*
+		Advances a session's connect and handshake as far as they'll go
+		without blocking.  Returns true once it's established, after which
+		poller no longer watches it.  A failed session is closed.
+	*/
+	
+	static bool Handshake( Poller& poller, Session* session )
+	{
+		Session& s = *session;
+		
+		if ( s.connecting )
+		{
+			int error = 0;
+			
+			socklen_t len = sizeof error;
+			
+			getsockopt( s.remote, SOL_SOCKET, SO_ERROR, &error, &len );
+			
+			if ( error )
+			{
+				p7::perror( "s-tunnel", "connect", error );
 				
-				active = true;
+				Close( poller, session );
 				
-				if ( bytes != dataSize )  break;
+				return false;
 			}
+			
+			s.connecting = false;
 		}
-		catch ( const no_input_pending& )
+		
+		ERR_clear_error();
+		
+		const int result = SSL_connect( s.ssl );
+		
+		if ( result == 1 )
 		{
+			poller.Set( s.remote, 0 );
 			
+			s.established = true;
+			
+			return true;
 		}
-		catch ( PeerClosedSocket& )
+		
+		unsigned waits = 0;
+		
+		if ( !SSLWaits( s, result, waits ) )
 		{
-			p7::write( p7::stderr_fileno, STR_LEN( "Local peer closed socket\n" ) );
-			isComplete = true;
+			Close( poller, session );
+			
+			return false;
 		}
-		catch ( p7::errno_t& error )
+		
+		poller.Set( s.remote, waits, session );
+		
+		return false;
+	}
+	
+	static bool BeginHandshake( Poller& poller, Session* session )
+	{
+		Session& s = *session;
+		
+		s.remote = socket( PF_INET, SOCK_STREAM, IPPROTO_TCP );
+		
+		if ( s.remote < 0 )
 		{
-			p7::perror( "s-tunnel: Local read error" );
+			p7::perror( "s-tunnel", "socket" );
+			
+			Close( poller, session );
 			
-			isComplete = true;
+			return false;
 		}
 		
-		if ( isComplete )
+		fcntl( s.remote, F_SETFD, FD_CLOEXEC );
+		
+		set_nonblocking( s.remote );
+		set_nodelay    ( s.remote );
+		
+		if ( connect( s.remote, (const sockaddr*) &gRemoteAddress, sizeof gRemoteAddress ) < 0 )
 		{
-			exit( 1 );
+			if ( errno != EINPROGRESS )
+			{
+				p7::perror( "s-tunnel", "connect" );
+				
+				Close( poller, session );
+				
+				return false;
+			}
+			
+			s.connecting = true;
 		}
+		
+		s.ssl = SSL_new( gContext );
+		
+		SSL_set_fd( s.ssl, s.remote );
+		
+		if ( s.connecting )
+		{
+			poller.Set( s.remote, want_write, session );
+			
+			return false;
+		}
+		
+		return Handshake( poller, session );
 	}
 	
-	static int setnonblocking( int fd )
+#ifdef HANDSHAKE_THREAD
+
+	static int gHandoff[ 2 ];      // accepted clients, to the handshaker
+	static int gEstablished[ 2 ];  // sessions ready to pump, to the main loop
+	
+	static Session* ReceiveSession( int fd )
 	{
-		int nonblocking = true;
+		Session* session;
 		
-		return ioctl( fd, FIONBIO, &nonblocking );
+		// Pointers are written whole, well under PIPE_BUF.
+		
+		return read( fd, &session, sizeof session ) == sizeof session ? session : NULL;
 	}
 	
-	static void WaitForClients()
+	static void* Handshaker( void* )
 	{
-		struct sockaddr_in from_addr;
-		socklen_t len = sizeof from_addr;
+		Poller poller;
+		
+		poller.Set( gHandoff[ 0 ], want_read );
 		
-		int server_socket = -1;
-		errno = 0;
+		Event events[ 64 ];
 		
-		while ( server_socket == -1 && errno == 0  )
+		while ( true )
 		{
-			sleep( 1 );
-			server_socket = accept( gListenerSocket, (sockaddr*)&from_addr, &len );
+			const int n = poller.Wait( events, 64 );
+			
+			for ( int i = 0;  i < n;  ++i )
+			{
+				const int fd = events[ i ].fd;
+				
+				Session* session = NULL;
+				
+				bool established = false;
+				
+				if ( fd == gHandoff[ 0 ] )
+				{
+					while ( (session = ReceiveSession( fd )) )
+					{
+						if ( BeginHandshake( poller, session ) )
+						{
+							p7::write( p7::fd_t( gEstablished[ 1 ] ), (const char*) &session, sizeof session );
+						}
+					}
+				}
+				else if ( (session = poller.Find( fd )) )
+				{
+					established = Handshake( poller, session );
+				}
+				
+				if ( established )
+				{
+					// The main loop never blocks, so neither does this for long.
+					
+					p7::write( p7::fd_t( gEstablished[ 1 ] ), (const char*) &session, sizeof session );
+				}
+			}
 		}
 		
-		if ( server_socket == -1 )
+		return NULL;
+	}
+	
+	static void StartHandshaker()
+	{
+		if ( pipe( gHandoff ) < 0  ||  pipe( gEstablished ) < 0 )
 		{
-			std::fprintf( stderr, "Failed to accept incoming connection: %d\n", errno );
+			p7::perror( "s-tunnel", "pipe" );
 			
-			return;
+			throw p7::exit_failure;
+		}
+		
+		for ( int i = 0;  i < 2;  ++i )
+		{
+			fcntl( gHandoff    [ i ], F_SETFD, FD_CLOEXEC );
+			fcntl( gEstablished[ i ], F_SETFD, FD_CLOEXEC );
+		}
+		
+		// If the handshaker falls that far behind, new clients are refused.
+		
+		set_nonblocking( gHandoff    [ 1 ] );
+		set_nonblocking( gHandoff    [ 0 ] );
+		set_nonblocking( gEstablished[ 0 ] );
+		
+		pthread_t thread;
+		
+		if ( const int error = pthread_create( &thread, NULL, &Handshaker, NULL ) )
+		{
+			p7::perror( "s-tunnel", "pthread_create", error );
+			
+			throw p7::exit_failure;
 		}
 		
-		std::fprintf( stderr, "Connection from %s, port %d.\n",
-		                                       "?",     from_addr.sin_port );
+		pthread_detach( thread );
+	}
+	
+#endif
+
+	static void NewClient( Poller& poller, int client )
+	{
+		fcntl( client, F_SETFD, FD_CLOEXEC );
 		
-		setnonblocking( server_socket );
+		set_nonblocking( client );
+		set_nodelay    ( client );
 		
-		int client_socket = socket( PF_INET, SOCK_STREAM, IPPROTO_TCP );
+		Session* session = new Session( client );
 		
-		int connected = connect( client_socket, (const sockaddr*)&gRemoteAddress, sizeof (sockaddr_in) );
-		int unblocked = setnonblocking( client_socket );
+	#ifdef HANDSHAKE_THREAD
 		
-		SSL_METHOD const*  mySSLMethod  = SSLv3_client_method();
-		SSL_CTX*           mySSLContext = SSL_CTX_new( mySSLMethod  );
-		SSL*               mySSLSession = SSL_new    ( mySSLContext );
+		if ( write( gHandoff[ 1 ], &session, sizeof session ) != sizeof session )
+		{
+			p7::perror( "s-tunnel", "handshakes backed up" );
+			
+			close( client );
+			
+			delete session;
+		}
 		
-		SSL_set_fd( mySSLSession, client_socket );
+	#else
 		
-		int error = SSL_connect( mySSLSession );
+		if ( BeginHandshake( poller, session ) )
+		{
+			StartPumping( poller, session );
+		}
+		
+	#endif
+	}
+	
+	static void AcceptClients( Poller& poller, int listener )
+	{
+		for ( int i = 0;  i < max_accept_batch;  ++i )
+		{
+			const int client = accept( listener, NULL, NULL );
+			
+			if ( client < 0 )
+			{
+				if ( errno != EAGAIN  &&  errno != EINTR  &&  errno != ECONNABORTED )
+				{
+					p7::perror( "s-tunnel", "accept" );
+				}
+				
+				break;
+			}
+			
+			NewClient( poller, client );
+		}
+	}
+	
+	static void Run( int listener )
+	{
+		Poller poller;
+		
+		poller.Set( listener, want_read );
+		
+	#ifdef HANDSHAKE_THREAD
+		
+		poller.Set( gEstablished[ 0 ], want_read );
+		
+	#endif
+		
+		Event events[ 64 ];
 		
 		while ( true )
 		{
-			Poll( mySSLSession, server_socket );
+			const int n = poller.Wait( events, 64 );
+			
+			if ( n < 0  &&  errno != EINTR )
+			{
+				p7::perror( "s-tunnel", "wait" );
+				
+				throw p7::exit_failure;
+			}
+			
+			for ( int i = 0;  i < n;  ++i )
+			{
+				const int fd = events[ i ].fd;
+				
+				if ( fd == listener )
+				{
+					AcceptClients( poller, listener );
+					
+					continue;
+				}
+				
+			#ifdef HANDSHAKE_THREAD
+				
+				if ( fd == gEstablished[ 0 ] )
+				{
+					while ( Session* session = ReceiveSession( fd ) )
+					{
+						StartPumping( poller, session );
+					}
+					
+					continue;
+				}
+				
+			#endif
+				
+				Session* session = poller.Find( fd );
+				
+				if ( session == NULL )
+				{
+					continue;  // closed earlier in this batch
+				}
+				
+				if ( !session->established )
+				{
+					if ( Handshake( poller, session ) )
+					{
+						StartPumping( poller, session );
+					}
+					
+					continue;
+				}
+				
+				if ( fd == session->local )
+				{
+					session->local_ready |= events[ i ].ready;
+				}
+				else
+				{
+					session->remote_ready |= events[ i ].ready;
+				}
+				
+				Pump( poller, session );
+			}
+		}
+	}
+	
+	static int Listen( const struct sockaddr_in& listener_addr )
+	{
+		const int listener = socket( PF_INET, SOCK_STREAM, IPPROTO_TCP );
+		
+		if ( listener < 0 )
+		{
+			p7::perror( "s-tunnel", "socket" );
+			
+			throw p7::exit_failure;
 		}
+		
+		int on = 1;
+		
+		setsockopt( listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on );
+		
+		if ( bind( listener, (const sockaddr*) &listener_addr, sizeof listener_addr ) < 0  ||  listen( listener, SOMAXCONN ) < 0 )
+		{
+			p7::perror( "s-tunnel", "listen" );
+			
+			throw p7::exit_failure;
+		}
+		
+		fcntl( listener, F_SETFD, FD_CLOEXEC );
+		
+		set_nonblocking( listener );
+		
+		return listener;
+	}
+	
+	static void Startup()
+	{
+		SSLeay_add_ssl_algorithms();
+		SSL_load_error_strings();
+		
+		gContext = SSL_CTX_new( SSLv23_client_method() );
+		
+		if ( gContext == NULL )
+		{
+			ERR_print_errors_fp( stderr );
+			
+			throw p7::exit_failure;
+		}
+		
+	#ifdef SSL_OP_IGNORE_UNEXPECTED_EOF
+		
+		SSL_CTX_set_options( gContext, SSL_OP_IGNORE_UNEXPECTED_EOF );
+		
+	#endif
+		
+		// Writes to a client that's gone fail with EPIPE instead.
+		
+		signal( SIGPIPE, SIG_IGN );
 	}
 	
 	
@@ -271,7 +1081,7 @@ namespace tool
 	{
 		hostent* hosts = gethostbyname( hostname );
 		
-		if ( !hosts || h_errno )
+		if ( hosts == NULL )
 		{
 			p7::perror( "s-tunnel: Domain name lookup failed", h_errno );
 			
@@ -285,7 +1095,7 @@ namespace tool
 	
 	int Main( int argc, char** argv )
 	{
-		const char* remote_host;
+		const char* remote_host = NULL;
 		
 		const char* lport = "0";
 		const char* rport = "0";
@@ -305,6 +1115,12 @@ namespace tool
 			return 1;
 		}
 		
+		if ( remote_host == NULL )
+		{
+			p7::write( p7::stderr_fileno, STR_LEN( "Usage: s-tunnel --lport port --remote host [--rport port]\n" ) );
+			return 2;
+		}
+		
 		if ( remote_port == 0 )
 		{
 			remote_port = listener_port;
@@ -312,32 +1128,37 @@ namespace tool
 		
 		struct in_addr ip = ResolveHostname( remote_host );
 		
-		struct sockaddr_in remoteAddr;
+		struct sockaddr_in remoteAddr = { 0 };
 		
 		remoteAddr.sin_family = AF_INET;
-		remoteAddr.sin_port   = remote_port;
+		remoteAddr.sin_port   = htons( remote_port );
 		remoteAddr.sin_addr   = ip;
 		
 		gRemoteAddress = remoteAddr;
 		
 		p7::write( p7::stdout_fileno, STR_LEN( "Secure tunnel daemon starting up..." ) );
 		
-		unsigned int listen_ip = INADDR_ANY;
+		struct sockaddr_in listenAddr = { 0 };
+		
+		listenAddr.sin_family      = AF_INET;
+		listenAddr.sin_port        = htons( listener_port );
+		listenAddr.sin_addr.s_addr = htonl( INADDR_ANY );
 		
-		struct sockaddr_in listenAddr;
+		Startup();
 		
-		listenAddr.sin_family = AF_INET;
-		listenAddr.sin_port = listener_port;
-		listenAddr.sin_addr.s_addr = listen_ip;
+		const int listener = Listen( listenAddr );
 		
-		Startup( listenAddr );
+	#ifdef HANDSHAKE_THREAD
+		
+		StartHandshaker();
+		
+	#endif
 		
 		p7::write( p7::stdout_fileno, STR_LEN( " done.\n" ) );
 		
-		WaitForClients();
+		Run( listener );
 		
 		return 0;
 	}
 	
 }
-
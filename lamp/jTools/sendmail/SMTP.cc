@@ -38,7 +38,7 @@ namespace SMTP
 			memcpy( chars, response.data(), size );
 		}
 		
-		static void GetResponse( text_input::feed feed, p7::fd_reader& reader )
+		static void GetResponse( text_input::feed& feed, p7::fd_reader& reader )
 		{
 			while ( const plus::string* s = get_line_bare_from_feed( feed, reader ) )
 			{
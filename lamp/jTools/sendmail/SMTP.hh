@@ -51,6 +51,16 @@ namespace SMTP
 				return "DATA";
 			}
 			
+			inline plus::string EndData()
+			{
+				return ".";
+			}
+			
+			inline plus::string Reset()
+			{
+				return "RSET";
+			}
+			
 			inline plus::string Quit()
 			{
 				return "QUIT";
@@ -118,7 +128,13 @@ namespace SMTP
 				
 				void EndData()
 				{
-					verify_response();
+					DoCommand( Commands::EndData() );
+				}
+				
+				// Ends a transaction, so the session can carry another.
+				void Reset()
+				{
+					DoCommand( Commands::Reset() );
 				}
 				
 				void Quit()
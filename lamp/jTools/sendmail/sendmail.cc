@@ -5,38 +5,63 @@
 
 // Standard C++
 #include <algorithm>
+#include <map>
 #include <vector>
 
 // Standard C/C++
-#include <cctype>
 #include <cstdio>
 
+// Standard C
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
 // Mac OS
+#ifdef __RELIX__
 #ifndef __OPENTRANSPORT__
 #include <OpenTransport.h>
 #endif
+#endif
 
 // POSIX
 #include <arpa/inet.h>
+#include <fcntl.h>
 #include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/file.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// gear
+#include "gear/parse_decimal.hh"
 
 // plus
-#include "plus/pointer_to_function.hh"
 #include "plus/var_string.hh"
 
 // Nitrogen
-#include "Nitrogen/Folders.hh"
+#ifdef __RELIX__
 #include "Nitrogen/OpenTransportProviders.hh"
+#endif
 
 // poseven
 #include "poseven/bundles/inet.hh"
+#include "poseven/extras/fd_reader.hh"
+#include "poseven/extras/write_all.hh"
 #include "poseven/functions/gethostname.hh"
+#include "poseven/functions/lseek.hh"
+#include "poseven/functions/openat.hh"
 #include "poseven/functions/perror.hh"
+#include "poseven/functions/read.hh"
 #include "poseven/functions/write.hh"
 #include "poseven/types/exit_t.hh"
 
-// FSContents
-#include "FSContents.h"
+// text-input
+#include "text_input/feed.hh"
+#include "text_input/get_line_from_feed.hh"
+
+// MailSpool
+#include "MailSpool/Spool.hh"
 
 // Arcana / SMTP
 #include "SMTP.hh"
@@ -46,31 +71,86 @@
 #include "Orion/Main.hh"
 
 
+/*
+	sendmail [--queue dir] [--relay host[:port]] [--port port]
+	         [--jobs n] [--per-host n] [--batch n]
+	
+	Delivers the messages queued by smtpd (see MailSpool/Spool.hh).  The
+	recipients of each message are grouped by the host that will receive
+	them (the relay, or else their domain's mail exchanger), and each host
+	gets one transaction per message, with every recipient it's receiving.
+	
+	A host's transactions are carried over sessions of up to --batch
+	messages each, with RSET between them.  Up to --jobs sessions run at
+	once (each in its own process), but no more than --per-host to any one
+	host.  MacRelix can't fork, so there they run one after another.
+	
+	A message is removed once every recipient has it (or has been refused
+	for good).  Otherwise, the recipients already served are noted in the
+	file "<name>.sent", so the next run doesn't send to them again.
+*/
+
+#ifdef __RELIX__
+
 inline bool operator<( const InetMailExchange& a, const InetMailExchange& b )
 {
 	return a.preference < b.preference;
 }
 
+#endif
+
 
 namespace tool
 {
 	
-	namespace n = nucleus;
-	namespace N = Nitrogen;
 	namespace n = nucleus;
 	namespace p7 = poseven;
 	namespace o = orion;
 	
-	using namespace io::path_descent_operators;
 	
+	static const char* gQueueDirectory = "/var/spool/mail/queue";
+	static const char* gRelayServer    = NULL;
 	
-	static const char* gRelayServer = NULL;
+	static std::size_t gPort    = 25;
+	static std::size_t gJobs    = 8;
+	static std::size_t gPerHost = 2;
+	static std::size_t gBatch   = 100;
 	
 	
-	static N::FSDirSpec QueueDirectory()
+	struct Message
 	{
-		return N::FSpMake_FSDirSpec( io::system_root< N::FSDirSpec >() / "j" / "var" / "spool" / "jmail" / "queue" );
-	}
+		plus::string                 name;
+		plus::string                 returnPath;
+		off_t                        dataOffset;
+		std::vector< plus::string >  recipients;  // not yet served
+		std::vector< plus::string >  served;      // in this run
+		bool                         deferred;
+	};
+	
+	// One message, to one host
+	struct Delivery
+	{
+		size_t                       message;
+		std::vector< plus::string >  recipients;
+	};
+	
+	// One SMTP session
+	struct Connection
+	{
+		plus::string           host;
+		std::vector< size_t >  deliveries;
+	};
+	
+	enum
+	{
+		kDelivered = 'd',
+		kDeferred  = 't',  // a temporary failure, or none at all
+		kRefused   = 'p'   // a permanent failure
+	};
+	
+	static std::vector< Message    > gMessages;
+	static std::vector< Delivery   > gDeliveries;
+	static std::vector< Connection > gConnections;
 	
 	
 	static plus::string DomainFromEmailAddress( const plus::string& emailAddr )
@@ -79,21 +159,23 @@ namespace tool
 		
 		if ( at >= emailAddr.size() - 1 )
 		{
-			Mac::ThrowOSStatus( paramErr );  // bad email address
+			return "";  // bad email address
 		}
 		
 		return emailAddr.substr( at + 1, emailAddr.find( '>' ) - (at + 1) );
 	}
 	
-	static plus::string OTLookup( const plus::string& domain )
+	static plus::string LookupMailExchange( const plus::string& domain )
 	{
-	#if TARGET_RT_MAC_MACHO
+	#if !defined( __RELIX__ )  ||  TARGET_RT_MAC_MACHO
 		
 		return "";
 		
 	#else
 		
-		std::vector< InetMailExchange > results;	
+		namespace N = Nitrogen;
+		
+		std::vector< InetMailExchange > results;
 		
 		results.resize( 10 );  // Should be more than enough
 		
@@ -109,13 +191,41 @@ namespace tool
 	#endif
 	}
 	
+	static plus::string HostForRecipient( const plus::string& forwardPath )
+	{
+		if ( gRelayServer != NULL )
+		{
+			return gRelayServer;
+		}
+		
+		static std::map< plus::string, plus::string > exchanges;
+		
+		const plus::string domain = DomainFromEmailAddress( forwardPath );
+		
+		if ( domain.empty() )
+		{
+			return "";
+		}
+		
+		std::map< plus::string, plus::string >::iterator it = exchanges.find( domain );
+		
+		if ( it == exchanges.end() )
+		{
+			plus::string exchange = LookupMailExchange( domain );
+			
+			it = exchanges.insert( std::make_pair( domain, exchange.empty() ? domain : exchange ) ).first;
+		}
+		
+		return it->second;
+	}
+	
 	static p7::in_addr_t ResolveHostname( const char* hostname )
 	{
 		hostent* hosts = gethostbyname( hostname );
 		
-		if ( !hosts || h_errno )
+		if ( hosts == NULL )
 		{
-			p7::perror( "sendmail: Domain name lookup failed", h_errno );
+			p7::perror( "sendmail: Domain name lookup failed", hostname, h_errno );
 			
 			throw p7::exit_failure;
 		}
@@ -125,208 +235,622 @@ namespace tool
 		return p7::in_addr_t( addr.s_addr );
 	}
 	
-	static void Relay( const plus::string&  returnPath,
-	                   const plus::string&  forwardPath,
-	                   const FSSpec&        messageFile )
+	static n::owned< p7::fd_t > Connect( const plus::string& host )
+	{
+		const plus::string::size_type colon = host.find( ':' );
+		
+		const unsigned port = colon != plus::string::npos ? gear::parse_unsigned_decimal( host.c_str() + colon + 1 )
+		                                                  : gPort;
+		
+		const plus::string name = host.substr( 0, colon );
+		
+		n::owned< p7::fd_t > server = p7::connect( ResolveHostname( name.c_str() ), p7::in_port_t( port ) );
+		
+		// Each command waits for its reply, so none should wait to be sent.
+		
+		int on = 1;
+		
+		(void) setsockopt( server, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on );
+		
+		return server;
+	}
+	
+	
+	static plus::string SentFilename( const plus::string& name )
+	{
+		return name + ".sent";
+	}
+	
+	static bool ReadEnvelope( p7::fd_t queue, Message& message )
 	{
-		if ( forwardPath == "" )
+		n::owned< p7::fd_t > file = p7::openat( queue, message.name, p7::o_rdonly );
+		
+		text_input::feed feed;
+		
+		p7::fd_reader reader( file );
+		
+		off_t offset = 0;
+		
+		while ( const plus::string* s = get_line_bare_from_feed( feed, reader ) )
+		{
+			const plus::string& line = *s;
+			
+			offset += line.size() + 1;
+			
+			if ( line.empty() )
+			{
+				message.dataOffset = offset;
+				
+				return true;
+			}
+			
+			if ( line.substr( 0, 5 ) == "From " )
+			{
+				message.returnPath = line.substr( 5 );
+			}
+			else if ( line.substr( 0, 3 ) == "To " )
+			{
+				message.recipients.push_back( line.substr( 3 ) );
+			}
+		}
+		
+		return false;
+	}
+	
+	// Removes the recipients served by an earlier run.
+	
+	static void ForgetServedRecipients( p7::fd_t queue, Message& message )
+	{
+		const int fd = openat( queue, SentFilename( message.name ).c_str(), O_RDONLY );
+		
+		if ( fd < 0 )
 		{
-			// This will be the case if the dest file's data fork was empty,
-			// which will be true of an Icon file.
-			// The file will be deleted after we return.
 			return;
 		}
 		
-		std::printf( "Relaying from %s to %s\n", returnPath.c_str(), forwardPath.c_str() );
+		n::owned< p7::fd_t > file = n::owned< p7::fd_t >::seize( p7::fd_t( fd ) );
 		
-		plus::string smtpServer;
+		text_input::feed feed;
 		
-		if ( gRelayServer != NULL )
+		p7::fd_reader reader( file );
+		
+		std::vector< plus::string >& recipients = message.recipients;
+		
+		while ( const plus::string* s = get_line_bare_from_feed( feed, reader ) )
 		{
-			smtpServer = gRelayServer;
-			
-			std::printf( "Using relay %s\n", gRelayServer );
+			if ( s->substr( 0, 3 ) == "To " )
+			{
+				recipients.erase( std::remove( recipients.begin(),
+				                               recipients.end(),
+				                               s->substr( 3 ) ),
+				                  recipients.end() );
+			}
 		}
-		else
+	}
+	
+	static void LoadQueue( const MailSpool::Spool& spool )
+	{
+		const std::vector< MailSpool::Record > records = spool.queued();
+		
+		for ( size_t i = 0;  i < records.size();  ++i )
 		{
-			plus::string rcptDomain = DomainFromEmailAddress( forwardPath );
+			Message message;
 			
-			//smtpServer = ResolverLookup( rcptDomain );
-			smtpServer = OTLookup( rcptDomain );
+			message.name       = records[ i ].name;
+			message.dataOffset = 0;
+			message.deferred   = false;
 			
-			if ( !smtpServer.empty() )
+			try
 			{
-				std::printf( "MX for %s is %s\n", rcptDomain.c_str(), smtpServer.c_str() );
+				if ( !ReadEnvelope( spool.dir(), message ) )
+				{
+					continue;
+				}
+				
+				ForgetServedRecipients( spool.dir(), message );
 			}
-			else
+			catch ( ... )
 			{
-				smtpServer = rcptDomain;
-				
-				std::printf( "Using domain %s as server\n", rcptDomain.c_str() );
+				continue;  // delivered by someone else just now
 			}
 			
+			gMessages.push_back( message );
 		}
+	}
+	
+	static void PlanDeliveries()
+	{
+		typedef std::map< plus::string, std::vector< size_t > > HostMap;
 		
-		p7::in_port_t smtp_port = p7::in_port_t( 25 );
-		
-		p7::in_addr_t addr = ResolveHostname( smtpServer.c_str() );
-		
-		struct in_addr sin_addr = { addr };
+		HostMap hosts;  // deliveries to each host
 		
-		std::printf( "Address of %s is %s\n", smtpServer.c_str(), inet_ntoa( sin_addr ) );
+		for ( size_t i = 0;  i < gMessages.size();  ++i )
+		{
+			Message& message = gMessages[ i ];
+			
+			std::map< plus::string, size_t > deliveries;  // to each host, of this message
+			
+			for ( size_t j = 0;  j < message.recipients.size();  ++j )
+			{
+				const plus::string& recipient = message.recipients[ j ];
+				
+				const plus::string host = HostForRecipient( recipient );
+				
+				if ( host.empty() )
+				{
+					std::fprintf( stderr, "sendmail: %s: no domain in %s\n", message.name.c_str(),
+					                                                         recipient.c_str() );
+					
+					message.served.push_back( recipient );  // Nothing else will happen
+					
+					continue;
+				}
+				
+				if ( deliveries.find( host ) == deliveries.end() )
+				{
+					Delivery delivery;
+					
+					delivery.message = i;
+					
+					deliveries[ host ] = gDeliveries.size();
+					
+					hosts[ host ].push_back( gDeliveries.size() );
+					
+					gDeliveries.push_back( delivery );
+				}
+				
+				gDeliveries[ deliveries[ host ] ].recipients.push_back( recipient );
+			}
+		}
 		
-		// Make a new socket
-		// and connect to the server.  This could fail, thanks to a bunch of Cox.
+		for ( HostMap::const_iterator it = hosts.begin();  it != hosts.end();  ++it )
+		{
+			const std::vector< size_t >& deliveries = it->second;
+			
+			for ( size_t i = 0;  i < deliveries.size();  i += gBatch )
+			{
+				Connection connection;
+				
+				connection.host = it->first;
+				
+				connection.deliveries.assign( deliveries.begin() + i,
+				                              deliveries.begin() + std::min< size_t >( i + gBatch, deliveries.size() ) );
+				
+				gConnections.push_back( connection );
+			}
+		}
+	}
+	
+	
+	static void SendData( p7::fd_t queue, p7::fd_t server, const Message& message )
+	{
+		n::owned< p7::fd_t > file = p7::openat( queue, message.name, p7::o_rdonly );
 		
-		n::owned< p7::fd_t > smtp_server = p7::connect( addr, smtp_port );
+		p7::lseek( file, message.dataOffset );
 		
-		SMTP::Client::Session smtpSession( smtp_server );
+		const std::size_t blockSize = 64 * 1024;
 		
-		n::owned< N::FSFileRefNum > messageStream = io::open_for_reading( messageFile );
+		static char data[ blockSize ];
 		
-		smtpSession.Hello      ( p7::gethostname() );
-		smtpSession.MailFrom   ( returnPath  );
-		smtpSession.RecipientTo( forwardPath );
+		while ( std::size_t bytes = p7::read( file, data, blockSize ) )
+		{
+			p7::write_all( server, data, bytes );
+		}
+	}
+	
+	// One result per recipient, in delivery order
+	
+	static size_t CountResults( const Connection& connection )
+	{
+		size_t n = 0;
 		
-		smtpSession.BeginData();
+		for ( size_t i = 0;  i < connection.deliveries.size();  ++i )
+		{
+			n += gDeliveries[ connection.deliveries[ i ] ].recipients.size();
+		}
 		
-		const std::size_t blockSize = 4096;
+		return n;
+	}
+	
+	/*
+		Sets a result for each recipient of the connection's deliveries.
+		A recipient refused at RCPT doesn't stop the others; the message
+		goes to whichever were accepted.  If the session breaks, the rest
+		are deferred.
+	*/
+	
+	static void RunConnection( p7::fd_t queue, const Connection& connection, char* results )
+	{
+		const size_t n_deliveries = connection.deliveries.size();
 		
-		char data[ blockSize ];
+		std::fill( results, results + CountResults( connection ), char( kDeferred ) );
 		
-		while ( std::size_t bytes = io::read( messageStream, data, blockSize ) )
+		try
+		{
+			n::owned< p7::fd_t > server = Connect( connection.host );
+			
+			SMTP::Client::Session smtpSession( server );
+			
+			smtpSession.Hello( p7::gethostname() );
+			
+			for ( size_t i = 0;  i < n_deliveries;  ++i )
+			{
+				const Delivery& delivery = gDeliveries[ connection.deliveries[ i ] ];
+				
+				const Message& message = gMessages[ delivery.message ];
+				
+				const size_t n_recipients = delivery.recipients.size();
+				
+				if ( i > 0 )
+				{
+					smtpSession.Reset();
+				}
+				
+				std::vector< size_t > accepted;
+				
+				bool mailing = false;
+				
+				try
+				{
+					smtpSession.MailFrom( message.returnPath );
+					
+					mailing = true;
+					
+					for ( size_t j = 0;  j < n_recipients;  ++j )
+					{
+						try
+						{
+							smtpSession.RecipientTo( delivery.recipients[ j ] );
+							
+							accepted.push_back( j );
+						}
+						catch ( const SMTP::Client::Failure& )
+						{
+							results[ j ] = kRefused;
+						}
+						catch ( const SMTP::Client::Error& )
+						{
+						}
+					}
+					
+					if ( !accepted.empty() )
+					{
+						smtpSession.BeginData();
+						
+						SendData( queue, server, message );
+						
+						smtpSession.EndData();
+						
+						for ( size_t k = 0;  k < accepted.size();  ++k )
+						{
+							results[ accepted[ k ] ] = kDelivered;
+						}
+					}
+				}
+				catch ( const SMTP::Client::Failure& )
+				{
+					// MAIL refuses everyone; DATA, only those it was for.
+					
+					if ( !mailing )
+					{
+						std::fill( results, results + n_recipients, char( kRefused ) );
+					}
+					
+					for ( size_t k = 0;  k < accepted.size();  ++k )
+					{
+						results[ accepted[ k ] ] = kRefused;
+					}
+				}
+				catch ( const SMTP::Client::Error& )
+				{
+				}
+				
+				results += n_recipients;
+			}
+			
+			smtpSession.Quit();
+		}
+		catch ( ... )
 		{
-			p7::write( smtp_server, data, bytes );
 		}
-		
-		smtpSession.EndData();
-		smtpSession.Quit();
 	}
 	
-	static bool IsControlChar( char c )
+	static void ApplyResults( const Connection& connection, const char* results, size_t n_results )
 	{
-		return std::iscntrl( c );
+		size_t r = 0;
+		
+		for ( size_t i = 0;  i < connection.deliveries.size();  ++i )
+		{
+			const Delivery& delivery = gDeliveries[ connection.deliveries[ i ] ];
+			
+			Message& message = gMessages[ delivery.message ];
+			
+			for ( size_t j = 0;  j < delivery.recipients.size();  ++j, ++r )
+			{
+				const plus::string& recipient = delivery.recipients[ j ];
+				
+				const char result = r < n_results ? results[ r ] : char( kDeferred );
+				
+				if ( result == kDeferred )
+				{
+					message.deferred = true;
+					
+					continue;
+				}
+				
+				if ( result == kRefused )
+				{
+					std::fprintf( stderr, "sendmail: %s: %s refused by %s\n", message.name.c_str(),
+					                                                           recipient.c_str(),
+					                                                           connection.host.c_str() );
+				}
+				
+				message.served.push_back( recipient );
+			}
+		}
 	}
 	
-	template < class Stream >
-	static plus::string ReadOneLinerFromStream( Stream fileH )
+#ifndef __RELIX__
+
+	struct Running
 	{
-		const size_t file_size = io::get_file_size( fileH );
+		size_t  connection;
+		int     results;  // read end of a pipe
+	};
+	
+	static void StartConnection( p7::fd_t queue, size_t index, std::map< pid_t, Running >& running )
+	{
+		int fds[ 2 ];
+		
+		if ( pipe( fds ) < 0 )
+		{
+			p7::throw_errno( errno );
+		}
 		
-		plus::var_string contents;
+		std::fflush( NULL );
 		
-		char* p = contents.reset( file_size );
+		const pid_t pid = fork();
 		
-		io::read( fileH, p, file_size );
+		if ( pid < 0 )
+		{
+			p7::throw_errno( errno );
+		}
 		
-		const char* end_of_first_line = std::find_if( p,
-		                                              p + file_size,
-		                                              std::ptr_fun( IsControlChar ) );
+		if ( pid == 0 )
+		{
+			close( fds[ 0 ] );
+			
+			const Connection& connection = gConnections[ index ];
+			
+			std::vector< char > results( CountResults( connection ) );
+			
+			RunConnection( queue, connection, &results[ 0 ] );
+			
+			(void) write( fds[ 1 ], &results[ 0 ], results.size() );
+			
+			_exit( 0 );
+		}
 		
-		const std::size_t length_of_first_line = end_of_first_line - p;
+		close( fds[ 1 ] );
 		
-		contents.resize( length_of_first_line );
+		const Running connection = { index, fds[ 0 ] };
 		
-		return contents;
+		running[ pid ] = connection;
 	}
 	
-	template < class FileSpec >
-	static inline plus::string ReadOneLinerFromFile( const FileSpec& file )
+	static void FinishConnection( const Running& finished )
 	{
-		return ReadOneLinerFromStream( io::open_for_reading( file ) );
+		const Connection& connection = gConnections[ finished.connection ];
+		
+		std::vector< char > results( CountResults( connection ) );
+		
+		size_t n_read = 0;
+		
+		while ( n_read < results.size() )
+		{
+			const ssize_t n = read( finished.results, &results[ n_read ], results.size() - n_read );
+			
+			if ( n <= 0 )
+			{
+				break;  // crashed, so anything unreported is deferred
+			}
+			
+			n_read += n;
+		}
+		
+		close( finished.results );
+		
+		ApplyResults( connection, &results[ 0 ], n_read );
 	}
 	
-	
-	class Transmitter
+	static void RunConnections( p7::fd_t queue )
 	{
-		private:
-			plus::string  itsReturnPath;
-			FSSpec        itsMessageFile;
-			FSSpec        itsDestinations;
-		
-		public:
-			Transmitter( const plus::string&  returnPath,
-			             const FSSpec&        message,
-			             const FSSpec&        dests )
-			:
-				itsReturnPath  ( returnPath ),
-				itsMessageFile ( message    ),
-				itsDestinations( dests      )
+		std::vector< size_t > waiting;
+		
+		for ( size_t i = 0;  i < gConnections.size();  ++i )
+		{
+			waiting.push_back( i );
+		}
+		
+		std::map< pid_t, Running > running;
+		
+		std::map< plus::string, std::size_t > busy;  // sessions with each host
+		
+		while ( true )
+		{
+			typedef std::vector< size_t >::iterator Iter;
+			
+			for ( Iter it = waiting.begin();  it != waiting.end()  &&  running.size() < gJobs;  )
 			{
+				std::size_t& sessions = busy[ gConnections[ *it ].host ];
+				
+				if ( sessions < gPerHost )
+				{
+					StartConnection( queue, *it, running );
+					
+					++sessions;
+					
+					it = waiting.erase( it );
+				}
+				else
+				{
+					++it;
+				}
 			}
 			
-			void operator()( const unsigned char* dest_filename );
-	};
+			if ( running.empty() )
+			{
+				break;
+			}
+			
+			int status;
+			
+			const pid_t pid = wait( &status );
+			
+			if ( pid < 0 )
+			{
+				if ( errno == EINTR )
+				{
+					continue;
+				}
+				
+				p7::throw_errno( errno );
+			}
+			
+			std::map< pid_t, Running >::iterator it = running.find( pid );
+			
+			if ( it != running.end() )
+			{
+				--busy[ gConnections[ it->second.connection ].host ];
+				
+				FinishConnection( it->second );
+				
+				running.erase( it );
+			}
+		}
+	}
 	
-	void Transmitter::operator()( const unsigned char* dest_filename )
+#else
+
+	static void RunConnections( p7::fd_t queue )
 	{
-		try
+		for ( size_t i = 0;  i < gConnections.size();  ++i )
 		{
-			FSSpec destFile = itsDestinations / dest_filename;
+			const Connection& connection = gConnections[ i ];
 			
-			// destFile serves as a lock on this destination
-			// We can't switch from FSSpec to pathname until we sort out locking
-			Relay( itsReturnPath,
-			       ReadOneLinerFromStream( io::open_for_io( destFile ) ),
-			       itsMessageFile );
+			std::vector< char > results( CountResults( connection ) );
 			
-			io::delete_file( destFile );
-		}
-		catch ( ... )
-		{
+			RunConnection( queue, connection, &results[ 0 ] );
 			
+			ApplyResults( connection, &results[ 0 ], results.size() );
 		}
 	}
 	
+#endif
+
+	// Returns true if the message is finished with.
 	
-	static void ProcessMessage( const N::FSDirSpec& messages, const unsigned char* name )
+	static bool UpdateQueue( p7::fd_t queue, const Message& message )
 	{
-		FSSpec msgFolderItem = messages / name;
-		
-		if ( !io::directory_exists( msgFolderItem ) )  return;  // Icon files, et al
-		
-		typedef io::filespec_traits< FSSpec >::optimized_directory_spec directory_spec;
+		const plus::string sent = SentFilename( message.name );
 		
-		directory_spec msgFolder( N::FSpMake_FSDirSpec( msgFolderItem ) );
-		
-		FSSpec message      = msgFolder / "Message";
-		FSSpec returnPath   = msgFolder / "Return-Path";
-		FSSpec destinations = msgFolder / "Destinations";
+		if ( !message.deferred )
+		{
+			(void) unlinkat( queue, message.name.c_str(), 0 );
+			(void) unlinkat( queue, sent.c_str(),         0 );
+			
+			return true;
+		}
 		
-		directory_spec destFolder( N::FSpMake_FSDirSpec( destinations ) );
+		if ( !message.served.empty() )
+		{
+			plus::var_string lines;
+			
+			for ( size_t i = 0;  i < message.served.size();  ++i )
+			{
+				lines += "To ";
+				lines += message.served[ i ];
+				lines += "\n";
+			}
+			
+			n::owned< p7::fd_t > file = p7::openat( queue,
+			                                        sent,
+			                                        p7::o_wronly | p7::o_creat | p7::o_append,
+			                                        p7::_600 );
+			
+			p7::write_all( file, lines.data(), lines.size() );
+			
+			(void) fsync( file );
+		}
 		
-		typedef io::directory_contents_traits< directory_spec >::container_type directory_container;
-		directory_container contents = io::directory_contents( destFolder );
+		return false;
+	}
+	
+	static double Now()
+	{
+		timespec now;
 		
-		std::for_each( contents.begin(),
-		               contents.end(),
-		               Transmitter( ReadOneLinerFromFile( returnPath ),
-		                            message,
-		                            destinations ) );
+		clock_gettime( CLOCK_MONOTONIC, &now );
 		
-		io::delete_empty_directory( destFolder );  // this fails if destinations remain
-		io::delete_file           ( returnPath );
-		io::delete_file           ( message    );
-		io::delete_empty_directory( msgFolder  );
+		return now.tv_sec + now.tv_nsec / 1e9;
 	}
 	
-	
 	int Main( int argc, char** argv )
 	{
-		o::bind_option_to_variable( "--relay", gRelayServer );
+		o::bind_option_to_variable( "--queue",    gQueueDirectory );
+		o::bind_option_to_variable( "--relay",    gRelayServer    );
+		o::bind_option_to_variable( "--port",     gPort           );
+		o::bind_option_to_variable( "--jobs",     gJobs           );
+		o::bind_option_to_variable( "--per-host", gPerHost        );
+		o::bind_option_to_variable( "--batch",    gBatch          );
 		
 		o::get_options( argc, argv );
 		
-		N::FSDirSpec queue_dir = QueueDirectory();
+		gJobs    = std::max< std::size_t >( gJobs,    1 );
+		gPerHost = std::max< std::size_t >( gPerHost, 1 );
+		gBatch   = std::max< std::size_t >( gBatch,   1 );
+		
+		MailSpool::Spool spool( gQueueDirectory );
+		
+		const p7::fd_t queue = spool.dir();
+		
+		// One queue run at a time
+		
+		if ( flock( queue, LOCK_EX | LOCK_NB ) < 0  &&  errno == EWOULDBLOCK )
+		{
+			return 0;
+		}
+		
+		const double start = Now();
+		
+		LoadQueue( spool );
+		
+		PlanDeliveries();
+		
+		RunConnections( queue );
+		
+		unsigned finished = 0;
+		
+		for ( size_t i = 0;  i < gMessages.size();  ++i )
+		{
+			finished += UpdateQueue( queue, gMessages[ i ] );
+		}
 		
-		N::FSSpecContents_Container queue = io::directory_contents( queue_dir );
+		spool.compact();
 		
-		std::for_each( queue.begin(),
-		               queue.end(),
-		               std::bind1st( plus::ptr_fun( ProcessMessage ), queue_dir ) );
+		const double elapsed = Now() - start;
+		
+		if ( !gMessages.empty() )
+		{
+			std::printf( "%u of %u messages sent (%u sessions) in %.2fs, %.0f messages/s\n",
+			             finished,
+			             unsigned( gMessages.size() ),
+			             unsigned( gConnections.size() ),
+			             elapsed,
+			             finished / elapsed );
+		}
 		
-		return 0;
+		return finished == gMessages.size() ? 0 : 1;
 	}
-
+	
 }
-
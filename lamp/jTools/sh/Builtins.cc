@@ -39,6 +39,7 @@
 #include "poseven/functions/write.hh"
 
 // sh
+#include "CommandHash.hh"
 #include "Options.hh"
 #include "PositionalParameters.hh"
 #include "Execution.hh"
@@ -458,6 +459,40 @@ namespace tool
 		return p7::exit_success;
 	}
 	
+	static p7::exit_t Builtin_Hash( int argc, char** argv )
+	{
+		if ( argc == 1 )
+		{
+			// $ hash
+			PrintCommands();
+			
+			return p7::exit_success;
+		}
+		
+		if ( std::strcmp( argv[ 1 ], "-r" ) == 0 )
+		{
+			// $ hash -r
+			ForgetCommands();
+			
+			return p7::exit_success;
+		}
+		
+		p7::exit_t result = p7::exit_success;
+		
+		while ( *++argv != NULL )
+		{
+			// $ hash foo
+			if ( FindBuiltin( *argv ) == NULL  &&  LookupCommand( *argv ).empty() )
+			{
+				more::perror( "sh: hash", *argv, "not found" );
+				
+				result = p7::exit_failure;
+			}
+		}
+		
+		return result;
+	}
+	
 	static p7::exit_t Builtin_PWD( int argc, char** argv )
 	{
 		char** args = argv;
@@ -622,6 +657,7 @@ namespace tool
 		{ "exec",    Builtin_Exec    },
 		{ "exit",    Builtin_Exit    },
 		{ "export",  Builtin_Export  },
+		{ "hash",    Builtin_Hash    },
 		{ "pwd",     Builtin_PWD     },
 		{ "set",     Builtin_Set     },
 		{ "unalias", Builtin_Unalias },
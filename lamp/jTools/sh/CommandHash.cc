@@ -0,0 +1,176 @@
+// ==============
+// CommandHash.cc
+// ==============
+
+#include "CommandHash.hh"
+
+// Standard C++
+#include <map>
+
+// Standard C/C++
+#include <cstring>
+
+// Standard C
+#include <stdlib.h>
+
+// POSIX
+#include <sys/stat.h>
+#include <unistd.h>
+
+// plus
+#include "plus/var_string.hh"
+
+// poseven
+#include "poseven/functions/write.hh"
+
+
+namespace tool
+{
+	
+	namespace p7 = poseven;
+	
+	
+	typedef std::map< plus::string, plus::string > StringMap;
+	
+	static StringMap gCommands;
+	
+	// The PATH the commands were found in
+	static plus::string gPath;
+	
+	static const char* GetPath()
+	{
+		const char* path = getenv( "PATH" );
+		
+		// The same default as execvp()
+		return path != NULL ? path : "/bin:/usr/bin";
+	}
+	
+	static bool IsFile( const char* path )
+	{
+		struct stat st;
+		
+		return stat( path, &st ) == 0  &&  S_ISREG( st.st_mode );
+	}
+	
+	static bool IsExecutable( const char* path )
+	{
+		return IsFile( path )  &&  access( path, X_OK ) == 0;
+	}
+	
+	/*
+		Only a command found in an absolute directory is hashed, since a
+		relative one depends on the current directory.
+		
+		If nothing on PATH can be executed, the first file that merely
+		exists is returned, unhashed, so that trying to run it fails with
+		EACCES (exit status 126) rather than "command not found" (127).
+	*/
+	
+	static plus::string SearchPath( const char* path, const char* name, bool& absolute )
+	{
+		plus::var_string file;
+		
+		plus::string not_executable;
+		
+		while ( true )
+		{
+			const char* end = std::strchr( path, ':' );
+			
+			if ( end == NULL )
+			{
+				end = path + std::strlen( path );
+			}
+			
+			// An empty directory is the current one.
+			
+			file.assign( path, end );
+			
+			if ( !file.empty() )
+			{
+				file += "/";
+			}
+			
+			file += name;
+			
+			if ( IsExecutable( file.c_str() ) )
+			{
+				absolute = path[ 0 ] == '/';
+				
+				return file;
+			}
+			
+			if ( not_executable.empty()  &&  IsFile( file.c_str() ) )
+			{
+				not_executable = file;
+			}
+			
+			if ( *end == '\0' )
+			{
+				break;
+			}
+			
+			path = end + 1;
+		}
+		
+		return not_executable;
+	}
+	
+	plus::string LookupCommand( const char* name )
+	{
+		if ( std::strchr( name, '/' ) )
+		{
+			return name;
+		}
+		
+		const char* path = GetPath();
+		
+		if ( gPath != path )
+		{
+			gCommands.clear();
+			
+			gPath = path;
+		}
+		
+		StringMap::const_iterator found = gCommands.find( name );
+		
+		if ( found != gCommands.end() )
+		{
+			return found->second;
+		}
+		
+		bool absolute = false;
+		
+		plus::string file = SearchPath( path, name, absolute );
+		
+		if ( absolute )
+		{
+			gCommands[ name ] = file;
+		}
+		
+		return file;
+	}
+	
+	bool ForgetCommand( const char* name )
+	{
+		return gCommands.erase( name ) != 0;
+	}
+	
+	void ForgetCommands()
+	{
+		gCommands.clear();
+	}
+	
+	void PrintCommands()
+	{
+		plus::var_string list;
+		
+		for ( StringMap::const_iterator it = gCommands.begin();  it != gCommands.end();  ++it )
+		{
+			list += it->second;
+			list += "\n";
+		}
+		
+		p7::write( p7::stdout_fileno, list );
+	}
+	
+}
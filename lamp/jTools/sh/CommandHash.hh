@@ -0,0 +1,29 @@
+// ==============
+// CommandHash.hh
+// ==============
+
+#ifndef COMMANDHASH_HH
+#define COMMANDHASH_HH
+
+// plus
+#include "plus/string.hh"
+
+
+namespace tool
+{
+	
+	// Returns the path of a command, searching PATH only the first time.
+	// A name with a slash is its own path.  Empty if not found.  A file
+	// found without execute permission is returned (but not hashed).
+	
+	plus::string LookupCommand( const char* name );
+	
+	bool ForgetCommand( const char* name );
+	
+	void ForgetCommands();
+	
+	void PrintCommands();
+	
+}
+
+#endif
@@ -7,6 +7,7 @@
 // Standard C++
 #include <algorithm>
 #include <map>
+#include <vector>
 
 // Standard C/C++
 #include <cctype>
@@ -14,10 +15,14 @@
 
 // Standard C
 #include <errno.h>
+#include <signal.h>
 #include <stdlib.h>
 
 // POSIX
 #include <fcntl.h>
+#ifndef __RELIX__
+#include <spawn.h>
+#endif
 #include <sys/stat.h>
 #include <unistd.h>
 
@@ -48,6 +53,7 @@
 
 // sh
 #include "Builtins.hh"
+#include "CommandHash.hh"
 #include "Options.hh"
 #include "PositionalParameters.hh"
 
@@ -104,6 +110,17 @@ const char* strsignal( int signo )
 #endif
 
 
+extern "C" char** environ;
+
+
+/*
+	Commands run by the shell are started with posix_spawn(), and builtins
+	in a pipeline run in a fork()ed copy of the shell.  MacRelix has vfork()
+	but neither of those, so there, commands are exec'ed from a vforked
+	child, which can't run a builtin in a pipeline, so it execs a new shell
+	to run it.
+*/
+
 namespace tool
 {
 	
@@ -446,6 +463,25 @@ namespace tool
 		_exit( errno == ENOENT ? 127 : 126 );  // Use _exit() to exit a forked but not exec'ed process.
 	}
 	
+	static void CloseOnExec( int fd )
+	{
+		p7::throw_posix_result( fcntl( fd, F_SETFD, FD_CLOEXEC ) );
+	}
+	
+	static void Pipe( int fds[ 2 ] )
+	{
+		p7::throw_posix_result( pipe( fds ) );
+		
+	#ifndef __RELIX__
+		
+		// A spawned command gets copies on 0 and 1, not the originals.
+		
+		CloseOnExec( fds[ 0 ] );
+		CloseOnExec( fds[ 1 ] );
+		
+	#endif
+	}
+	
 	
 	static p7::exit_t CallBuiltin( Builtin builtin, char** argv )
 	{
@@ -454,6 +490,8 @@ namespace tool
 		return builtin( argc, argv );
 	}
 	
+#ifdef __RELIX__
+	
 	static plus::string EscapeForShell( const char* word )
 	{
 		plus::var_string result;
@@ -484,6 +522,8 @@ namespace tool
 		return command;
 	}
 	
+#endif
+	
 	static bool CommandIsOnlyAssignments( char** argv )
 	{
 		//ASSERT( argv != NULL );
@@ -552,6 +592,331 @@ namespace tool
 		}
 	}
 	
+#ifndef __RELIX__
+	
+	static bool IsAssigned( const char* var, char** begin, char** end )
+	{
+		for ( ;  begin != end;  ++begin )
+		{
+			// Compare the names, including the '='
+			const std::size_t length = std::strchr( *begin, '=' ) - *begin + 1;
+			
+			if ( std::strncmp( var, *begin, length ) == 0 )
+			{
+				return true;
+			}
+		}
+		
+		return false;
+	}
+	
+	/*
+		Assignments before a spawned command's name go into its environment,
+		as ShiftEnvironmentVariables() would set them in a child.  On return,
+		argv points to the name.
+	*/
+	
+	static char** MakeEnvironment( char**& argv, std::vector< const char* >& envp )
+	{
+		char** assignments = argv;
+		
+		while ( std::strchr( *argv, '=' ) )
+		{
+			++argv;
+		}
+		
+		if ( argv == assignments )
+		{
+			return environ;
+		}
+		
+		for ( char** var = environ;  *var != NULL;  ++var )
+		{
+			if ( !IsAssigned( *var, assignments, argv ) )
+			{
+				envp.push_back( *var );
+			}
+		}
+		
+		for ( char** var = assignments;  var != argv;  ++var )
+		{
+			if ( !IsAssigned( *var, var + 1, argv ) )
+			{
+				envp.push_back( *var );
+			}
+		}
+		
+		envp.push_back( NULL );
+		
+		return const_cast< char** >( &envp[ 0 ] );
+	}
+	
+	// Files opened for a spawned command's redirections
+	
+	struct SpawnFiles
+	{
+		std::vector< int > opened;      // closed in the shell after spawning
+		std::vector< int > redirected;  // descriptors already redirected
+		
+		~SpawnFiles()
+		{
+			std::for_each( opened.begin(), opened.end(), std::ptr_fun( close ) );
+		}
+	};
+	
+	static void AddDup2( posix_spawn_file_actions_t& actions, int fd, int target, SpawnFiles& files )
+	{
+		p7::throw_errno( posix_spawn_file_actions_adddup2( &actions, fd, target ) );
+		
+		files.redirected.push_back( target );
+	}
+	
+	static int OpenForSpawn( int opened, SpawnFiles& files )
+	{
+		// Keep the file out of the way of any descriptor a redirection names.
+		
+		const int moved = fcntl( opened, F_DUPFD, 10 );
+		
+		close( opened );
+		
+		p7::throw_posix_result( moved );
+		
+		files.opened.push_back( moved );
+		
+		CloseOnExec( moved );
+		
+		return moved;
+	}
+	
+	/*
+		The shell opens a spawned command's files and checks descriptors to
+		be duplicated, so it can report errors as RedirectIO() does.  The
+		child only duplicates descriptors, in order.
+	*/
+	
+	static void AddRedirection( posix_spawn_file_actions_t&  actions,
+	                            const Sh::Redirection&       redirection,
+	                            SpawnFiles&                  files )
+	{
+		const char* param = redirection.param.c_str();
+		
+		int fd     = redirection.fd;
+		int second = -1;  // also redirected to the same file
+		
+		int file = -1;
+		
+		try
+		{
+			switch ( redirection.op )
+			{
+				case Sh::kRedirectInput:
+					file = OpenForSpawn( Open( param, O_RDONLY ), files );
+					break;
+				
+				case Sh::kRedirectInputHere:
+				case Sh::kRedirectInputHereStrippingTabs:
+					return;
+				
+				case Sh::kRedirectInputDuplicate:
+				case Sh::kRedirectOutputDuplicate:
+					file = gear::parse_unsigned_decimal( param );
+					
+					if ( std::find( files.redirected.begin(),
+					                files.redirected.end(),
+					                file ) == files.redirected.end() )
+					{
+						p7::throw_posix_result( fcntl( file, F_GETFD ) );
+					}
+					
+					break;
+				
+				case Sh::kRedirectInputAndOutput:
+					file = OpenForSpawn( Open( param, O_RDWR ), files );
+					
+					if ( fd == -1 )
+					{
+						fd     = 0;
+						second = 1;
+					}
+					
+					break;
+				
+				case Sh::kRedirectOutput:
+					if ( GetOption( kOptionNonClobberingRedirection ) )
+					{
+						file = OpenForSpawn( OpenNoClobber( param ), files );
+						
+						break;
+					}
+					// else fall through
+					
+				case Sh::kRedirectOutputClobbering:
+					file = OpenForSpawn( Open( param, O_WRONLY | O_CREAT | O_TRUNC ), files );
+					break;
+				
+				case Sh::kRedirectOutputAppending:
+					file = OpenForSpawn( Open( param, O_WRONLY | O_APPEND | O_CREAT ), files );
+					break;
+				
+				case Sh::kRedirectOutputAndError:
+					file = OpenForSpawn( Open( param, O_WRONLY | O_CREAT | O_TRUNC ), files );
+					
+					fd     = 1;
+					second = 2;
+					break;
+			}  // switch
+		}
+		catch ( const p7::errno_t& errnum )
+		{
+			more::perror( "sh", param, errnum );
+			
+			throw;
+		}
+		
+		AddDup2( actions, file, fd, files );
+		
+		if ( second >= 0 )
+		{
+			AddDup2( actions, file, second, files );
+		}
+	}
+	
+	static void SetJobControl( posix_spawnattr_t& attr, p7::pid_t pgid )
+	{
+		// The same as SetupChildProcess(), except for tcsetpgrp()
+		
+		sigset_t defaults;
+		
+		sigemptyset( &defaults );
+		
+		sigaddset( &defaults, SIGINT  );
+		sigaddset( &defaults, SIGQUIT );
+		sigaddset( &defaults, SIGTSTP );
+		sigaddset( &defaults, SIGTTIN );
+		sigaddset( &defaults, SIGTTOU );
+		
+		posix_spawnattr_setsigdefault( &attr, &defaults );
+		
+		posix_spawnattr_setpgroup( &attr, pgid );
+		
+		posix_spawnattr_setflags( &attr, POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETPGROUP );
+	}
+	
+	static int SpawnCommand( pid_t&                             pid,
+	                         char**                             argv,
+	                         const posix_spawn_file_actions_t&  actions,
+	                         const posix_spawnattr_t&           attr,
+	                         char**                             env )
+	{
+		const char* name = argv[ 0 ];
+		
+		plus::string file = LookupCommand( name );
+		
+		int error = file.empty() ? ENOENT : posix_spawnp( &pid, file.c_str(), &actions, &attr, argv, env );
+		
+		// If a hashed command has gone, look for it again.
+		
+		if ( error == ENOENT  &&  ForgetCommand( name ) )
+		{
+			file = LookupCommand( name );
+			
+			error = file.empty() ? ENOENT : posix_spawnp( &pid, file.c_str(), &actions, &attr, argv, env );
+		}
+		
+		return error;
+	}
+	
+	/*
+		Spawns a command with its input and output (unless -1) on the given
+		descriptors, and returns its pid.  A command that can't be spawned
+		returns 0, and sets status.
+	*/
+	
+	static p7::pid_t Spawn( char**                                 argv,
+	                        const std::vector< Sh::Redirection >&  redirections,
+	                        int                                    in,
+	                        int                                    out,
+	                        p7::pid_t                              pgid,
+	                        p7::wait_t&                            status )
+	{
+		std::vector< const char* > envp;
+		
+		char** env = MakeEnvironment( argv, envp );
+		
+		const char* file = argv[ 0 ];
+		
+		posix_spawn_file_actions_t actions;
+		posix_spawnattr_t          attr;
+		
+		posix_spawn_file_actions_init( &actions );
+		posix_spawnattr_init( &attr );
+		
+		int error = 0;
+		
+		pid_t pid = 0;
+		
+		try
+		{
+			SpawnFiles files;
+			
+			if ( in >= 0 )
+			{
+				AddDup2( actions, in, 0, files );
+			}
+			
+			if ( out >= 0 )
+			{
+				AddDup2( actions, out, 1, files );
+			}
+			
+			typedef std::vector< Sh::Redirection >::const_iterator Iter;
+			
+			for ( Iter it = redirections.begin();  it != redirections.end();  ++it )
+			{
+				AddRedirection( actions, *it, files );
+			}
+			
+			if ( GetOption( kOptionMonitor ) )
+			{
+				SetJobControl( attr, pgid );
+			}
+			
+			error = SpawnCommand( pid, argv, actions, attr, env );
+			
+			if ( error != 0 )
+			{
+				const char* error_msg = error == ENOENT ? "command not found" : std::strerror( error );
+				
+				more::perror( "sh", file, error_msg );
+			}
+		}
+		catch ( const p7::errno_t& )
+		{
+			error = -1;  // already reported
+		}
+		
+		posix_spawnattr_destroy( &attr );
+		posix_spawn_file_actions_destroy( &actions );
+		
+		if ( error != 0 )
+		{
+			status = wait_from_exit( error ==     -1 ? p7::exit_failure
+			                       : error == ENOENT ? p7::exit_t( 127 )
+			                       :                   p7::exit_t( 126 ) );
+			
+			return p7::pid_t( 0 );
+		}
+		
+		if ( GetOption( kOptionMonitor ) )
+		{
+			tcsetpgrp( 0, pgid != 0 ? pgid : pid );
+		}
+		
+		return p7::pid_t( pid );
+	}
+	
+#endif
+	
 	static p7::wait_t ExecuteCommand( const Command& command )
 	{
 		Sh::StringArray argvec( command.args );
@@ -572,6 +937,22 @@ namespace tool
 				return wait_from_exit( CallBuiltin( builtin, argv ) );  // wait from exit
 			}
 			
+		#ifndef __RELIX__
+			
+			if ( builtin == NULL )
+			{
+				p7::wait_t status;
+				
+				if ( Spawn( argv, command.redirections, -1, -1, p7::pid_t( 0 ), status ) )
+				{
+					status = p7::wait();
+				}
+				
+				return status;
+			}
+			
+		#endif
+			
 			// This variable is set before and examined after a longjmp(), so it
 			// needs to be volatile to make sure it doesn't wind up in a register
 			// and subsequently clobbered.
@@ -669,11 +1050,19 @@ namespace tool
 			
 			if ( Builtin builtin = FindBuiltin( argv[ 0 ] ) )
 			{
+			#ifdef __RELIX__
+				
 				plus::string subshell = MakeShellCommandFromBuiltin( argv );
 				
 				const char* subshell_argv[] = { "/bin/sh", "-c", subshell.c_str(), NULL };
 				
 				Exec( subshell_argv );
+				
+			#else
+				
+				return wait_from_exit( CallBuiltin( builtin, argv ) );
+				
+			#endif
 			}
 			
 			Exec( argv );
@@ -703,6 +1092,81 @@ namespace tool
 		}
 	}
 	
+	static char** CommandName( char** argv )
+	{
+		while ( *argv != NULL  &&  std::strchr( *argv, '=' ) )
+		{
+			++argv;
+		}
+		
+		return argv;
+	}
+	
+	/*
+		Starts a command in a pipeline, with its input and output (unless -1)
+		on the given pipe ends, and returns its pid.  The child closes the
+		unused end of the next pipe.  A command that can't be started returns
+		0, and sets status.
+	*/
+	
+	static p7::pid_t LaunchFromPipeline( const Command&  command,
+	                                     int             in,
+	                                     int             out,
+	                                     int             unused,
+	                                     p7::pid_t       pgid,
+	                                     p7::wait_t&     status )
+	{
+	#ifndef __RELIX__
+		
+		Sh::StringArray argvec( command.args );
+		
+		char** argv = argvec.GetPointer();
+		
+		const char* name = *CommandName( argv );
+		
+		if ( name != NULL  &&  FindBuiltin( name ) == NULL )
+		{
+			return Spawn( argv, command.redirections, in, out, pgid, status );
+		}
+		
+		// A builtin runs in a copy of the shell, which vfork() doesn't make.
+		
+		p7::pid_t pid = p7::pid_t( p7::throw_posix_result( fork() ) );
+		
+	#else
+		
+		p7::pid_t pid = POSEVEN_VFORK();
+		
+	#endif
+		
+		if ( pid == 0 )
+		{
+			if ( in >= 0 )
+			{
+				dup2( in, 0 );
+				close( in );
+			}
+			
+			if ( out >= 0 )
+			{
+				dup2( out, 1 );
+				close( out );
+			}
+			
+			if ( unused >= 0 )
+			{
+				close( unused );
+			}
+			
+			SetupChildProcess( pgid );
+			
+			// exec or exit
+			ExecuteCommandAndExitFromPipeline( command );
+		}
+		
+		return pid;
+	}
+	
 	static p7::wait_t ExecutePipeline( const Pipeline& pipeline )
 	{
 		std::vector< Command > commands( pipeline.commands.size() );
@@ -731,34 +1195,26 @@ namespace tool
 		
 		int pipes[ 2 ];
 		
-		pipe( pipes );  // pipe between first two processes
+		Pipe( pipes );  // pipe between first two processes
 		
 		int reading = pipes[ 0 ];
 		int writing = pipes[ 1 ];
 		
+		// The status of a command that couldn't be started
+		p7::wait_t status = wait_from_exit( p7::exit_failure );
+		
 		// The first command in the pipline
-		p7::pid_t first = POSEVEN_VFORK();
+		p7::pid_t first = LaunchFromPipeline( *command, -1, writing, reading, p7::pid_t( 0 ), status );
 		
-		if ( first == 0 )
-		{
-			// Redirect output to write-end of pipe
-			dup2( writing, 1 );
-			
-			// Close duped write-end and unused read-end
-			close( writing );     // we duped this, close it
-			close( pipes[ 0 ] );  // we don't read from this pipe, close it
-			
-			SetupChildProcess();
-			
-			// exec or exit
-			ExecuteCommandAndExitFromPipeline( commands.front() );
-		}
+		int processes = first != 0;
+		
+		p7::pid_t pgid = first;
 		
 		// previous pipe fd's are saved in 'reading' and 'writing'.
 		
 		while ( ++command != commands.end() - 1 )
 		{
-			pipe( pipes );  // next pipe
+			Pipe( pipes );  // next pipe
 			
 			// Close previous write-end
 			close( writing );
@@ -766,27 +1222,16 @@ namespace tool
 			writing = pipes[ 1 ];  // write-end of next pipe
 			
 			// Middle command in the pipeline (not first or last)
-			p7::pid_t middle = POSEVEN_VFORK();
+			p7::pid_t middle = LaunchFromPipeline( *command, reading, writing, pipes[ 0 ], pgid, status );
 			
-			if ( middle == 0 )
+			processes += middle != 0;
+			
+			if ( pgid == 0 )
 			{
-				// Redirect input from read-end of previous pipe
-				dup2( reading, 0 );
-				
-				// Redirect output to write-end of next pipe
-				dup2( writing, 1 );
-				
-				// Close duped pipe-in, duped pipe-out, and unused read-end
-				close( reading );     // we duped this, close it
-				close( writing );     // we duped this, close it
-				close( pipes[ 0 ] );  // we don't read from this pipe, close it
-				
-				SetupChildProcess( first );
-				
-				ExecuteCommandAndExitFromPipeline( *command );
+				pgid = middle;
 			}
 			
-			// Child is forked, so we're done reading
+			// Child is started, so we're done reading
 			close( reading );
 			
 			reading = pipes[ 0 ];  // read-end of next pipe
@@ -797,26 +1242,14 @@ namespace tool
 		// Close previous write-end
 		close( writing );
 		
-		p7::pid_t last = POSEVEN_VFORK();
+		p7::pid_t last = LaunchFromPipeline( *command, reading, -1, -1, pgid, status );
 		
-		if ( last == 0 )
-		{
-			// Redirect input from read-end of previous pipe
-			dup2( reading, 0 );
-			
-			close( reading );     // we duped this, close it
-			
-			SetupChildProcess( first );
-			
-			ExecuteCommandAndExitFromPipeline( *command );
-		}
+		processes += last != 0;
 		
-		// Child is forked, so we're done reading
+		// Child is started, so we're done reading
 		close( reading );
 		
-		int processes = commands.size();
-		
-		p7::wait_t wait_status = p7::wait_t( -1 );
+		p7::wait_t wait_status = last != 0 ? p7::wait_t( -1 ) : status;
 		
 		while ( processes )
 		{
@@ -902,9 +1335,60 @@ namespace tool
 		return status;
 	}
 	
+	/*
+		Command lines are tokenized once and kept, since scripts and sourced
+		files run the same lines over and over.  Expansion depends on the
+		shell's parameters, so it's still done each time a line runs.
+	*/
+	
+	typedef std::map< plus::string, List > ParsedCmdLines;
+	
+	static ParsedCmdLines gParsedCmdLines;
+	
+	static const std::size_t kMaxParsedCmdLines = 1024;
+	
+	// The number of ExecuteCmdLine() calls running, e.g. for '.'
+	static unsigned gCmdLineDepth = 0;
+	
+	class CmdLineScope
+	{
+		public:
+			CmdLineScope()   { ++gCmdLineDepth; }
+			~CmdLineScope()  { --gCmdLineDepth; }
+	};
+	
+	static const List& ParseCmdLine( const plus::string& cmd, List& uncached )
+	{
+		ParsedCmdLines::const_iterator found = gParsedCmdLines.find( cmd );
+		
+		if ( found != gParsedCmdLines.end() )
+		{
+			return found->second;
+		}
+		
+		// Lines running further up the stack are in use, so the cache is
+		// only emptied between top-level lines.
+		
+		if ( gParsedCmdLines.size() >= kMaxParsedCmdLines )
+		{
+			if ( gCmdLineDepth > 0 )
+			{
+				return uncached = Sh::Tokenization( cmd );
+			}
+			
+			gParsedCmdLines.clear();
+		}
+		
+		return gParsedCmdLines[ cmd ] = Sh::Tokenization( cmd );
+	}
+	
 	p7::wait_t ExecuteCmdLine( const plus::string& cmd )
 	{
-		List list = Sh::Tokenization( cmd );
+		List uncached;
+		
+		const List& list = ParseCmdLine( cmd, uncached );
+		
+		CmdLineScope scope;
 		
 		p7::wait_t status = ExecuteList( list );
 		
@@ -0,0 +1,45 @@
+#!/usr/bin/perl
+
+# Times pipelines with a builtin stage and with external ones only.
+#
+#   bench-pipelines.pl [sh ...]
+
+use warnings;
+use strict;
+
+use Time::HiRes qw( time );
+
+my $count = 500;
+
+my %scripts =
+(
+	builtin  => "echo foo | cat > /dev/null\n",
+	external => "/bin/echo foo | cat > /dev/null\n",
+	three    => "/bin/echo foo | tr a-z A-Z | cat > /dev/null\n",
+);
+
+my @shells = @ARGV ? @ARGV : "/bin/sh";
+
+my $script = "/tmp/bench-pipelines.$$";
+
+for my $name ( sort keys %scripts )
+{
+	open my $out, ">", $script or die "Can't write $script: $!\n";
+	
+	print $out $scripts{ $name } x $count;
+	
+	close $out;
+	
+	for my $sh ( @shells )
+	{
+		my $start = time;
+		
+		system( $sh, $script ) == 0 or die "$sh failed\n";
+		
+		my $elapsed = time - $start;
+		
+		printf "%-8s  %-24s  %6.1f us/pipeline\n", $name, $sh, $elapsed / $count * 1e6;
+	}
+}
+
+unlink $script;
@@ -0,0 +1,213 @@
+#!/usr/bin/perl
+
+# Measures messages per second accepted by an SMTP server.  Each message
+# accepted with a 250 has its Message-ID logged, and --verify checks that
+# every one of them is in the queue, e.g. after the server was killed with
+# SIGKILL partway through a run.  Recipients are sink@ each of the -d
+# domains in turn (default localhost).
+#
+#   smtp-load.pl [-c clients] [-n messages] [-m per-connection] [-s size] [-l log] [-d domain,...] host:port
+#   smtp-load.pl --verify log queue-dir
+
+use warnings;
+use strict;
+
+use IO::Socket::INET;
+use Time::HiRes qw( time );
+
+my $clients  = 8;
+my $count    = 4000;
+my $per_conn = 10;
+my $size     = 2000;
+my $log      = "smtp-load.log";
+my @domains  = ( "localhost" );
+
+my $usage = "Usage: smtp-load.pl [-c clients] [-n messages] [-m per-connection] [-s size] [-l log] [-d domain,...] host:port\n"
+          . "       smtp-load.pl --verify log queue-dir\n";
+
+if ( @ARGV  &&  $ARGV[0] eq "--verify" )
+{
+	@ARGV == 3 or die $usage;
+
+	exit verify( $ARGV[1], $ARGV[2] );
+}
+
+while ( @ARGV  &&  $ARGV[0] =~ /^-/ )
+{
+	my $option = shift;
+
+	$option eq "-c" and $clients  = shift, next;
+	$option eq "-n" and $count    = shift, next;
+	$option eq "-m" and $per_conn = shift, next;
+	$option eq "-s" and $size     = shift, next;
+	$option eq "-l" and $log      = shift, next;
+	$option eq "-d" and @domains  = split( /,/, shift ), next;
+
+	die $usage;
+}
+
+@ARGV == 1 or die $usage;
+
+my $address = shift;
+
+sub expect
+{
+	my ( $socket, $code ) = @_;
+
+	my $reply = <$socket>;
+
+	defined $reply or die "connection closed\n";
+
+	$reply =~ /^$code/ or die "expected $code, got $reply";
+}
+
+sub command
+{
+	my ( $socket, $command, $code ) = @_;
+
+	print $socket "$command\r\n";
+
+	expect( $socket, $code );
+}
+
+# Returns the number of messages accepted.
+
+sub client
+{
+	my ( $n, $log_fh ) = @_;
+
+	my $body = ( "x" x 76 . "\r\n" ) x ( $size / 78 );
+
+	my $sent = 0;
+
+	eval
+	{
+		while ( $sent < $n )
+		{
+			my $socket = IO::Socket::INET->new( PeerAddr => $address ) or die "$address: $!\n";
+
+			$socket->autoflush( 1 );
+
+			expect( $socket, 220 );
+
+			command( $socket, "HELO smtp-load", 250 );
+
+			for ( 1 .. $per_conn )
+			{
+				last if $sent == $n;
+
+				my $id = sprintf "<%d.%d.%.6f\@smtp-load>", $$, $sent, time;
+
+				my $domain = $domains[ $sent % @domains ];
+
+				command( $socket, "MAIL FROM:<load\@localhost>", 250 );
+				command( $socket, "RCPT TO:<sink\@$domain>",     250 );
+				command( $socket, "DATA",                        354 );
+
+				print $socket "Message-ID: $id\r\nSubject: load\r\n\r\n$body.\r\n";
+
+				expect( $socket, 250 );
+
+				syswrite $log_fh, "$id\n";
+
+				++$sent;
+			}
+
+			command( $socket, "QUIT", 221 );
+		}
+	};
+
+	warn "client $$: $@" if $@;
+
+	return $sent;
+}
+
+open my $log_fh, ">>", $log or die "$log: $!\n";
+
+my $start = time;
+
+my @pids;
+
+for my $i ( 1 .. $clients )
+{
+	my $pid = fork;
+
+	defined $pid or die "fork: $!\n";
+
+	if ( $pid == 0 )
+	{
+		my $sent = client( int( $count / $clients ), $log_fh );
+
+		exit( $sent == int( $count / $clients ) ? 0 : 1 );
+	}
+
+	push @pids, $pid;
+}
+
+my $failed = 0;
+
+for my $pid ( @pids )
+{
+	waitpid( $pid, 0 );
+
+	++$failed if $? != 0;
+}
+
+my $elapsed = time - $start;
+
+my $accepted = int( $count / $clients ) * ( $clients - $failed );
+
+printf "%d clients:  %7.0f messages/s%s\n", $clients,
+                                            $accepted / $elapsed,
+                                            $failed ? "  ($failed clients stopped early)" : "";
+
+exit( $failed ? 1 : 0 );
+
+sub verify
+{
+	my ( $log, $queue ) = @_;
+
+	my %queued;
+
+	open my $index, "<", "$queue/index" or die "$queue/index: $!\n";
+
+	while ( <$index> )
+	{
+		my ( $name, $size ) = /^(\S+) (\d+)$/ or next;
+
+		next if ( -s "$queue/$name" || 0 ) != $size;  # incomplete or delivered
+
+		open my $message, "<", "$queue/$name" or next;
+
+		while ( <$message> )
+		{
+			if ( /^Message-ID: (\S+)/ )
+			{
+				$queued{ $1 } = 1;
+
+				last;
+			}
+		}
+	}
+
+	open my $log_fh, "<", $log or die "$log: $!\n";
+
+	my ( $acked, $missing ) = ( 0, 0 );
+
+	while ( my $id = <$log_fh> )
+	{
+		chomp $id;
+
+		++$acked;
+
+		next if $queued{ $id };
+
+		++$missing;
+
+		print "missing: $id\n";
+	}
+
+	printf "%d accepted, %d queued, %d missing\n", $acked, scalar keys %queued, $missing;
+
+	return $missing ? 1 : 0;
+}
@@ -4,7 +4,6 @@
  */
 
 // Standard C++
-#include <algorithm>
 #include <list>
 #include <memory>
 #include <vector>
@@ -20,6 +19,7 @@
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
+#include <unistd.h>
 
 // iota
 #include "iota/strings.hh"
@@ -28,46 +28,54 @@
 #include "gear/inscribe_decimal.hh"
 
 // plus
+#include "plus/var_string.hh"
 #include "plus/string/concat.hh"
 
 // text-input
 #include "text_input/feed.hh"
 #include "text_input/get_line_from_feed.hh"
 
-// Io
-#include "io/io.hh"
-
 // poseven
 #include "poseven/extras/fd_reader.hh"
-#include "poseven/extras/spew.hh"
-#include "poseven/functions/mkdir.hh"
+#include "poseven/extras/write_all.hh"
+#include "poseven/functions/openat.hh"
+#include "poseven/functions/unlinkat.hh"
 #include "poseven/functions/write.hh"
 #include "poseven/types/exit_t.hh"
 
-// pfiles
-#include "pfiles/common.hh"
+// MailSpool
+#include "MailSpool/Spool.hh"
 
 // Orion
+#include "Orion/get_options.hh"
 #include "Orion/Main.hh"
 
 
+/*
+	smtpd [--queue dir]
+	
+	Each message is queued as described in MailSpool/Spool.hh, and "250" is sent
+	only once it's on disk.  Messages arriving together over several
+	connections share the syncing.
+*/
+
+
 namespace tool
 {
 	
 	namespace n = nucleus;
 	namespace p7 = poseven;
+	namespace o = orion;
 	
-	using namespace io::path_descent_operators;
 	
-	
-	// E.g. "19840124.183000"
+	// E.g. "19840124.183000-1234-1"
 	static plus::string DateFormattedForFilename( const time_t& now, int serial )
 	{
 		const struct tm* t = gmtime( &now );
 		
-		plus::string result;
+		plus::var_string result;
 		
-		char* p = result.reset( STRLEN( "YYYYMMDD.hhmmss-nn" ) );
+		char* p = result.reset( STRLEN( "YYYYMMDD.hhmmss-" ) );
 		
 		gear::fill_unsigned_decimal( t->tm_year + 1900, &p[0], 4 );
 		gear::fill_unsigned_decimal( t->tm_mon  +    1, &p[4], 2 );
@@ -81,7 +89,11 @@ namespace tool
 		
 		p[15] = '-';
 		
-		gear::fill_unsigned_decimal( serial, &p[16], 2 );
+		// Other smtpd processes may be naming messages in the same second.
+		
+		result += gear::inscribe_unsigned_decimal( getpid() );
+		result += "-";
+		result += gear::inscribe_unsigned_decimal( serial );
 		
 		return result;
 	}
@@ -125,30 +137,20 @@ namespace tool
 		return fromLine.substr( STRLEN( "MAIL FROM:" ) );
 	}
 	
-	static void CreateOneLiner( const plus::string& path, const plus::string& line )
-	{
-		plus::string output = line + "\n";
-		
-		p7::spew( p7::open( path, p7::o_wronly | p7::o_creat | p7::o_excl ), output );
-	}
+	static const char* gQueueDirectory = "/var/spool/mail/queue";
 	
-	static void CreateDestinationFile( const plus::string& dest_dir_path, const plus::string& dest )
-	{
-		CreateOneLiner( dest_dir_path / dest,
-		                dest );
-	}
-	
-	static const char* QueueDirectory()
-	{
-		return "/var/spool/mail/queue";
-	}
+	static std::auto_ptr< MailSpool::Spool > gSpool;
 	
 	
 	class PartialMessage
 	{
 		private:
-			plus::string          dir;
+			plus::string          name;
 			n::owned< p7::fd_t >  out;
+			plus::var_string      buffer;  // not yet appended
+			off_t                 size;
+			
+			void Flush();
 		
 		private:
 			// non-copyable
@@ -156,44 +158,67 @@ namespace tool
 			PartialMessage& operator=( const PartialMessage& );
 		
 		public:
-			PartialMessage( const plus::string& dir );
+			PartialMessage( const plus::string& name );
 			
 			~PartialMessage();
 			
-			const plus::string& Dir() const  { return dir; }
+			const plus::string& Name() const  { return name; }
+			
+			void Write( const plus::string& data )  { buffer += data; }
+			
 			void WriteLine( const plus::string& line );
 			
+			off_t Complete();
+			
 			void Finished();
 	};
 	
-	PartialMessage::PartialMessage( const plus::string& dirLoc )
+	PartialMessage::PartialMessage( const plus::string& messageName )
 	:
-		dir( dirLoc )
+		name( messageName ),
+		out( p7::openat( gSpool->dir(), name, p7::o_wronly | p7::o_creat | p7::o_excl | p7::o_append, p7::_400 ) ),
+		size( 0 )
 	{
-		p7::mkdir( dir );
-		
-		out = p7::open( dir / "Message", p7::o_wronly | p7::o_creat | p7::o_excl, p7::_400 );
 	}
 	
 	PartialMessage::~PartialMessage()
 	{
-		if ( !dir.empty() )
+		if ( !name.empty() )
 		{
-			io::recursively_delete_directory( dir );
+			(void) unlinkat( gSpool->dir(), name.c_str(), 0 );
 		}
 	}
 	
+	void PartialMessage::Flush()
+	{
+		p7::write_all( out, buffer.data(), buffer.size() );
+		
+		size += buffer.size();
+		
+		buffer.clear();
+	}
+	
 	void PartialMessage::WriteLine( const plus::string& line )
 	{
-		//static unsigned int lastFlushKBytes = 0;
-		plus::string terminatedLine = line + "\r\n";
+		buffer += line;
+		buffer += "\r\n";
+		
+		if ( buffer.size() >= 64 * 1024 )
+		{
+			Flush();
+		}
+	}
+	
+	off_t PartialMessage::Complete()
+	{
+		Flush();
 		
-		p7::write( out, terminatedLine );
+		return size;
 	}
 	
 	void PartialMessage::Finished()
 	{
-		dir.reset();
+		name.reset();
 	}
 	
 	
@@ -206,44 +231,31 @@ namespace tool
 	bool dataMode = false;
 	
 	
-	class oneliner_creator
+	static void WriteEnvelope( PartialMessage& message )
 	{
-		private:
-			const plus::string& its_dir;
+		plus::var_string envelope = "From " + myFrom + "\n";
 		
-		public:
-			oneliner_creator( const plus::string& dir ) : its_dir( dir )
-			{
-			}
-			
-			void operator()( const plus::string& line );
-	};
-	
-	void oneliner_creator::operator()( const plus::string& line )
-	{
-		CreateOneLiner( its_dir / line,
-		                line );
+		typedef std::list< plus::string >::const_iterator Iter;
+		
+		for ( Iter it = myTo.begin();  it != myTo.end();  ++it )
+		{
+			envelope += "To ";
+			envelope += *it;
+			envelope += "\n";
+		}
+		
+		envelope += "\n";
+		
+		message.Write( envelope );
 	}
 	
 	static void QueueMessage()
 	{
-		const plus::string& dir = myMessage->Dir();
-		
-		// Create the Destinations subdirectory.
-		plus::string destinations_dir = dir / "Destinations";
+		const off_t size = myMessage->Complete();
 		
-		p7::mkdir( destinations_dir );
-		
-		// Create the destination files.
-		std::for_each( myTo.begin(),
-		               myTo.end(),
-		               oneliner_creator( destinations_dir ) );
-		
-		// Create the Return-Path file.
-		// Write this last so the sender won't delete the message prematurely.
-		CreateOneLiner( dir / "Return-Path", 
-		                myFrom );
+		// The record follows the whole message, and the reply follows both.
 		
+		gSpool->commit( gSpool->append( myMessage->Name(), size ) );
 	}
 	
 	static void DoCommand( const plus::string& command )
@@ -257,6 +269,7 @@ namespace tool
 		else if ( word == "MAIL" )
 		{
 			myFrom = GetReversePath( command );
+			myTo.clear();
 			
 			p7::write( p7::stdout_fileno, STR_LEN( "250 Sender ok, probably"  "\r\n" ) );
 		}
@@ -268,9 +281,11 @@ namespace tool
 		}
 		else if ( word == "DATA" )
 		{
-			myMessage.reset( new PartialMessage( QueueDirectory() / MakeMessageName() ) );
+			myMessage.reset( new PartialMessage( MakeMessageName() ) );
 			dataMode  = true;
 			
+			WriteEnvelope( *myMessage );
+			
 			p7::write( p7::stdout_fileno, STR_LEN( "354 I'm listening"  "\r\n" ) );
 		}
 		else if ( word == "HELO" )
@@ -307,12 +322,8 @@ namespace tool
 	
 	static void DoData( const plus::string& data )
 	{
-		myMessage->WriteLine( data );
-		
 		if ( data == "." )
 		{
-			p7::write( p7::stderr_fileno, STR_LEN( "done\n" ) );
-			
 			dataMode = false;
 			
 			bool queued = false;
@@ -334,10 +345,12 @@ namespace tool
 			p7::write( p7::stdout_fileno, message, std::strlen( message ) );
 			
 			myMessage.reset();
+			
+			myTo.clear();
 		}
 		else
 		{
-			//
+			myMessage->WriteLine( data );
 		}
 	}
 	
@@ -355,6 +368,12 @@ namespace tool
 	
 	int Main( int argc, char** argv )
 	{
+		o::bind_option_to_variable( "--queue", gQueueDirectory );
+		
+		o::get_options( argc, argv );
+		
+		gSpool.reset( new MailSpool::Spool( gQueueDirectory ) );
+		
 		sockaddr_in peer;
 		socklen_t peerlen = sizeof peer;
 		
@@ -400,6 +419,6 @@ namespace tool
 		
 		return 0;
 	}
-
+	
 }
 
@@ -3,49 +3,457 @@
  *	======
  */
 
-// Iota
-#include "iota/strings.hh"
+// Standard C++
+#include <algorithm>
+#include <vector>
+
+// Standard C
+#include <errno.h>
+#include <stdlib.h>
+
+// POSIX
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 // poseven
+#include "poseven/extras/write_all.hh"
 #include "poseven/functions/open.hh"
+#include "poseven/functions/perror.hh"
 #include "poseven/functions/read.hh"
-#include "poseven/functions/write.hh"
+#include "poseven/types/errno_t.hh"
 
 // Orion
+#include "Orion/get_options.hh"
 #include "Orion/Main.hh"
 
 
+/*
+	tee [-a] [file ...]
+	
+	Standard input is copied to standard output and to each file.  A file
+	that can't be opened or written is reported and dropped, and the rest
+	carry on; the exit status is 1 if any of them failed.
+	
+	On Linux, when standard input and output are both pipes, the data
+	never passes through user space:  tee(2) duplicates it into a scratch
+	pipe which is spliced into each file in turn, and finally it's spliced
+	from standard input to standard output.  Whenever that can't deliver
+	a whole chunk to every output, the chunk (which is still in standard
+	input) is read and written the ordinary way.
+*/
+
 namespace tool
 {
 	
+	namespace n = nucleus;
 	namespace p7 = poseven;
+	namespace o = orion;
 	
-	int Main( int argc, char** argv )
+	
+	static const char* const program = "tee";
+	
+	static const size_t buffer_size = 256 * 1024;
+	
+	
+	struct Output
+	{
+		const char*  name;
+		p7::fd_t     fd;
+		bool         failed;
+		bool         spliceable;
+		size_t       delivered;  // of the current chunk
+		
+		Output( const char* n, p7::fd_t f )
+		:
+			name( n ),
+			fd( f ),
+			failed(),
+			spliceable( true ),
+			delivered()
+		{
+		}
+	};
+	
+	typedef std::vector< Output > Outputs;
+	
+	
+	static int exit_status = 0;
+	
+	static void fail( Output& output, int errnum )
+	{
+		p7::perror( program, output.name, errnum );
+		
+		output.failed = true;
+		
+		exit_status = 1;
+	}
+	
+	static bool any_live( const Outputs& outputs )
+	{
+		for ( size_t i = 0;  i < outputs.size();  ++i )
+		{
+			if ( !outputs[ i ].failed )
+			{
+				return true;
+			}
+		}
+		
+		return false;
+	}
+	
+	static void write_rest( Output& output, const char* buffer, size_t n )
+	{
+		if ( output.failed  ||  output.delivered >= n )
+		{
+			return;
+		}
+		
+		try
+		{
+			p7::write_all( output.fd, buffer + output.delivered, n - output.delivered );
+		}
+		catch ( const p7::errno_t& err )
+		{
+			fail( output, err );
+		}
+	}
+	
+	static void write_all_rest( Outputs& outputs, const char* buffer, size_t n )
+	{
+		for ( size_t i = 0;  i < outputs.size();  ++i )
+		{
+			write_rest( outputs[ i ], buffer, n );
+			
+			outputs[ i ].delivered = 0;
+		}
+	}
+	
+	static void copy_buffered( Outputs& outputs, char* buffer )
+	{
+		while ( const ssize_t n = p7::read( p7::stdin_fileno, buffer, buffer_size ) )
+		{
+			write_all_rest( outputs, buffer, n );
+			
+			if ( !any_live( outputs ) )
+			{
+				break;
+			}
+		}
+	}
+	
+#ifdef __linux__
+
+	static bool is_pipe( int fd )
+	{
+		struct stat sb;
+		
+		return fstat( fd, &sb ) == 0  &&  S_ISFIFO( sb.st_mode );
+	}
+	
+	static bool is_unsupported( int error )
+	{
+		return error == EINVAL  ||  error == ENOSYS  ||  error == EOPNOTSUPP;
+	}
+	
+	// Reads exactly n bytes, all of which are known to be waiting in the pipe.
+	
+	static void read_exactly( int fd, char* buffer, size_t n )
 	{
-		// Check for correct number of args
-		if ( argc != 2 )
+		for ( size_t n_read = 0;  n_read < n;  )
 		{
-			p7::write( p7::stderr_fileno, STR_LEN( "tee: needs one argument\n" ) );
+			n_read += p7::read( p7::fd_t( fd ), buffer + n_read, n - n_read );
+		}
+	}
+	
+	class Scratch
+	{
+		private:
+			int its_reader;
+			int its_writer;
+			
+			// non-copyable
+			Scratch           ( const Scratch& );
+			Scratch& operator=( const Scratch& );
+			
+		public:
+			Scratch() : its_reader( -1 ), its_writer( -1 )
+			{
+				int fds[ 2 ];
+				
+				if ( pipe( fds ) == 0 )
+				{
+					its_reader = fds[ 0 ];
+					its_writer = fds[ 1 ];
+					
+				#ifdef F_SETPIPE_SZ
+					
+					// Room for a whole chunk, if we can have it
+					
+					(void) fcntl( its_writer, F_SETPIPE_SZ, buffer_size );
+					
+				#endif
+				}
+			}
+			
+			~Scratch()
+			{
+				if ( its_reader >= 0 )
+				{
+					close( its_reader );
+					close( its_writer );
+				}
+			}
+			
+			bool opened() const  { return its_reader >= 0; }
+			
+			int reader() const  { return its_reader; }
+			int writer() const  { return its_writer; }
+	};
+	
+	// Moves all n bytes in the scratch pipe to the output, or discards them.
+	
+	static void drain( Scratch& scratch, Output& output, size_t n, char* buffer )
+	{
+		output.delivered = 0;
+		
+		while ( output.delivered < n )
+		{
+			const ssize_t moved = splice( scratch.reader(), NULL,
+			                              output.fd,        NULL,
+			                              n - output.delivered,
+			                              SPLICE_F_MOVE );
+			
+			if ( moved <= 0 )
+			{
+				if ( moved < 0  &&  is_unsupported( errno ) )
+				{
+					output.spliceable = false;
+				}
+				else
+				{
+					fail( output, moved < 0 ? errno : EIO );
+				}
+				
+				read_exactly( scratch.reader(), buffer, n - output.delivered );
+				
+				return;
+			}
+			
+			output.delivered += moved;
+		}
+	}
+	
+	/*
+		Returns false if the kernel won't tee or splice these pipes at all,
+		which it would say before any input was consumed.
+	*/
+	
+	static bool copy_spliced( Outputs& outputs, char* buffer )
+	{
+		Scratch scratch;
+		
+		if ( !scratch.opened() )
+		{
+			return false;
+		}
+		
+		Output& stdout_output = outputs.back();
+		
+		bool started = false;
+		
+		while ( any_live( outputs ) )
+		{
+			size_t n = 0;  // The chunk size, once a tee sets it
+			
+			bool whole = true;  // Every output can have it by splicing
+			
+			for ( size_t i = 0;  i + 1 < outputs.size();  ++i )
+			{
+				Output& output = outputs[ i ];
+				
+				output.delivered = 0;
+				
+				if ( output.failed )
+				{
+					continue;
+				}
+				
+				if ( !output.spliceable )
+				{
+					whole = false;
+					
+					continue;
+				}
+				
+				const ssize_t copied = tee( p7::stdin_fileno, scratch.writer(), n ? n : buffer_size, 0 );
+				
+				if ( copied < 0 )
+				{
+					if ( !started  &&  is_unsupported( errno ) )
+					{
+						return false;
+					}
+					
+					p7::throw_errno( errno );
+				}
+				
+				if ( copied == 0 )
+				{
+					return true;  // end of input
+				}
+				
+				started = true;
+				
+				if ( n == 0 )
+				{
+					n = copied;
+				}
+				
+				drain( scratch, output, copied, buffer );
+				
+				whole = whole  &&  (output.failed  ||  output.delivered == n);
+			}
 			
-			return 1;
+			// Standard output gets the chunk last, which consumes it.
+			
+			if ( whole  &&  !stdout_output.failed )
+			{
+				const size_t limit = n ? n : buffer_size;
+				
+				size_t consumed = 0;
+				
+				do
+				{
+					const ssize_t moved = splice( p7::stdin_fileno,  NULL,
+					                              p7::stdout_fileno, NULL,
+					                              limit - consumed,
+					                              SPLICE_F_MOVE );
+					
+					if ( moved < 0 )
+					{
+						if ( !started  &&  is_unsupported( errno ) )
+						{
+							return false;
+						}
+						
+						fail( stdout_output, errno );
+						
+						break;
+					}
+					
+					if ( moved == 0 )
+					{
+						return true;  // end of input
+					}
+					
+					started = true;
+					
+					consumed += moved;
+				}
+				while ( consumed < n );
+				
+				// Whatever's left of the chunk is now for nobody.
+				
+				read_exactly( p7::stdin_fileno, buffer, n - std::min( n, consumed ) );
+				
+				continue;
+			}
+			
+			if ( n == 0 )
+			{
+				// No tee took place, so take what's there.
+				
+				n = p7::read( p7::stdin_fileno, buffer, buffer_size );
+				
+				if ( n == 0 )
+				{
+					return true;
+				}
+			}
+			else
+			{
+				read_exactly( p7::stdin_fileno, buffer, n );
+			}
+			
+			started = true;
+			
+			write_all_rest( outputs, buffer, n );
 		}
 		
-		const char* const outFile = argv[ 1 ];
+		return true;
+	}
+	
+#endif
+
+	static char* aligned_buffer()
+	{
+		// Page-aligned, which suits the kernel's copying
+		
+		const size_t alignment = 4096;
+		
+		char* block = (char*) malloc( buffer_size + alignment );  // Freed at exit
+		
+		if ( block == NULL )
+		{
+			p7::throw_errno( ENOMEM );
+		}
+		
+		return block + (alignment - (size_t) block % alignment);
+	}
+	
+	int Main( int argc, char** argv )
+	{
+		bool appending = false;
+		
+		o::bind_option_to_variable( "-a", appending );
 		
-		const p7::fd_t output = p7::open( outFile, p7::o_wronly ).release();  // Will be closed when we exit
+		o::alias_option( "-a", "--append" );
 		
-		const std::size_t blockSize = 4096;
+		o::get_options( argc, argv );
 		
-		char data[ blockSize ];
+		char const *const *free_args = o::free_arguments();
 		
-		while ( std::size_t bytes = p7::read( p7::stdin_fileno, data, blockSize ) )
+		const p7::open_flags_t flags = p7::o_wronly | p7::o_creat
+		                             | (appending ? p7::o_append : p7::o_trunc);
+		
+		Outputs outputs;
+		
+		for ( char const *const *it = free_args;  *it != NULL;  ++it )
 		{
-			(void) p7::write( output,            data, bytes );
-			(void) p7::write( p7::stdout_fileno, data, bytes );
+			try
+			{
+				// Will be closed when we exit
+				
+				outputs.push_back( Output( *it, p7::open( *it, flags ).release() ) );
+			}
+			catch ( const p7::errno_t& err )
+			{
+				p7::perror( program, *it, err );
+				
+				exit_status = 1;
+			}
 		}
 		
-		return 0;
+		outputs.push_back( Output( "standard output", p7::stdout_fileno ) );
+		
+		char* buffer = aligned_buffer();
+		
+	#ifdef __linux__
+		
+		if ( is_pipe( p7::stdin_fileno )  &&  is_pipe( p7::stdout_fileno ) )
+		{
+			if ( copy_spliced( outputs, buffer ) )
+			{
+				return exit_status;
+			}
+		}
+		
+	#endif
+		
+		copy_buffered( outputs, buffer );
+		
+		return exit_status;
 	}
 	
 }
-
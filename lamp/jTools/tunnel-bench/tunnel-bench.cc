@@ -0,0 +1,512 @@
+/*	===============
+ *	tunnel-bench.cc
+ *	===============
+ */
+
+// Standard C++
+#include <algorithm>
+#include <vector>
+
+// Standard C/C++
+#include <cstdio>
+
+// Standard C
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+
+// POSIX
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// OpenSSL
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+// Iota
+#include "iota/strings.hh"
+
+// gear
+#include "gear/parse_decimal.hh"
+
+// plus
+#include "plus/string.hh"
+
+// poseven
+#include "poseven/functions/gettimeofday.hh"
+#include "poseven/functions/perror.hh"
+#include "poseven/functions/write.hh"
+#include "poseven/types/exit_t.hh"
+
+// Orion
+#include "Orion/get_options.hh"
+#include "Orion/Main.hh"
+
+
+/*
+	tunnel-bench measures s-tunnel on loopback.  With --echo, it first
+	starts a TLS echo server on that port (one process per connection),
+	for the tunnel to use as its remote.  Each of its clients then
+	connects to the tunnel and sends messages one at a time, waiting for
+	each to come back, and it reports aggregate throughput and the round
+	trip latency seen by each connection.  A connection's first round
+	trip includes the tunnel's connect and handshake, so it's reported
+	separately.
+	
+	E.g.  openssl req -x509 -newkey rsa:2048 -nodes -subj /CN=localhost \
+	                  -keyout key.pem -out cert.pem
+	      s-tunnel --lport 18080 --remote 127.0.0.1 --rport 18443 &
+	      tunnel-bench --echo 18443 --cert cert.pem --key key.pem \
+	                   -c 64 -n 1000 -s 16384 127.0.0.1:18080
+*/
+
+namespace tool
+{
+	
+	namespace p7 = poseven;
+	namespace o = orion;
+	
+	
+	typedef unsigned long long microseconds;
+	
+	static microseconds now()
+	{
+		const timeval tv = p7::gettimeofday();
+		
+		return tv.tv_sec * 1000000ull + tv.tv_usec;
+	}
+	
+	
+	struct Client
+	{
+		int           fd;
+		std::size_t   rounds;    // completed
+		std::size_t   sent;      // this round
+		std::size_t   received;  // likewise
+		microseconds  start;     // of this round
+		
+		Client() : fd( -1 ), rounds( 0 ), sent( 0 ), received( 0 ), start( 0 )
+		{
+		}
+	};
+	
+	
+	static plus::string gMessage;
+	
+	static std::size_t gRounds;
+	static std::size_t gErrors = 0;
+	
+	static std::vector< microseconds > gFirstLatencies;
+	static std::vector< microseconds > gLatencies;
+	
+	
+	static void Echo( SSL_CTX* context, int fd )
+	{
+		SSL* ssl = SSL_new( context );
+		
+		SSL_set_fd( ssl, fd );
+		
+		if ( SSL_accept( ssl ) != 1 )
+		{
+			ERR_print_errors_fp( stderr );
+			
+			return;
+		}
+		
+		char buffer[ 16384 ];
+		
+		int n;
+		
+		while ( (n = SSL_read( ssl, buffer, sizeof buffer )) > 0 )
+		{
+			if ( SSL_write( ssl, buffer, n ) != n )
+			{
+				return;
+			}
+		}
+		
+		SSL_shutdown( ssl );
+	}
+	
+	static void Serve( int listener, const char* cert, const char* key )
+	{
+		SSL_library_init();
+		SSL_load_error_strings();
+		
+		SSL_CTX* context = SSL_CTX_new( SSLv23_server_method() );
+		
+		if (    context == NULL
+		     || SSL_CTX_use_certificate_chain_file( context, cert ) != 1
+		     || SSL_CTX_use_PrivateKey_file( context, key, SSL_FILETYPE_PEM ) != 1 )
+		{
+			ERR_print_errors_fp( stderr );
+			
+			_exit( 1 );
+		}
+		
+		signal( SIGCHLD, SIG_IGN );  // no zombies
+		
+		while ( true )
+		{
+			const int fd = accept( listener, NULL, NULL );
+			
+			if ( fd < 0 )
+			{
+				continue;
+			}
+			
+			int on = 1;
+			
+			setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on );
+			
+			if ( fork() == 0 )
+			{
+				close( listener );
+				
+				Echo( context, fd );
+				
+				_exit( 0 );
+			}
+			
+			close( fd );
+		}
+	}
+	
+	static pid_t StartEchoServer( unsigned short port, const char* cert, const char* key )
+	{
+		const int listener = socket( PF_INET, SOCK_STREAM, IPPROTO_TCP );
+		
+		int on = 1;
+		
+		setsockopt( listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on );
+		
+		struct sockaddr_in address = { 0 };
+		
+		address.sin_family      = AF_INET;
+		address.sin_port        = htons( port );
+		address.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+		
+		if ( bind( listener, (const sockaddr*) &address, sizeof address ) < 0  ||  listen( listener, SOMAXCONN ) < 0 )
+		{
+			p7::perror( "tunnel-bench", "echo server" );
+			
+			throw p7::exit_failure;
+		}
+		
+		// Listening already, so the tunnel can connect as soon as we return.
+		
+		const pid_t pid = fork();
+		
+		if ( pid == 0 )
+		{
+			Serve( listener, cert, key );
+		}
+		
+		close( listener );
+		
+		return pid;
+	}
+	
+	static bool Send( Client& client )
+	{
+		while ( client.sent < gMessage.size() )
+		{
+			ssize_t n = write( client.fd, gMessage.data() + client.sent, gMessage.size() - client.sent );
+			
+			if ( n < 0 )
+			{
+				return errno == EAGAIN;
+			}
+			
+			client.sent += n;
+		}
+		
+		return true;
+	}
+	
+	// Returns false on error, EOF, or an echo that doesn't match
+	static bool Receive( Client& client )
+	{
+		char buffer[ 64 * 1024 ];
+		
+		const std::size_t wanted = std::min( sizeof buffer, gMessage.size() - client.received );
+		
+		ssize_t n = read( client.fd, buffer, wanted );
+		
+		if ( n <= 0 )
+		{
+			return n < 0  &&  errno == EAGAIN;
+		}
+		
+		if ( memcmp( buffer, gMessage.data() + client.received, n ) != 0 )
+		{
+			return false;
+		}
+		
+		client.received += n;
+		
+		if ( client.received < gMessage.size() )
+		{
+			return true;
+		}
+		
+		const microseconds latency = now() - client.start;
+		
+		(client.rounds++ ? gLatencies : gFirstLatencies).push_back( latency );
+		
+		if ( client.rounds == gRounds )
+		{
+			close( client.fd );
+			
+			client.fd = -1;
+			
+			return true;
+		}
+		
+		client.sent     = 0;
+		client.received = 0;
+		client.start    = now();
+		
+		return Send( client );
+	}
+	
+	static int Connect( const sockaddr_in& address )
+	{
+		const int fd = socket( PF_INET, SOCK_STREAM, IPPROTO_TCP );
+		
+		if ( fd < 0  ||  connect( fd, (const sockaddr*) &address, sizeof address ) < 0 )
+		{
+			p7::perror( "tunnel-bench", "connect" );
+			
+			throw p7::exit_failure;
+		}
+		
+		int on = 1;
+		
+		setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on );
+		
+		fcntl( fd, F_SETFL, fcntl( fd, F_GETFL, 0 ) | O_NONBLOCK );
+		
+		return fd;
+	}
+	
+	static double percentile( const std::vector< microseconds >& sorted, unsigned pct )
+	{
+		if ( sorted.empty() )
+		{
+			return 0;
+		}
+		
+		std::size_t i = (sorted.size() - 1) * pct / 100;
+		
+		return sorted[ i ] / 1000.0;
+	}
+	
+	static void PrintLatencies( const char* label, std::vector< microseconds >& latencies )
+	{
+		std::sort( latencies.begin(), latencies.end() );
+		
+		microseconds total = 0;
+		
+		for ( std::size_t i = 0;  i < latencies.size();  ++i )
+		{
+			total += latencies[ i ];
+		}
+		
+		const std::size_t n = latencies.size();
+		
+		std::printf( "%s mean %.3f ms, p50 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+		             label,
+		             n ? total / 1000.0 / n : 0.0,
+		             percentile( latencies, 50 ),
+		             percentile( latencies, 99 ),
+		             percentile( latencies, 100 ) );
+	}
+	
+	int Main( int argc, char** argv )
+	{
+		std::size_t n_connections = 16;
+		std::size_t n_rounds      = 1000;
+		std::size_t message_size  = 16384;
+		
+		const char* echo_port = NULL;
+		const char* cert      = "cert.pem";
+		const char* key       = "key.pem";
+		
+		o::bind_option_to_variable( "-c", n_connections );
+		o::bind_option_to_variable( "-n", n_rounds      );
+		o::bind_option_to_variable( "-s", message_size  );
+		
+		o::bind_option_to_variable( "--echo", echo_port );
+		o::bind_option_to_variable( "--cert", cert      );
+		o::bind_option_to_variable( "--key",  key       );
+		
+		o::alias_option( "-c", "--connections" );
+		o::alias_option( "-n", "--rounds"      );
+		o::alias_option( "-s", "--size"        );
+		
+		o::get_options( argc, argv );
+		
+		char const *const *freeArgs = o::free_arguments();
+		
+		if ( o::free_argument_count() == 0  ||  n_rounds == 0  ||  message_size == 0 )
+		{
+			p7::write( p7::stderr_fileno, STR_LEN( "Usage: tunnel-bench [--echo port [--cert file] [--key file]]\n"
+			                                       "                    [-c connections] [-n rounds] [-s size] host:port\n" ) );
+			
+			return 2;
+		}
+		
+		const char* host = freeArgs[ 0 ];
+		const char* end  = host + strlen( host );
+		const char* port = std::find( host, end, ':' );
+		
+		const plus::string hostname( host, port );
+		
+		hostent* hosts = gethostbyname( hostname.c_str() );
+		
+		if ( hosts == NULL  ||  port == end )
+		{
+			p7::write( p7::stderr_fileno, STR_LEN( "tunnel-bench: host lookup failed\n" ) );
+			
+			return 1;
+		}
+		
+		struct sockaddr_in address = { 0 };
+		
+		address.sin_family = AF_INET;
+		address.sin_port   = htons( gear::parse_unsigned_decimal( port + 1 ) );
+		address.sin_addr   = *(in_addr*) hosts->h_addr;
+		
+		signal( SIGPIPE, SIG_IGN );
+		
+		const pid_t server = echo_port ? StartEchoServer( gear::parse_unsigned_decimal( echo_port ), cert, key )
+		                               : 0;
+		
+		plus::string message( message_size, '\0' );
+		
+		for ( std::size_t i = 0;  i < message_size;  ++i )
+		{
+			const_cast< char* >( message.data() )[ i ] = 'a' + i % 26;
+		}
+		
+		gMessage = message;
+		
+		gRounds = n_rounds;
+		
+		gFirstLatencies.reserve( n_connections );
+		gLatencies     .reserve( n_connections * n_rounds );
+		
+		std::vector< Client > clients( n_connections );
+		
+		std::vector< pollfd > pollfds( n_connections );
+		
+		const microseconds t0 = now();
+		
+		for ( std::size_t i = 0;  i < n_connections;  ++i )
+		{
+			clients[ i ].fd    = Connect( address );
+			clients[ i ].start = now();
+			
+			Send( clients[ i ] );
+		}
+		
+		std::size_t n_open = n_connections;
+		
+		while ( n_open > 0 )
+		{
+			for ( std::size_t i = 0;  i < n_connections;  ++i )
+			{
+				const Client& client = clients[ i ];
+				
+				pollfds[ i ].fd      = client.fd;
+				pollfds[ i ].events  = client.sent < gMessage.size() ? POLLIN | POLLOUT : POLLIN;
+				pollfds[ i ].revents = 0;
+			}
+			
+			if ( poll( &pollfds[ 0 ], n_connections, -1 ) < 0 )
+			{
+				if ( errno == EINTR )
+				{
+					continue;
+				}
+				
+				std::perror( "tunnel-bench: poll" );
+				
+				return 1;
+			}
+			
+			for ( std::size_t i = 0;  i < n_connections;  ++i )
+			{
+				Client& client = clients[ i ];
+				
+				const short revents = pollfds[ i ].revents;
+				
+				if ( client.fd < 0  ||  revents == 0 )
+				{
+					continue;
+				}
+				
+				bool ok = true;
+				
+				if ( revents & POLLOUT )
+				{
+					ok = Send( client );
+				}
+				
+				if ( ok  &&  revents & (POLLIN | POLLHUP | POLLERR) )
+				{
+					ok = Receive( client );
+				}
+				
+				if ( !ok )
+				{
+					++gErrors;
+					
+					close( client.fd );
+					
+					client.fd = -1;
+				}
+				
+				if ( client.fd < 0 )
+				{
+					--n_open;
+				}
+			}
+		}
+		
+		const microseconds elapsed = now() - t0;
+		
+		if ( server > 0 )
+		{
+			kill( server, SIGTERM );
+		}
+		
+		const std::size_t completed = gFirstLatencies.size() + gLatencies.size();
+		
+		const double seconds = (elapsed ? elapsed : 1) / 1000000.0;
+		
+		std::printf( "rounds:      %lu completed, %lu errors, %lu connections, %lu bytes each\n",
+		             (unsigned long) completed,
+		             (unsigned long) gErrors,
+		             (unsigned long) n_connections,
+		             (unsigned long) message_size );
+		
+		std::printf( "elapsed:     %.3f s\n", seconds );
+		
+		std::printf( "throughput:  %.1f MB/s echoed, %.0f rounds/s\n",
+		             completed * message_size / seconds / (1024 * 1024),
+		             completed / seconds );
+		
+		PrintLatencies( "latency:    ", gLatencies );
+		PrintLatencies( "first round:", gFirstLatencies );
+		
+		return gErrors ? 1 : 0;
+	}
+	
+}
@@ -8,21 +8,21 @@
 // Standard C/C++
 #include <cctype>
 #include <cerrno>
+#include <cstddef>
 #include <cstring>
 
 // Standard C++
+#include <algorithm>
 #include <vector>
 
 // Iota
 #include "iota/strings.hh"
 
 // gear
+#include "gear/hexidecimal.hh"
 #include "gear/inscribe_decimal.hh"
 #include "gear/parse_decimal.hh"
 
-// Debug
-#include "debug/assert.hh"
-
 // poseven
 #include "poseven/functions/fstat.hh"
 #include "poseven/functions/read.hh"
@@ -53,192 +53,482 @@ namespace HTTP
 	}
 	
 	
-	static inline HeaderFieldEntry MakeHeaderFieldEntry( std::size_t name,
-	                                                     std::size_t colon,
-	                                                     std::size_t value,
-	                                                     std::size_t crlf )
+	static bool strings_case_insensitively_equal( const char* a, std::size_t a_len,
+	                                              const char* b, std::size_t b_len )
 	{
-		HeaderFieldEntry result;
+		if ( a_len != b_len )  return false;
 		
-		result.field_offset = name;
-		result.colon_offset = colon;
-		result.value_offset = value;
-		result.crlf_offset  = crlf;
+		for ( const char* a_end = a + a_len;  a < a_end;  ++a, ++b )
+		{
+			if ( std::tolower( *a ) != std::tolower( *b ) )
+			{
+				return false;
+			}
+		}
 		
-		return result;
+		return true;
 	}
 	
-	
-	static HeaderIndex MakeHeaderIndex( const char* header_stream, const char* end )
+	static bool contains_token_case_insensitively( const char*  p,
+	                                               const char*  end,
+	                                               const char*  token,
+	                                               std::size_t  length )
 	{
-		HeaderIndex result;
+		while ( end - p >= std::ptrdiff_t( length ) )
+		{
+			if ( strings_case_insensitively_equal( p, length, token, length ) )
+			{
+				return true;
+			}
+			
+			++p;
+		}
 		
-		const char* p = header_stream;
+		return false;
+	}
+	
+	
+	struct known_field_name
+	{
+		const char*         name;
+		std::size_t         length;
+		known_header_field  field;
+	};
+	
+	static const known_field_name known_field_names[] =
+	{
+		{ STR_LEN( "Connection"        ), field_connection        },
+		{ STR_LEN( "Content-Length"    ), field_content_length    },
+		{ STR_LEN( "Content-Type"      ), field_content_type      },
+		{ STR_LEN( "Host"              ), field_host              },
+		{ STR_LEN( "If-Modified-Since" ), field_if_modified_since },
+		{ STR_LEN( "If-None-Match"     ), field_if_none_match     },
+		{ STR_LEN( "Transfer-Encoding" ), field_transfer_encoding },
+		{ STR_LEN( "User-Agent"        ), field_user_agent        },
+	};
+	
+	static int find_known_field( const char* name, std::size_t length )
+	{
+		const std::size_t n = sizeof known_field_names / sizeof known_field_names[0];
 		
-		while ( p < end )
+		for ( std::size_t i = 0;  i < n;  ++i )
 		{
-			const char* field = p;
+			const known_field_name& known = known_field_names[ i ];
 			
-			const char* crlf = std::strstr( p, "\r\n" );
+			// Nearly all mismatches are rejected by length alone
 			
-			if ( crlf == p )
+			if ( known.length == length  &&  strings_case_insensitively_equal( name, length, known.name, length ) )
 			{
-				// Empty line indicates end of header
-				return result;
+				return known.field;
 			}
+		}
+		
+		return -1;
+	}
+	
+	
+	void MessageParser::Reset()
+	{
+		itsHeaderIndex.clear();  // keeps its capacity
+		
+		std::fill( itsKnownFields, itsKnownFields + n_known_header_fields, 0 );
+		
+		itsScanMark            = 0;
+		itsLineStart           = 0;
+		itsStartOfHeaderFields = 0;
+		itsHeaderSize          = 0;
+		itsContentLength       = 0;
+		itsBodyRemaining       = 0;
+		itsState               = state_start_line;
+		itsChunkState          = chunk_size;
+		itsBodyFraming         = body_none;
+		itsChunkSizeIsEmpty    = true;
+		itsTrailerLineIsEmpty  = true;
+	}
+	
+	void MessageParser::IndexHeaderField( const char* message, std::size_t begin, std::size_t end )
+	{
+		const char* line = message + begin;
+		const char* crlf = message + end;
+		
+		const char* colon = (const char*) std::memchr( line, ':', crlf - line );
+		
+		if ( colon == NULL )
+		{
+			throw MalformedHeader();
+		}
+		
+		const char* value = colon + 1;
+		
+		while ( value < crlf  &&  (*value == ' '  ||  *value == '\t') )
+		{
+			++value;
+		}
+		
+		const char* header_stream = message + itsStartOfHeaderFields;
+		
+		HeaderFieldEntry entry;
+		
+		entry.field_offset = line  - header_stream;
+		entry.colon_offset = colon - header_stream;
+		entry.value_offset = value - header_stream;
+		entry.crlf_offset  = crlf  - header_stream;
+		
+		itsHeaderIndex.push_back( entry );
+		
+		const int known = find_known_field( line, colon - line );
+		
+		// The first occurrence wins, as with a linear search
+		
+		if ( known >= 0  &&  itsKnownFields[ known ] == 0 )
+		{
+			itsKnownFields[ known ] = itsHeaderIndex.size();
+		}
+	}
+	
+	void MessageParser::DetermineBodyFraming( const char* message )
+	{
+		const char* header_stream = message + itsStartOfHeaderFields;
+		
+		itsBodyFraming = itIsResponse ? body_until_eof : body_none;
+		
+		if ( itIsResponse )
+		{
+			// 1xx, 204, and 304 responses never have a body
 			
-			ASSERT( crlf != NULL );
+			const char* space = (const char*) std::memchr( message, ' ', itsStartOfHeaderFields );
 			
-			const char* colon = std::strchr( p, ':' );
+			const unsigned status = space ? gear::parse_unsigned_decimal( space + 1 ) : 0;
 			
-			if ( colon == NULL  ||  colon > crlf )
+			if ( status / 100 == 1  ||  status == 204  ||  status == 304 )
 			{
-				throw MalformedHeader();
+				itsBodyFraming = body_none;
+				
+				return;
 			}
+		}
+		
+		if ( const HeaderFieldEntry* te = Find( field_transfer_encoding ) )
+		{
+			if ( contains_token_case_insensitively( header_stream + te->value_offset,
+			                                        header_stream + te->crlf_offset,
+			                                        STR_LEN( "chunked" ) ) )
+			{
+				itsBodyFraming = body_chunked;
+				
+				return;
+			}
+		}
+		
+		if ( const HeaderFieldEntry* length = Find( field_content_length ) )
+		{
+			const char* p = header_stream + length->value_offset;
 			
-			p = colon;
-			
-			while ( *++p == ' ' )  continue;
-			
-			const char* value = p;
-			
-			HeaderFieldEntry tuple = MakeHeaderFieldEntry( field - header_stream,
-			                                               colon - header_stream,
-			                                               value - header_stream,
-			                                               crlf  - header_stream );
+			if ( !std::isdigit( *p ) )
+			{
+				throw MalformedHeader();
+			}
 			
-			result.push_back( tuple );
+			itsContentLength = gear::parse_unsigned_decimal( p );
+			itsBodyRemaining = itsContentLength;
 			
-			p = crlf + STRLEN( "\r\n" );
+			itsBodyFraming = itsContentLength != 0 ? body_sized : body_none;
 		}
-		
-		// Ran out of data without finding end of header
-		throw MalformedHeader();
 	}
 	
-	static bool strings_case_insensitively_equal( const char* a, std::size_t a_len,
-	                                              const char* b, std::size_t b_len )
+	bool MessageParser::ParseHeader( const char* message, std::size_t size )
 	{
-		if ( a_len != b_len )  return false;
-		
-		for ( const char* a_end = a + a_len;  a < a_end;  ++a, ++b )
+		while ( itsState < state_body )
 		{
-			if ( std::tolower( *a ) != std::tolower( *b ) )
+			// Resume scanning where the last call left off
+			
+			const char* p = message + itsScanMark;
+			
+			const char* lf = (const char*) std::memchr( p, '\n', size - itsScanMark );
+			
+			if ( lf == NULL )
 			{
+				itsScanMark = size;
+				
 				return false;
 			}
+			
+			const std::size_t lf_offset = lf - message;
+			
+			if ( lf_offset == itsLineStart  ||  lf[ -1 ] != '\r' )
+			{
+				throw MalformedHeader();
+			}
+			
+			const std::size_t line_start = itsLineStart;
+			const std::size_t crlf       = lf_offset - 1;
+			
+			itsScanMark  =
+			itsLineStart = lf_offset + 1;
+			
+			if ( itsState == state_start_line )
+			{
+				itsStartOfHeaderFields = itsLineStart;
+				
+				itsState = state_header_fields;
+			}
+			else if ( crlf == line_start )
+			{
+				// Empty line indicates end of header
+				
+				itsHeaderSize = itsLineStart;
+				
+				DetermineBodyFraming( message );
+				
+				itsState = itsBodyFraming == body_none ? state_done : state_body;
+			}
+			else
+			{
+				IndexHeaderField( message, line_start, crlf );
+			}
 		}
 		
 		return true;
 	}
 	
-	static const HeaderFieldEntry* FindHeaderFieldInStream( const char*         stream,
-	                                                        const HeaderIndex&  index,
-	                                                        const char*         name,
-	                                                        std::size_t         name_length )
+	std::size_t MessageParser::ParseBody( const char*   data,
+	                                      std::size_t   size,
+	                                      const char*&  payload,
+	                                      std::size_t&  payload_size )
 	{
-		for ( HeaderIndex::const_iterator it = index.begin();  it != index.end();  ++it )
+		payload      = data;
+		payload_size = 0;
+		
+		if ( itsState != state_body )
 		{
-			const char* field = stream + it->field_offset;
+			return 0;
+		}
+		
+		switch ( itsBodyFraming )
+		{
+			case body_until_eof:
+				payload_size = size;
+				
+				return size;
 			
-			std::size_t length = it->colon_offset - it->field_offset;
+			case body_sized:
+				payload_size = std::min( size, itsBodyRemaining );
+				
+				itsBodyRemaining -= payload_size;
+				
+				if ( itsBodyRemaining == 0 )
+				{
+					itsState = state_done;
+				}
+				
+				return payload_size;
 			
-			if ( strings_case_insensitively_equal( field, length, name, name_length ) )
-			{
-				return &*it;
-			}
+			case body_chunked:
+				return ParseChunked( data, size, payload, payload_size );
+			
+			default:
+				break;
 		}
 		
-		return NULL;
+		return 0;
 	}
 	
-	
-	void MessageReceiver::ReceiveContent( const char* data, std::size_t byteCount )
+	std::size_t MessageParser::ParseChunked( const char*   data,
+	                                         std::size_t   size,
+	                                         const char*&  payload,
+	                                         std::size_t&  payload_size )
 	{
-		itsContentBytesReceived += byteCount;
+		const char* p   = data;
+		const char* end = data + size;
 		
-		itsPartialContent.append( data, byteCount );
-	}
-	
-	void MessageReceiver::ReceiveData( const char* data, std::size_t byteCount )
-	{
-		// Are we receiving header or content?
-		if ( !itHasReceivedEntireHeader )
+		while ( p < end )
 		{
-			// We haven't received the entire header yet.
-			// We need to concatenate all received data to check for the EOH marker.
-			itsReceivedData.append( data, byteCount );
-			
-			if ( itsStartOfHeaderFields == 0 )
+			if ( itsChunkState == chunk_data )
 			{
-				if ( std::size_t crlf = itsReceivedData.find( "\r\n" ) )
+				// Return each run of chunk data in place
+				
+				payload      = p;
+				payload_size = std::min( std::size_t( end - p ), itsBodyRemaining );
+				
+				itsBodyRemaining -= payload_size;
+				
+				if ( itsBodyRemaining == 0 )
 				{
-					itsStartOfHeaderFields = crlf + STRLEN( "\r\n" );
-					
-					itsPlaceToLookForEndOfHeader = crlf;
+					itsChunkState = chunk_data_end;
 				}
+				
+				return p + payload_size - data;
 			}
 			
-			if ( itsPlaceToLookForEndOfHeader == 0 )
-			{
-				return;
-			}
+			const char c = *p++;
 			
-			if ( itsReceivedData.size() - itsPlaceToLookForEndOfHeader < STRLEN( "\r\n" "\r\n" ) )
+			if ( c == '\r' )
 			{
-				return;
+				continue;
 			}
 			
-			std::size_t eohMarker = itsReceivedData.find( "\r\n" "\r\n", itsPlaceToLookForEndOfHeader );
-			
-			if ( eohMarker == itsReceivedData.npos )
+			switch ( itsChunkState )
 			{
-				itsPlaceToLookForEndOfHeader = itsReceivedData.size() - STRLEN( "\r\n" "\r\n" ) + 1;
+				case chunk_size:
+					if ( std::isxdigit( c ) )
+					{
+						if ( itsBodyRemaining > std::size_t( -1 ) >> 4 )
+						{
+							throw MalformedChunkedBody();
+						}
+						
+						itsBodyRemaining = itsBodyRemaining << 4 | gear::decoded_hex_digit( c );
+						
+						itsChunkSizeIsEmpty = false;
+						
+						break;
+					}
+					
+					if ( c != '\n' )
+					{
+						// chunk extension, ignored
+						itsChunkState = chunk_extension;
+						
+						break;
+					}
+					
+					// fall through
 				
-				return;
+				case chunk_extension:
+					if ( c != '\n' )
+					{
+						break;
+					}
+					
+					if ( itsChunkSizeIsEmpty )
+					{
+						throw MalformedChunkedBody();
+					}
+					
+					itsChunkState = itsBodyRemaining ? chunk_data : chunk_trailer;
+					
+					itsContentLength += itsBodyRemaining;
+					
+					break;
+				
+				case chunk_data_end:
+					if ( c != '\n' )
+					{
+						throw MalformedChunkedBody();
+					}
+					
+					itsChunkState = chunk_size;
+					
+					itsChunkSizeIsEmpty = true;
+					
+					break;
+				
+				case chunk_trailer:
+					if ( c != '\n' )
+					{
+						itsTrailerLineIsEmpty = false;
+						
+						break;
+					}
+					
+					if ( itsTrailerLineIsEmpty )
+					{
+						itsState = state_done;
+						
+						return p - data;
+					}
+					
+					itsTrailerLineIsEmpty = true;
+					
+					break;
+				
+				default:
+					break;
 			}
+		}
+		
+		return p - data;
+	}
+	
+	const HeaderFieldEntry* MessageParser::Find( const char*  header_stream,
+	                                             const char*  name,
+	                                             std::size_t  name_length ) const
+	{
+		const int known = find_known_field( name, name_length );
+		
+		if ( known >= 0 )
+		{
+			return Find( known_header_field( known ) );
+		}
+		
+		typedef HeaderIndex::const_iterator Iter;
+		
+		for ( Iter it = itsHeaderIndex.begin();  it != itsHeaderIndex.end();  ++it )
+		{
+			const char* field = header_stream + it->field_offset;
 			
-			// Found it, so we've got the entire header now
-			itHasReceivedEntireHeader = true;
+			std::size_t length = it->colon_offset - it->field_offset;
 			
-			// The content starts after the two CRLF
-			std::size_t startOfContent = eohMarker + STRLEN( "\r\n" "\r\n" );
+			if ( strings_case_insensitively_equal( field, length, name, name_length ) )
+			{
+				return &*it;
+			}
+		}
+		
+		return NULL;
+	}
+	
+	
+	void MessageReceiver::ReceiveContent( const char* data, std::size_t byteCount )
+	{
+		while ( byteCount > 0 )
+		{
+			const char* payload;
+			std::size_t payload_size;
 			
-			// Anything left over is content
-			std::size_t leftOver = itsReceivedData.size() - startOfContent;
+			const std::size_t consumed = itsParser.ParseBody( data, byteCount, payload, payload_size );
 			
-			// Start writing content if we have any
-			if ( leftOver > 0 )
+			if ( consumed == 0 )
 			{
-				ReceiveContent( itsReceivedData.data() + startOfContent, leftOver );
-				
-				itsReceivedData.resize( startOfContent );
+				// Anything past the end of the message is ignored
+				break;
 			}
 			
-			const char* header_stream = GetHeaderStream();
+			itsContentBytesReceived += payload_size;
 			
-			itsHeaderIndex = MakeHeaderIndex( header_stream, &*itsReceivedData.end() );
+			itsPartialContent.append( payload, payload_size );
 			
-			if ( const HeaderFieldEntry* contentLengthEntry = FindHeaderFieldInStream( header_stream,
-			                                                                           itsHeaderIndex,
-			                                                                           STR_LEN( "Content-Length" ) ) )
-			{
-				const char* contentLength = header_stream + contentLengthEntry->value_offset;
-				
-				// Now get the *real* value, as opposed to its textual representation
-				itsContentLength = gear::parse_unsigned_decimal( contentLength );
-				itsContentLengthIsKnown = true;
-			}
-			else
-			{
-				// itsContentLength is already set to 0
-				// itsContentLengthIsKnown is already false
-			}
+			data      += consumed;
+			byteCount -= consumed;
 		}
-		else
+	}
+	
+	void MessageReceiver::ReceiveData( const char* data, std::size_t byteCount )
+	{
+		// Are we receiving header or content?
+		if ( itsParser.HasCompleteHeader() )
 		{
-			// We already have the headers, just count and write the data
 			ReceiveContent( data, byteCount );
+			
+			return;
+		}
+		
+		// The parser resumes scanning from where it stopped last time.
+		itsReceivedData.append( data, byteCount );
+		
+		if ( !itsParser.ParseHeader( itsReceivedData.data(), itsReceivedData.size() ) )
+		{
+			return;
+		}
+		
+		const std::size_t startOfContent = itsParser.GetHeaderSize();
+		
+		// Anything left over is content
+		if ( std::size_t leftOver = itsReceivedData.size() - startOfContent )
+		{
+			ReceiveContent( itsReceivedData.data() + startOfContent, leftOver );
+			
+			itsReceivedData.resize( startOfContent );
 		}
 	}
 	
@@ -250,14 +540,14 @@ namespace HTTP
 		
 		std::size_t bytesToRead = blockSize;
 		
-		if ( itHasReceivedEntireHeader && itsContentLengthIsKnown )
+		if ( itsParser.IsComplete() )
 		{
-			std::size_t bytesToGo = itsContentLength - itsContentBytesReceived;
-			
-			if ( bytesToGo == 0 )
-			{
-				return false;
-			}
+			return false;
+		}
+		
+		if ( itsParser.HasCompleteHeader()  &&  itsParser.GetBodyFraming() == body_sized )
+		{
+			std::size_t bytesToGo = itsParser.GetContentLength() - itsContentBytesReceived;
 			
 			bytesToRead = std::min( bytesToRead, bytesToGo );
 		}
@@ -270,12 +560,12 @@ namespace HTTP
 		{
 			itHasReachedEndOfInput = true;
 			
-			if ( !itHasReceivedEntireHeader )
+			if ( !itsParser.HasCompleteHeader() )
 			{
 				throw MalformedHeader();
 			}
 			
-			if ( itsContentLengthIsKnown  &&  itsContentBytesReceived != itsContentLength )
+			if ( itsParser.GetBodyFraming() != body_until_eof )
 			{
 				throw IncompleteMessageBody();
 			}
@@ -288,7 +578,7 @@ namespace HTTP
 	
 	void MessageReceiver::ReceiveHeader( p7::fd_t socket )
 	{
-		while ( !itHasReceivedEntireHeader && ReceiveBlock( socket ) )
+		while ( !itsParser.HasCompleteHeader() && ReceiveBlock( socket ) )
 		{
 			continue;
 		}
@@ -306,10 +596,7 @@ namespace HTTP
 	{
 		const char* stream = GetHeaderStream();
 		
-		const HeaderFieldEntry* it = FindHeaderFieldInStream( stream,
-		                                                      itsHeaderIndex,
-		                                                      name.data(),
-		                                                      name.size() );
+		const HeaderFieldEntry* it = FindHeaderField( name.data(), name.size() );
 		
 		if ( it != NULL )
 		{
@@ -24,12 +24,15 @@ namespace HTTP
 	
 	class MalformedHeader {};
 	
+	class MalformedChunkedBody {};
+	
 	class IncompleteMessageBody {};
 	
 	class NoSuchHeaderField {};
 	
 	
-	// Used to process an incoming message header
+	// Used to process an incoming message header.
+	// Offsets are relative to the start of the header fields.
 	struct HeaderFieldEntry
 	{
 		std::size_t field_offset;
@@ -41,47 +44,180 @@ namespace HTTP
 	typedef std::vector< HeaderFieldEntry > HeaderIndex;
 	
 	
+	// Header fields that can be found in constant time once indexed
+	enum known_header_field
+	{
+		field_connection,
+		field_content_length,
+		field_content_type,
+		field_host,
+		field_if_modified_since,
+		field_if_none_match,
+		field_transfer_encoding,
+		field_user_agent,
+		
+		n_known_header_fields
+	};
+	
+	enum body_framing
+	{
+		body_none,
+		body_sized,      // Content-Length
+		body_chunked,    // Transfer-Encoding: chunked
+		body_until_eof   // response without a length
+	};
+	
+	/*
+		MessageParser is a resumable parser for one HTTP message.  It never
+		copies the message:  The caller owns the buffer and passes the whole
+		message-so-far to ParseHeader() until it returns true.  The buffer may
+		move between calls (e.g. when a string grows), since the index holds
+		offsets, and scanning resumes where the previous call stopped.
+		
+		The body is then fed to ParseBody() in arbitrary pieces; chunked
+		transfer encoding is decoded in place, returning each run of payload
+		as a pointer into the caller's data.
+		
+		Reset() prepares for the next message on a persistent connection
+		while keeping the index's storage, so steady-state parsing doesn't
+		allocate.
+	*/
+	
+	class MessageParser
+	{
+		private:
+			enum parse_state
+			{
+				state_start_line,
+				state_header_fields,
+				state_body,
+				state_done
+			};
+			
+			enum chunk_state
+			{
+				chunk_size,
+				chunk_extension,
+				chunk_data,
+				chunk_data_end,
+				chunk_trailer
+			};
+			
+			HeaderIndex   itsHeaderIndex;
+			std::size_t   itsKnownFields[ n_known_header_fields ];  // index + 1, or 0
+			std::size_t   itsScanMark;
+			std::size_t   itsLineStart;
+			std::size_t   itsStartOfHeaderFields;
+			std::size_t   itsHeaderSize;
+			std::size_t   itsContentLength;
+			std::size_t   itsBodyRemaining;  // in the message, or the current chunk
+			parse_state   itsState;
+			chunk_state   itsChunkState;
+			body_framing  itsBodyFraming;
+			bool          itIsResponse;
+			bool          itsChunkSizeIsEmpty;
+			bool          itsTrailerLineIsEmpty;
+			
+			void IndexHeaderField( const char* message, std::size_t begin, std::size_t end );
+			
+			void DetermineBodyFraming( const char* message );
+			
+			std::size_t ParseChunked( const char*   data,
+			                          std::size_t   size,
+			                          const char*&  payload,
+			                          std::size_t&  payload_size );
+		
+		public:
+			explicit MessageParser( bool is_response = false ) : itIsResponse( is_response )
+			{
+				Reset();
+			}
+			
+			void Reset();
+			
+			// Returns true once the header (through the empty line) is complete.
+			bool ParseHeader( const char* message, std::size_t size );
+			
+			// Returns the number of bytes consumed; payload points into data.
+			std::size_t ParseBody( const char*   data,
+			                       std::size_t   size,
+			                       const char*&  payload,
+			                       std::size_t&  payload_size );
+			
+			bool HasCompleteHeader() const  { return itsState >= state_body; }
+			
+			bool IsComplete() const  { return itsState == state_done; }
+			
+			std::size_t GetStartOfHeaderFields() const  { return itsStartOfHeaderFields; }
+			
+			std::size_t GetHeaderSize() const  { return itsHeaderSize; }
+			
+			const HeaderIndex& GetHeaderIndex() const  { return itsHeaderIndex; }
+			
+			body_framing GetBodyFraming() const  { return itsBodyFraming; }
+			
+			std::size_t GetContentLength() const  { return itsContentLength; }
+			
+			const HeaderFieldEntry* Find( known_header_field field ) const
+			{
+				const std::size_t i = itsKnownFields[ field ];
+				
+				return i ? &itsHeaderIndex[ i - 1 ] : NULL;
+			}
+			
+			const HeaderFieldEntry* Find( const char*  header_stream,
+			                              const char*  name,
+			                              std::size_t  name_length ) const;
+	};
+	
+	
 	class MessageReceiver
 	{
 		private:
-			HeaderIndex       itsHeaderIndex;
+			MessageParser     itsParser;
 			plus::var_string  itsReceivedData;
 			plus::var_string  itsPartialContent;
-			std::size_t       itsStartOfHeaderFields;
-			std::size_t       itsPlaceToLookForEndOfHeader;
-			std::size_t       itsContentLength;
 			std::size_t       itsContentBytesReceived;
-			bool              itHasReceivedEntireHeader;
-			bool              itsContentLengthIsKnown;
 			bool              itHasReachedEndOfInput;
 			
 			void ReceiveContent( const char* data, std::size_t byteCount );
-			void ReceiveData   ( const char* data, std::size_t byteCount );
 		
 		public:
-			MessageReceiver() : itsStartOfHeaderFields      ( 0 ),
-			                    itsPlaceToLookForEndOfHeader( 0 ),
-			                    itsContentLength            ( 0 ),
-			                    itsContentBytesReceived     ( 0 ),
-			                    itHasReceivedEntireHeader   ( false ),
-			                    itsContentLengthIsKnown     ( false ),
-			                    itHasReachedEndOfInput      ( false )
+			explicit MessageReceiver( bool is_response = false )
+			:
+				itsParser              ( is_response ),
+				itsContentBytesReceived( 0 ),
+				itHasReachedEndOfInput ( false )
 			{
 			}
 			
+			void ReceiveData( const char* data, std::size_t byteCount );
+			
 			bool ReceiveBlock( poseven::fd_t socket );
 			
 			void ReceiveHeader( poseven::fd_t socket );
 			
 			void Receive( poseven::fd_t socket );
 			
+			const MessageParser& GetParser() const  { return itsParser; }
+			
 			const plus::string& GetMessageStream() const  { return itsReceivedData; }
 			
-			plus::string GetStatusLine() const  { return plus::string( itsReceivedData.data(), itsStartOfHeaderFields - 2 ); }
+			plus::string GetStatusLine() const  { return plus::string( itsReceivedData.data(), itsParser.GetStartOfHeaderFields() - 2 ); }
 			
-			const char* GetHeaderStream() const  { return itsReceivedData.data() + itsStartOfHeaderFields; }
+			const char* GetHeaderStream() const  { return itsReceivedData.data() + itsParser.GetStartOfHeaderFields(); }
 			
-			const HeaderIndex& GetHeaderIndex() const  { return itsHeaderIndex; }
+			const HeaderIndex& GetHeaderIndex() const  { return itsParser.GetHeaderIndex(); }
+			
+			const HeaderFieldEntry* FindHeaderField( known_header_field field ) const
+			{
+				return itsParser.Find( field );
+			}
+			
+			const HeaderFieldEntry* FindHeaderField( const char* name, std::size_t length ) const
+			{
+				return itsParser.Find( GetHeaderStream(), name, length );
+			}
 			
 			plus::string GetHeaderField( const plus::string& name, const char* nullValue = NULL );
 			
@@ -91,6 +227,10 @@ namespace HTTP
 	class ResponseReceiver : public MessageReceiver
 	{
 		public:
+			ResponseReceiver() : MessageReceiver( true )
+			{
+			}
+			
 			plus::string GetResult() const;
 			
 			unsigned GetResultCode() const;
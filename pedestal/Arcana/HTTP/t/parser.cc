@@ -0,0 +1,226 @@
+/*
+	t/parser.cc
+	-----------
+*/
+
+// Standard C
+#include <string.h>
+
+// iota
+#include "iota/strings.hh"
+
+// plus
+#include "plus/var_string.hh"
+
+// Arcana
+#include "HTTP.hh"
+
+// tap-out
+#include "tap/test.hh"
+
+
+static const unsigned n_tests = 6 + 4 + 3 + 3 + 2;
+
+
+using tap::ok_if;
+
+
+static bool field_value_is( const char*                    message,
+                            const HTTP::MessageParser&     parser,
+                            const HTTP::HeaderFieldEntry*  entry,
+                            const char*                    value,
+                            std::size_t                    length )
+{
+	if ( entry == NULL )
+	{
+		return false;
+	}
+	
+	const char* stream = message + parser.GetStartOfHeaderFields();
+	
+	return entry->crlf_offset - entry->value_offset == length
+	    && memcmp( stream + entry->value_offset, value, length ) == 0;
+}
+
+static void byte_at_a_time()
+{
+	const char message[] = "GET / HTTP/1.1"       "\r\n"
+	                       "Host: example.com"    "\r\n"
+	                       "X-Custom:\tvalue"     "\r\n"
+	                       "content-LENGTH: 3"    "\r\n"
+	                                              "\r\n"
+	                       "abc";
+	
+	const std::size_t header_size = sizeof message - 1 - STRLEN( "abc" );
+	
+	HTTP::MessageParser parser;
+	
+	std::size_t size = 0;
+	
+	while ( size < header_size  &&  !parser.ParseHeader( message, ++size ) )
+	{
+		continue;
+	}
+	
+	ok_if( size == header_size, "header completes at the empty line" );
+	
+	ok_if( parser.GetHeaderSize() == header_size );
+	
+	ok_if( parser.GetHeaderIndex().size() == 3 );
+	
+	ok_if( field_value_is( message, parser, parser.Find( HTTP::field_host ), STR_LEN( "example.com" ) ) );
+	
+	const HTTP::HeaderFieldEntry* custom = parser.Find( message + parser.GetStartOfHeaderFields(),
+	                                                    STR_LEN( "x-custom" ) );
+	
+	ok_if( field_value_is( message, parser, custom, STR_LEN( "value" ) ), "case-insensitive lookup" );
+	
+	ok_if( parser.GetBodyFraming() == HTTP::body_sized  &&  parser.GetContentLength() == 3 );
+}
+
+static void sized_body()
+{
+	const char message[] = "POST / HTTP/1.1"     "\r\n"
+	                       "Content-Length: 3"   "\r\n"
+	                                             "\r\n"
+	                       "abc"
+	                       "GET /";
+	
+	HTTP::MessageParser parser;
+	
+	ok_if( parser.ParseHeader( message, sizeof message - 1 ) );
+	
+	const char* body = message + parser.GetHeaderSize();
+	
+	const char* payload;
+	std::size_t payload_size;
+	
+	std::size_t consumed = parser.ParseBody( body, strlen( body ), payload, payload_size );
+	
+	ok_if( consumed == 3  &&  payload == body  &&  payload_size == 3 );
+	
+	ok_if( parser.IsComplete(), "next request is not consumed" );
+	
+	parser.Reset();
+	
+	ok_if( !parser.HasCompleteHeader()  &&  parser.GetHeaderIndex().empty() );
+}
+
+static void chunked_body()
+{
+	const char header[] = "HTTP/1.1 200 OK"                 "\r\n"
+	                      "Transfer-Encoding: chunked"      "\r\n"
+	                                                        "\r\n";
+	
+	const char body[] = "5;name=value"  "\r\n"
+	                    "hello"         "\r\n"
+	                    "A"             "\r\n"
+	                    ", world..!"    "\r\n"
+	                    "0"             "\r\n"
+	                    "Trailer: x"    "\r\n"
+	                                    "\r\n";
+	
+	HTTP::MessageParser parser( true );
+	
+	parser.ParseHeader( header, sizeof header - 1 );
+	
+	ok_if( parser.GetBodyFraming() == HTTP::body_chunked );
+	
+	plus::var_string content;
+	
+	// Feed the body in two-byte pieces to exercise every state transition
+	
+	for ( const char* p = body;  *p != '\0'  &&  !parser.IsComplete(); )
+	{
+		const std::size_t n = p[1] != '\0' ? 2 : 1;
+		
+		std::size_t i = 0;
+		
+		while ( i < n  &&  !parser.IsComplete() )
+		{
+			const char* payload;
+			std::size_t payload_size;
+			
+			i += parser.ParseBody( p + i, n - i, payload, payload_size );
+			
+			content.append( payload, payload_size );
+		}
+		
+		p += n;
+	}
+	
+	ok_if( content == "hello, world..!" );
+	
+	ok_if( parser.IsComplete()  &&  parser.GetContentLength() == 15 );
+}
+
+static void malformed()
+{
+	HTTP::MessageParser parser;
+	
+	bool threw = false;
+	
+	try
+	{
+		parser.ParseHeader( STR_LEN( "GET / HTTP/1.1\r\nNo colon here\r\n\r\n" ) );
+	}
+	catch ( const HTTP::MalformedHeader& )
+	{
+		threw = true;
+	}
+	
+	ok_if( threw, "field without a colon" );
+	
+	parser.Reset();
+	
+	parser.ParseHeader( STR_LEN( "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n" ) );
+	
+	threw = false;
+	
+	try
+	{
+		const char* payload;
+		std::size_t payload_size;
+		
+		parser.ParseBody( STR_LEN( "\r\n" ), payload, payload_size );
+	}
+	catch ( const HTTP::MalformedChunkedBody& )
+	{
+		threw = true;
+	}
+	
+	ok_if( threw, "chunk size line without digits" );
+	
+	const char response[] = "HTTP/1.1 304 Not Modified\r\n\r\n";
+	
+	HTTP::MessageParser not_modified( true );
+	
+	not_modified.ParseHeader( response, sizeof response - 1 );
+	
+	ok_if( not_modified.IsComplete(), "304 has no body" );
+}
+
+static void receiver()
+{
+	HTTP::ResponseReceiver response;
+	
+	response.ReceiveData( STR_LEN( "HTTP/1.1 404 Not Found\r\nContent-Type: text/plain\r\n" ) );
+	response.ReceiveData( STR_LEN( "Content-Length: 4\r\n\r\nnope" ) );
+	
+	ok_if( response.GetResultCode() == 404  &&  response.GetPartialContent() == "nope" );
+	
+	ok_if( response.GetHeaderField( "content-type" ) == "text/plain" );
+}
+
+int main( int argc, const char *const *argv )
+{
+	tap::start( "parser", n_tests );
+	
+	byte_at_a_time();
+	sized_body();
+	chunked_body();
+	malformed();
+	receiver();
+	
+	return 0;
+}
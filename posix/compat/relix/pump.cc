@@ -10,76 +10,378 @@
 // Standard C++
 #include <algorithm>
 
+// Standard C
+#include <stdlib.h>
+
 // POSIX
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
+#ifdef __linux__
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#endif
+
 
 #ifndef __RELIX__
 
-ssize_t pump( int fd_in, off_t* off_in, int fd_out, off_t* off_out, size_t count, unsigned flags )
+// Each method moves at most this much per call, and stops at EOF if count is 0.
+
+static const size_t max_chunk = 1024 * 1024 * 1024;
+
+static inline size_t chunk_size( size_t count, size_t pumped, size_t limit = max_chunk )
+{
+	return count ? std::min( count - pumped, limit ) : limit;
+}
+
+static inline ssize_t pump_result( ssize_t last, size_t pumped )
 {
-	const std::size_t buffer_size = 4096;
+	// Report an error only if nothing was transferred, as read() does.
 	
-	char buffer[ buffer_size ];
+	return last < 0  &&  pumped == 0 ? -1 : pumped;
+}
+
+#ifdef __linux__
+
+static ssize_t sys_copy_file_range( int fd_in, loff_t* off_in, int fd_out, loff_t* off_out, size_t len )
+{
+#ifdef __NR_copy_file_range
+
+	return syscall( __NR_copy_file_range, fd_in, off_in, fd_out, off_out, len, 0 );
+	
+#endif
+
+	errno = ENOSYS;
 	
-	if ( off_in != NULL )
+	return -1;
+}
+
+static ssize_t pump_copy_file_range( int fd_in, off_t* off_in, int fd_out, off_t* off_out, size_t count )
+{
+	loff_t in_offset  = off_in  ? *off_in  : 0;
+	loff_t out_offset = off_out ? *off_out : 0;
+	
+	size_t pumped = 0;
+	
+	ssize_t n;
+	
+	while ( (n = sys_copy_file_range( fd_in,  off_in  ? &in_offset  : NULL,
+	                                  fd_out, off_out ? &out_offset : NULL,
+	                                  chunk_size( count, pumped ) )) > 0 )
 	{
-		if ( lseek( fd_in, *off_in, 0 ) == -1 )
+		pumped += n;
+		
+		if ( pumped == count )
 		{
-			return -1;
+			break;
 		}
 	}
 	
-	if ( off_out != NULL )
+	if ( off_in  )  *off_in  = in_offset;
+	if ( off_out )  *off_out = out_offset;
+	
+	return pump_result( n, pumped );
+}
+
+static ssize_t pump_sendfile( int fd_in, off_t* off_in, int fd_out, size_t count )
+{
+	size_t pumped = 0;
+	
+	ssize_t n;
+	
+	while ( (n = sendfile( fd_out, fd_in, off_in, chunk_size( count, pumped ) )) > 0 )
 	{
-		if ( lseek( fd_out, *off_out, 0 ) == -1 )
+		pumped += n;
+		
+		if ( pumped == count )
 		{
-			return -1;
+			break;
 		}
 	}
 	
-	ssize_t bytes_pumped = 0;
+	return pump_result( n, pumped );
+}
+
+static ssize_t pump_splice( int fd_in, off_t* off_in, int fd_out, off_t* off_out, size_t count )
+{
+	// One end is a pipe.
+	
+	loff_t in_offset  = off_in  ? *off_in  : 0;
+	loff_t out_offset = off_out ? *off_out : 0;
+	
+	size_t pumped = 0;
+	
+	ssize_t n;
 	
-	while ( int bytes_read = read( fd_in, buffer, count ? std::min( count - bytes_pumped, buffer_size ) : buffer_size ) )
+	while ( (n = splice( fd_in,  off_in  ? &in_offset  : NULL,
+	                     fd_out, off_out ? &out_offset : NULL,
+	                     chunk_size( count, pumped ),
+	                     SPLICE_F_MOVE )) > 0 )
 	{
-		if ( bytes_read == -1 )
+		pumped += n;
+		
+		if ( pumped == count )
 		{
-			return bytes_pumped == 0 ? -1 : bytes_pumped;
+			break;
 		}
+	}
+	
+	if ( off_in  )  *off_in  = in_offset;
+	if ( off_out )  *off_out = out_offset;
+	
+	return pump_result( n, pumped );
+}
+
+static ssize_t pump_splice_via_pipe( int fd_in, off_t* off_in, int fd_out, off_t* off_out, size_t count )
+{
+	int pipe_fds[ 2 ];
+	
+	if ( pipe( pipe_fds ) < 0 )
+	{
+		return -1;
+	}
+	
+	const int reader = pipe_fds[ 0 ];
+	const int writer = pipe_fds[ 1 ];
+	
+	size_t pipe_size = 64 * 1024;
+	
+#ifdef F_SETPIPE_SZ
+
+	// A bigger pipe means fewer round trips; it's fine if we can't have one.
+	
+	const int resized = fcntl( writer, F_SETPIPE_SZ, 1024 * 1024 );
+	
+	if ( resized > 0 )
+	{
+		pipe_size = resized;
+	}
+	
+#endif
+
+	loff_t in_offset  = off_in  ? *off_in  : 0;
+	loff_t out_offset = off_out ? *off_out : 0;
+	
+	size_t pumped = 0;
+	
+	ssize_t n;
+	
+	while ( (n = splice( fd_in, off_in ? &in_offset : NULL,
+	                     writer, NULL,
+	                     chunk_size( count, pumped, pipe_size ),
+	                     SPLICE_F_MOVE )) > 0 )
+	{
+		// Drain the pipe completely, since its contents have left fd_in.
 		
-		int bytes_written = write( fd_out, buffer, bytes_read );
-		
-		if ( bytes_written == -1 )
+		do
 		{
-			return -1;
+			ssize_t written = splice( reader, NULL,
+			                          fd_out, off_out ? &out_offset : NULL,
+			                          n,
+			                          SPLICE_F_MOVE );
+			
+			if ( written <= 0 )
+			{
+				if ( written == 0 )
+				{
+					errno = EIO;
+				}
+				
+				n = -1;
+				
+				goto done;
+			}
+			
+			pumped += written;
+			
+			n -= written;
 		}
+		while ( n > 0 );
 		
-		if ( bytes_written != bytes_read )
+		if ( pumped == count )
 		{
-			errno = EIO;
-			return -1;
+			break;
 		}
+	}
+	
+done:
+	
+	const int saved_errno = errno;
+	
+	close( reader );
+	close( writer );
+	
+	errno = saved_errno;
+	
+	if ( off_in  )  *off_in  = in_offset;
+	if ( off_out )  *off_out = out_offset;
+	
+	return pump_result( n, pumped );
+}
+
+static bool is_unsupported( int error )
+{
+	// Errors that mean "not for these files", before anything was moved
+	
+	switch ( error )
+	{
+		case EBADF:  // copy_file_range() with O_APPEND
+		case EINVAL:
+		case ENOSYS:
+		case EXDEV:
+		case EOPNOTSUPP:
+			return true;
 		
-		bytes_pumped += bytes_written;
+		default:
+			return false;
 	}
+}
+
+static inline bool settled( ssize_t result )
+{
+	/*
+		A method that moved nothing might not understand the files (e.g.
+		procfs files can look empty to copy_file_range()), so the next one
+		gets a try.  At genuine EOF, that costs a few extra system calls.
+	*/
+	
+	return result > 0  ||  (result < 0  &&  !is_unsupported( errno ));
+}
+
+static inline bool is_spliceable( const struct stat& sb )
+{
+	return S_ISREG( sb.st_mode )  ||  S_ISSOCK( sb.st_mode );
+}
+
+#endif  // #ifdef __linux__
+
+static ssize_t pump_buffered( int fd_in, off_t* off_in, int fd_out, off_t* off_out, size_t count )
+{
+	const size_t buffer_size = 128 * 1024;
+	
+	char* buffer = (char*) malloc( buffer_size );
 	
-	if ( off_in != NULL )
+	if ( buffer == NULL )
 	{
-		lseek( fd_in, *off_in, 0 );
+		errno = ENOMEM;
 		
-		*off_in += bytes_pumped;
+		return -1;
 	}
 	
-	if ( off_out != NULL )
+	size_t pumped = 0;
+	
+	ssize_t n;
+	
+	while ( (n = off_in ? pread( fd_in, buffer, chunk_size( count, pumped, buffer_size ), *off_in + pumped )
+	                    : read ( fd_in, buffer, chunk_size( count, pumped, buffer_size ) )) > 0 )
 	{
-		lseek( fd_out, *off_out, 0 );
+		size_t written = 0;
 		
-		*off_out += bytes_pumped;
+		do
+		{
+			ssize_t m = off_out ? pwrite( fd_out, buffer + written, n - written, *off_out + pumped + written )
+			                    : write ( fd_out, buffer + written, n - written );
+			
+			if ( m < 0 )
+			{
+				pumped += written;
+				
+				n = -1;
+				
+				goto done;
+			}
+			
+			written += m;
+		}
+		while ( written < (size_t) n );
+		
+		pumped += n;
+		
+		if ( pumped == count )
+		{
+			break;
+		}
 	}
 	
-	return bytes_pumped;
+done:
+	
+	const int saved_errno = errno;
+	
+	free( buffer );
+	
+	errno = saved_errno;
+	
+	if ( off_in  )  *off_in  += pumped;
+	if ( off_out )  *off_out += pumped;
+	
+	return pump_result( n, pumped );
 }
 
+ssize_t pump( int fd_in, off_t* off_in, int fd_out, off_t* off_out, size_t count, unsigned flags )
+{
+#ifdef __linux__
+
+	struct stat in, out;
+	
+	if ( fstat( fd_in, &in ) < 0  ||  fstat( fd_out, &out ) < 0 )
+	{
+		return -1;
+	}
+	
+	ssize_t result;
+	
+	if ( !(flags & PUMP_NO_COPY_FILE_RANGE)  &&  S_ISREG( in.st_mode )  &&  S_ISREG( out.st_mode ) )
+	{
+		if ( settled( result = pump_copy_file_range( fd_in, off_in, fd_out, off_out, count ) ) )
+		{
+			return result;
+		}
+	}
+	
+	// sendfile() writes at the current position of fd_out only.
+	
+	if ( !(flags & PUMP_NO_SENDFILE)  &&  S_ISREG( in.st_mode )  &&  off_out == NULL )
+	{
+		if ( settled( result = pump_sendfile( fd_in, off_in, fd_out, count ) ) )
+		{
+			return result;
+		}
+	}
+	
+	if ( !(flags & PUMP_NO_SPLICE) )
+	{
+		if ( S_ISFIFO( in.st_mode )  ||  S_ISFIFO( out.st_mode ) )
+		{
+			if ( settled( result = pump_splice( fd_in, off_in, fd_out, off_out, count ) ) )
+			{
+				return result;
+			}
+		}
+		else if ( is_spliceable( in )  &&  is_spliceable( out ) )
+		{
+			/*
+				Once data is in the intermediate pipe, it's gone from fd_in,
+				so only use it where writes can't be refused for want of
+				kernel support or blocking.
+			*/
+			
+			const int out_flags = fcntl( fd_out, F_GETFL );
+			
+			if ( out_flags >= 0  &&  !(out_flags & (O_APPEND | O_NONBLOCK)) )
+			{
+				if ( settled( result = pump_splice_via_pipe( fd_in, off_in, fd_out, off_out, count ) ) )
+				{
+					return result;
+				}
+			}
+		}
+	}
+	
 #endif
 
+	return pump_buffered( fd_in, off_in, fd_out, off_out, count );
+}
+
+#endif
@@ -13,6 +13,21 @@
 
 #ifndef __RELIX__
 
+/*
+	Outside of Relix, pump() chooses the fastest transfer the host offers
+	for the given file descriptors -- on Linux, copy_file_range() between
+	regular files, sendfile() from a regular file, or splice() (through an
+	intermediate pipe if neither end is one) -- and otherwise copies with
+	large pread()/pwrite() calls.  These flags rule out specific methods,
+	mainly so they can be compared.
+*/
+
+#define PUMP_NO_COPY_FILE_RANGE  0x01
+#define PUMP_NO_SENDFILE         0x02
+#define PUMP_NO_SPLICE           0x04
+
+#define PUMP_BUFFERED  (PUMP_NO_COPY_FILE_RANGE | PUMP_NO_SENDFILE | PUMP_NO_SPLICE)
+
 #ifdef __cplusplus
 extern "C"
 #endif
@@ -22,4 +37,3 @@ ssize_t pump( int fd_in, off_t* off_in, int fd_out, off_t* off_out, size_t count
 #endif
 
 #endif
-
@@ -215,6 +215,7 @@ char *progname;       /* program name */
 int maxbits = BITS;   /* max bits per code for LZW */
 int method = DEFLATED;/* compression method */
 int level = 6;        /* compression level */
+int processes = 1;    /* compress on this many threads (-p) */
 int exit_code = OK;   /* program exit code */
 int save_orig_name;   /* set if original name must be saved */
 int last_member;      /* set for .zip and .Z files */
@@ -256,6 +257,7 @@ struct option longopts[] =
     {"license",    0, 0, 'L'}, /* display software license */
     {"no-name",    0, 0, 'n'}, /* don't save or restore original name & time */
     {"name",       0, 0, 'N'}, /* save or restore original name & time */
+    {"processes",  1, 0, 'p'}, /* compress on this many threads */
     {"quiet",      0, 0, 'q'}, /* quiet mode */
     {"silent",     0, 0, 'q'}, /* quiet mode */
     {"recursive",  0, 0, 'r'}, /* recurse through directories */
@@ -307,7 +309,7 @@ local void reset_times  OF((char *name, struct stat *statb));
 /* ======================================================================== */
 local void usage()
 {
-    fprintf(stderr, "usage: %s [-%scdfhlLnN%stvV19] [-S suffix] [file ...]\n",
+    fprintf(stderr, "usage: %s [-%scdfhlLnN%stvV19] [-p n] [-S suffix] [file ...]\n",
 	    progname,
 #if O_BINARY
 	    "a",
@@ -343,6 +345,7 @@ local void help()
 #endif
  " -n --no-name     do not save or restore the original name and time stamp",
  " -N --name        save or restore the original name and time stamp",
+ " -p --processes n compress on n threads at once",
  " -q --quiet       suppress all warnings",
 #ifndef NO_DIR
  " -r --recursive   operate recursively on directories",
@@ -478,7 +481,7 @@ int main (argc, argv)
     strncpy(z_suffix, Z_SUFFIX, sizeof(z_suffix)-1);
     z_len = strlen(z_suffix);
 
-    while ((optc = getopt_long (argc, argv, "ab:cdfhH?lLmMnNqrS:tvVZ123456789",
+    while ((optc = getopt_long (argc, argv, "ab:cdfhH?lLmMnNp:qrS:tvVZ123456789",
 				longopts, (int *)0)) != EOF) {
 	switch (optc) {
         case 'a':
@@ -506,6 +509,15 @@ int main (argc, argv)
 	    no_name = no_time = 1; break;
 	case 'N':
 	    no_name = no_time = 0; break;
+	case 'p':
+	    processes = atoi(optarg);
+	    if (processes < 1) {
+		fprintf(stderr, "%s: -p needs at least one process\n",
+			progname);
+		usage();
+		do_exit(ERROR);
+	    }
+	    break;
 	case 'q':
 	    quiet = 1; verbose = 0; break;
 	case 'r':
@@ -198,6 +198,7 @@ extern int exit_code;      /* program exit code */
 extern int verbose;        /* be verbose (-v) */
 extern int quiet;          /* be quiet (-q) */
 extern int level;          /* compression level */
+extern int processes;      /* compress on this many threads (-p) */
 extern int test;           /* check .z file integrity */
 extern int to_stdout;      /* output to stdout (-c) */
 extern int save_orig_name; /* set if original name must be saved */
@@ -284,6 +285,7 @@ extern int unlzh      OF((int in, int out));
 RETSIGTYPE abort_gzip OF((void));
 
         /* in deflate.c */
+#define deflate gzip_deflate  /* not zlib's, which -p uses */
 void lm_init OF((int pack_level, ush *flags));
 ulg  deflate OF((void));
 
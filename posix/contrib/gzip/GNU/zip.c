@@ -27,6 +27,7 @@ static char rcsid[] = "$Id$";
 
 #include "gzip.h"
 #include "crypt.h"
+#include "parallel.h"
 
 #ifdef HAVE_UNISTD_H
 #  include <unistd.h>
@@ -75,9 +76,14 @@ int zip(in, out)
     /* Write deflated file to zip file */
     crc = updcrc(0, 0);
 
-    bi_init(out);
-    ct_init(&attr, &method);
-    lm_init(level, &deflate_flags);
+    if (processes > 1) {
+	/* Same extra flags as lm_init() would have set */
+	deflate_flags = level == 1 ? 4 : level == 9 ? 2 : 0;
+    } else {
+	bi_init(out);
+	ct_init(&attr, &method);
+	lm_init(level, &deflate_flags);
+    }
 
     put_byte((uch)deflate_flags); /* extra flags */
     put_byte(OS_CODE);            /* OS identifier */
@@ -94,7 +100,20 @@ int zip(in, out)
     }
     header_bytes = (long)outcnt;
 
-    (void)deflate();
+    if (processes > 1) {
+	long n;
+	ulg size;
+
+	flush_outbuf();
+	n = parallel_deflate(in, out, level, processes, write_buf,
+			     &crc, &size);
+	if (n == -1) read_error();
+	if (n < 0) error("out of memory");
+	isize += (ulg)size;  /* i.e. bytes_in, as file_read() counts it */
+	bytes_out += n;
+    } else {
+	(void)deflate();
+    }
 
 #if !defined(NO_SIZE_CHECK) && !defined(RECORD_IO)
   /* Check input size (but not in VMS -- variable record lengths mess it up)
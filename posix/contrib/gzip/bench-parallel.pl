@@ -0,0 +1,85 @@
+#!/usr/bin/perl
+
+# Times gzip -p N against plain gzip, checking that each output gunzips.
+#
+#   bench-parallel.pl [gzip [file]]
+#
+# Without a file, about 32 MB of log-like text is made up for the purpose.
+
+use warnings;
+use strict;
+
+use Time::HiRes qw( time );
+
+my $gzip  = shift || "gzip";
+my $input = shift;
+
+my @modes = ( "", map { "-p $_" } 1, 2, 4, 8 );
+
+my $rounds = 3;  # the best is reported
+
+my $output = "/tmp/bench-parallel.$$.gz";
+
+my $made_up;
+
+if ( !defined $input )
+{
+	$input = $made_up = "/tmp/bench-parallel.$$";
+	
+	open my $out, ">", $input or die "Can't write $input: $!\n";
+	
+	my @words = qw( open read write close stat accept connect fork exec wait
+	                ok failed retry timeout queued sent deferred refused );
+	
+	my $seed = 1;
+	
+	for my $i ( 1 .. 400_000 )
+	{
+		my $line = sprintf "%08d %5d", $i, $i % 9973;
+		
+		for ( 1 .. 8 )
+		{
+			$seed = ($seed * 1103515245 + 12345) % 2**31;
+			
+			$line .= " " . $words[ $seed % @words ] . ($seed >> 20);
+		}
+		
+		print $out $line, "\n";
+	}
+	
+	close $out;
+}
+
+my $size = -s $input;
+
+my $baseline;
+
+for my $mode ( @modes )
+{
+	my $best;
+	
+	for ( 1 .. $rounds )
+	{
+		my $start = time;
+		
+		system( "$gzip -c $mode < $input > $output" ) == 0 or die "$gzip $mode failed\n";
+		
+		my $elapsed = time - $start;
+		
+		$best = $elapsed if !defined $best  ||  $elapsed < $best;
+	}
+	
+	system( "gunzip -c < $output | cmp -s - $input" ) == 0 or die "$gzip $mode: output doesn't match\n";
+	
+	$baseline = $best if !defined $baseline;
+	
+	printf "%-6s  %7.1f MB/s  %5.1f%% of input  %5.2fx\n",
+	       $mode || "plain",
+	       $size / $best / 1e6,
+	       100 * (-s $output) / $size,
+	       $baseline / $best;
+}
+
+unlink $output;
+
+unlink $made_up if defined $made_up;
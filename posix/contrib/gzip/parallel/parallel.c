@@ -0,0 +1,390 @@
+/* parallel.c -- block-parallel deflate for gzip -p
+ *
+ * The reading thread cuts the input into BLOCK_SIZE blocks and hands them
+ * to a pool of workers through a ring of jobs.  Each worker runs zlib's
+ * deflate on its block as a raw stream, primed with the preceding 32K of
+ * input (so matches can reach back across the seam) and ending with a
+ * sync flush -- or with the final block, for the last one -- so the
+ * compressed blocks concatenate into one valid deflate stream.  The
+ * reading thread also writes the finished blocks, in order, and combines
+ * their crcs.
+ *
+ * Without threads, the same code compresses each block as it's read.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+
+#ifdef _POSIX_THREADS
+#  include <pthread.h>
+#endif
+
+#include "zlib.h"
+
+#include "parallel.h"
+
+#define BLOCK_SIZE  (128 * 1024)
+#define DICT_SIZE   (32 * 1024)
+
+enum { FREE, READY, DONE };
+
+typedef struct job {
+    int             state;
+    int             last;      /* ends the stream */
+    unsigned char  *in;        /* DICT_SIZE of history, then the block */
+    unsigned        dict_len;
+    unsigned        in_len;
+    unsigned char  *out;
+    unsigned        out_size;
+    unsigned        out_len;
+    unsigned long   crc;       /* of the block alone */
+    int             failed;    /* out of memory */
+} job;
+
+typedef struct pool {
+    job            *jobs;
+    int             n_jobs;
+    int             level;
+    unsigned long   filled;    /* jobs handed out by the reader */
+    unsigned long   taken;     /* jobs picked up by the workers */
+    int             quit;
+#ifdef _POSIX_THREADS
+    pthread_mutex_t lock;
+    pthread_cond_t  work;      /* signaled when a job is READY, or quit */
+    pthread_cond_t  done;      /* signaled when a job is DONE */
+#endif
+} pool;
+
+/* ===========================================================================
+ * Compress one job's block with a stream that's been initialized (and is
+ * reset here).  Sets j->failed if the output buffer can't grow.
+ */
+static void compress_job(z_stream *strm, job *j)
+{
+    int flush = j->last ? Z_FINISH : Z_SYNC_FLUSH;
+    int ret;
+
+    deflateReset(strm);
+
+    if (j->dict_len) {
+        deflateSetDictionary(strm, j->in + DICT_SIZE - j->dict_len,
+                             j->dict_len);
+    }
+
+    strm->next_in  = j->in + DICT_SIZE;
+    strm->avail_in = j->in_len;
+
+    j->out_len = 0;
+
+    for (;;) {
+        if (j->out_len == j->out_size) {
+            unsigned size = j->out_size * 2;
+            unsigned char *out = (unsigned char *) realloc(j->out, size);
+
+            if (out == NULL) {
+                j->failed = 1;
+                break;
+            }
+
+            j->out      = out;
+            j->out_size = size;
+        }
+
+        strm->next_out  = j->out      + j->out_len;
+        strm->avail_out = j->out_size - j->out_len;
+
+        ret = deflate(strm, flush);
+
+        j->out_len = j->out_size - strm->avail_out;
+
+        /* A flush is complete once deflate stops short of filling the
+         * buffer; finishing is complete at the end of the stream.
+         */
+        if (ret == Z_STREAM_END) break;
+        if (flush == Z_SYNC_FLUSH && strm->avail_out != 0) break;
+    }
+
+    j->crc = crc32(0L, j->in + DICT_SIZE, j->in_len);
+}
+
+static int init_stream(z_stream *strm, int level)
+{
+    memset(strm, 0, sizeof *strm);
+
+    return deflateInit2(strm, level, Z_DEFLATED, -MAX_WBITS, 8,
+                        Z_DEFAULT_STRATEGY);
+}
+
+#ifdef _POSIX_THREADS
+
+static void *worker(void *arg)
+{
+    pool *p = (pool *) arg;
+    z_stream strm;
+    int ok = init_stream(&strm, p->level) == Z_OK;
+
+    pthread_mutex_lock(&p->lock);
+
+    for (;;) {
+        job *j;
+
+        while (p->taken == p->filled && !p->quit) {
+            pthread_cond_wait(&p->work, &p->lock);
+        }
+
+        if (p->taken == p->filled) break;
+
+        j = &p->jobs[p->taken++ % p->n_jobs];
+
+        pthread_mutex_unlock(&p->lock);
+
+        if (ok) {
+            compress_job(&strm, j);
+        } else {
+            j->failed = 1;
+        }
+
+        pthread_mutex_lock(&p->lock);
+
+        j->state = DONE;
+
+        pthread_cond_signal(&p->done);
+    }
+
+    pthread_mutex_unlock(&p->lock);
+
+    if (ok) deflateEnd(&strm);
+
+    return NULL;
+}
+
+#endif
+
+/* ===========================================================================
+ * Read up to BLOCK_SIZE bytes into the job, after its dictionary.
+ * Returns the count, or -1 on error.
+ */
+static long read_block(int in, job *j)
+{
+    unsigned char *buf = j->in + DICT_SIZE;
+    long n = 0;
+
+    while (n < BLOCK_SIZE) {
+        long got = read(in, buf + n, BLOCK_SIZE - n);
+
+        if (got < 0 && errno == EINTR) continue;
+        if (got < 0) return -1;
+        if (got == 0) break;
+
+        n += got;
+    }
+
+    return n;
+}
+
+long parallel_deflate(int in, int out, int level, int n_threads,
+                      pzip_writer write_out,
+                      unsigned long *crc, unsigned long *in_size)
+{
+    pool p;
+    unsigned char dict[DICT_SIZE];
+    unsigned dict_len = 0;
+    unsigned long written = 0;
+    int eof = 0;
+    int failed = 0;       /* out of memory */
+    int read_failed = 0;
+    long bytes = 0;
+    int i;
+#ifdef _POSIX_THREADS
+    pthread_t *threads = NULL;
+    int n_started = 0;
+#else
+    z_stream strm;
+    int ok;
+#endif
+
+    *crc     = 0;
+    *in_size = 0;
+
+#ifdef _POSIX_THREADS
+    if (n_threads < 1) n_threads = 1;
+
+    /* Two jobs per thread keeps every worker busy while blocks are
+     * being read and written.
+     */
+    p.n_jobs = n_threads * 2;
+#else
+    p.n_jobs = 1;
+#endif
+
+    p.level  = level;
+    p.filled = 0;
+    p.taken  = 0;
+    p.quit   = 0;
+
+    p.jobs = (job *) calloc(p.n_jobs, sizeof (job));
+
+    if (p.jobs == NULL) return -2;
+
+    for (i = 0; i < p.n_jobs; i++) {
+        job *j = &p.jobs[i];
+
+        j->out_size = BLOCK_SIZE + BLOCK_SIZE / 8;
+
+        j->in  = (unsigned char *) malloc(DICT_SIZE + BLOCK_SIZE);
+        j->out = (unsigned char *) malloc(j->out_size);
+
+        if (j->in == NULL || j->out == NULL) failed = 1;
+    }
+
+#ifdef _POSIX_THREADS
+    pthread_mutex_init(&p.lock, NULL);
+    pthread_cond_init(&p.work, NULL);
+    pthread_cond_init(&p.done, NULL);
+
+    if (!failed) {
+        threads = (pthread_t *) malloc(n_threads * sizeof (pthread_t));
+    }
+
+    if (threads != NULL) {
+        while (n_started < n_threads &&
+               pthread_create(&threads[n_started], NULL, worker, &p) == 0) {
+            n_started++;
+        }
+    }
+
+    if (n_started == 0) failed = 1;
+#else
+    ok = init_stream(&strm, level) == Z_OK;
+
+    if (!ok) failed = 1;
+#endif
+
+    eof = failed;
+
+    for (;;) {
+        job *j;
+
+        if (!eof && p.filled - written < (unsigned long) p.n_jobs) {
+            long n;
+
+            j = &p.jobs[p.filled % p.n_jobs];
+
+            memcpy(j->in + DICT_SIZE - dict_len, dict, dict_len);
+
+            j->dict_len = dict_len;
+
+            n = read_block(in, j);
+
+            if (n < 0) {
+                read_failed = 1;
+                n = 0;
+            }
+
+            j->in_len = (unsigned) n;
+            j->last   = n < BLOCK_SIZE;
+            j->failed = 0;
+
+            if (j->last) {
+                eof = 1;
+            }
+
+            /* The next block's dictionary is the end of this one. */
+            dict_len = n < DICT_SIZE ? (unsigned) n : DICT_SIZE;
+
+            memcpy(dict, j->in + DICT_SIZE + n - dict_len, dict_len);
+
+            *in_size += (unsigned long) n;
+
+#ifdef _POSIX_THREADS
+            pthread_mutex_lock(&p.lock);
+
+            j->state = READY;
+            p.filled++;
+
+            pthread_cond_signal(&p.work);
+            pthread_mutex_unlock(&p.lock);
+#else
+            compress_job(&strm, j);
+
+            j->state = DONE;
+            p.filled++;
+#endif
+        }
+
+        if (written == p.filled) {
+            if (eof) break;
+            continue;
+        }
+
+        /* Write the oldest job if it's done.  Wait for it only when the
+         * ring is full or there's nothing left to read.
+         */
+        j = &p.jobs[written % p.n_jobs];
+
+#ifdef _POSIX_THREADS
+        pthread_mutex_lock(&p.lock);
+
+        if (j->state != DONE && !eof &&
+            p.filled - written < (unsigned long) p.n_jobs) {
+            pthread_mutex_unlock(&p.lock);
+            continue;
+        }
+
+        while (j->state != DONE) {
+            pthread_cond_wait(&p.done, &p.lock);
+        }
+
+        pthread_mutex_unlock(&p.lock);
+#endif
+
+        if (j->failed) {
+            failed = 1;
+            eof = 1;
+        }
+
+        if (!failed && !read_failed) {
+            write_out(out, j->out, j->out_len);
+
+            bytes += (long) j->out_len;
+
+            *crc = crc32_combine(*crc, j->crc, (z_off_t) j->in_len);
+        }
+
+        j->state = FREE;
+        written++;
+    }
+
+#ifdef _POSIX_THREADS
+    pthread_mutex_lock(&p.lock);
+
+    p.quit = 1;
+
+    pthread_cond_broadcast(&p.work);
+    pthread_mutex_unlock(&p.lock);
+
+    for (i = 0; i < n_started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    free(threads);
+
+    pthread_cond_destroy(&p.done);
+    pthread_cond_destroy(&p.work);
+    pthread_mutex_destroy(&p.lock);
+#else
+    if (ok) deflateEnd(&strm);
+#endif
+
+    for (i = 0; i < p.n_jobs; i++) {
+        free(p.jobs[i].in);
+        free(p.jobs[i].out);
+    }
+
+    free(p.jobs);
+
+    return read_failed ? -1 : failed ? -2 : bytes;
+}
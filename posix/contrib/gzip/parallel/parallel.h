@@ -0,0 +1,23 @@
+/* parallel.h -- block-parallel deflate for gzip -p
+ *
+ * The input is cut into blocks which are compressed independently, each
+ * primed with the last 32K of the block before it, and the raw deflate
+ * streams are concatenated in order.  The result is a single ordinary
+ * deflate stream, so any gunzip can read it.
+ */
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+typedef void (*pzip_writer)(int fd, void *buf, unsigned count);
+
+/* Compress all of in (to EOF) onto out at the given level, using up to
+ * n_threads threads.  On return, *crc and *in_size describe the input.
+ * Returns the number of bytes written, -1 if reading failed, or -2 if
+ * memory ran out.
+ */
+long parallel_deflate(int in, int out, int level, int n_threads,
+                      pzip_writer write_out,
+                      unsigned long *crc, unsigned long *in_size);
+
+#endif
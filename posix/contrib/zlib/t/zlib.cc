@@ -0,0 +1,210 @@
+/*
+	t/zlib.cc
+	---------
+*/
+
+// Standard C
+#include <stdlib.h>
+#include <string.h>
+
+// zlib
+#include "zlib.h"
+
+// tap-out
+#include "tap/test.hh"
+
+
+static const unsigned n_tests = 4 + 3;
+
+
+using tap::ok_if;
+
+
+static unsigned char gData[ 256 * 1024 + 16 ];
+
+static void fill_data()
+{
+	srand( 1 );
+	
+	for ( unsigned i = 0;  i < sizeof gData;  ++i )
+	{
+		gData[ i ] = rand() >> 4;
+	}
+}
+
+/*
+	Pieces shorter than 16 bytes never reach the vector paths, so checking
+	whole buffers against the same bytes in pieces checks the vector paths
+	(where the CPU has them) against the scalar ones.
+*/
+
+static bool pieces_match( unsigned n_trials )
+{
+	for ( unsigned i = 0;  i < n_trials;  ++i )
+	{
+		const unsigned size   = rand() % (sizeof gData - 16 + 1);
+		const unsigned offset = rand() % 16;
+		
+		const unsigned char* data = gData + offset;
+		
+		uLong crc   = crc32( 0, data, size );
+		uLong adler = adler32( 1, data, size );
+		
+		uLong crc_pieces   = 0;
+		uLong adler_pieces = 1;
+		
+		for ( unsigned n = 0;  n < size;  )
+		{
+			unsigned piece = rand() % 16;
+			
+			if ( piece > size - n )
+			{
+				piece = size - n;
+			}
+			
+			crc_pieces   = crc32  ( crc_pieces,   data + n, piece );
+			adler_pieces = adler32( adler_pieces, data + n, piece );
+			
+			n += piece;
+		}
+		
+		if ( crc != crc_pieces  ||  adler != adler_pieces )
+		{
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+static void checksums()
+{
+	ok_if( crc32( 0, (const Bytef*) "123456789", 9 ) == 0xCBF43926, "CRC-32 check value" );
+	
+	ok_if( adler32( 1, (const Bytef*) "Wikipedia", 9 ) == 0x11E60398, "Adler-32 check value" );
+	
+	ok_if( pieces_match( 100 ), "whole buffers match pieces" );
+	
+	static unsigned char ones[ 100 * 1024 ];
+	
+	memset( ones, 0xFF, sizeof ones );
+	
+	uLong adler = 1;
+	
+	for ( unsigned i = 0;  i < sizeof ones;  i += 10 )
+	{
+		adler = adler32( adler, ones + i, 10 );
+	}
+	
+	ok_if( adler32( 1, ones, sizeof ones ) == adler, "Adler-32 sums stay in range" );
+}
+
+static unsigned char gCompressed[ sizeof gData * 2 ];
+static unsigned char gExpanded  [ sizeof gData ];
+
+// Match distances shorter than a word repeat a pattern.
+
+static void fill_pattern( unsigned size, unsigned period )
+{
+	for ( unsigned i = 0;  i < size;  ++i )
+	{
+		gData[ i ] = "abcdefghijklmnopqrst"[ i % period ] + (rand() % 64 == 0);
+	}
+}
+
+static bool round_trips( unsigned size, int level )
+{
+	uLongf compressed_size = sizeof gCompressed;
+	uLongf expanded_size   = sizeof gExpanded;
+	
+	compress2( gCompressed, &compressed_size, gData, size, level );
+	
+	return uncompress( gExpanded, &expanded_size, gCompressed, compressed_size ) == Z_OK
+	       &&  expanded_size == size
+	       &&  memcmp( gExpanded, gData, size ) == 0;
+}
+
+// inflate() leaves the last few hundred bytes of each buffer to the slow path.
+
+static bool round_trips_in_pieces( unsigned size )
+{
+	uLongf compressed_size = sizeof gCompressed;
+	
+	compress2( gCompressed, &compressed_size, gData, size, 9 );
+	
+	z_stream stream = {};
+	
+	inflateInit( &stream );
+	
+	stream.next_in  = gCompressed;
+	stream.avail_in = compressed_size;
+	
+	unsigned n = 0;
+	
+	int result;
+	
+	do
+	{
+		unsigned piece = 300 + rand() % 3000;
+		
+		if ( piece > sizeof gExpanded - n )
+		{
+			piece = sizeof gExpanded - n;
+		}
+		
+		stream.next_out  = gExpanded + n;
+		stream.avail_out = piece;
+		
+		result = inflate( &stream, Z_NO_FLUSH );
+		
+		n = stream.next_out - gExpanded;
+	}
+	while ( result == Z_OK );
+	
+	inflateEnd( &stream );
+	
+	return result == Z_STREAM_END  &&  n == size  &&  memcmp( gExpanded, gData, size ) == 0;
+}
+
+static void inflation()
+{
+	bool random_ok = true;
+	
+	for ( int level = 1;  level <= 9;  level += 4 )
+	{
+		random_ok = random_ok  &&  round_trips( sizeof gData, level );
+	}
+	
+	ok_if( random_ok, "random data" );
+	
+	bool patterns_ok = true;
+	bool pieces_ok   = true;
+	
+	for ( unsigned period = 1;  period <= 20;  ++period )
+	{
+		const unsigned size = 1000 + rand() % (sizeof gData - 1000);
+		
+		fill_pattern( size, period );
+		
+		patterns_ok = patterns_ok  &&  round_trips( size, period % 10 );
+		
+		pieces_ok = pieces_ok  &&  round_trips_in_pieces( size );
+	}
+	
+	ok_if( patterns_ok, "short repeating patterns" );
+	
+	ok_if( pieces_ok, "small output buffers" );
+}
+
+int main( int argc, const char *const *argv )
+{
+	tap::start( "zlib", n_tests );
+	
+	fill_data();
+	
+	checksums();
+	
+	inflation();
+	
+	return 0;
+}
@@ -5,8 +5,7 @@
 
 /* @(#) $Id$ */
 
-#define ZLIB_INTERNAL
-#include "zlib.h"
+#include "zutil.h"
 
 #define BASE 65521UL    /* largest prime smaller than 65536 */
 #define NMAX 5552
@@ -53,6 +52,85 @@
 #  define MOD4(a) a %= BASE
 #endif
 
+#ifdef Z_X86_SIMD
+
+#include <tmmintrin.h>
+
+local uLong adler32_ssse3 OF((uLong adler, const Bytef *buf, uInt len))
+    __attribute__((target("ssse3")));
+
+/* ===========================================================================
+   Sum len bytes (a multiple of 32) in 32-byte blocks.  Within a block, sum2
+   gains 32 times the running adler plus each byte weighted by its distance
+   from the end, which the multiply-adds compute sixteen bytes at a time.
+   The running adler's share is totalled lane-wise and scaled once per run
+   of blocks, which is kept under NMAX bytes as for the scalar sums.
+ */
+local uLong adler32_ssse3(adler, buf, len)
+    uLong adler;
+    const Bytef *buf;
+    uInt len;
+{
+    unsigned long s1 = adler & 0xffff;
+    unsigned long s2 = (adler >> 16) & 0xffff;
+    unsigned blocks = len / 32;
+
+    const __m128i tap1 = _mm_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25,
+                                       24, 23, 22, 21, 20, 19, 18, 17);
+    const __m128i tap2 = _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10, 9,
+                                        8,  7,  6,  5,  4,  3,  2, 1);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi16(1);
+
+    while (blocks) {
+        unsigned n = NMAX / 32;
+        __m128i v_ps, v_s1, v_s2;
+
+        if (n > blocks)
+            n = blocks;
+        blocks -= n;
+
+        v_ps = _mm_set_epi32(0, 0, 0, (int)(s1 * n));
+        v_s2 = _mm_set_epi32(0, 0, 0, (int)s2);
+        v_s1 = zero;
+
+        do {
+            const __m128i bytes1 = _mm_loadu_si128((const __m128i *)buf);
+            const __m128i bytes2 = _mm_loadu_si128((const __m128i *)(buf + 16));
+
+            v_ps = _mm_add_epi32(v_ps, v_s1);
+
+            v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(bytes1, zero));
+            v_s2 = _mm_add_epi32(v_s2,
+                       _mm_madd_epi16(_mm_maddubs_epi16(bytes1, tap1), ones));
+
+            v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(bytes2, zero));
+            v_s2 = _mm_add_epi32(v_s2,
+                       _mm_madd_epi16(_mm_maddubs_epi16(bytes2, tap2), ones));
+
+            buf += 32;
+        } while (--n);
+
+        v_s2 = _mm_add_epi32(v_s2, _mm_slli_epi32(v_ps, 5));
+
+        /* add up the lanes */
+        v_s1 = _mm_add_epi32(v_s1, _mm_shuffle_epi32(v_s1, _MM_SHUFFLE(2, 3, 0, 1)));
+        v_s1 = _mm_add_epi32(v_s1, _mm_shuffle_epi32(v_s1, _MM_SHUFFLE(1, 0, 3, 2)));
+        v_s2 = _mm_add_epi32(v_s2, _mm_shuffle_epi32(v_s2, _MM_SHUFFLE(2, 3, 0, 1)));
+        v_s2 = _mm_add_epi32(v_s2, _mm_shuffle_epi32(v_s2, _MM_SHUFFLE(1, 0, 3, 2)));
+
+        s1 += (unsigned)_mm_cvtsi128_si32(v_s1);
+        s2  = (unsigned)_mm_cvtsi128_si32(v_s2);
+
+        MOD(s1);
+        MOD(s2);
+    }
+
+    return s1 | (s2 << 16);
+}
+
+#endif /* Z_X86_SIMD */
+
 /* ========================================================================= */
 uLong ZEXPORT adler32(adler, buf, len)
     uLong adler;
@@ -93,6 +171,19 @@ uLong ZEXPORT adler32(adler, buf, len)
         return adler | (sum2 << 16);
     }
 
+#ifdef Z_X86_SIMD
+    /* do whole 32-byte blocks with SSSE3 where the CPU has it */
+    if (len >= 64 && (z_cpu_features() & Z_CPU_SSSE3)) {
+        uInt blocks = len & ~31U;
+
+        adler = adler32_ssse3(adler | (sum2 << 16), buf, blocks);
+        sum2 = adler >> 16;
+        adler &= 0xffff;
+        buf += blocks;
+        len -= blocks;
+    }
+#endif
+
     /* do length NMAX blocks -- requires just one modulo operation */
     while (len >= NMAX) {
         len -= NMAX;
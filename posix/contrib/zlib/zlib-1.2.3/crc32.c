@@ -211,6 +211,96 @@ const unsigned long FAR * ZEXPORT get_crc_table()
     return (const unsigned long FAR *)crc_table;
 }
 
+#ifdef Z_X86_SIMD
+
+#include <emmintrin.h>
+#include <wmmintrin.h>
+
+local unsigned long crc32_pclmul OF((unsigned long,
+                                     const unsigned char FAR *, unsigned));
+
+/* ===========================================================================
+   Fold len bytes (a multiple of 16, at least 64) into the register with
+   carry-less multiplication, as in Intel's "Fast CRC Computation for
+   Generic Polynomials Using PCLMULQDQ Instruction".  Four 128-bit streams
+   are folded across 512 bits at a time, then into one another, and the
+   last 128 bits are brought down to 64 and Barrett-reduced to 32.  The
+   constants are powers of x modulo the bit-reflected polynomial, shifted
+   one bit to suit the reflected product.  crc is the register itself (the
+   complement of the running CRC).
+ */
+__attribute__((target("pclmul,sse2")))
+local unsigned long crc32_pclmul(crc, buf, len)
+    unsigned long crc;
+    const unsigned char FAR *buf;
+    unsigned len;
+{
+    const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596LL, 0x0154442bd4LL);
+    const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009eLL, 0x01751997d0LL);
+    const __m128i k5k0 = _mm_set_epi64x(0, 0x0163cd6124LL);
+    const __m128i poly = _mm_set_epi64x(0x01f7011641LL, 0x01db710641LL);
+    const __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+    __m128i x0, x1, x2, x3, x4;
+
+#define FOLD(x, k, y) _mm_xor_si128(_mm_xor_si128( \
+                          _mm_clmulepi64_si128(x, k, 0x00), \
+                          _mm_clmulepi64_si128(x, k, 0x11)), (y))
+
+    x1 = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+    x2 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+    x3 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+    x4 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+
+    buf += 64;
+    len -= 64;
+
+    while (len >= 64) {
+        x1 = FOLD(x1, k1k2, _mm_loadu_si128((const __m128i *)(buf + 0x00)));
+        x2 = FOLD(x2, k1k2, _mm_loadu_si128((const __m128i *)(buf + 0x10)));
+        x3 = FOLD(x3, k1k2, _mm_loadu_si128((const __m128i *)(buf + 0x20)));
+        x4 = FOLD(x4, k1k2, _mm_loadu_si128((const __m128i *)(buf + 0x30)));
+        buf += 64;
+        len -= 64;
+    }
+
+    /* four streams into one */
+    x1 = FOLD(x1, k3k4, x2);
+    x1 = FOLD(x1, k3k4, x3);
+    x1 = FOLD(x1, k3k4, x4);
+
+    while (len >= 16) {
+        x1 = FOLD(x1, k3k4, _mm_loadu_si128((const __m128i *)buf));
+        buf += 16;
+        len -= 16;
+    }
+
+#undef FOLD
+
+    /* 128 bits to 64 */
+    x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, mask);
+    x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    /* Barrett reduction to 32 */
+    x2 = _mm_and_si128(x1, mask);
+    x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+    x2 = _mm_and_si128(x2, mask);
+    x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    x0 = _mm_srli_si128(x1, 4);
+
+    return (unsigned long)(unsigned)_mm_cvtsi128_si32(x0);
+}
+
+#endif /* Z_X86_SIMD */
+
 /* ========================================================================= */
 #define DO1 crc = crc_table[0][((int)crc ^ (*buf++)) & 0xff] ^ (crc >> 8)
 #define DO8 DO1; DO1; DO1; DO1; DO1; DO1; DO1; DO1
@@ -228,6 +318,18 @@ unsigned long ZEXPORT crc32(crc, buf, len)
         make_crc_table();
 #endif /* DYNAMIC_CRC_TABLE */
 
+#ifdef Z_X86_SIMD
+    if (len >= 64 && (z_cpu_features() & Z_CPU_PCLMUL)) {
+        unsigned n = len & ~15U;
+
+        crc = crc32_pclmul(crc ^ 0xffffffffUL, buf, n) ^ 0xffffffffUL;
+        buf += n;
+        len -= n;
+        if (len == 0)
+            return crc;
+    }
+#endif /* Z_X86_SIMD */
+
 #ifdef BYFOUR
     if (sizeof(void *) == sizeof(ptrdiff_t)) {
         u4 endian;
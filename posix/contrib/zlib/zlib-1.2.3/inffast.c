@@ -29,6 +29,60 @@
 #  define PUP(a) *++(a)
 #endif
 
+local unsigned char FAR *copy_match OF((unsigned char FAR *out,
+                                        unsigned dist, unsigned len));
+
+/*
+   Copy a match of len bytes starting dist bytes back in the output, and
+   return the updated out (which, like the one passed in, is as PUP()
+   expects).  Words are moved whole when the source is at least a word
+   behind, so that every load sees only bytes already stored.  A shorter
+   distance repeats a pattern, so a few bytes are first copied singly until
+   the pattern lies a whole number of periods and at least a word behind.
+ */
+local unsigned char FAR *copy_match(out, dist, len)
+unsigned char FAR *out;
+unsigned dist;
+unsigned len;
+{
+    unsigned char FAR *to;
+    unsigned char FAR *from;
+    unsigned period;
+    unsigned n;
+
+    to = out + OFF;
+    from = to - dist;
+    if (dist < 8) {
+        period = dist;
+        while (period < 8)
+            period += dist;
+        n = period - dist;
+        if (n > len)
+            n = len;
+        len -= n;
+        while (n--)
+            *to++ = *from++;
+        from = to - period;
+    }
+    if (to - from >= 16) {
+        while (len >= 16) {
+            zmemcpy(to, from, 16);
+            to += 16;
+            from += 16;
+            len -= 16;
+        }
+    }
+    while (len >= 8) {
+        zmemcpy(to, from, 8);
+        to += 8;
+        from += 8;
+        len -= 8;
+    }
+    while (len--)
+        *to++ = *from++;
+    return to - OFF;
+}
+
 /*
    Decode literal, length, and distance codes and write out the resulting
    literal and match bytes until either not enough input or output is
@@ -244,18 +298,7 @@ unsigned start;         /* inflate()'s starting value for strm->avail_out */
                     }
                 }
                 else {
-                    from = out - dist;          /* copy direct from output */
-                    do {                        /* minimum length is three */
-                        PUP(out) = PUP(from);
-                        PUP(out) = PUP(from);
-                        PUP(out) = PUP(from);
-                        len -= 3;
-                    } while (len > 2);
-                    if (len) {
-                        PUP(out) = PUP(from);
-                        if (len > 1)
-                            PUP(out) = PUP(from);
-                    }
+                    out = copy_match(out, dist, len);   /* direct from output */
                 }
             }
             else if ((op & 64) == 0) {          /* 2nd level distance code */
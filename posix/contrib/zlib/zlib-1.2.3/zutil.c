@@ -316,3 +316,30 @@ void  zcfree (opaque, ptr)
 }
 
 #endif /* MY_ZCALLOC */
+
+
+#ifdef Z_X86_SIMD
+
+#include <cpuid.h>
+
+int z_cpu_features()
+{
+    /* No lock:  every thread that races here computes the same value. */
+    static int features = -1;
+
+    if (features < 0) {
+        unsigned a, b, c, d;
+        int found = 0;
+
+        if (__get_cpuid(1, &a, &b, &c, &d)) {
+            if (c & bit_SSSE3)
+                found |= Z_CPU_SSSE3;
+            if ((c & bit_PCLMUL) && (d & bit_SSE2))
+                found |= Z_CPU_PCLMUL;
+        }
+        features = found;
+    }
+    return features;
+}
+
+#endif /* Z_X86_SIMD */
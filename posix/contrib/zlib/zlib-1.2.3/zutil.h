@@ -266,4 +266,20 @@ void   zcfree  OF((voidpf opaque, voidpf ptr));
 #define ZFREE(strm, addr)  (*((strm)->zfree))((strm)->opaque, (voidpf)(addr))
 #define TRY_FREE(s, p) {if (p) ZFREE(s, p);}
 
+/* SIMD paths for x86, chosen at run time.  They need intrinsics that can
+   be enabled per function, so that the rest of zlib builds for the
+   baseline CPU.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  if defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)
+#    define Z_X86_SIMD
+#  endif
+#endif
+
+#ifdef Z_X86_SIMD
+#  define Z_CPU_SSSE3  1
+#  define Z_CPU_PCLMUL 2
+   int z_cpu_features OF((void));   /* Z_CPU_* flags for this machine */
+#endif
+
 #endif /* ZUTIL_H */
@@ -0,0 +1,51 @@
+/*
+	map_for_reading.cc
+	------------------
+*/
+
+
+#include "poseven/extras/map_for_reading.hh"
+
+// POSIX
+#include <sys/stat.h>
+
+// poseven
+#include "poseven/functions/fstat.hh"
+#include "poseven/functions/mmap.hh"
+
+
+namespace poseven
+{
+	
+	nucleus::owned< mmap_t > map_for_reading( fd_t fd )
+	{
+		nucleus::owned< mmap_t > result;
+		
+		const struct stat sb = fstat( fd );
+		
+		const size_t size = sb.st_size;
+		
+		if ( !S_ISREG( sb.st_mode )  ||  size == 0  ||  off_t( size ) != sb.st_size )
+		{
+			return result;
+		}
+		
+		try
+		{
+			result = mmap( size, prot_read, map_private, fd );
+		}
+		catch ( const errno_t& )
+		{
+			return result;
+		}
+		
+	#ifdef MADV_SEQUENTIAL
+		
+		(void) madvise( result.get().addr, size, MADV_SEQUENTIAL );
+		
+	#endif
+		
+		return result;
+	}
+	
+}
@@ -0,0 +1,34 @@
+/*
+	map_for_reading.hh
+	------------------
+*/
+
+
+#ifndef POSEVEN_EXTRAS_MAPFORREADING_HH
+#define POSEVEN_EXTRAS_MAPFORREADING_HH
+
+// poseven
+#ifndef POSEVEN_TYPES_FD_T_HH
+#include "poseven/types/fd_t.hh"
+#endif
+#ifndef POSEVEN_TYPES_MMAP_T_HH
+#include "poseven/types/mmap_t.hh"
+#endif
+
+
+namespace poseven
+{
+	
+	/*
+		Maps a nonempty regular file privately and read-only, advised for
+		sequential access.  Anything it can't map (a pipe, an empty file,
+		one too big for size_t, or one on a file system that doesn't do
+		mmap()) comes back unmapped, with an addr of MAP_FAILED, and should
+		be read instead.  Only fstat() failures are thrown.
+	*/
+	
+	nucleus::owned< mmap_t > map_for_reading( fd_t fd );
+	
+}
+
+#endif
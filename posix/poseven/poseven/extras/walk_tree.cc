@@ -0,0 +1,806 @@
+/*
+	walk_tree.cc
+	------------
+*/
+
+#include "poseven/extras/walk_tree.hh"
+
+// Standard C++
+#include <algorithm>
+#include <deque>
+#include <new>
+#include <vector>
+
+// Standard C
+#include <errno.h>
+#include <string.h>
+
+// POSIX
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#ifdef _POSIX_THREADS
+#include <pthread.h>
+#endif
+
+// Extended API Set Part 2
+#include "extended-api-set/part-2.h"
+
+// plus
+#include "plus/var_string.hh"
+
+// poseven
+#include "poseven/functions/dup.hh"
+#include "poseven/functions/fdopendir.hh"
+#include "poseven/functions/openat.hh"
+#include "poseven/types/errno_t.hh"
+
+
+namespace poseven
+{
+	
+	namespace n = nucleus;
+	
+	
+	::mode_t walk_entry::type() const
+	{
+		if ( itsType == 0 )
+		{
+			itsType = stat().st_mode & S_IFMT;
+		}
+		
+		return itsType;
+	}
+	
+	const struct stat& walk_entry::stat() const
+	{
+		if ( !itIsStatted )
+		{
+			throw_posix_result( ::fstatat( itsDirFD, itsName, &itsStat, AT_SYMLINK_NOFOLLOW ) );
+			
+			itIsStatted = true;
+		}
+		
+		return itsStat;
+	}
+	
+	
+	tree_visitor::~tree_visitor()
+	{
+	}
+	
+	bool tree_visitor::enter_directory( const walk_entry& dir )
+	{
+		return true;
+	}
+	
+	void tree_visitor::leave_directory( const walk_entry& dir )
+	{
+	}
+	
+	
+	// A directory's names, NUL-terminated and end to end
+	typedef std::vector< char > name_buffer;
+	
+	struct raw_entry
+	{
+		std::size_t  name_offset;
+		::mode_t     type;  // 0 if the directory didn't say
+	};
+	
+	typedef std::vector< raw_entry > raw_entries;
+	
+	// getdents64() scratch space, one for each thread that reads directories
+	typedef std::vector< long long > dirent_buffer;
+	
+	static const std::size_t dirent_buffer_size = 64 * 1024;
+	
+	struct name_precedes
+	{
+		const char* names;
+		
+		bool operator()( const raw_entry& a, const raw_entry& b ) const
+		{
+			return strcmp( names + a.name_offset, names + b.name_offset ) < 0;
+		}
+	};
+	
+	static inline bool name_is_dots( const char* name )
+	{
+		return name[0] == '.'  &&  ( name[ 1 + (name[1] == '.') ] == '\0' );
+	}
+	
+#ifdef DT_UNKNOWN
+
+	static ::mode_t type_from_d_type( unsigned char d_type )
+	{
+		switch ( d_type )
+		{
+			case DT_REG:   return S_IFREG;
+			case DT_DIR:   return S_IFDIR;
+			case DT_LNK:   return S_IFLNK;
+			case DT_FIFO:  return S_IFIFO;
+			case DT_SOCK:  return S_IFSOCK;
+			case DT_CHR:   return S_IFCHR;
+			case DT_BLK:   return S_IFBLK;
+			
+			default:
+				return 0;
+		}
+	}
+	
+#endif
+
+	static void add_entry( name_buffer&  names,
+	                       raw_entries&  entries,
+	                       const char*   name,
+	                       ::mode_t      type )
+	{
+		if ( name_is_dots( name ) )
+		{
+			return;
+		}
+		
+		const raw_entry entry = { names.size(), type };
+		
+		names.insert( names.end(), name, name + strlen( name ) + 1 );
+		
+		entries.push_back( entry );
+	}
+	
+#ifdef __linux__
+
+	struct linux_dirent64
+	{
+		unsigned long long  d_ino;
+		long long           d_off;
+		unsigned short      d_reclen;
+		unsigned char       d_type;
+		char                d_name[ 1 ];
+	};
+	
+	static void read_directory( fd_t            dirfd,
+	                            dirent_buffer&  buffer,
+	                            name_buffer&    names,
+	                            raw_entries&    entries )
+	{
+		if ( buffer.empty() )
+		{
+			buffer.resize( dirent_buffer_size / sizeof (long long) );
+		}
+		
+		const std::size_t size = buffer.size() * sizeof (long long);
+		
+		while ( true )
+		{
+			const long n_read = syscall( SYS_getdents64, dirfd, &buffer[ 0 ], size );
+			
+			if ( n_read == 0 )
+			{
+				break;
+			}
+			
+			if ( n_read < 0 )
+			{
+				if ( errno == EINTR )
+				{
+					continue;
+				}
+				
+				throw_errno( errno );
+			}
+			
+			const char* p   = (const char*) &buffer[ 0 ];
+			const char* end = p + n_read;
+			
+			while ( p < end )
+			{
+				const linux_dirent64* entry = (const linux_dirent64*) p;
+				
+				add_entry( names, entries, entry->d_name, type_from_d_type( entry->d_type ) );
+				
+				p += entry->d_reclen;
+			}
+		}
+	}
+	
+#else
+
+	static void read_directory( fd_t            dirfd,
+	                            dirent_buffer&  buffer,
+	                            name_buffer&    names,
+	                            raw_entries&    entries )
+	{
+		n::owned< dir_t > dir = fdopendir( dup( dirfd ) );
+		
+		errno = 0;
+		
+		while ( const dirent* entry = ::readdir( dir ) )
+		{
+			::mode_t type = 0;
+			
+		#ifdef DT_UNKNOWN
+			
+			type = type_from_d_type( entry->d_type );
+			
+		#endif
+			
+			add_entry( names, entries, entry->d_name, type );
+		}
+		
+		if ( errno != 0 )
+		{
+			throw_errno( errno );
+		}
+	}
+	
+#endif
+
+	struct walk_context;
+	
+	struct subdirectory_job;
+	
+	static void walk_item( const walk_entry&  entry,
+	                       subdirectory_job*  job,
+	                       plus::var_string&  path,
+	                       walk_context&      context );
+	
+#ifdef _POSIX_THREADS
+
+	/*
+		With more than one thread, the walk's own thread still calls the
+		visitor for everything, in the order a single thread would.  The
+		others read subdirectories ahead of it:  When a directory is listed,
+		its subdirectories are queued, and a worker opens one, reads it, and
+		looks up whatever types its entries lack.  If the walk reaches a
+		subdirectory that no worker has started, it takes the job back and
+		does it itself instead of waiting.
+	*/
+	
+	enum
+	{
+		job_idle,     // not queued (yet)
+		job_queued,
+		job_running,
+		job_done,
+		job_taken     // claimed by the walk, or withdrawn
+	};
+	
+	struct subdirectory_job
+	{
+		fd_t         parent;  // open until every job in it is taken
+		const char*  name;
+		std::size_t  entry;   // index in the parent's entries
+		int          state;
+		int          fd;      // the subdirectory, once done
+		int          error;   // or why it couldn't be opened or read
+		name_buffer  names;
+		raw_entries  entries;
+	};
+	
+	static void look_up_types( fd_t dirfd, const name_buffer& names, raw_entries& entries )
+	{
+		typedef raw_entries::iterator Iter;
+		
+		for ( Iter it = entries.begin();  it != entries.end();  ++it )
+		{
+			struct stat sb;
+			
+			if ( it->type == 0  &&  ::fstatat( dirfd, &names[ it->name_offset ], &sb, AT_SYMLINK_NOFOLLOW ) == 0 )
+			{
+				it->type = sb.st_mode & S_IFMT;
+			}
+		}
+	}
+	
+	static void list_subdirectory( subdirectory_job& job, dirent_buffer& buffer )
+	{
+		try
+		{
+			n::owned< fd_t > dir = openat( job.parent, job.name, o_rdonly | o_directory );
+			
+			read_directory( dir, buffer, job.names, job.entries );
+			
+			look_up_types( dir, job.names, job.entries );
+			
+			job.fd = dir.release();
+		}
+		catch ( const errno_t& err )
+		{
+			job.error = err;
+		}
+		catch ( const std::bad_alloc& )
+		{
+			job.error = ENOMEM;
+		}
+	}
+	
+	/*
+		A queued or finished job may be holding a directory open, so only
+		so many are outstanding at once.  The rest are queued as others are
+		taken, or done by the walk itself.
+	*/
+	
+	static const std::size_t max_outstanding_jobs = 256;
+	
+	class walk_pool
+	{
+		private:
+			std::deque< subdirectory_job* >  itsQueue;
+			std::vector< pthread_t >         itsThreads;
+			std::size_t                      itsOutstanding;
+			bool                             itIsQuitting;
+			pthread_mutex_t                  itsLock;
+			pthread_cond_t                   itsWork;  // signaled when a job is queued, or on quit
+			pthread_cond_t                   itsDone;  // signaled when a job is done
+			
+			static void* worker( void* arg );
+			
+			bool claim( subdirectory_job& job );
+			
+			// not implemented:
+			walk_pool( const walk_pool& );
+			walk_pool& operator=( const walk_pool& );
+			
+		public:
+			walk_pool( std::size_t n_workers );
+			
+			~walk_pool();
+			
+			std::size_t worker_count() const  { return itsThreads.size(); }
+			
+			// Returns false if there's no room for the job now
+			bool enqueue( subdirectory_job& job );
+			
+			// Finishes the job, doing it here if no worker has started it
+			void take( subdirectory_job& job, dirent_buffer& buffer );
+			
+			void withdraw( subdirectory_job& job );
+	};
+	
+	walk_pool::walk_pool( std::size_t n_workers )
+	:
+		itsOutstanding( 0 ),
+		itIsQuitting( false )
+	{
+		pthread_mutex_init( &itsLock, NULL );
+		pthread_cond_init( &itsWork, NULL );
+		pthread_cond_init( &itsDone, NULL );
+		
+		itsThreads.reserve( n_workers );
+		
+		pthread_t thread;
+		
+		while ( itsThreads.size() < n_workers  &&  pthread_create( &thread, NULL, &worker, this ) == 0 )
+		{
+			itsThreads.push_back( thread );
+		}
+	}
+	
+	walk_pool::~walk_pool()
+	{
+		pthread_mutex_lock( &itsLock );
+		
+		itIsQuitting = true;
+		
+		pthread_cond_broadcast( &itsWork );
+		pthread_mutex_unlock( &itsLock );
+		
+		for ( std::size_t i = 0;  i < itsThreads.size();  ++i )
+		{
+			pthread_join( itsThreads[ i ], NULL );
+		}
+		
+		pthread_cond_destroy( &itsDone );
+		pthread_cond_destroy( &itsWork );
+		pthread_mutex_destroy( &itsLock );
+	}
+	
+	void* walk_pool::worker( void* arg )
+	{
+		walk_pool& pool = *(walk_pool*) arg;
+		
+		dirent_buffer buffer;
+		
+		pthread_mutex_lock( &pool.itsLock );
+		
+		while ( true )
+		{
+			while ( pool.itsQueue.empty()  &&  !pool.itIsQuitting )
+			{
+				pthread_cond_wait( &pool.itsWork, &pool.itsLock );
+			}
+			
+			if ( pool.itsQueue.empty() )
+			{
+				break;
+			}
+			
+			subdirectory_job& job = *pool.itsQueue.front();
+			
+			pool.itsQueue.pop_front();
+			
+			job.state = job_running;
+			
+			pthread_mutex_unlock( &pool.itsLock );
+			
+			list_subdirectory( job, buffer );
+			
+			pthread_mutex_lock( &pool.itsLock );
+			
+			job.state = job_done;
+			
+			pthread_cond_broadcast( &pool.itsDone );
+		}
+		
+		pthread_mutex_unlock( &pool.itsLock );
+		
+		return NULL;
+	}
+	
+	bool walk_pool::enqueue( subdirectory_job& job )
+	{
+		pthread_mutex_lock( &itsLock );
+		
+		const bool room = itsOutstanding < max_outstanding_jobs;
+		
+		if ( room  &&  job.state == job_idle )
+		{
+			job.state = job_queued;
+			
+			itsQueue.push_back( &job );
+			
+			++itsOutstanding;
+			
+			pthread_cond_signal( &itsWork );
+		}
+		
+		pthread_mutex_unlock( &itsLock );
+		
+		return room;
+	}
+	
+	// Called with the lock held.  Returns true if a worker did the job.
+	
+	bool walk_pool::claim( subdirectory_job& job )
+	{
+		switch ( job.state )
+		{
+			case job_queued:
+				itsQueue.erase( std::find( itsQueue.begin(), itsQueue.end(), &job ) );
+				
+				--itsOutstanding;
+				
+				job.state = job_taken;
+				
+				return false;
+			
+			case job_running:
+				while ( job.state != job_done )
+				{
+					pthread_cond_wait( &itsDone, &itsLock );
+				}
+				
+				// fall through
+			
+			case job_done:
+				--itsOutstanding;
+				
+				job.state = job_taken;
+				
+				return true;
+			
+			default:
+				job.state = job_taken;
+				
+				return false;
+		}
+	}
+	
+	void walk_pool::take( subdirectory_job& job, dirent_buffer& buffer )
+	{
+		pthread_mutex_lock( &itsLock );
+		
+		const bool done = claim( job );
+		
+		pthread_mutex_unlock( &itsLock );
+		
+		if ( !done )
+		{
+			list_subdirectory( job, buffer );
+		}
+	}
+	
+	void walk_pool::withdraw( subdirectory_job& job )
+	{
+		pthread_mutex_lock( &itsLock );
+		
+		(void) claim( job );
+		
+		pthread_mutex_unlock( &itsLock );
+		
+		if ( job.fd >= 0 )
+		{
+			::close( job.fd );
+			
+			job.fd = -1;
+		}
+	}
+	
+	// The jobs for one directory's subdirectories, queued as there's room
+	
+	class subdirectory_jobs
+	{
+		private:
+			walk_pool*                       itsPool;
+			std::vector< subdirectory_job >  itsJobs;
+			std::size_t                      itsNextQueued;
+			std::size_t                      itsNextFound;
+			
+			void queue_more();
+			
+			// not implemented:
+			subdirectory_jobs( const subdirectory_jobs& );
+			subdirectory_jobs& operator=( const subdirectory_jobs& );
+			
+		public:
+			subdirectory_jobs( walk_pool*          pool,
+			                   fd_t                dirfd,
+			                   const char*         names,
+			                   const raw_entries&  entries );
+			
+			~subdirectory_jobs();
+			
+			// Called for each entry in turn; NULL unless it's a subdirectory
+			subdirectory_job* find( std::size_t entry );
+	};
+	
+	subdirectory_jobs::subdirectory_jobs( walk_pool*          pool,
+	                                      fd_t                dirfd,
+	                                      const char*         names,
+	                                      const raw_entries&  entries )
+	:
+		itsPool( pool ),
+		itsNextQueued( 0 ),
+		itsNextFound( 0 )
+	{
+		if ( pool == NULL )
+		{
+			return;
+		}
+		
+		for ( std::size_t i = 0;  i < entries.size();  ++i )
+		{
+			if ( S_ISDIR( entries[ i ].type ) )
+			{
+				subdirectory_job job;
+				
+				job.parent = dirfd;
+				job.name   = names + entries[ i ].name_offset;
+				job.entry  = i;
+				job.state  = job_idle;
+				job.fd     = -1;
+				job.error  = 0;
+				
+				itsJobs.push_back( job );
+			}
+		}
+		
+		queue_more();
+	}
+	
+	subdirectory_jobs::~subdirectory_jobs()
+	{
+		for ( std::size_t i = 0;  i < itsJobs.size();  ++i )
+		{
+			itsPool->withdraw( itsJobs[ i ] );
+		}
+	}
+	
+	void subdirectory_jobs::queue_more()
+	{
+		while ( itsNextQueued < itsJobs.size()  &&  itsPool->enqueue( itsJobs[ itsNextQueued ] ) )
+		{
+			++itsNextQueued;
+		}
+	}
+	
+	subdirectory_job* subdirectory_jobs::find( std::size_t entry )
+	{
+		if ( itsNextFound == itsJobs.size()  ||  itsJobs[ itsNextFound ].entry != entry )
+		{
+			return NULL;
+		}
+		
+		queue_more();
+		
+		return &itsJobs[ itsNextFound++ ];
+	}
+	
+#else
+
+	class walk_pool;
+	
+#endif
+
+	struct walk_context
+	{
+		tree_visitor&  visitor;
+		int            flags;
+		dirent_buffer  buffer;  // for the walk's own thread
+		walk_pool*     pool;    // NULL unless there are workers
+		
+		walk_context( tree_visitor& v, int f ) : visitor( v ), flags( f ), pool()
+		{
+		}
+	};
+	
+	static n::owned< fd_t > open_subdirectory( const walk_entry&  entry,
+	                                           subdirectory_job*  job,
+	                                           walk_context&      context,
+	                                           name_buffer&       names,
+	                                           raw_entries&       entries )
+	{
+	#ifdef _POSIX_THREADS
+		
+		if ( job != NULL )
+		{
+			context.pool->take( *job, context.buffer );
+			
+			throw_errno( job->error );
+			
+			names  .swap( job->names   );
+			entries.swap( job->entries );
+			
+			const fd_t fd = fd_t( job->fd );
+			
+			job->fd = -1;
+			
+			return n::owned< fd_t >::seize( fd );
+		}
+		
+	#endif
+		
+		n::owned< fd_t > dir = openat( entry.dirfd(), entry.name(), o_rdonly | o_directory );
+		
+		read_directory( dir, context.buffer, names, entries );
+		
+		return dir;
+	}
+	
+	static void walk_directory( fd_t               dirfd,
+	                            const char*        base,
+	                            raw_entries&       entries,
+	                            plus::var_string&  path,
+	                            unsigned           depth,
+	                            walk_context&      context )
+	{
+		if ( entries.empty() )
+		{
+			return;
+		}
+		
+		if ( context.flags & walk_sorted )
+		{
+			const name_precedes less = { base };
+			
+			std::sort( entries.begin(), entries.end(), less );
+		}
+		
+		if ( path.empty()  ||  path[ path.size() - 1 ] != '/' )
+		{
+			path += '/';
+		}
+		
+		const std::size_t dir_length = path.size();
+		
+	#ifdef _POSIX_THREADS
+		
+		subdirectory_jobs jobs( context.pool, dirfd, base, entries );
+		
+	#endif
+		
+		for ( std::size_t i = 0;  i < entries.size();  ++i )
+		{
+			const char* name = base + entries[ i ].name_offset;
+			
+			path.resize( dir_length );
+			
+			path += name;
+			
+			const walk_entry entry( dirfd, name, path, depth, entries[ i ].type );
+			
+			subdirectory_job* job = NULL;
+			
+		#ifdef _POSIX_THREADS
+			
+			job = jobs.find( i );
+			
+		#endif
+			
+			walk_item( entry, job, path, context );
+		}
+	}
+	
+	static void walk_item( const walk_entry&  entry,
+	                       subdirectory_job*  job,
+	                       plus::var_string&  path,
+	                       walk_context&      context )
+	{
+		tree_visitor& visitor = context.visitor;
+		
+		if ( !entry.is_directory() )
+		{
+			visitor.visit_file( entry );
+		}
+		else if ( visitor.enter_directory( entry ) )
+		{
+			name_buffer  names;
+			raw_entries  entries;
+			
+			n::owned< fd_t > dir = open_subdirectory( entry, job, context, names, entries );
+			
+			const std::size_t length = path.size();
+			
+			walk_directory( dir,
+			                names.empty() ? "" : &names[ 0 ],
+			                entries,
+			                path,
+			                entry.depth() + 1,
+			                context );
+			
+			path.resize( length );
+			
+			visitor.leave_directory( entry );
+		}
+		
+	#ifdef _POSIX_THREADS
+		
+		else if ( job != NULL )
+		{
+			context.pool->withdraw( *job );
+		}
+		
+	#endif
+	}
+	
+	static void walk_root( const char* path, walk_context& context )
+	{
+		plus::var_string pathname = path;
+		
+		const walk_entry root( at_fdcwd, path, pathname, 0, 0 );
+		
+		walk_item( root, NULL, pathname, context );
+	}
+	
+	void walk_tree( const char* path, tree_visitor& visitor, int flags, unsigned n_threads )
+	{
+		walk_context context( visitor, flags );
+		
+	#ifdef _POSIX_THREADS
+		
+		if ( n_threads > 1 )
+		{
+			walk_pool pool( n_threads - 1 );
+			
+			if ( pool.worker_count() > 0 )
+			{
+				context.pool = &pool;
+			}
+			
+			walk_root( path, context );
+			
+			return;
+		}
+		
+	#endif
+		
+		walk_root( path, context );
+	}
+	
+}
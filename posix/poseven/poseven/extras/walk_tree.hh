@@ -0,0 +1,130 @@
+/*
+	walk_tree.hh
+	------------
+*/
+
+
+#ifndef POSEVEN_EXTRAS_WALKTREE_HH
+#define POSEVEN_EXTRAS_WALKTREE_HH
+
+// POSIX
+#include <sys/stat.h>
+
+// iota
+#include "iota/string_traits.hh"
+
+// plus
+#include "plus/string.hh"
+
+// poseven
+#ifndef POSEVEN_TYPES_FD_T_HH
+#include "poseven/types/fd_t.hh"
+#endif
+
+
+namespace poseven
+{
+	
+	/*
+		walk_tree() visits every item beneath a path (without following
+		symlinks).  Each directory is read in large batches (getdents64()
+		on Linux) before any of its subdirectories, file types come from
+		the directory entries wherever the file system supplies them, and
+		anything else is looked up relative to the parent directory's
+		descriptor.  A visitor that only needs names and types never causes
+		a stat() at all.
+		
+		Given more than one thread (where there are pthreads), walk_tree()
+		has the others read subdirectories ahead of the walk.  The visitor
+		is still called only on the calling thread, in the same order.
+	*/
+	
+	class walk_entry
+	{
+		private:
+			fd_t                 itsDirFD;
+			const char*          itsName;
+			const plus::string&  itsPath;
+			unsigned             itsDepth;
+			mutable ::mode_t     itsType;
+			mutable bool         itIsStatted;
+			mutable struct stat  itsStat;
+			
+			// not implemented:
+			walk_entry( const walk_entry& );
+			walk_entry& operator=( const walk_entry& );
+			
+		public:
+			walk_entry( fd_t                 dirfd,
+			            const char*          name,
+			            const plus::string&  path,
+			            unsigned             depth,
+			            ::mode_t             type )
+			:
+				itsDirFD   ( dirfd ),
+				itsName    ( name  ),
+				itsPath    ( path  ),
+				itsDepth   ( depth ),
+				itsType    ( type  ),
+				itIsStatted( false )
+			{
+			}
+			
+			// The containing directory, and the name within it
+			fd_t dirfd() const  { return itsDirFD; }
+			
+			const char* name() const  { return itsName; }
+			
+			// The walk's root path, followed by the names leading here
+			const plus::string& path() const  { return itsPath; }
+			
+			// 0 for the root
+			unsigned depth() const  { return itsDepth; }
+			
+			// The S_IFMT bits, without a stat() unless the directory lacks them
+			::mode_t type() const;
+			
+			bool is_directory() const  { return S_ISDIR( type() ); }
+			
+			// fstatat() relative to dirfd(), done once
+			const struct stat& stat() const;
+	};
+	
+	class tree_visitor
+	{
+		public:
+			virtual ~tree_visitor();
+			
+			// Return false to skip the directory's contents and leave_directory().
+			virtual bool enter_directory( const walk_entry& dir );
+			
+			// Called for everything that isn't a directory
+			virtual void visit_file( const walk_entry& file ) = 0;
+			
+			virtual void leave_directory( const walk_entry& dir );
+	};
+	
+	enum walk_flags_t
+	{
+		walk_sorted = 1  // visit each directory's entries in strcmp() order
+	};
+	
+	void walk_tree( const char*    path,
+	                tree_visitor&  visitor,
+	                int            flags     = 0,
+	                unsigned       n_threads = 1 );
+	
+	template < class String >
+	inline void walk_tree( const String&  path,
+	                       tree_visitor&  visitor,
+	                       int            flags     = 0,
+	                       unsigned       n_threads = 1 )
+	{
+		using iota::get_string_c_str;
+		
+		walk_tree( get_string_c_str( path ), visitor, flags, n_threads );
+	}
+	
+}
+
+#endif
@@ -0,0 +1,368 @@
+/*
+	t/walk_tree.cc
+	--------------
+*/
+
+// Standard C
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// POSIX
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Extended API Set Part 2
+#include "extended-api-set/part-2.h"
+
+// plus
+#include "plus/var_string.hh"
+
+// poseven
+#include "poseven/extras/walk_tree.hh"
+
+// tap-out
+#include "tap/check.hh"
+#include "tap/test.hh"
+
+
+static const unsigned n_tests = 4 + 3 + 4 + 4;
+
+
+namespace p7 = poseven;
+
+using tap::ok_if;
+
+
+/*
+	The tree, made in a fresh directory under /tmp:
+		
+		t/b       "abc"
+		t/a       ""
+		t/c/z     ""
+		t/c/y     ""
+		t/d/
+		t/l    -> c
+		t/many/d000/f ... t/many/d299/f
+		
+	The names are made out of order, and there are more subdirectories
+	in t/many than the walk keeps queued at once.
+*/
+
+static const unsigned n_many = 300;
+
+static void make_file( const char* path, const char* contents = "" )
+{
+	const int fd = CHECK( open( path, O_WRONLY | O_CREAT | O_TRUNC, 0666 ) );
+	
+	CHECK( write( fd, contents, strlen( contents ) ) );
+	
+	CHECK( close( fd ) );
+}
+
+static void make_tree()
+{
+	CHECK( mkdir( "t", 0777 ) );
+	
+	make_file( "t/b", "abc" );
+	make_file( "t/a" );
+	
+	CHECK( mkdir( "t/c", 0777 ) );
+	
+	make_file( "t/c/z" );
+	make_file( "t/c/y" );
+	
+	CHECK( mkdir( "t/d", 0777 ) );
+	
+	CHECK( symlink( "c", "t/l" ) );
+	
+	CHECK( mkdir( "t/many", 0777 ) );
+	
+	for ( unsigned i = 0;  i < n_many;  ++i )
+	{
+		char path[ sizeof "t/many/d000/f" ];
+		
+		sprintf( path, "t/many/d%.3u", i );
+		
+		CHECK( mkdir( path, 0777 ) );
+		
+		strcat( path, "/f" );
+		
+		make_file( path );
+	}
+}
+
+/*
+	Logs each event as "+path" (entering), "-path" (leaving), or the path
+	of anything else, with "@" after a symlink.  Leaves out t/many's
+	contents unless asked, and never enters anything named "skip".
+*/
+
+class logger : public p7::tree_visitor
+{
+	private:
+		plus::var_string  itsLog;
+		bool              itLogsMany;
+		unsigned          itsMaxDepth;
+		
+		bool logs( const p7::walk_entry& entry ) const
+		{
+			return itLogsMany  ||  strncmp( entry.path().c_str(), "t/many/", 7 ) != 0;
+		}
+		
+		void log( char prefix, const p7::walk_entry& entry, const char* suffix = "" )
+		{
+			if ( entry.depth() > itsMaxDepth )
+			{
+				itsMaxDepth = entry.depth();
+			}
+			
+			if ( logs( entry ) )
+			{
+				if ( !itsLog.empty() )
+				{
+					itsLog += ' ';
+				}
+				
+				if ( prefix )
+				{
+					itsLog += prefix;
+				}
+				
+				itsLog += entry.path();
+				itsLog += suffix;
+			}
+		}
+		
+	public:
+		logger( bool logs_many = false ) : itLogsMany( logs_many ), itsMaxDepth()
+		{
+		}
+		
+		const plus::string& get() const  { return itsLog; }
+		
+		unsigned max_depth() const  { return itsMaxDepth; }
+		
+		bool enter_directory( const p7::walk_entry& dir )
+		{
+			log( '+', dir );
+			
+			return strcmp( dir.name(), "skip" ) != 0;
+		}
+		
+		void visit_file( const p7::walk_entry& file )
+		{
+			log( '\0', file, S_ISLNK( file.type() ) ? "@" : "" );
+		}
+		
+		void leave_directory( const p7::walk_entry& dir )
+		{
+			log( '-', dir );
+		}
+};
+
+class remover : public p7::tree_visitor
+{
+	public:
+		void visit_file( const p7::walk_entry& file )
+		{
+			CHECK( unlinkat( file.dirfd(), file.name(), 0 ) );
+		}
+		
+		void leave_directory( const p7::walk_entry& dir )
+		{
+			CHECK( unlinkat( dir.dirfd(), dir.name(), AT_REMOVEDIR ) );
+		}
+};
+
+static const char* expected_sorted = "+t t/a t/b +t/c t/c/y t/c/z -t/c +t/d -t/d t/l@ +t/many -t/many -t";
+
+static void sorted()
+{
+	logger log;
+	
+	p7::walk_tree( "t", log, p7::walk_sorted );
+	
+	ok_if( log.get() == expected_sorted, "sorted" );
+	
+	ok_if( log.max_depth() == 3, "depth of t/many/d000/f" );
+	
+	// The root's name is kept as given, so there's no doubled slash.
+	
+	logger slashed;
+	
+	p7::walk_tree( "t/c/", slashed, p7::walk_sorted );
+	
+	ok_if( slashed.get() == "+t/c/ t/c/y t/c/z -t/c/" );
+	
+	CHECK( rename( "t/d", "t/skip" ) );
+	
+	logger skipping;
+	
+	p7::walk_tree( "t", skipping, p7::walk_sorted );
+	
+	CHECK( rename( "t/skip", "t/d" ) );
+	
+	ok_if( skipping.get() == "+t t/a t/b +t/c t/c/y t/c/z -t/c t/l@ +t/many -t/many +t/skip -t",
+	       "an unentered directory isn't left" );
+}
+
+static void symlinks()
+{
+	// The link is visited, not followed, and the root needn't be a directory.
+	
+	logger log;
+	
+	p7::walk_tree( "t/l", log );
+	
+	ok_if( log.get() == "t/l@", "symlink root" );
+	
+	logger file;
+	
+	p7::walk_tree( "t/b", file );
+	
+	ok_if( file.get() == "t/b", "file root" );
+	
+	logger link_slash;
+	
+	p7::walk_tree( "t/l/", link_slash, p7::walk_sorted );
+	
+	ok_if( link_slash.get() == "+t/l/ t/l/y t/l/z -t/l/", "a trailing slash follows the link" );
+}
+
+static void types_and_stats()
+{
+	// Entries whose types aren't given fall back on fstatat().
+	
+	const int dirfd = CHECK( open( "t", O_RDONLY | O_DIRECTORY ) );
+	
+	const plus::string path = "t/x";
+	
+	const p7::walk_entry c( p7::fd_t( dirfd ), "c", path, 1, 0 );
+	const p7::walk_entry l( p7::fd_t( dirfd ), "l", path, 1, 0 );
+	const p7::walk_entry b( p7::fd_t( dirfd ), "b", path, 1, 0 );
+	
+	ok_if( c.type() == S_IFDIR  &&  c.is_directory(), "d_type fallback:  directory" );
+	ok_if( l.type() == S_IFLNK, "symlink" );
+	
+	const struct stat& sb = b.stat();
+	
+	ok_if( b.type() == S_IFREG  &&  sb.st_size == 3, "file" );
+	
+	// The stat is done once; later changes aren't seen.
+	
+	const int fd = CHECK( open( "t/b", O_WRONLY | O_APPEND ) );
+	
+	CHECK( write( fd, "def", 3 ) );
+	
+	CHECK( close( fd ) );
+	
+	ok_if( &b.stat() == &sb  &&  b.stat().st_size == 3, "fstatat() result is cached" );
+	
+	CHECK( close( dirfd ) );
+}
+
+static void threaded()
+{
+	logger serial( true );
+	
+	p7::walk_tree( "t", serial, p7::walk_sorted );
+	
+	logger parallel( true );
+	
+	p7::walk_tree( "t", parallel, p7::walk_sorted, 4 );
+	
+	ok_if( parallel.get() == serial.get(), "threaded walk, sorted" );
+	
+	logger serial_unsorted( true );
+	logger parallel_unsorted( true );
+	
+	p7::walk_tree( "t", serial_unsorted );
+	p7::walk_tree( "t", parallel_unsorted, 0, 4 );
+	
+	ok_if( parallel_unsorted.get() == serial_unsorted.get(), "threaded walk, unsorted" );
+	
+	CHECK( rename( "t/many/d150", "t/many/skip" ) );
+	
+	logger serial_skipping( true );
+	logger parallel_skipping( true );
+	
+	p7::walk_tree( "t", serial_skipping, p7::walk_sorted );
+	p7::walk_tree( "t", parallel_skipping, p7::walk_sorted, 4 );
+	
+	CHECK( rename( "t/many/skip", "t/many/d150" ) );
+	
+	ok_if( parallel_skipping.get() == serial_skipping.get(), "threaded walk, skipping" );
+	
+	// A visitor's exception ends the walk, leaving nothing open.
+	
+	class thrower : public logger
+	{
+		public:
+			bool enter_directory( const p7::walk_entry& dir )
+			{
+				if ( strcmp( dir.name(), "d150" ) == 0 )
+				{
+					throw dir.depth();
+				}
+				
+				return logger::enter_directory( dir );
+			}
+	};
+	
+	const int next_fd = CHECK( dup( 0 ) );
+	
+	CHECK( close( next_fd ) );
+	
+	bool threw = false;
+	
+	try
+	{
+		thrower t;
+		
+		p7::walk_tree( "t", t, p7::walk_sorted, 4 );
+	}
+	catch ( unsigned depth )
+	{
+		threw = depth == 2;
+	}
+	
+	const int fd = CHECK( dup( 0 ) );
+	
+	CHECK( close( fd ) );
+	
+	ok_if( threw  &&  fd == next_fd, "a throwing visitor" );
+}
+
+int main( int argc, char** argv )
+{
+	tap::start( "walk_tree", n_tests );
+	
+	char temp[] = "/tmp/walk_tree.XXXXXX";
+	
+	if ( mkdtemp( temp ) == NULL  ||  chdir( temp ) < 0 )
+	{
+		return 1;
+	}
+	
+	make_tree();
+	
+	sorted();
+	
+	symlinks();
+	
+	types_and_stats();
+	
+	threaded();
+	
+	remover r;
+	
+	p7::walk_tree( "t", r );
+	
+	CHECK( chdir( "/" ) );
+	
+	CHECK( rmdir( temp ) );
+	
+	return 0;
+}
@@ -0,0 +1,210 @@
+/*
+	t/lookup_cache.cc
+	-----------------
+*/
+
+// Standard C
+#include <errno.h>
+#include <string.h>
+
+// vfs
+#include "vfs/lookup_cache.hh"
+
+// tap-out
+#include "tap/test.hh"
+
+
+static const unsigned n_tests = 4 + 3 + 4 + 3 + 3;
+
+
+using tap::ok_if;
+
+
+/*
+	A synthetic file tree:  Each node has a parent and a name, and lookup
+	is a linear search that counts how often it runs.
+*/
+
+struct node
+{
+	const char*  name;
+	const node*  parent;
+};
+
+static node gTree[] =
+{
+	{ "",      NULL },
+	{ "sys",   &gTree[ 0 ] },
+	{ "mac",   &gTree[ 1 ] },
+	{ "vol",   &gTree[ 2 ] },
+	{ "gui",   &gTree[ 0 ] },
+	{ "mac",   &gTree[ 4 ] },
+};
+
+static const std::size_t n_nodes = sizeof gTree / sizeof gTree[0];
+
+static const node* const root = &gTree[ 0 ];
+
+static unsigned gLookups = 0;
+
+typedef vfs::lookup_cache< const node* > cache_type;
+
+static const node* lookup( cache_type& cache, const node* parent, const plus::string& name )
+{
+	const node* child;
+	int         error;
+	
+	if ( cache.find( parent, name, child, error ) )
+	{
+		return child;  // NULL for a cached ENOENT
+	}
+	
+	++gLookups;
+	
+	for ( std::size_t i = 0;  i < n_nodes;  ++i )
+	{
+		if ( gTree[ i ].parent == parent  &&  name == gTree[ i ].name )
+		{
+			cache.insert( parent, name, &gTree[ i ] );
+			
+			return &gTree[ i ];
+		}
+	}
+	
+	cache.insert_error( parent, name, ENOENT );
+	
+	return NULL;
+}
+
+static const node* resolve( cache_type& cache, const char* path )
+{
+	const node* result = root;
+	
+	while ( result != NULL  &&  *path != '\0' )
+	{
+		const char* slash = strchr( path, '/' );
+		const char* end   = slash ? slash : path + strlen( path );
+		
+		result = lookup( cache, result, plus::string( path, end ) );
+		
+		path = *end ? end + 1 : end;
+	}
+	
+	return result;
+}
+
+static void hits()
+{
+	cache_type cache;
+	
+	gLookups = 0;
+	
+	ok_if( resolve( cache, "sys/mac/vol" ) == &gTree[ 3 ] );
+	
+	ok_if( gLookups == 3, "three misses" );
+	
+	ok_if( resolve( cache, "sys/mac/vol" ) == &gTree[ 3 ]  &&  gLookups == 3, "then three hits" );
+	
+	ok_if( resolve( cache, "gui/mac" ) == &gTree[ 5 ]  &&  gLookups == 5, "same name, different parent" );
+}
+
+static void negatives()
+{
+	cache_type cache;
+	
+	gLookups = 0;
+	
+	ok_if( resolve( cache, "sys/nonesuch" ) == NULL  &&  gLookups == 2 );
+	
+	ok_if( resolve( cache, "sys/nonesuch" ) == NULL  &&  gLookups == 2, "failure is cached" );
+	
+	const node* child;
+	int         error = 0;
+	
+	ok_if( cache.find( &gTree[ 1 ], "nonesuch", child, error )  &&  error == ENOENT );
+}
+
+static void invalidation()
+{
+	cache_type cache;
+	
+	resolve( cache, "sys/mac" );
+	resolve( cache, "sys/macintosh" );
+	
+	gLookups = 0;
+	
+	// rename sys/mac sys/macintosh
+	
+	gTree[ 2 ].name = "macintosh";
+	
+	cache.invalidate();
+	
+	ok_if( resolve( cache, "sys/mac" ) == NULL  &&  gLookups == 2, "invalidate() retires every entry" );
+	
+	ok_if( resolve( cache, "sys/macintosh/vol" ) == &gTree[ 3 ] );
+	
+	gTree[ 2 ].name = "mac";
+	
+	cache.clear();
+	
+	gLookups = 0;
+	
+	ok_if( resolve( cache, "sys/mac/vol" ) == &gTree[ 3 ]  &&  gLookups == 3, "clear() empties it" );
+	
+	ok_if( resolve( cache, "sys/mac/vol" ) == &gTree[ 3 ]  &&  gLookups == 3 );
+}
+
+static void bounds()
+{
+	cache_type cache( 1 );
+	
+	ok_if( cache.capacity() == 1 );
+	
+	gLookups = 0;
+	
+	resolve( cache, "sys" );
+	resolve( cache, "gui" );
+	resolve( cache, "gui" );
+	
+	ok_if( gLookups == 2, "the newest entry is kept" );
+	
+	resolve( cache, "sys" );
+	
+	ok_if( gLookups == 3, "older ones are replaced" );
+}
+
+static void pathnames()
+{
+	// A directory made anew for each lookup is only found by its pathname.
+	
+	vfs::lookup_cache< const node*, plus::string > cache;
+	
+	cache.insert( "/sys", "mac", &gTree[ 2 ] );
+	cache.insert( "/gui", "mac", &gTree[ 5 ] );
+	
+	const node* child = NULL;
+	int         error = 0;
+	
+	ok_if( cache.find( "/sys", "mac", child, error )  &&  child == &gTree[ 2 ] );
+	
+	ok_if( cache.find( "/gui", "mac", child, error )  &&  child == &gTree[ 5 ], "same name, different path" );
+	
+	ok_if( !cache.find( "/sys/mac", "vol", child, error ) );
+}
+
+int main( int argc, const char *const *argv )
+{
+	tap::start( "lookup_cache", n_tests );
+	
+	hits();
+	
+	negatives();
+	
+	invalidation();
+	
+	bounds();
+	
+	pathnames();
+	
+	return 0;
+}
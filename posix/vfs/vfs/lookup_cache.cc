@@ -0,0 +1,49 @@
+/*
+	lookup_cache.cc
+	---------------
+*/
+
+#include "vfs/lookup_cache.hh"
+
+
+namespace vfs
+{
+	
+	static std::size_t fnv1a( std::size_t hash, const plus::string& s )
+	{
+		const char* p   = s.data();
+		const char* end = p + s.size();
+		
+		while ( p < end )
+		{
+			hash = (hash ^ (unsigned char) *p++) * 16777619u;
+		}
+		
+		return hash;
+	}
+	
+	std::size_t hash_lookup_key( const void* parent, const plus::string& name )
+	{
+		// FNV-1a over the name, seeded with the parent's address
+		
+		std::size_t hash = 2166136261u ^ (std::size_t) parent ^ ((std::size_t) parent >> 9);
+		
+		hash = fnv1a( hash, name );
+		
+		return hash ^ (hash >> 16);
+	}
+	
+	std::size_t hash_lookup_key( const plus::string& parent, const plus::string& name )
+	{
+		// FNV-1a over "<parent>/<name>"
+		
+		std::size_t hash = fnv1a( 2166136261u, parent );
+		
+		hash = (hash ^ '/') * 16777619u;
+		
+		hash = fnv1a( hash, name );
+		
+		return hash ^ (hash >> 16);
+	}
+	
+}
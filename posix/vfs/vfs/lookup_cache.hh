@@ -0,0 +1,146 @@
+/*
+	lookup_cache.hh
+	---------------
+*/
+
+#ifndef VFS_LOOKUPCACHE_HH
+#define VFS_LOOKUPCACHE_HH
+
+// Standard C/C++
+#include <cstddef>
+
+// plus
+#include "plus/string.hh"
+
+
+namespace vfs
+{
+	
+	std::size_t hash_lookup_key( const void* parent, const plus::string& name );
+	
+	std::size_t hash_lookup_key( const plus::string& parent, const plus::string& name );
+	
+	/*
+		A bounded cache of directory lookups, keyed by (parent, name), where
+		the parent is identified by Key:  either its node, or a string (such
+		as its pathname) if nodes aren't unique.
+		A lookup's result is either a node (which may be one that doesn't
+		exist, as a negative entry) or the errno it failed with.
+		
+		It's direct-mapped:  Each key has one slot, and a colliding insert
+		replaces it.  invalidate() retires every entry at once by bumping a
+		generation count, so it's cheap enough to call on every rename(),
+		unlink(), mkdir(), etc.  Stale entries keep their nodes (and, by
+		extension, the nodes' parents) alive until they're replaced or
+		clear() is called, so only cache nodes whose lifetimes don't matter.
+		
+		NodePtr may be a raw or smart pointer to const node.  Key defaults
+		to NodePtr, which must then be a raw pointer.
+	*/
+	
+	template < class NodePtr, class Key = NodePtr >
+	class lookup_cache
+	{
+		private:
+			struct entry
+			{
+				Key            parent;
+				plus::string   name;
+				NodePtr        child;
+				int            error;
+				unsigned long  generation;
+				
+				entry() : parent(), child(), error(), generation()
+				{
+				}
+			};
+			
+			entry*         itsEntries;
+			std::size_t    itsMask;
+			unsigned long  itsGeneration;
+			
+			// not implemented:
+			lookup_cache( const lookup_cache& );
+			lookup_cache& operator=( const lookup_cache& );
+			
+			entry& slot( const Key& parent, const plus::string& name ) const
+			{
+				return itsEntries[ hash_lookup_key( parent, name ) & itsMask ];
+			}
+			
+			void set( const Key& parent, const plus::string& name, const NodePtr& child, int error )
+			{
+				entry& e = slot( parent, name );
+				
+				e.parent     = parent;
+				e.name       = name;
+				e.child      = child;
+				e.error      = error;
+				e.generation = itsGeneration;
+			}
+		
+		public:
+			// The capacity is rounded up to a power of two.
+			explicit lookup_cache( std::size_t capacity = 256 )
+			:
+				itsMask( 0 ),
+				itsGeneration( 1 )
+			{
+				while ( itsMask + 1 < capacity )
+				{
+					itsMask = itsMask << 1 | 1;
+				}
+				
+				itsEntries = new entry[ itsMask + 1 ];
+			}
+			
+			~lookup_cache()
+			{
+				delete [] itsEntries;
+			}
+			
+			std::size_t capacity() const  { return itsMask + 1; }
+			
+			// Returns true on a hit, setting either child or error.
+			bool find( const Key& parent, const plus::string& name, NodePtr& child, int& error ) const
+			{
+				const entry& e = slot( parent, name );
+				
+				if ( e.generation != itsGeneration  ||  e.parent != parent  ||  e.name != name )
+				{
+					return false;
+				}
+				
+				child = e.child;
+				error = e.error;
+				
+				return true;
+			}
+			
+			void insert( const Key& parent, const plus::string& name, const NodePtr& child )
+			{
+				set( parent, name, child, 0 );
+			}
+			
+			void insert_error( const Key& parent, const plus::string& name, int error )
+			{
+				set( parent, name, NodePtr(), error );
+			}
+			
+			void invalidate()  { ++itsGeneration; }
+			
+			// Invalidate, and release every entry's nodes.
+			void clear()
+			{
+				invalidate();
+				
+				for ( std::size_t i = 0;  i <= itsMask;  ++i )
+				{
+					itsEntries[ i ] = entry();
+				}
+			}
+	};
+	
+}
+
+#endif
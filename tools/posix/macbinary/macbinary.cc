@@ -0,0 +1,208 @@
+/*
+	macbinary.cc
+	------------
+*/
+
+// Standard C++
+#include <vector>
+
+// Standard C
+#include <string.h>
+
+// iota
+#include "iota/strings.hh"
+
+// plus
+#include "plus/string/concat.hh"
+
+// poseven
+#include "poseven/functions/dup.hh"
+#include "poseven/functions/open.hh"
+#include "poseven/functions/perror.hh"
+#include "poseven/functions/read.hh"
+#include "poseven/functions/write.hh"
+
+// mbin
+#include "mbin/decoder.hh"
+#include "mbin/encode.hh"
+
+// Orion
+#include "Orion/get_options.hh"
+#include "Orion/Main.hh"
+
+
+/*
+	macbinary --encode path [archive]
+	macbinary --decode [archive [directory]]
+	
+	Encoding writes the file or folder at path to the archive (by default,
+	path's name plus ".bin"); decoding extracts the archive (by default,
+	standard input) into the directory (by default, the current one).  An
+	archive named "-" is standard input or output.
+	
+	Resource forks and Finder info are read from extended attributes or
+	AppleDouble files, whichever are present, and written to AppleDouble
+	files, or with --xattr, to extended attributes where they fit.
+*/
+
+namespace tool
+{
+	
+	namespace n = nucleus;
+	namespace p7 = poseven;
+	namespace o = orion;
+	
+	
+	enum mode
+	{
+		mode_none,
+		mode_encode,
+		mode_decode
+	};
+	
+	const std::size_t chunk_size = 1024 * 1024;
+	
+	static n::owned< p7::fd_t > open_archive( const char* path, p7::open_flags_t flags, p7::fd_t std_fd )
+	{
+		if ( strcmp( path, "-" ) == 0 )
+		{
+			return p7::dup( std_fd );
+		}
+		
+		return p7::open( path, flags );
+	}
+	
+	static plus::string default_archive_name( const char* path )
+	{
+		std::size_t length = strlen( path );
+		
+		while ( length > 1  &&  path[ length - 1 ] == '/' )
+		{
+			--length;
+		}
+		
+		return plus::string( path, length ) + ".bin";
+	}
+	
+	static void encode( const char* path, const char* archive )
+	{
+		n::owned< p7::fd_t > output = open_archive( archive,
+		                                            p7::o_wronly | p7::o_creat | p7::o_trunc,
+		                                            p7::stdout_fileno );
+		
+		mbin::encode( path, output );
+	}
+	
+	static bool decode( const char* archive, const char* dir, mbin::fork_storage storage )
+	{
+		n::owned< p7::fd_t > input = open_archive( archive, p7::o_rdonly, p7::stdin_fileno );
+		
+		mbin::decoder decoder( dir, storage );
+		
+		std::vector< char > buffer( chunk_size );
+		
+		while ( ssize_t n_read = p7::read( input, &buffer[ 0 ], chunk_size ) )
+		{
+			decoder.write( &buffer[ 0 ], n_read );
+		}
+		
+		return decoder.idle();
+	}
+	
+	int Main( int argc, char** argv )
+	{
+		mode the_mode = mode_none;
+		
+		bool xattrs = false;
+		
+		o::bind_option_to_variable( "--encode", the_mode, mode_encode );
+		o::bind_option_to_variable( "--decode", the_mode, mode_decode );
+		
+		o::alias_option( "--encode", "-e" );
+		o::alias_option( "--decode", "-d" );
+		
+		o::bind_option_to_variable( "--xattr", xattrs );
+		
+		o::get_options( argc, argv );
+		
+		char const *const *free_args = o::free_arguments();
+		
+		const std::size_t n_args = o::free_argument_count();
+		
+		const mbin::fork_storage storage = xattrs ? mbin::fork_storage_xattr
+		                                          : mbin::fork_storage_appledouble;
+		
+		const char* archive = "-";
+		
+		plus::string default_archive;
+		
+		try
+		{
+			if ( the_mode == mode_encode  &&  (n_args == 1  ||  n_args == 2) )
+			{
+				const char* path = free_args[ 0 ];
+				
+				if ( n_args == 2 )
+				{
+					archive = free_args[ 1 ];
+				}
+				else
+				{
+					default_archive = default_archive_name( path );
+					
+					archive = default_archive.c_str();
+				}
+				
+				encode( path, archive );
+			}
+			else if ( the_mode == mode_decode  &&  n_args <= 2 )
+			{
+				if ( n_args > 0 )
+				{
+					archive = free_args[ 0 ];
+				}
+				
+				if ( !decode( archive, n_args > 1 ? free_args[ 1 ] : ".", storage ) )
+				{
+					p7::perror( "macbinary", archive, "archive is truncated" );
+					
+					return 1;
+				}
+			}
+			else
+			{
+				p7::write( p7::stderr_fileno, STR_LEN( "Usage:  macbinary --encode path [archive]\n"
+				                                       "        macbinary --decode [archive [dir]]\n" ) );
+				
+				return 2;
+			}
+		}
+		catch ( const p7::errno_t& err )
+		{
+			p7::perror( "macbinary", archive, err );
+			
+			return 1;
+		}
+		catch ( const mbin::invalid_header& )
+		{
+			p7::perror( "macbinary", archive, "not a MacBinary archive" );
+			
+			return 1;
+		}
+		catch ( const mbin::incompatible_header& )
+		{
+			p7::perror( "macbinary", archive, "requires a newer MacBinary version" );
+			
+			return 1;
+		}
+		catch ( const mbin::too_many_end_blocks& )
+		{
+			p7::perror( "macbinary", archive, "folder ends without starting" );
+			
+			return 1;
+		}
+		
+		return 0;
+	}
+	
+}
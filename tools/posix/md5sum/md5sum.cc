@@ -3,6 +3,9 @@
 	---------
 */
 
+// Standard C++
+#include <vector>
+
 // Standard C
 #include <string.h>
 
@@ -16,26 +19,69 @@
 #include "gear/hexidecimal.hh"
 
 // poseven
+#include "poseven/extras/map_for_reading.hh"
 #include "poseven/functions/open.hh"
+#include "poseven/functions/perror.hh"
 #include "poseven/functions/read.hh"
 
 // Arcana
 #include "MD5/MD5.hh"
 
 // Orion
+#include "Orion/get_options.hh"
 #include "Orion/Main.hh"
 
 
+/*
+	md5sum [-j N] file...
+	
+	Regular files are mapped into memory and hashed in place; anything
+	else is read in large chunks.  With -j, up to N files (at most
+	MD5::max_lanes) are hashed at once, in the lanes of the MD5 engine,
+	which pays off when the lanes are vectors.  Either way, the sums are
+	printed in the order the files were named.
+*/
+
 namespace tool
 {
 	
+	namespace n = nucleus;
 	namespace p7 = poseven;
+	namespace o = orion;
 	
 	
-	static inline size_t min( size_t a, size_t b )
+	const std::size_t block_size = 64;
+	
+	// Multiple of block_size
+	const std::size_t chunk_size = 64 * 1024;
+	
+	const std::size_t n_MD5_nibbles = 32;
+	
+	struct Digest
 	{
-		return a < b ? a : b;
-	}
+		char  hex[ n_MD5_nibbles ];
+		bool  done;
+		bool  failed;
+	};
+	
+	struct Job
+	{
+		std::size_t             index;  // into the file arguments
+		bool                    busy;
+		n::owned< p7::fd_t >    fd;
+		n::owned< p7::mmap_t >  map;
+		char*                   buffer;
+		MD5::Engine             engine;
+		
+		// The unhashed input:  whole blocks, unless at_eof
+		const char*             data;
+		std::size_t             available;
+		bool                    at_eof;
+		
+		Job() : busy(), buffer()  {}
+		
+		~Job()  { delete [] buffer; }
+	};
 	
 	static void md5_hex( char* result, const MD5::Result& md5 )
 	{
@@ -46,83 +92,234 @@ namespace tool
 		}
 	}
 	
-	static ssize_t buffered_read( p7::fd_t fd, char* small_buffer, size_t n_bytes_requested )
+	static bool map_input( Job& job )
 	{
-		static char big_buffer[ 4096 ];
+		// A mapped file is one chunk with no refill; the rest stream through job.buffer.
 		
-		static size_t mark = 0;
-		static size_t n_bytes_available = 0;
+		job.map = p7::map_for_reading( job.fd );
 		
-		if ( n_bytes_available == 0 )
+		const p7::mmap_t& map = job.map.get();
+		
+		if ( map.addr == MAP_FAILED )
 		{
-			n_bytes_available = p7::read( fd, big_buffer, sizeof big_buffer );
-			
-			mark = 0;
+			return false;
 		}
 		
-		const size_t bytes_to_copy = min( n_bytes_requested, n_bytes_available );
+		job.data      = (const char*) map.addr;
+		job.available = map.len;
+		job.at_eof    = true;
 		
-		memcpy( small_buffer, big_buffer + mark, bytes_to_copy );
+		return true;
+	}
+	
+	static void start( Job& job, std::size_t index, const char* path )
+	{
+		job.index  = index;
+		job.engine = MD5::Engine();
+		
+		job.fd = p7::open( path, p7::o_rdonly );
+		
+		job.data      = NULL;
+		job.available = 0;
+		job.at_eof    = false;
 		
-		n_bytes_available -= bytes_to_copy;
-		mark              += bytes_to_copy;
+		if ( !map_input( job )  &&  job.buffer == NULL )
+		{
+			job.buffer = new char[ chunk_size ];
+		}
+		
+		job.busy = true;
+	}
+	
+	static void stop( Job& job )
+	{
+		job.map.reset();
+		job.fd .reset();
 		
-		return bytes_to_copy;
+		job.busy = false;
 	}
 	
-	static void MD5Sum( char* result, p7::fd_t input )
+	static void refill( Job& job )
 	{
-		const std::size_t blockSize = 64;
+		// Fill the buffer completely, so that only the last chunk is partial.
 		
-		char data[ blockSize ];
-		std::size_t bytes;
-		MD5::Engine engine;
+		std::size_t n_read = 0;
 		
-		// loop exits on a partial block or at EOF
-		while ( ( bytes = buffered_read( input, data, blockSize ) ) == blockSize )
+		while ( n_read < chunk_size )
 		{
-			engine.DoBlock( data );
+			const ssize_t n = p7::read( job.fd, job.buffer + n_read, chunk_size - n_read );
+			
+			if ( n == 0 )
+			{
+				job.at_eof = true;
+				
+				break;
+			}
+			
+			n_read += n;
 		}
 		
-		engine.Finish( data, bytes * 8 );
+		job.data      = job.buffer;
+		job.available = n_read;
+	}
+	
+	static void print_digest( const Digest& digest, const char* path )
+	{
+		struct iovec output_message[] =
+		{
+			{ (void*) digest.hex, n_MD5_nibbles      },
+			{ (void*) STR_LEN( "  "                ) },
+			{ (void*) path,       strlen( path )     },
+			{ (void*) STR_LEN( "\n"                ) }
+		};
 		
-		md5_hex( result, engine.GetResult() );
+		(void) writev( STDOUT_FILENO, output_message, sizeof output_message / sizeof output_message[0] );
 	}
 	
 	int Main( int argc, char** argv )
 	{
+		std::size_t n_jobs = 1;
+		
+		o::bind_option_to_variable( "-j", n_jobs );
+		
+		o::alias_option( "-j", "--jobs" );
+		
+		o::get_options( argc, argv );
+		
+		char const *const *free_args = o::free_arguments();
+		
+		const std::size_t n_files = o::free_argument_count();
+		
+		if ( n_jobs == 0 )
+		{
+			n_jobs = 1;
+		}
+		
+		if ( n_jobs > MD5::max_lanes )
+		{
+			n_jobs = MD5::max_lanes;
+		}
+		
+		std::vector< Digest > digests( n_files );
+		
+		Job jobs[ MD5::max_lanes ];
+		
+		std::size_t next_file   = 0;
+		std::size_t next_output = 0;
+		
 		int fail = 0;
 		
-		for ( int i = 1;  i < argc;  ++i )
+		while ( next_output < n_files )
 		{
-			try
+			Job*          lanes  [ MD5::max_lanes ];
+			MD5::Engine*  engines[ MD5::max_lanes ];
+			const void*   inputs [ MD5::max_lanes ];
+			
+			unsigned n_lanes = 0;
+			
+			std::size_t n_blocks = std::size_t( -1 );
+			
+			for ( std::size_t i = 0;  i < n_jobs;  ++i )
 			{
-				const size_t n_MD5_nibbles = 32;
+				Job& job = jobs[ i ];
+				
+				try
+				{
+					while ( !job.busy  &&  next_file < n_files )
+					{
+						const std::size_t index = next_file++;
+						
+						try
+						{
+							start( job, index, free_args[ index ] );
+						}
+						catch ( const p7::errno_t& err )
+						{
+							p7::perror( "md5sum", free_args[ index ], err );
+							
+							digests[ index ].done   = true;
+							digests[ index ].failed = true;
+						}
+					}
+					
+					if ( !job.busy )
+					{
+						continue;
+					}
+					
+					if ( job.available == 0  &&  !job.at_eof )
+					{
+						refill( job );
+					}
+					
+					if ( job.available < block_size  &&  job.at_eof )
+					{
+						job.engine.Finish( job.data, job.available * 8 );
+						
+						md5_hex( digests[ job.index ].hex, job.engine.GetResult() );
+						
+						digests[ job.index ].done = true;
+						
+						stop( job );
+						
+						continue;
+					}
+				}
+				catch ( const p7::errno_t& err )
+				{
+					p7::perror( "md5sum", free_args[ job.index ], err );
+					
+					digests[ job.index ].done   = true;
+					digests[ job.index ].failed = true;
+					
+					stop( job );
+					
+					continue;
+				}
 				
-				char buffer[ n_MD5_nibbles ];
+				lanes  [ n_lanes ] = &job;
+				engines[ n_lanes ] = &job.engine;
+				inputs [ n_lanes ] = job.data;
 				
-				MD5Sum( buffer, p7::open( argv[ i ], p7::o_rdonly ) );
+				++n_lanes;
 				
-				buffer[ n_MD5_nibbles ] = '\0';
+				const std::size_t n = job.available / block_size;
 				
-				struct iovec output_message[] =
+				if ( n < n_blocks )
 				{
-					{ buffer, n_MD5_nibbles              },
-					{ (void*) STR_LEN( "  "            ) },
-					{ (void*) argv[i], strlen( argv[i] ) },
-					{ (void*) STR_LEN( "\n"            ) }
-				};
+					n_blocks = n;
+				}
+			}
+			
+			if ( n_lanes > 0 )
+			{
+				MD5::Engine::DoBlocks( engines, inputs, n_lanes, n_blocks );
 				
-				(void) writev( STDOUT_FILENO, output_message, sizeof output_message / sizeof output_message[0] );
+				for ( unsigned j = 0;  j < n_lanes;  ++j )
+				{
+					lanes[ j ]->data      += n_blocks * block_size;
+					lanes[ j ]->available -= n_blocks * block_size;
+				}
 			}
-			catch ( ... )
+			
+			while ( next_output < n_files  &&  digests[ next_output ].done )
 			{
-				fail++;
+				const Digest& digest = digests[ next_output ];
+				
+				if ( digest.failed )
+				{
+					++fail;
+				}
+				else
+				{
+					print_digest( digest, free_args[ next_output ] );
+				}
+				
+				++next_output;
 			}
 		}
 		
 		return fail == 0 ? 0 : 1;
 	}
-
+	
 }
-